@@ -241,4 +241,15 @@ class ConfusionMatrix:
         self.tp = 0
         self.tn = 0
         self.fp = 0
-        self.fn = 0
\ No newline at end of file
+        self.fn = 0
+
+# Use the C++ detectors (main/Detectors.hpp, O(1) per sample) when the
+# bioreactor_detectors module has been built; ConfusionMatrix stays in Python.
+try:
+    from bioreactor_detectors import baseline as _native
+
+    ZScoreDetector = _native.ZScoreDetector
+    HysteresisDetector = _native.HysteresisDetector
+    SlidingWindowDetector = _native.SlidingWindowDetector
+except ImportError:
+    pass
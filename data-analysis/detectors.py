@@ -66,4 +66,15 @@ class SlidingWindowDetector:
         if avg < (self.ideal_value - self.threshold):
             return True, float(avg)
 
-        return False, 0.0
\ No newline at end of file
+        return False, 0.0
+
+# Use the C++ detectors (main/Detectors.hpp, O(1) per sample) when the
+# bioreactor_detectors module has been built; same constructors and results.
+try:
+    from bioreactor_detectors import windowed as _native
+
+    ZScoreDetector = _native.ZScoreDetector
+    HysteresisDetector = _native.HysteresisDetector
+    SlidingWindowDetector = _native.SlidingWindowDetector
+except ImportError:
+    pass
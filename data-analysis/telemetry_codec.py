@@ -0,0 +1,158 @@
+"""
+Decoder for the binary telemetry frames published by the firmware
+(main/TelemetryFrame.hpp). Keep the two in step when the layout changes.
+
+Usage:
+    python telemetry_codec.py frames.bin     # length-prefixed frames from bioreactor_telemetry --out
+"""
+import struct
+import sys
+
+MAGIC = 0xB7
+VERSION = 3  # 3: heater duty is 10-bit
+# magic, version, count, flags, sequence, first sample time (us), publish time (us)
+HEADER = struct.Struct("<BBBBIQQ")
+
+# Times below this (2020-01-01) are time since boot: the device clock was not synchronised yet
+EPOCH_VALID_US = 1577836800 * 1000000
+
+FRAME_BACKFILL = 0x01  # Older samples sent after an outage
+
+FIELD_FLAGS = 0x20
+FIELD_SETPOINTS = 0x40
+NUMERIC_FIELDS = ("temp_centi", "ph_milli", "rpm", "heater_duty", "motor_duty")
+
+FLAG_ACID = 0x01
+FLAG_BASE = 0x02
+FLAG_HEATER = 0x04
+FLAG_ACTIVE = 0x08
+FLAG_SVM = 0x10  # On-device One-Class SVM outlier
+
+HEATER_PWM_MAX = 1023  # 10-bit heater PWM (Actuators.hpp)
+MOTOR_PWM_MAX = 1023   # 10-bit motor PWM
+
+
+def _varint(buf, pos, max_shift=35):
+    result = 0
+    shift = 0
+    while True:
+        if pos >= len(buf) or shift >= max_shift:
+            raise ValueError("truncated varint")
+        b = buf[pos]
+        pos += 1
+        result |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return result, pos
+        shift += 7
+
+
+def _zigzag(buf, pos, max_shift=35):
+    v, pos = _varint(buf, pos, max_shift)
+    return (v >> 1) ^ -(v & 1), pos
+
+
+def frame_flags(buf):
+    """Returns the FRAME_* flags of a frame."""
+    return buf[3] if len(buf) >= HEADER.size else 0
+
+
+def frame_info(buf):
+    """Returns the header fields of a frame: flags, sequence and publish_us."""
+    if len(buf) < HEADER.size:
+        raise ValueError("frame too short")
+    _, _, _, flags, sequence, _, publish_us = HEADER.unpack_from(buf, 0)
+    return {"flags": flags, "sequence": sequence, "publish_us": publish_us}
+
+
+def decode_frame_raw(buf):
+    """Returns the samples of one frame as dicts of the raw fixed-point fields."""
+    if len(buf) < HEADER.size:
+        raise ValueError("frame too short")
+    magic, version, count, _, _, t0, _ = HEADER.unpack_from(buf, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError(f"bad header {magic:#x} v{version}")
+
+    pos = HEADER.size
+    prev = dict.fromkeys(NUMERIC_FIELDS, 0)
+    prev.update(time_us=t0, flags=0, temp_set_centi=0, ph_set_milli=0, rpm_set=0)
+    samples = []
+
+    for _ in range(count):
+        s = dict(prev)
+        dt, pos = _zigzag(buf, pos, 70)
+        s["time_us"] = (prev["time_us"] + dt) & 0xFFFFFFFFFFFFFFFF
+
+        if pos >= len(buf):
+            raise ValueError("truncated sample")
+        mask = buf[pos]
+        pos += 1
+
+        for bit, name in enumerate(NUMERIC_FIELDS):
+            if mask & (1 << bit):
+                delta, pos = _zigzag(buf, pos)
+                s[name] = prev[name] + delta
+        if mask & FIELD_FLAGS:
+            if pos >= len(buf):
+                raise ValueError("truncated flags")
+            s["flags"] = buf[pos]
+            pos += 1
+        if mask & FIELD_SETPOINTS:
+            for name in ("temp_set_centi", "ph_set_milli", "rpm_set"):
+                delta, pos = _zigzag(buf, pos)
+                s[name] = prev[name] + delta
+
+        samples.append(s)
+        prev = s
+
+    if pos != len(buf):
+        raise ValueError("trailing bytes")
+    return samples
+
+
+def decode_frame(buf):
+    """Returns the samples of one frame in the units of the JSON telemetry."""
+    out = []
+    for s in decode_frame_raw(buf):
+        flags = s["flags"]
+        out.append({
+            "time_us": s["time_us"],
+            "temperature": s["temp_centi"] / 100.0,
+            "pH": s["ph_milli"] / 1000.0,
+            "rpm_measured": s["rpm"],
+            "heater_pwm": 100.0 * s["heater_duty"] / HEATER_PWM_MAX,
+            "motor_pwm": 100.0 * s["motor_duty"] / MOTOR_PWM_MAX,
+            "acid_pump": bool(flags & FLAG_ACID),
+            "base_pump": bool(flags & FLAG_BASE),
+            "heater_state": bool(flags & FLAG_HEATER),
+            "operational_mode": bool(flags & FLAG_ACTIVE),
+            "svm_anomaly": bool(flags & FLAG_SVM),
+            "target_temperature": s["temp_set_centi"] / 100.0,
+            "target_pH": s["ph_set_milli"] / 1000.0,
+            "rpm_set": s["rpm_set"],
+        })
+    return out
+
+
+def read_frames(path):
+    """Yields frames from a file of uint16 length-prefixed frames."""
+    with open(path, "rb") as f:
+        data = f.read()
+    pos = 0
+    while pos + 2 <= len(data):
+        (n,) = struct.unpack_from("<H", data, pos)
+        pos += 2
+        yield data[pos:pos + n]
+        pos += n
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print(__doc__)
+        sys.exit(1)
+
+    print("time_us,temperature,pH,rpm_measured,heater_pwm,motor_pwm,acid_pump,base_pump,target_temperature,target_pH,rpm_set,svm_anomaly")
+    for frame in read_frames(sys.argv[1]):
+        for s in decode_frame(frame):
+            print(f"{s['time_us']},{s['temperature']:.2f},{s['pH']:.3f},{s['rpm_measured']},"
+                  f"{s['heater_pwm']:.1f},{s['motor_pwm']:.1f},{int(s['acid_pump'])},{int(s['base_pump'])},"
+                  f"{s['target_temperature']:.2f},{s['target_pH']:.3f},{s['rpm_set']},{int(s['svm_anomaly'])}")
@@ -4,6 +4,8 @@ import time
 import os
 import sys
 
+from telemetry_codec import EPOCH_VALID_US, FRAME_BACKFILL, decode_frame, frame_info
+
 # Configuration
 # Update these to match your actual MQTT broker settings
 BROKER = "mqtt.eu.thingsboard.cloud" 
@@ -11,15 +13,77 @@ PORT = 1883
 ACCESS_TOKEN = "ujp5e0v81hgvbkr2e4el"  # Replace with your device access token
 
 TOPIC = "v1/devices/me/telemetry" 
+# Batched binary samples (TELEMETRY_BIN_TOPIC in main.ino). Only sent by builds
+# with TELEMETRY_BINARY 1 to a broker that accepts it; ThingsBoard does not.
+TOPIC_BIN = "bioreactor/telemetry/bin"
 OUTPUT_FILE = "logs/bioreactor_data.csv"
 
+# Wall clock minus device clock (s), taken from the latest live binary frame.
+# Only used while the device clock is not synchronised (SNTP).
+device_offset = None
+
+# Sequence number expected in the next binary frame
+next_sequence = None
+
 def on_connect(client, userdata, flags, rc, properties=None):
     print(f"Connected with result code {rc}")
     client.subscribe(TOPIC)
-    print(f"Subscribed to {TOPIC}")
+    client.subscribe(TOPIC_BIN)
+    print(f"Subscribed to {TOPIC} and {TOPIC_BIN}")
+
+def write_rows(rows):
+    with open(OUTPUT_FILE, "a") as f:
+        f.writelines(rows)
+
+def check_sequence(sequence):
+    """Reports frames lost between the previous frame and this one."""
+    global next_sequence
+    if next_sequence is not None and sequence != next_sequence:
+        if sequence == 0:
+            print("Device restarted (sequence back to 0)")
+        elif (sequence - next_sequence) & 0xFFFFFFFF < 0x80000000:
+            print(f"Lost {(sequence - next_sequence) & 0xFFFFFFFF} frame(s) before #{sequence}")
+        else:
+            print(f"Duplicate or reordered frame #{sequence}")
+    next_sequence = (sequence + 1) & 0xFFFFFFFF
+
+def on_binary_message(payload):
+    global device_offset
+    received = time.time()
+    samples = decode_frame(payload)
+    if not samples:
+        return
+    info = frame_info(payload)
+    check_sequence(info["sequence"])
+
+    # Samples are stamped at acquisition. Once the device clock is synchronised
+    # that is Unix time; before, it is time since boot, and a live frame (which
+    # ends with the newest sample) maps it to arrival time instead. Back-filled
+    # frames reuse that mapping.
+    if device_offset is None or not info["flags"] & FRAME_BACKFILL:
+        device_offset = received - samples[-1]["time_us"] / 1e6
+    rows = []
+    for s in samples:
+        if s["time_us"] >= EPOCH_VALID_US:
+            timestamp = s["time_us"] / 1e6
+        else:
+            timestamp = device_offset + s["time_us"] / 1e6
+        acid_pwm = 100 if s["acid_pump"] else 0
+        base_pwm = 100 if s["base_pump"] else 0
+        rows.append(f"{timestamp:.3f},{s['temperature']},{s['pH']},{s['rpm_measured']},"
+                    f"{s['heater_pwm']:.1f},{s['motor_pwm']:.1f},{acid_pwm},{base_pwm},None\n")
+    write_rows(rows)
+    latency = ""
+    if info["publish_us"] >= EPOCH_VALID_US:
+        latency = f", publish -> logger {1000 * (time.time() - info['publish_us'] / 1e6):.0f} ms"
+    print(f"Logged frame #{info['sequence']}: {len(rows)} samples ({len(payload)} bytes){latency}")
 
 def on_message(client, userdata, msg):
     try:
+        if msg.topic == TOPIC_BIN:
+            on_binary_message(msg.payload)
+            return
+
         payload = msg.payload.decode()
         data = json.loads(payload)
         
@@ -43,8 +107,7 @@ def on_message(client, userdata, msg):
         
         row = f"{timestamp},{temp_mean},{ph_mean},{rpm_mean},{heater_pwm},{motor_pwm},{acid_pwm},{base_pwm},{faults}\n"
         
-        with open(OUTPUT_FILE, "a") as f:
-            f.write(row)
+        write_rows([row])
             
         print(f"Logged: {row.strip()}")
         
@@ -0,0 +1,3 @@
+// Globals that main.ino owns on the device, defined here for host builds.
+
+bool is_system_active = true;
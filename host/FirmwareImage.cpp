@@ -0,0 +1,56 @@
+#include "FirmwareImage.hpp"
+#include <dlfcn.h>
+#include <link.h>
+#include <string.h>
+
+struct SegmentSearch {
+  const void* base;   // Load address of the object we are after
+  uintptr_t start;
+  uintptr_t end;
+};
+
+static int findSegment(dl_phdr_info* info, size_t, void* data) {
+  SegmentSearch* search = (SegmentSearch*)data;
+  if ((const void*)info->dlpi_addr != search->base) return 0;
+
+  uintptr_t start = 0, end = 0, relroEnd = 0;
+  int writable = 0;
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr)& header = info->dlpi_phdr[i];
+    uintptr_t from = info->dlpi_addr + header.p_vaddr;
+    if (header.p_type == PT_LOAD && (header.p_flags & PF_W)) {
+      start = from;
+      end = from + header.p_memsz;
+      writable++;
+    } else if (header.p_type == PT_GNU_RELRO) {
+      relroEnd = from + header.p_memsz;
+    }
+  }
+  // RELRO (GOT, vtables, .data.rel.ro) opens the writable segment and is read-only
+  // by now. Any other layout (no RELRO, or state in more than one segment) is
+  // not one this copies correctly: refuse it rather than swap part of the state.
+  if (writable != 1 || relroEnd <= start || relroEnd > end) return 1;
+  start = relroEnd;
+  search->start = start;
+  search->end = end;
+  return 1;
+}
+
+bool FirmwareImage::attach(const void* address) {
+  Dl_info info;
+  if (!dladdr(address, &info) || !info.dli_fbase) return false;
+
+  SegmentSearch search = {info.dli_fbase, 0, 0};
+  if (!dl_iterate_phdr(findSegment, &search) || search.end <= search.start) return false;
+  base_ = (uint8_t*)search.start;
+  size_ = search.end - search.start;
+  return true;
+}
+
+void FirmwareImage::save(uint8_t* state) const {
+  memcpy(state, base_, size_);
+}
+
+void FirmwareImage::load(const uint8_t* state) {
+  memcpy(base_, state, size_);
+}
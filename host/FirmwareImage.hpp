@@ -0,0 +1,58 @@
+#ifndef FIRMWAREIMAGE_HPP
+#define FIRMWAREIMAGE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The firmware keeps its state in globals, so one process normally holds one
+// device. bioreactor_loadgen links the firmware as a shared library
+// (bioreactor_image) and runs many devices on that one copy of the code by
+// giving each its own copy of the library's writable data (.data and .bss,
+// the part of the writable segment after RELRO): a device's copy is loaded
+// before the device runs and saved afterwards.
+//
+// The rules that make this safe:
+//  - The library is linked with -z now -z relro, so its GOT lies in RELRO
+//    and is not part of the state. attach() refuses a library without RELRO
+//    or with more than one writable segment.
+//  - Only one device is loaded at a time, from one thread.
+//  - Nothing outside the library keeps pointers into the state.
+//  - The library's globals own no heap memory: every device starts from the
+//    same bytes, so a heap pointer would be shared by all of them. There are
+//    no containers among them (the HAL's console input is a fixed ring), and
+//    bioreactor_loadgen aborts if firmware code it runs keeps a heap block
+//    past the call or frees one from before it. The one exception is each
+//    device's own SampleHistory.
+
+class FirmwareImage {
+public:
+  FirmwareImage() : base_(nullptr), size_(0) {}
+
+  /**
+   * @brief Finds the writable data of the shared object that contains
+   * address (any function of the library).
+   * @return false if address is not in a shared object, or it has none.
+   */
+  bool attach(const void* address);
+
+  /**
+   * @brief Bytes of state per device.
+   */
+  size_t size() const { return size_; }
+
+  /**
+   * @brief Copies the state now in the library to state (size() bytes).
+   */
+  void save(uint8_t* state) const;
+
+  /**
+   * @brief Makes state (from save()) the library's state.
+   */
+  void load(const uint8_t* state);
+
+private:
+  uint8_t* base_;
+  size_t size_;
+};
+
+#endif // FIRMWAREIMAGE_HPP
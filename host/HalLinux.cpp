@@ -0,0 +1,367 @@
+// Linux backend of the hardware abstraction layer (host build).
+#include "HalLinux.hpp"
+#include "Profiler.hpp"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+struct PinState {
+  HalPinMode mode;
+  bool level;
+  int adc;
+  uint32_t duty;        // Target of a fade in progress
+  uint32_t fadeFrom;
+  uint64_t fadeStartUs;
+  uint64_t fadeEndUs;   // Fade done once the clock reaches it
+  uint8_t resolution;
+  HalIsr isr;
+  HalEdge edge;
+  uint16_t edgesPerCapture; // 0: not captured
+  uint32_t edges;
+  uint64_t lastCaptureUs;
+  HalPulseCapture capture;
+};
+
+PinState pins[HAL_SIM_PIN_COUNT];
+uint64_t simTimeUs = 0;
+bool realClock = false;
+uint64_t simEpochOffsetUs = 0; // Simulated clock to Unix time; 0 until halSimSetEpochUs()
+bool logEnabled = true;
+HalAdcHook adcHook = nullptr;
+HalPwmHook pwmHook = nullptr;
+HalGpioHook gpioHook = nullptr;
+std::vector<HalSimPwmCommand>* pwmLog = nullptr;
+// Console input as a fixed ring: no heap, so the state stays plain bytes
+// (bioreactor_loadgen copies it per device, FirmwareImage.hpp)
+char consoleLines[HAL_SIM_CONSOLE_LINES][HAL_SIM_CONSOLE_LINE_MAX];
+size_t consoleHead = 0;
+size_t consoleCount = 0;
+const auto realEpoch = std::chrono::steady_clock::now();
+
+inline bool validPin(uint8_t pin) {
+  return pin < HAL_SIM_PIN_COUNT;
+}
+
+uint64_t nowUs() {
+  if (realClock) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - realEpoch).count();
+  }
+  return simTimeUs;
+}
+
+uint32_t pwmDutyAt(const PinState& p, uint64_t now) {
+  if (now >= p.fadeEndUs) return p.duty;
+  double f = (double)(now - p.fadeStartUs) / (double)(p.fadeEndUs - p.fadeStartUs);
+  return (uint32_t)((double)p.fadeFrom + f * ((double)p.duty - (double)p.fadeFrom) + 0.5);
+}
+
+// Mean duty over [from, to) with no further commands: the fade's straight
+// line up to its end, the final duty after it
+double pwmMeanBetween(const PinState& p, uint64_t from, uint64_t to) {
+  if (to <= from || from >= p.fadeEndUs) return p.duty;
+  auto at = [&](uint64_t t) {
+    double f = (double)(t - p.fadeStartUs) / (double)(p.fadeEndUs - p.fadeStartUs);
+    return (double)p.fadeFrom + f * ((double)p.duty - (double)p.fadeFrom);
+  };
+  uint64_t fadeTo = to < p.fadeEndUs ? to : p.fadeEndUs;
+  double area = 0.5 * (at(from) + at(fadeTo)) * (double)(fadeTo - from);
+  area += (double)p.duty * (double)(to - fadeTo);
+  return area / (double)(to - from);
+}
+
+void logPwm(uint8_t pin, uint32_t from, uint32_t to, uint32_t fadeUs) {
+  if (pwmLog) pwmLog->push_back(HalSimPwmCommand{nowUs(), pin, from, to, fadeUs});
+}
+
+} // namespace
+
+// --- HAL interface ---
+
+uint32_t halMicros() {
+  return (uint32_t)nowUs();
+}
+
+uint32_t halMillis() {
+  return (uint32_t)(nowUs() / 1000);
+}
+
+void halDelayMs(uint32_t ms) {
+  if (realClock) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  } else {
+    simTimeUs += (uint64_t)ms * 1000;
+  }
+}
+
+// Host programs run on the system clock's own synchronisation
+void halClockSyncStart(const char*) {
+}
+
+// The real clock is the host's own (NTP-disciplined) system clock
+uint64_t halTimestampUs() {
+  if (realClock) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+  return simEpochOffsetUs + simTimeUs;
+}
+
+void halPinMode(uint8_t pin, HalPinMode mode) {
+  if (!validPin(pin)) return;
+  pins[pin].mode = mode;
+  if (mode == HAL_INPUT_PULLUP) pins[pin].level = true;
+}
+
+void halDigitalWrite(uint8_t pin, bool level) {
+  if (!validPin(pin)) return;
+  pins[pin].level = level;
+  if (gpioHook) gpioHook(pin, level);
+}
+
+bool halDigitalRead(uint8_t pin) {
+  return validPin(pin) && pins[pin].level;
+}
+
+int halAdcRead(uint8_t pin) {
+  if (adcHook) return adcHook(pin);
+  return validPin(pin) ? pins[pin].adc : 0;
+}
+
+bool halAdcStartContinuous(uint8_t pin) {
+  return validPin(pin); // Every read is a fresh conversion here
+}
+
+int halAdcReadBurst(uint8_t pin, uint16_t* out, int count) {
+  for (int i = 0; i < count; i++) {
+    out[i] = (uint16_t)halAdcRead(pin);
+  }
+  return count;
+}
+
+bool halPwmAttach(uint8_t pin, uint32_t freqHz, uint8_t resolutionBits) {
+  (void)freqHz;
+  if (!validPin(pin) || resolutionBits == 0 || resolutionBits > 16) return false;
+  pins[pin].resolution = resolutionBits;
+  pins[pin].duty = 0;
+  pins[pin].fadeEndUs = 0;
+  return true;
+}
+
+void halPwmWrite(uint8_t pin, uint32_t duty) {
+  if (!validPin(pin)) return;
+  PinState& p = pins[pin];
+  logPwm(pin, pwmDutyAt(p, nowUs()), duty, 0);
+  p.duty = duty;
+  p.fadeEndUs = 0;
+  if (pwmHook) pwmHook(pin, duty, p.resolution);
+}
+
+// Like the LEDC fade unit: a straight line from the present duty, stepped by
+// the clock rather than by code
+bool halPwmFade(uint8_t pin, uint32_t targetDuty, uint32_t fadeMs) {
+  if (!validPin(pin) || pins[pin].resolution == 0) return false;
+  PinState& p = pins[pin];
+  uint64_t now = nowUs();
+  p.fadeFrom = pwmDutyAt(p, now);
+  logPwm(pin, p.fadeFrom, targetDuty, fadeMs * 1000);
+  p.duty = targetDuty;
+  p.fadeStartUs = now;
+  p.fadeEndUs = now + (uint64_t)fadeMs * 1000;
+  return true;
+}
+
+uint32_t halPwmDuty(uint8_t pin) {
+  return validPin(pin) ? pwmDutyAt(pins[pin], nowUs()) : 0;
+}
+
+void halAttachInterrupt(uint8_t pin, HalIsr isr, HalEdge edge) {
+  if (!validPin(pin)) return;
+  pins[pin].isr = isr;
+  pins[pin].edge = edge;
+}
+
+// Like the ESP32 capture unit: one capture per edgesPerCapture edges, fed by
+// halSimTriggerInterrupt(). Timestamps come from the simulated clock.
+bool halPulseCaptureStart(uint8_t pin, uint16_t edgesPerCapture) {
+  if (!validPin(pin) || edgesPerCapture < 1 || edgesPerCapture > 256) return false;
+  pins[pin].edgesPerCapture = edgesPerCapture;
+  pins[pin].edges = 0;
+  memset(&pins[pin].capture, 0, sizeof(pins[pin].capture));
+  return true;
+}
+
+bool halPulseCaptureRead(uint8_t pin, HalPulseCapture& out) {
+  if (!validPin(pin) || pins[pin].edgesPerCapture == 0) return false;
+  out = pins[pin].capture;
+  return true;
+}
+
+// ISRs are invoked synchronously by halSimTriggerInterrupt() on the control
+// thread, so there is nothing to mask.
+void halEnterCritical() {
+}
+
+void halExitCritical() {
+}
+
+void halLog(const char* fmt, ...) {
+  if (!logEnabled) return;
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+bool halConsoleReadLine(char* buf, size_t len) {
+  if (len == 0 || consoleCount == 0) return false;
+
+  char* line = consoleLines[consoleHead];
+  consoleHead = (consoleHead + 1) % HAL_SIM_CONSOLE_LINES;
+  consoleCount--;
+  size_t n = strlen(line);
+  while (n > 0 && (line[n - 1] == '\r' || line[n - 1] == ' ' || line[n - 1] == '\t')) {
+    n--;
+  }
+  if (n > len - 1) n = len - 1;
+
+  memcpy(buf, line, n);
+  buf[n] = '\0';
+  return n > 0;
+}
+
+void* halAllocLarge(size_t bytes) {
+  return malloc(bytes);
+}
+
+// glibc has no fixed heap to run out of
+uint32_t halFreeHeap() {
+  return 0;
+}
+
+uint32_t halMinFreeHeap() {
+  return 0;
+}
+
+uint32_t halCycles() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t halCyclesPerUs() {
+  return 1000;
+}
+
+// --- Simulation controls ---
+
+void halSimUseRealClock(bool real) {
+  realClock = real;
+}
+
+void halSimAdvanceUs(uint64_t us) {
+  simTimeUs += us;
+}
+
+void halSimSetTimeUs(uint64_t us) {
+  simTimeUs = us;
+}
+
+uint64_t halSimTimeUs() {
+  return nowUs();
+}
+
+void halSimSetEpochUs(uint64_t epochUs) {
+  simEpochOffsetUs = epochUs ? epochUs - simTimeUs : 0;
+}
+
+void halSimSetAdc(uint8_t pin, int raw) {
+  if (validPin(pin)) pins[pin].adc = raw;
+}
+
+void halSimSetAdcHook(HalAdcHook hook) {
+  adcHook = hook;
+}
+
+uint32_t halSimPwmDuty(uint8_t pin) {
+  return halPwmDuty(pin);
+}
+
+uint8_t halSimPwmResolution(uint8_t pin) {
+  return validPin(pin) ? pins[pin].resolution : 0;
+}
+
+double halSimPwmFraction(uint8_t pin) {
+  if (!validPin(pin) || pins[pin].resolution == 0) return 0;
+  return halPwmDuty(pin) / (double)((1u << pins[pin].resolution) - 1);
+}
+
+double halSimPwmMeanFraction(uint8_t pin, uint64_t spanUs) {
+  if (!validPin(pin) || pins[pin].resolution == 0) return 0;
+  uint64_t now = nowUs();
+  return pwmMeanBetween(pins[pin], now, now + spanUs) / (double)((1u << pins[pin].resolution) - 1);
+}
+
+void halSimRecordPwm(std::vector<HalSimPwmCommand>* log) {
+  pwmLog = log;
+}
+
+bool halSimDigitalLevel(uint8_t pin) {
+  return validPin(pin) && pins[pin].level;
+}
+
+void halSimSetPwmHook(HalPwmHook hook) {
+  pwmHook = hook;
+}
+
+void halSimSetGpioHook(HalGpioHook hook) {
+  gpioHook = hook;
+}
+
+void halSimSetDigitalInput(uint8_t pin, bool level) {
+  if (validPin(pin)) pins[pin].level = level;
+}
+
+bool halSimTriggerInterrupt(uint8_t pin) {
+  if (!validPin(pin)) return false;
+  PinState& p = pins[pin];
+  if (p.edgesPerCapture && ++p.edges % p.edgesPerCapture == 0) {
+    uint64_t now = nowUs();
+    if (p.capture.captures > 0) p.capture.spanNs = (uint32_t)((now - p.lastCaptureUs) * 1000);
+    p.lastCaptureUs = now;
+    p.capture.lastUs = (uint32_t)now;
+    p.capture.captures++;
+    PROFILE_COUNT(PROFILE_ISR_CAPTURE);
+  }
+  if (p.isr) p.isr();
+  return p.isr != nullptr || p.edgesPerCapture != 0;
+}
+
+void halSimSetLogEnabled(bool enabled) {
+  logEnabled = enabled;
+}
+
+bool halSimConsoleInput(const char* line) {
+  if (consoleCount == HAL_SIM_CONSOLE_LINES) return false;
+  char* slot = consoleLines[(consoleHead + consoleCount) % HAL_SIM_CONSOLE_LINES];
+  strncpy(slot, line, HAL_SIM_CONSOLE_LINE_MAX - 1);
+  slot[HAL_SIM_CONSOLE_LINE_MAX - 1] = '\0';
+  consoleCount++;
+  return true;
+}
+
+void halSimReset() {
+  memset(pins, 0, sizeof(pins));
+  simTimeUs = 0;
+  realClock = false;
+  simEpochOffsetUs = 0;
+  adcHook = nullptr;
+  pwmHook = nullptr;
+  gpioHook = nullptr;
+  pwmLog = nullptr;
+  consoleHead = 0;
+  consoleCount = 0;
+}
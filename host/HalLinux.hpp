@@ -0,0 +1,100 @@
+#ifndef HALLINUX_HPP
+#define HALLINUX_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "Hal.hpp"
+
+// Host-side controls for the Linux HAL backend (HalLinux.cpp).
+// By default time is simulated: it only moves when halSimAdvanceUs() or
+// halSimSetTimeUs() is called, so controllers run as fast as the CPU allows.
+
+const int HAL_SIM_PIN_COUNT = 64;
+
+typedef int (*HalAdcHook)(uint8_t pin);
+typedef void (*HalPwmHook)(uint8_t pin, uint32_t duty, uint8_t resolutionBits);
+typedef void (*HalGpioHook)(uint8_t pin, bool level);
+
+// --- Clock ---
+/**
+ * @brief Switches between the simulated clock (default) and std::chrono::steady_clock.
+ */
+void halSimUseRealClock(bool real);
+void halSimAdvanceUs(uint64_t us);
+void halSimSetTimeUs(uint64_t us);
+uint64_t halSimTimeUs(); // Non-wrapping simulated time
+
+/**
+ * @brief "Synchronises" the simulated wall clock: halTimestampUs() reads
+ * epochUs now and runs on with the simulated clock. 0 goes back to time
+ * since boot. With the real clock, halTimestampUs() is the system clock.
+ */
+void halSimSetEpochUs(uint64_t epochUs);
+
+// --- ADC ---
+void halSimSetAdc(uint8_t pin, int raw);
+void halSimSetAdcHook(HalAdcHook hook); // Overrides halSimSetAdc() values when set
+
+// --- Outputs ---
+/**
+ * @brief One PWM command: a write (fadeUs 0) or the start of a fade.
+ */
+struct HalSimPwmCommand {
+  uint64_t timeUs;
+  uint8_t pin;
+  uint32_t fromDuty; // Duty being put out when the command came
+  uint32_t toDuty;
+  uint32_t fadeUs;
+};
+
+uint32_t halSimPwmDuty(uint8_t pin); // Now, part-way through a fade (as halPwmDuty())
+uint8_t halSimPwmResolution(uint8_t pin);
+
+/**
+ * @brief halSimPwmDuty() as a fraction of full scale (0 if not attached).
+ */
+double halSimPwmFraction(uint8_t pin);
+
+/**
+ * @brief Mean of halSimPwmFraction() over the next spanUs if no new command
+ * comes: what a plant integrating over that step receives during a fade.
+ */
+double halSimPwmMeanFraction(uint8_t pin, uint64_t spanUs);
+
+/**
+ * @brief Appends every PWM write and fade to log from now on; nullptr stops.
+ * A pin's waveform is the piecewise-linear curve through its commands.
+ */
+void halSimRecordPwm(std::vector<HalSimPwmCommand>* log);
+
+bool halSimDigitalLevel(uint8_t pin);
+void halSimSetPwmHook(HalPwmHook hook);
+void halSimSetGpioHook(HalGpioHook hook);
+void halSimSetDigitalInput(uint8_t pin, bool level);
+
+// --- Interrupts ---
+/**
+ * @brief Signals an edge on a pin: calls the attached ISR, and counts the edge
+ * towards the next capture if the pin is captured (halPulseCaptureStart()).
+ * @return false if the pin has neither.
+ */
+bool halSimTriggerInterrupt(uint8_t pin);
+
+// --- Console ---
+void halSimSetLogEnabled(bool enabled);
+const size_t HAL_SIM_CONSOLE_LINES = 8;
+const size_t HAL_SIM_CONSOLE_LINE_MAX = 128; // Longer lines are cut
+
+/**
+ * @brief Queues one line for halConsoleReadLine().
+ * @return false if HAL_SIM_CONSOLE_LINES lines are already waiting.
+ */
+bool halSimConsoleInput(const char* line);
+
+/**
+ * @brief Restores the power-on state (clock, pins, hooks, console).
+ */
+void halSimReset();
+
+#endif // HALLINUX_HPP
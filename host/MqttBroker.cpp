@@ -0,0 +1,168 @@
+#include "MqttBroker.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+MqttBroker::MqttBroker()
+    : listenFd_(-1), port_(0), hook_(nullptr), ctx_(nullptr), connections_(0), received_(0), forwarded_(0),
+      protocolErrors_(0) {
+}
+
+MqttBroker::~MqttBroker() {
+  for (Session& s : sessions_) close(s.fd);
+  if (listenFd_ >= 0) close(listenFd_);
+}
+
+bool MqttBroker::listen(const char* address, uint16_t port) {
+  listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd_ < 0) return false;
+  int one = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &addr.sin_addr) != 1 ||
+      bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listenFd_, 64) != 0) {
+    close(listenFd_);
+    listenFd_ = -1;
+    return false;
+  }
+
+  socklen_t length = sizeof(addr);
+  getsockname(listenFd_, (sockaddr*)&addr, &length);
+  port_ = ntohs(addr.sin_port);
+  return true;
+}
+
+void MqttBroker::setPublishHook(PublishHook hook, void* ctx) {
+  hook_ = hook;
+  ctx_ = ctx;
+}
+
+void MqttBroker::run(const std::atomic<bool>& running) {
+  std::vector<pollfd> fds;
+  while (running) {
+    fds.clear();
+    fds.push_back(pollfd{listenFd_, POLLIN, 0});
+    for (const Session& s : sessions_) fds.push_back(pollfd{s.fd, POLLIN, 0});
+
+    if (::poll(fds.data(), fds.size(), 50) <= 0) continue;
+
+    // Sessions first: accept() may grow sessions_
+    for (size_t i = fds.size() - 1; i >= 1; i--) {
+      if (!fds[i].revents) continue;
+      if (!serve(sessions_[i - 1])) {
+        close(sessions_[i - 1].fd);
+        sessions_.erase(sessions_.begin() + (i - 1));
+      }
+    }
+    if (fds[0].revents & POLLIN) accept();
+  }
+}
+
+MqttBrokerStats MqttBroker::stats() const {
+  return MqttBrokerStats{connections_, received_, forwarded_, protocolErrors_};
+}
+
+void MqttBroker::accept() {
+  int fd = ::accept(listenFd_, nullptr, nullptr);
+  if (fd < 0) return;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sessions_.push_back(Session{fd, false, {}, {}});
+  connections_++;
+}
+
+// Reads what is available and handles every complete packet
+bool MqttBroker::serve(Session& session) {
+  uint8_t chunk[8192];
+  ssize_t n = recv(session.fd, chunk, sizeof(chunk), 0);
+  if (n <= 0) return false;
+  session.rx.insert(session.rx.end(), chunk, chunk + n);
+
+  size_t pos = 0;
+  for (;;) {
+    MqttPacket packet;
+    long used = mqttParsePacket(session.rx.data() + pos, session.rx.size() - pos, packet);
+    if (used == 0) break;
+    if (used < 0 || !handle(session, packet)) {
+      protocolErrors_++;
+      return false;
+    }
+    pos += (size_t)used;
+  }
+  session.rx.erase(session.rx.begin(), session.rx.begin() + pos);
+  return true;
+}
+
+bool MqttBroker::handle(Session& session, const MqttPacket& packet) {
+  if (!session.connected && packet.type != MQTT_CONNECT) return false;
+
+  tx_.clear();
+  switch (packet.type) {
+  case MQTT_CONNECT: {
+    MqttConnect connect;
+    if (session.connected || !mqttParseConnect(packet, connect)) return false;
+    session.connected = true;
+    mqttEncodeConnack(tx_, 0);
+    return send(session, tx_);
+  }
+  case MQTT_PUBLISH: {
+    MqttPublish message;
+    if (!mqttParsePublish(packet, message) || message.qos > 1) return false;
+    received_++;
+    if (hook_) hook_(message, ctx_);
+    if (message.qos == 1) {
+      mqttEncodePuback(tx_, message.packetId);
+      if (!send(session, tx_)) return false;
+    }
+    forward(message);
+    return true;
+  }
+  case MQTT_SUBSCRIBE: {
+    uint16_t packetId;
+    std::vector<std::string> filters;
+    if (!mqttParseSubscribe(packet, packetId, filters)) return false;
+    session.filters.insert(session.filters.end(), filters.begin(), filters.end());
+    mqttEncodeSuback(tx_, packetId, (int)filters.size());
+    return send(session, tx_);
+  }
+  case MQTT_PINGREQ:
+    mqttEncodeEmpty(tx_, MQTT_PINGRESP);
+    return send(session, tx_);
+  case MQTT_DISCONNECT:
+    return false;
+  default:
+    return true; // PUBACKs from subscribers and the like
+  }
+}
+
+// Sessions that fail to take the message are dropped on their next read
+void MqttBroker::forward(const MqttPublish& message) {
+  std::vector<uint8_t> packet;
+  for (Session& s : sessions_) {
+    for (const std::string& filter : s.filters) {
+      if (!mqttTopicMatches(filter, message.topic, message.topicLength)) continue;
+      if (packet.empty()) {
+        mqttEncodePublish(packet, message.topic, message.topicLength, message.payload, message.payloadLength);
+      }
+      if (send(s, packet)) forwarded_++;
+      break; // Once per session, however many filters match
+    }
+  }
+}
+
+bool MqttBroker::send(Session& session, const std::vector<uint8_t>& bytes) {
+  size_t sent = 0;
+  while (sent < bytes.size()) {
+    ssize_t n = ::send(session.fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    sent += (size_t)n;
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+#ifndef MQTTBROKER_HPP
+#define MQTTBROKER_HPP
+
+#include "MqttCodec.hpp"
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Local stand-in for mosquitto: a single-threaded MQTT 3.1.1 broker on
+// poll(), for end-to-end runs of the host tools without a real broker.
+// QoS 0 only (QoS 1 publishes are acknowledged and forwarded at QoS 0), no
+// retained messages, no persistence, no authentication. A hook sees every
+// PUBLISH as it arrives, before it is forwarded.
+
+struct MqttBrokerStats {
+  uint32_t connections;
+  uint32_t received;  // PUBLISH packets in
+  uint32_t forwarded; // PUBLISH packets out, one per matching subscriber
+  uint32_t protocolErrors;
+};
+
+class MqttBroker {
+public:
+  typedef void (*PublishHook)(const MqttPublish& message, void* ctx);
+
+  MqttBroker();
+  ~MqttBroker();
+
+  MqttBroker(const MqttBroker&) = delete;
+  MqttBroker& operator=(const MqttBroker&) = delete;
+
+  /**
+   * @brief Binds the listening socket.
+   * @param port 0 picks a free port (see port()).
+   */
+  bool listen(const char* address, uint16_t port);
+  uint16_t port() const { return port_; }
+
+  void setPublishHook(PublishHook hook, void* ctx);
+
+  /**
+   * @brief Serves clients until running turns false (checked every 50 ms).
+   */
+  void run(const std::atomic<bool>& running);
+
+  MqttBrokerStats stats() const;
+
+private:
+  struct Session {
+    int fd;
+    bool connected;
+    std::vector<uint8_t> rx;
+    std::vector<std::string> filters;
+  };
+
+  void accept();
+  bool serve(Session& session);
+  bool handle(Session& session, const MqttPacket& packet);
+  void forward(const MqttPublish& message);
+  bool send(Session& session, const std::vector<uint8_t>& bytes);
+
+  int listenFd_;
+  uint16_t port_;
+  PublishHook hook_;
+  void* ctx_;
+  std::vector<Session> sessions_;
+  std::vector<uint8_t> tx_;
+
+  std::atomic<uint32_t> connections_;
+  std::atomic<uint32_t> received_;
+  std::atomic<uint32_t> forwarded_;
+  std::atomic<uint32_t> protocolErrors_;
+};
+
+#endif // MQTTBROKER_HPP
@@ -0,0 +1,169 @@
+#include "MqttClient.hpp"
+#include <chrono>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static uint64_t monotonicMs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MqttClient::MqttClient()
+    : fd_(-1), keepAliveS_(0), nextPacketId_(1), lastSendMs_(0), handler_(nullptr), ctx_(nullptr) {
+}
+
+MqttClient::~MqttClient() {
+  close();
+}
+
+bool MqttClient::connect(const char* host, uint16_t port, const char* clientId, const char* username,
+                         const char* password, uint16_t keepAliveS) {
+  close();
+
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  if (getaddrinfo(host, service, &hints, &addresses) != 0) return false;
+
+  for (addrinfo* a = addresses; a && fd_ < 0; a = a->ai_next) {
+    int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) continue;
+    if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+      fd_ = fd;
+    } else {
+      ::close(fd);
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd_ < 0) return false;
+
+  int one = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  keepAliveS_ = keepAliveS;
+  rx_.clear();
+  tx_.clear();
+  mqttEncodeConnect(tx_, clientId, username, password, keepAliveS);
+  if (!sendAll(tx_) || !waitFor(MQTT_CONNACK, 5000)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool MqttClient::subscribe(const char* filter, MessageHandler handler, void* ctx) {
+  handler_ = handler;
+  ctx_ = ctx;
+  tx_.clear();
+  mqttEncodeSubscribe(tx_, nextPacketId_++, filter);
+  return sendAll(tx_) && waitFor(MQTT_SUBACK, 5000);
+}
+
+bool MqttClient::publish(const char* topic, const uint8_t* payload, size_t length) {
+  tx_.clear();
+  mqttEncodePublish(tx_, topic, strlen(topic), payload, length);
+  return sendAll(tx_);
+}
+
+bool MqttClient::poll(int timeoutMs) {
+  if (fd_ < 0) return false;
+  if (keepAliveS_ && monotonicMs() - lastSendMs_ >= keepAliveS_ * 500u) {
+    tx_.clear();
+    mqttEncodeEmpty(tx_, MQTT_PINGREQ);
+    if (!sendAll(tx_)) return false;
+  }
+  return readOnce(timeoutMs, nullptr);
+}
+
+void MqttClient::disconnect() {
+  if (fd_ < 0) return;
+  tx_.clear();
+  mqttEncodeEmpty(tx_, MQTT_DISCONNECT);
+  sendAll(tx_);
+  close();
+}
+
+bool MqttClient::sendAll(const std::vector<uint8_t>& bytes) {
+  size_t sent = 0;
+  while (sent < bytes.size()) {
+    ssize_t n = send(fd_, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      close();
+      return false;
+    }
+    sent += (size_t)n;
+  }
+  lastSendMs_ = monotonicMs();
+  return true;
+}
+
+bool MqttClient::waitFor(MqttPacketType type, int timeoutMs) {
+  uint64_t deadline = monotonicMs() + timeoutMs;
+  for (;;) {
+    uint64_t now = monotonicMs();
+    if (now >= deadline) return false;
+    MqttPacketType seen = (MqttPacketType)0;
+    if (!readOnce((int)(deadline - now), &seen)) return false;
+    if (seen == type) return true;
+  }
+}
+
+// One read() and every complete packet in the buffer. *seen is set to the
+// type of the last non-PUBLISH packet, for waitFor().
+bool MqttClient::readOnce(int timeoutMs, MqttPacketType* seen) {
+  if (fd_ < 0) return false;
+  pollfd p = {fd_, POLLIN, 0};
+  int ready = ::poll(&p, 1, timeoutMs);
+  if (ready < 0) return false;
+  if (ready == 0) return true;
+
+  uint8_t chunk[4096];
+  ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+  if (n <= 0) {
+    close();
+    return false;
+  }
+  rx_.insert(rx_.end(), chunk, chunk + n);
+
+  size_t pos = 0;
+  for (;;) {
+    MqttPacket packet;
+    long used = mqttParsePacket(rx_.data() + pos, rx_.size() - pos, packet);
+    if (used < 0) {
+      close();
+      return false;
+    }
+    if (used == 0) break;
+
+    if (packet.type == MQTT_PUBLISH) {
+      MqttPublish message;
+      if (mqttParsePublish(packet, message) && handler_) handler_(message, ctx_);
+    } else if (packet.type == MQTT_CONNACK) {
+      uint8_t code;
+      if (!mqttParseConnack(packet, code) || code != 0) {
+        close();
+        return false;
+      }
+      if (seen) *seen = MQTT_CONNACK;
+    } else if (seen) {
+      *seen = (MqttPacketType)packet.type;
+    }
+    pos += (size_t)used;
+  }
+  rx_.erase(rx_.begin(), rx_.begin() + pos);
+  return true;
+}
+
+void MqttClient::close() {
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+}
@@ -0,0 +1,63 @@
+#ifndef MQTTCLIENT_HPP
+#define MQTTCLIENT_HPP
+
+#include "MqttCodec.hpp"
+#include <stdint.h>
+#include <vector>
+
+// Minimal blocking MQTT 3.1.1 client over TCP for the host tools (QoS 0).
+// One thread per client: publish() writes straight to the socket, poll()
+// waits for incoming messages and keeps the session alive with PINGREQs.
+
+class MqttClient {
+public:
+  typedef void (*MessageHandler)(const MqttPublish& message, void* ctx);
+
+  MqttClient();
+  ~MqttClient();
+
+  MqttClient(const MqttClient&) = delete;
+  MqttClient& operator=(const MqttClient&) = delete;
+
+  /**
+   * @brief Opens the TCP connection and waits for the CONNACK.
+   * @return false if the broker is unreachable or refuses the session.
+   */
+  bool connect(const char* host, uint16_t port, const char* clientId, const char* username = nullptr,
+               const char* password = nullptr, uint16_t keepAliveS = 60);
+
+  /**
+   * @brief Subscribes and waits for the SUBACK (messages arriving meanwhile
+   * are delivered to the handler).
+   */
+  bool subscribe(const char* filter, MessageHandler handler, void* ctx);
+
+  bool publish(const char* topic, const uint8_t* payload, size_t length);
+
+  /**
+   * @brief Reads for up to timeoutMs and hands every PUBLISH to the handler
+   * set by subscribe().
+   * @return false once the connection is lost.
+   */
+  bool poll(int timeoutMs);
+
+  void disconnect();
+  bool connected() const { return fd_ >= 0; }
+
+private:
+  bool sendAll(const std::vector<uint8_t>& bytes);
+  bool waitFor(MqttPacketType type, int timeoutMs);
+  bool readOnce(int timeoutMs, MqttPacketType* seen);
+  void close();
+
+  int fd_;
+  uint16_t keepAliveS_;
+  uint16_t nextPacketId_;
+  uint64_t lastSendMs_;
+  MessageHandler handler_;
+  void* ctx_;
+  std::vector<uint8_t> rx_;
+  std::vector<uint8_t> tx_;
+};
+
+#endif // MQTTCLIENT_HPP
@@ -0,0 +1,234 @@
+#include "MqttCodec.hpp"
+#include <string.h>
+
+// -------------------------------------------------------------
+// Field helpers
+// -------------------------------------------------------------
+namespace {
+
+struct Reader {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  bool u8(uint8_t& v) {
+    if (p >= end) return false;
+    v = *p++;
+    return true;
+  }
+
+  bool u16(uint16_t& v) {
+    if (end - p < 2) return false;
+    v = (uint16_t)(p[0] << 8 | p[1]);
+    p += 2;
+    return true;
+  }
+
+  bool string(const char*& s, size_t& length) {
+    uint16_t n;
+    if (!u16(n) || (size_t)(end - p) < n) return false;
+    s = (const char*)p;
+    length = n;
+    p += n;
+    return true;
+  }
+
+  bool string(std::string& s) {
+    const char* data;
+    size_t length;
+    if (!string(data, length)) return false;
+    s.assign(data, length);
+    return true;
+  }
+};
+
+void putU16(std::vector<uint8_t>& out, uint16_t v) {
+  out.push_back((uint8_t)(v >> 8));
+  out.push_back((uint8_t)v);
+}
+
+void putString(std::vector<uint8_t>& out, const char* s, size_t length) {
+  putU16(out, (uint16_t)length);
+  out.insert(out.end(), (const uint8_t*)s, (const uint8_t*)s + length);
+}
+
+void putFixedHeader(std::vector<uint8_t>& out, uint8_t type, uint8_t flags, size_t remaining) {
+  out.push_back((uint8_t)(type << 4 | flags));
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    out.push_back(remaining ? digit | 0x80 : digit);
+  } while (remaining);
+}
+
+} // namespace
+
+// -------------------------------------------------------------
+// Parsing
+// -------------------------------------------------------------
+long mqttParsePacket(const uint8_t* buf, size_t available, MqttPacket& out) {
+  if (available < 2) return 0;
+
+  size_t remaining = 0;
+  size_t pos = 1;
+  for (int shift = 0;; shift += 7) {
+    if (shift > 21) return -1; // At most four length bytes
+    if (pos >= available) return 0;
+    uint8_t b = buf[pos++];
+    remaining |= (size_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) break;
+  }
+  if (remaining > MQTT_MAX_PACKET_BYTES) return -1;
+  if (available - pos < remaining) return 0;
+
+  out.type = buf[0] >> 4;
+  out.flags = buf[0] & 0x0F;
+  out.body = buf + pos;
+  out.length = remaining;
+  return (long)(pos + remaining);
+}
+
+bool mqttParseConnect(const MqttPacket& packet, MqttConnect& out) {
+  if (packet.type != MQTT_CONNECT) return false;
+  Reader r = {packet.body, packet.body + packet.length};
+
+  const char* protocol;
+  size_t protocolLength;
+  uint8_t level, flags;
+  if (!r.string(protocol, protocolLength) || protocolLength != 4 || memcmp(protocol, "MQTT", 4) ||
+      !r.u8(level) || level != 4 || !r.u8(flags) || !r.u16(out.keepAliveS) || !r.string(out.clientId)) {
+    return false;
+  }
+  out.cleanSession = flags & 0x02;
+
+  if (flags & 0x04) { // Will topic and message: read past them
+    std::string will;
+    if (!r.string(will) || !r.string(will)) return false;
+  }
+  out.username.clear();
+  out.password.clear();
+  if ((flags & 0x80) && !r.string(out.username)) return false;
+  if ((flags & 0x40) && !r.string(out.password)) return false;
+  return r.p == r.end;
+}
+
+bool mqttParsePublish(const MqttPacket& packet, MqttPublish& out) {
+  if (packet.type != MQTT_PUBLISH) return false;
+  Reader r = {packet.body, packet.body + packet.length};
+
+  out.qos = (packet.flags >> 1) & 0x03;
+  out.retain = packet.flags & 0x01;
+  out.packetId = 0;
+  if (out.qos > 2 || !r.string(out.topic, out.topicLength)) return false;
+  if (out.qos > 0 && !r.u16(out.packetId)) return false;
+  out.payload = r.p;
+  out.payloadLength = (size_t)(r.end - r.p);
+  return true;
+}
+
+bool mqttParseSubscribe(const MqttPacket& packet, uint16_t& packetId, std::vector<std::string>& filters) {
+  if (packet.type != MQTT_SUBSCRIBE || packet.flags != 0x02) return false;
+  Reader r = {packet.body, packet.body + packet.length};
+
+  if (!r.u16(packetId)) return false;
+  filters.clear();
+  while (r.p < r.end) {
+    std::string filter;
+    uint8_t qos;
+    if (!r.string(filter) || filter.empty() || !r.u8(qos)) return false;
+    filters.push_back(filter);
+  }
+  return !filters.empty();
+}
+
+bool mqttParseConnack(const MqttPacket& packet, uint8_t& returnCode) {
+  if (packet.type != MQTT_CONNACK || packet.length != 2) return false;
+  returnCode = packet.body[1];
+  return true;
+}
+
+bool mqttTopicMatches(const std::string& filter, const char* topic, size_t topicLength) {
+  size_t f = 0, t = 0;
+  while (f < filter.size()) {
+    if (filter[f] == '#') return true; // Matches the rest, including the parent level
+    if (filter[f] == '+') {
+      while (t < topicLength && topic[t] != '/') t++;
+      f++;
+    } else {
+      if (t >= topicLength || filter[f] != topic[t]) {
+        // "a/#" also matches "a"
+        return t == topicLength && filter.compare(f, std::string::npos, "/#") == 0;
+      }
+      f++;
+      t++;
+    }
+  }
+  return t == topicLength;
+}
+
+// -------------------------------------------------------------
+// Encoding
+// -------------------------------------------------------------
+void mqttEncodeConnect(std::vector<uint8_t>& out, const char* clientId, const char* username, const char* password,
+                       uint16_t keepAliveS) {
+  size_t idLength = strlen(clientId);
+  size_t userLength = username ? strlen(username) : 0;
+  size_t passLength = password ? strlen(password) : 0;
+
+  uint8_t flags = 0x02; // Clean session
+  size_t remaining = 10 + 2 + idLength;
+  if (username) {
+    flags |= 0x80;
+    remaining += 2 + userLength;
+  }
+  if (password) {
+    flags |= 0x40;
+    remaining += 2 + passLength;
+  }
+
+  putFixedHeader(out, MQTT_CONNECT, 0, remaining);
+  putString(out, "MQTT", 4);
+  out.push_back(4); // Protocol level 3.1.1
+  out.push_back(flags);
+  putU16(out, keepAliveS);
+  putString(out, clientId, idLength);
+  if (username) putString(out, username, userLength);
+  if (password) putString(out, password, passLength);
+}
+
+void mqttEncodeConnack(std::vector<uint8_t>& out, uint8_t returnCode) {
+  putFixedHeader(out, MQTT_CONNACK, 0, 2);
+  out.push_back(0); // No session present
+  out.push_back(returnCode);
+}
+
+void mqttEncodePublish(std::vector<uint8_t>& out, const char* topic, size_t topicLength, const uint8_t* payload,
+                       size_t payloadLength, uint8_t qos, uint16_t packetId) {
+  size_t remaining = 2 + topicLength + (qos ? 2 : 0) + payloadLength;
+  putFixedHeader(out, MQTT_PUBLISH, (uint8_t)(qos << 1), remaining);
+  putString(out, topic, topicLength);
+  if (qos) putU16(out, packetId);
+  out.insert(out.end(), payload, payload + payloadLength);
+}
+
+void mqttEncodePuback(std::vector<uint8_t>& out, uint16_t packetId) {
+  putFixedHeader(out, MQTT_PUBACK, 0, 2);
+  putU16(out, packetId);
+}
+
+void mqttEncodeSubscribe(std::vector<uint8_t>& out, uint16_t packetId, const char* filter, uint8_t qos) {
+  size_t filterLength = strlen(filter);
+  putFixedHeader(out, MQTT_SUBSCRIBE, 0x02, 2 + 2 + filterLength + 1);
+  putU16(out, packetId);
+  putString(out, filter, filterLength);
+  out.push_back(qos);
+}
+
+void mqttEncodeSuback(std::vector<uint8_t>& out, uint16_t packetId, int filterCount, uint8_t grantedQos) {
+  putFixedHeader(out, MQTT_SUBACK, 0, 2 + (size_t)filterCount);
+  putU16(out, packetId);
+  for (int i = 0; i < filterCount; i++) out.push_back(grantedQos);
+}
+
+void mqttEncodeEmpty(std::vector<uint8_t>& out, MqttPacketType type) {
+  putFixedHeader(out, type, 0, 0);
+}
@@ -0,0 +1,96 @@
+#ifndef MQTTCODEC_HPP
+#define MQTTCODEC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// MQTT 3.1.1 packet encoding and parsing for the host tools: enough of the
+// protocol for a device, a subscriber and a stand-in broker (CONNECT,
+// PUBLISH at QoS 0/1, SUBSCRIBE, PING, DISCONNECT). No sockets here: encoders
+// append to a byte vector, and the parser works on whatever has been received
+// so far, so the same code serves blocking and non-blocking I/O.
+
+enum MqttPacketType : uint8_t {
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_SUBSCRIBE = 8,
+  MQTT_SUBACK = 9,
+  MQTT_UNSUBSCRIBE = 10,
+  MQTT_UNSUBACK = 11,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14,
+};
+
+// Largest packet accepted by the parser (the protocol allows 256 MB)
+const size_t MQTT_MAX_PACKET_BYTES = 1 << 20;
+
+/**
+ * @brief One framed packet; body points into the receive buffer.
+ */
+struct MqttPacket {
+  uint8_t type;  // MqttPacketType
+  uint8_t flags; // Low nibble of the fixed header
+  const uint8_t* body;
+  size_t length;
+};
+
+struct MqttConnect {
+  std::string clientId;
+  std::string username;
+  std::string password;
+  uint16_t keepAliveS;
+  bool cleanSession;
+};
+
+struct MqttPublish {
+  const char* topic; // Not NUL-terminated
+  size_t topicLength;
+  const uint8_t* payload;
+  size_t payloadLength;
+  uint8_t qos;
+  bool retain;
+  uint16_t packetId; // QoS > 0 only
+};
+
+/**
+ * @brief Frames the packet at the start of buf.
+ * @return Bytes the packet occupies, 0 if more bytes are needed, or -1 if
+ * the stream is malformed (the connection should be dropped).
+ */
+long mqttParsePacket(const uint8_t* buf, size_t available, MqttPacket& out);
+
+bool mqttParseConnect(const MqttPacket& packet, MqttConnect& out);
+bool mqttParsePublish(const MqttPacket& packet, MqttPublish& out);
+
+/**
+ * @brief Topic filters of a SUBSCRIBE (requested QoS is dropped).
+ */
+bool mqttParseSubscribe(const MqttPacket& packet, uint16_t& packetId, std::vector<std::string>& filters);
+
+/**
+ * @brief CONNACK return code (0: accepted).
+ */
+bool mqttParseConnack(const MqttPacket& packet, uint8_t& returnCode);
+
+/**
+ * @brief Matches a topic against a filter with '+' and '#' wildcards.
+ */
+bool mqttTopicMatches(const std::string& filter, const char* topic, size_t topicLength);
+
+// --- Encoders (append one packet to out) ---
+void mqttEncodeConnect(std::vector<uint8_t>& out, const char* clientId, const char* username = nullptr,
+                       const char* password = nullptr, uint16_t keepAliveS = 60);
+void mqttEncodeConnack(std::vector<uint8_t>& out, uint8_t returnCode);
+void mqttEncodePublish(std::vector<uint8_t>& out, const char* topic, size_t topicLength, const uint8_t* payload,
+                       size_t payloadLength, uint8_t qos = 0, uint16_t packetId = 0);
+void mqttEncodePuback(std::vector<uint8_t>& out, uint16_t packetId);
+void mqttEncodeSubscribe(std::vector<uint8_t>& out, uint16_t packetId, const char* filter, uint8_t qos = 0);
+void mqttEncodeSuback(std::vector<uint8_t>& out, uint16_t packetId, int filterCount, uint8_t grantedQos = 0);
+void mqttEncodeEmpty(std::vector<uint8_t>& out, MqttPacketType type); // PINGREQ, PINGRESP, DISCONNECT
+
+#endif // MQTTCODEC_HPP
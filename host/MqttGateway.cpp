@@ -0,0 +1,1007 @@
+#include "MqttGateway.hpp"
+#include "MqttClient.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <functional>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_set>
+
+// epoll data of the two non-session descriptors; session IDs start above them
+static const uint64_t LISTEN_ID = 0;
+static const uint64_t WAKE_ID = 1;
+
+static const size_t SESSION_TX_LIMIT = 4 * 1024 * 1024; // A device this far behind is dropped
+static const uint64_t CONNECT_TIMEOUT_MS = 10000;       // From accept() to CONNECT
+static const int UPSTREAM_BACKOFF_MAX_MS = 30000;
+
+static const char TELEMETRY_TOPIC[] = "v1/devices/me/telemetry";
+static const char ATTRIBUTES_TOPIC[] = "v1/devices/me/attributes";
+static const char ATTRIBUTE_REQUEST_PREFIX[] = "v1/devices/me/attributes/request/";
+static const char RPC_RESPONSE_PREFIX[] = "v1/devices/me/rpc/response/";
+static const char BINARY_TOPIC[] = "bioreactor/telemetry/bin";
+
+static uint64_t monotonicMs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t unixMs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t threadCpuNs() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static bool startsWith(const std::string& s, const char* prefix) {
+  return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// -------------------------------------------------------------
+// JSON: the gateway only reads the top-level fields it routes on; everything
+// else is passed through as raw text
+// -------------------------------------------------------------
+static const char* skipSpace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+  return p;
+}
+
+// Past the value at p, or nullptr if it is cut short
+static const char* skipValue(const char* p, const char* end) {
+  if (p >= end) return nullptr;
+  if (*p == '"') {
+    for (p++; p < end; p++) {
+      if (*p == '\\') p++;
+      else if (*p == '"') return p + 1;
+    }
+    return nullptr;
+  }
+  if (*p == '{' || *p == '[') {
+    int depth = 0;
+    for (; p < end; p++) {
+      if (*p == '"') {
+        p = skipValue(p, end);
+        if (!p) return nullptr;
+        p--;
+      } else if (*p == '{' || *p == '[') {
+        depth++;
+      } else if ((*p == '}' || *p == ']') && --depth == 0) {
+        return p + 1;
+      }
+    }
+    return nullptr;
+  }
+  while (p < end && !strchr(",}] \t\r\n", *p)) p++;
+  return p;
+}
+
+/**
+ * @brief Raw text of a top-level field of a JSON object.
+ */
+static bool jsonField(const char* json, size_t length, const char* key, const char*& value, size_t& valueLength) {
+  const char* end = json + length;
+  const char* p = skipSpace(json, end);
+  if (p >= end || *p++ != '{') return false;
+  size_t keyLength = strlen(key);
+  for (;;) {
+    p = skipSpace(p, end);
+    if (p >= end || *p != '"') return false;
+    const char* name = p + 1;
+    p = skipValue(p, end);
+    if (!p) return false;
+    bool match = (size_t)(p - 1 - name) == keyLength && memcmp(name, key, keyLength) == 0;
+    p = skipSpace(p, end);
+    if (p >= end || *p++ != ':') return false;
+    p = skipSpace(p, end);
+    const char* v = p;
+    p = skipValue(p, end);
+    if (!p) return false;
+    if (match) {
+      value = v;
+      valueLength = (size_t)(p - v);
+      return true;
+    }
+    p = skipSpace(p, end);
+    if (p >= end || *p++ != ',') return false;
+  }
+}
+
+static bool jsonField(const std::string& json, const char* key, std::string& out) {
+  const char* value;
+  size_t length;
+  if (!jsonField(json.data(), json.size(), key, value, length)) return false;
+  out.assign(value, length);
+  return true;
+}
+
+// A string field without escapes (device names and attribute keys)
+static bool jsonString(const std::string& json, const char* key, std::string& out) {
+  std::string raw;
+  if (!jsonField(json, key, raw) || raw.size() < 2 || raw[0] != '"' || raw.find('\\') != std::string::npos) {
+    return false;
+  }
+  out = raw.substr(1, raw.size() - 2);
+  return true;
+}
+
+static void appendQuoted(std::string& out, const std::string& text) {
+  out += '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  out += '"';
+}
+
+// An ID from a topic, as a JSON number when it is one
+static void appendId(std::string& out, const std::string& id) {
+  bool numeric = !id.empty() && id.find_first_not_of("0123456789") == std::string::npos;
+  if (numeric) out += id;
+  else appendQuoted(out, id);
+}
+
+// -------------------------------------------------------------
+// State
+// -------------------------------------------------------------
+struct MqttGateway::Session {
+  uint64_t id;
+  int fd;
+  bool connected = false;
+  bool registered = false; // In the registry under identity (until taken over)
+  bool watchingOut = false;
+  std::string identity;
+  uint16_t keepAliveS = 0;
+  uint64_t acceptedMs = 0;
+  uint64_t lastRxMs = 0;
+  std::vector<uint8_t> rx;
+  std::vector<uint8_t> tx; // Not yet taken by the socket, from txSent on
+  size_t txSent = 0;
+  std::vector<std::string> filters;
+};
+
+struct MqttGateway::Delivery {
+  uint64_t session;
+  std::string topic;
+  std::string payload;
+  bool kick; // Close the session instead (taken over)
+};
+
+struct MqttGateway::Worker {
+  int index = 0;
+  int epollFd = -1;
+  int listenFd = -1;
+  int wakeFd = -1; // eventfd: the inbox has deliveries
+  std::thread thread;
+  std::unordered_map<uint64_t, Session> sessions; // Worker thread only
+
+  std::mutex lock;
+  std::vector<Delivery> inbox;
+};
+
+struct AttributeRequest {
+  std::string device;
+  std::string localId;   // N of the device's .../attributes/request/N
+  std::string singleKey; // Set when one key was asked for: the answer is then "value", not "values"
+  bool client;
+};
+
+struct PendingTelemetry {
+  std::string entries; // Comma-separated {"ts":..,"values":..} objects
+  uint32_t count = 0;
+};
+
+struct MqttGateway::Upstream {
+  MqttGateway* gateway;
+  int index;
+  std::thread thread;
+  MqttClient client; // Upstream thread only
+
+  std::mutex lock;
+  std::vector<std::string> devices; // With telemetry queued, in the order they first sent
+  std::unordered_map<std::string, PendingTelemetry> telemetry;
+  std::vector<std::pair<std::string, std::string>> messages; // Topic, payload; sent first, in order
+  size_t pendingBytes = 0;
+  std::unordered_map<uint32_t, AttributeRequest> requests; // Gateway request ID -> device request
+};
+
+MqttGateway::MqttGateway()
+    : port_(0), running_(false), upstreamRunning_(false), nextSession_(WAKE_ID + 1), nextRequest_(1),
+      accepted_(0), takeovers_(0), received_(0), unrouted_(0), upstreamPublishes_(0), upstreamEntries_(0),
+      upstreamBytes_(0), upstreamReconnects_(0), dropped_(0), downstream_(0), undeliverable_(0),
+      protocolErrors_(0), cpuNs_(0) {
+}
+
+MqttGateway::~MqttGateway() {
+  stop();
+}
+
+bool MqttGateway::start(const MqttGatewayConfig& config) {
+  config_ = config;
+  if (config_.upstreamConnections < 1) config_.upstreamConnections = 1;
+  int threads = config_.ioThreads > 0 ? config_.ioThreads : (int)std::thread::hardware_concurrency();
+  if (threads < 1) threads = 1;
+
+  // One listening socket per worker on the same port; the kernel balances accepts
+  uint16_t port = config_.listenPort;
+  for (int w = 0; w < threads; w++) {
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->index = w;
+    worker->listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(worker->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(worker->listenFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, config_.listenAddress.c_str(), &addr.sin_addr) != 1 ||
+        bind(worker->listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(worker->listenFd, SOMAXCONN) != 0) {
+      close(worker->listenFd);
+      for (std::unique_ptr<Worker>& other : workers_) close(other->listenFd);
+      workers_.clear();
+      return false;
+    }
+    socklen_t length = sizeof(addr);
+    getsockname(worker->listenFd, (sockaddr*)&addr, &length);
+    port = ntohs(addr.sin_port); // The others bind the port the first one got
+
+    worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    worker->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_ID;
+    epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->listenFd, &event);
+    event.data.u64 = WAKE_ID;
+    epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->wakeFd, &event);
+    workers_.push_back(std::move(worker));
+  }
+  port_ = port;
+
+  for (int u = 0; u < config_.upstreamConnections; u++) {
+    std::unique_ptr<Upstream> upstream(new Upstream());
+    upstream->gateway = this;
+    upstream->index = u;
+    upstreams_.push_back(std::move(upstream));
+  }
+
+  running_ = true;
+  upstreamRunning_ = true;
+  for (std::unique_ptr<Upstream>& u : upstreams_) {
+    Upstream* upstream = u.get();
+    upstream->thread = std::thread([this, upstream] { runUpstream(*upstream); });
+  }
+  for (std::unique_ptr<Worker>& w : workers_) {
+    Worker* worker = w.get();
+    worker->thread = std::thread([this, worker] { runWorker(*worker); });
+  }
+  return true;
+}
+
+void MqttGateway::stop() {
+  if (!running_ && !upstreamRunning_) return;
+  running_ = false;
+  for (std::unique_ptr<Worker>& w : workers_) {
+    uint64_t one = 1;
+    ssize_t ignored = write(w->wakeFd, &one, sizeof(one));
+    (void)ignored;
+    if (w->thread.joinable()) w->thread.join();
+  }
+  upstreamRunning_ = false;
+  for (std::unique_ptr<Upstream>& u : upstreams_) {
+    if (u->thread.joinable()) u->thread.join();
+  }
+  for (std::unique_ptr<Worker>& w : workers_) {
+    close(w->listenFd);
+    close(w->wakeFd);
+    close(w->epollFd);
+  }
+}
+
+MqttGatewayStats MqttGateway::stats() const {
+  MqttGatewayStats s;
+  s.accepted = accepted_;
+  {
+    std::lock_guard<std::mutex> guard(registryLock_);
+    s.devices = registry_.size();
+  }
+  s.takeovers = takeovers_;
+  s.received = received_;
+  s.unrouted = unrouted_;
+  s.upstreamPublishes = upstreamPublishes_;
+  s.upstreamEntries = upstreamEntries_;
+  s.upstreamBytes = upstreamBytes_;
+  s.upstreamReconnects = upstreamReconnects_;
+  s.dropped = dropped_;
+  s.downstream = downstream_;
+  s.undeliverable = undeliverable_;
+  s.protocolErrors = protocolErrors_;
+  s.cpuS = cpuNs_ / 1e9;
+  return s;
+}
+
+// -------------------------------------------------------------
+// Device side: one epoll loop per worker
+// -------------------------------------------------------------
+void MqttGateway::runWorker(Worker& worker) {
+  epoll_event events[256];
+  uint64_t nextSweepMs = monotonicMs() + 1000;
+
+  while (running_) {
+    int n = epoll_wait(worker.epollFd, events, 256, 1000);
+    for (int i = 0; i < n; i++) {
+      uint64_t id = events[i].data.u64;
+      if (id == LISTEN_ID) {
+        accept(worker);
+        continue;
+      }
+      if (id == WAKE_ID) {
+        uint64_t count;
+        ssize_t ignored = read(worker.wakeFd, &count, sizeof(count));
+        (void)ignored;
+        drainInbox(worker);
+        continue;
+      }
+      // The session may have been closed by an earlier event of this batch
+      auto found = worker.sessions.find(id);
+      if (found == worker.sessions.end()) continue;
+      Session& session = found->second;
+      bool ok = true;
+      if (events[i].events & EPOLLOUT) ok = flushSession(worker, session);
+      if (ok && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) ok = serve(worker, session);
+      if (!ok) closeSession(worker, id);
+    }
+
+    // Sessions that never sent CONNECT, or went quiet for 1.5 keep-alive periods
+    uint64_t now = monotonicMs();
+    if (now >= nextSweepMs) {
+      nextSweepMs = now + 1000;
+      std::vector<uint64_t> expired;
+      for (auto& entry : worker.sessions) {
+        const Session& s = entry.second;
+        if (!s.connected ? now - s.acceptedMs > CONNECT_TIMEOUT_MS
+                         : s.keepAliveS && now - s.lastRxMs > s.keepAliveS * 1500u) {
+          expired.push_back(entry.first);
+        }
+      }
+      for (uint64_t id : expired) closeSession(worker, id);
+    }
+  }
+
+  std::vector<uint64_t> all;
+  for (auto& entry : worker.sessions) all.push_back(entry.first);
+  for (uint64_t id : all) closeSession(worker, id);
+  cpuNs_ += threadCpuNs();
+}
+
+void MqttGateway::accept(Worker& worker) {
+  for (;;) {
+    int fd = accept4(worker.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return; // EAGAIN: accepted everything pending
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint64_t id = nextSession_++;
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = id;
+    if (epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      continue;
+    }
+    Session& session = worker.sessions[id];
+    session.id = id;
+    session.fd = fd;
+    session.acceptedMs = session.lastRxMs = monotonicMs();
+    accepted_++;
+  }
+}
+
+// Reads what is available and handles every complete packet
+bool MqttGateway::serve(Worker& worker, Session& session) {
+  uint8_t chunk[16384];
+  ssize_t n = recv(session.fd, chunk, sizeof(chunk), 0);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+  if (n <= 0) return false;
+  session.rx.insert(session.rx.end(), chunk, chunk + n);
+  session.lastRxMs = monotonicMs();
+
+  size_t pos = 0;
+  for (;;) {
+    MqttPacket packet;
+    long used = mqttParsePacket(session.rx.data() + pos, session.rx.size() - pos, packet);
+    if (used == 0) break;
+    if (used < 0 || !handle(worker, session, packet)) {
+      if (used < 0 || packet.type != MQTT_DISCONNECT) protocolErrors_++;
+      return false;
+    }
+    pos += (size_t)used;
+  }
+  session.rx.erase(session.rx.begin(), session.rx.begin() + pos);
+  return true;
+}
+
+bool MqttGateway::handle(Worker& worker, Session& session, const MqttPacket& packet) {
+  if (!session.connected && packet.type != MQTT_CONNECT) return false;
+
+  std::vector<uint8_t> tx;
+  switch (packet.type) {
+  case MQTT_CONNECT: {
+    MqttConnect connect;
+    if (session.connected || !mqttParseConnect(packet, connect)) return false;
+    session.identity = config_.identityFromUsername && !connect.username.empty() ? connect.username
+                                                                                   : connect.clientId;
+    if (session.identity.empty()) {
+      mqttEncodeConnack(tx, 2); // Identifier rejected
+      send(worker, session, tx);
+      return false;
+    }
+    session.connected = true;
+    session.keepAliveS = connect.keepAliveS;
+
+    Route previous = {-1, 0};
+    {
+      std::lock_guard<std::mutex> guard(registryLock_);
+      auto found = registry_.find(session.identity);
+      if (found != registry_.end()) previous = found->second;
+      registry_[session.identity] = Route{worker.index, session.id};
+      if (previous.worker < 0) {
+        std::string payload = "{\"device\":";
+        appendQuoted(payload, session.identity);
+        payload += '}';
+        queueUpstream(upstreamFor(session.identity), "v1/gateway/connect", payload);
+      }
+    }
+    session.registered = true;
+    if (previous.worker >= 0) {
+      takeovers_++;
+      post(previous.worker, Delivery{previous.session, std::string(), std::string(), true});
+    }
+    mqttEncodeConnack(tx, 0);
+    return send(worker, session, tx);
+  }
+  case MQTT_PUBLISH: {
+    MqttPublish message;
+    if (!mqttParsePublish(packet, message) || message.qos > 1) return false;
+    received_++;
+    if (message.qos == 1) {
+      mqttEncodePuback(tx, message.packetId);
+      if (!send(worker, session, tx)) return false;
+    }
+    fromDevice(session, message);
+    return true;
+  }
+  case MQTT_SUBSCRIBE: {
+    uint16_t packetId;
+    std::vector<std::string> filters;
+    if (!mqttParseSubscribe(packet, packetId, filters)) return false;
+    session.filters.insert(session.filters.end(), filters.begin(), filters.end());
+    mqttEncodeSuback(tx, packetId, (int)filters.size());
+    return send(worker, session, tx);
+  }
+  case MQTT_PINGREQ:
+    mqttEncodeEmpty(tx, MQTT_PINGRESP);
+    return send(worker, session, tx);
+  case MQTT_DISCONNECT:
+    return false;
+  default:
+    return true; // PUBACKs and the like
+  }
+}
+
+bool MqttGateway::send(Worker& worker, Session& session, const std::vector<uint8_t>& bytes) {
+  size_t offset = 0;
+  if (session.tx.size() == session.txSent) {
+    // Nothing queued: straight to the socket
+    session.tx.clear();
+    session.txSent = 0;
+    while (offset < bytes.size()) {
+      ssize_t n = ::send(session.fd, bytes.data() + offset, bytes.size() - offset, MSG_NOSIGNAL);
+      if (n > 0) offset += (size_t)n;
+      else if (n < 0 && errno == EAGAIN) break;
+      else if (!(n < 0 && errno == EINTR)) return false;
+    }
+    if (offset == bytes.size()) return true;
+  }
+  session.tx.insert(session.tx.end(), bytes.begin() + offset, bytes.end());
+  if (session.tx.size() - session.txSent > SESSION_TX_LIMIT) return false;
+  if (!session.watchingOut) {
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.u64 = session.id;
+    epoll_ctl(worker.epollFd, EPOLL_CTL_MOD, session.fd, &event);
+    session.watchingOut = true;
+  }
+  return true;
+}
+
+bool MqttGateway::flushSession(Worker& worker, Session& session) {
+  while (session.txSent < session.tx.size()) {
+    ssize_t n = ::send(session.fd, session.tx.data() + session.txSent, session.tx.size() - session.txSent,
+                       MSG_NOSIGNAL);
+    if (n > 0) session.txSent += (size_t)n;
+    else if (n < 0 && errno == EAGAIN) return true;
+    else if (!(n < 0 && errno == EINTR)) return false;
+  }
+  session.tx.clear();
+  session.txSent = 0;
+  if (session.watchingOut) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = session.id;
+    epoll_ctl(worker.epollFd, EPOLL_CTL_MOD, session.fd, &event);
+    session.watchingOut = false;
+  }
+  return true;
+}
+
+void MqttGateway::closeSession(Worker& worker, uint64_t id) {
+  auto found = worker.sessions.find(id);
+  if (found == worker.sessions.end()) return;
+  Session& session = found->second;
+  epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, session.fd, nullptr);
+  close(session.fd);
+
+  if (session.registered) {
+    std::lock_guard<std::mutex> guard(registryLock_);
+    auto route = registry_.find(session.identity);
+    // Unless a newer session has taken the identity over
+    if (route != registry_.end() && route->second.session == id) {
+      registry_.erase(route);
+      std::string payload = "{\"device\":";
+      appendQuoted(payload, session.identity);
+      payload += '}';
+      queueUpstream(upstreamFor(session.identity), "v1/gateway/disconnect", payload);
+    }
+  }
+  worker.sessions.erase(found);
+}
+
+void MqttGateway::post(int worker, Delivery delivery) {
+  Worker& w = *workers_[worker];
+  {
+    std::lock_guard<std::mutex> guard(w.lock);
+    w.inbox.push_back(std::move(delivery));
+  }
+  uint64_t one = 1;
+  ssize_t ignored = write(w.wakeFd, &one, sizeof(one));
+  (void)ignored;
+}
+
+void MqttGateway::drainInbox(Worker& worker) {
+  std::vector<Delivery> inbox;
+  {
+    std::lock_guard<std::mutex> guard(worker.lock);
+    inbox.swap(worker.inbox);
+  }
+  std::vector<uint8_t> packet;
+  for (Delivery& d : inbox) {
+    auto found = worker.sessions.find(d.session);
+    if (found == worker.sessions.end()) {
+      if (!d.kick) undeliverable_++;
+      continue;
+    }
+    Session& session = found->second;
+    if (d.kick) {
+      session.registered = false; // The identity belongs to the new session now
+      closeSession(worker, d.session);
+      continue;
+    }
+
+    bool subscribed = false;
+    for (const std::string& filter : session.filters) {
+      if (mqttTopicMatches(filter, d.topic.data(), d.topic.size())) {
+        subscribed = true;
+        break;
+      }
+    }
+    if (!subscribed) {
+      undeliverable_++;
+      continue;
+    }
+    packet.clear();
+    mqttEncodePublish(packet, d.topic.data(), d.topic.size(), (const uint8_t*)d.payload.data(), d.payload.size());
+    if (send(worker, session, packet)) downstream_++;
+    else closeSession(worker, d.session);
+  }
+}
+
+// -------------------------------------------------------------
+// Device -> upstream
+// -------------------------------------------------------------
+MqttGateway::Upstream& MqttGateway::upstreamFor(const std::string& identity) {
+  return *upstreams_[std::hash<std::string>()(identity) % upstreams_.size()];
+}
+
+void MqttGateway::queueUpstream(Upstream& upstream, const char* topic, std::string payload) {
+  std::lock_guard<std::mutex> guard(upstream.lock);
+  upstream.pendingBytes += payload.size();
+  upstream.messages.emplace_back(topic, std::move(payload));
+}
+
+void MqttGateway::fromDevice(Session& session, const MqttPublish& message) {
+  std::string topic(message.topic, message.topicLength);
+  std::string payload((const char*)message.payload, message.payloadLength);
+  Upstream& upstream = upstreamFor(session.identity);
+
+  if (topic == TELEMETRY_TOPIC) {
+    // The device API takes {..}, {"ts":..,"values":{..}} or an array of either
+    std::string entries;
+    uint32_t count = 0;
+    const char* begin = payload.data();
+    const char* end = begin + payload.size();
+    const char* p = skipSpace(begin, end);
+    std::string values;
+    if (p < end && *p == '[') {
+      for (p = skipSpace(p + 1, end); p < end && *p != ']';) {
+        const char* next = skipValue(p, end);
+        if (!next) break;
+        std::string entry(p, next);
+        if (!entries.empty()) entries += ',';
+        if (jsonField(entry, "values", values)) {
+          entries += entry;
+        } else {
+          entries += "{\"ts\":" + std::to_string(unixMs()) + ",\"values\":" + entry + "}";
+        }
+        count++;
+        p = skipSpace(next, end);
+        if (p < end && *p == ',') p = skipSpace(p + 1, end);
+      }
+    } else if (jsonField(payload, "values", values)) {
+      entries = payload;
+      count = 1;
+    } else {
+      entries = "{\"ts\":" + std::to_string(unixMs()) + ",\"values\":" + payload + "}";
+      count = 1;
+    }
+    if (!count) return;
+
+    std::lock_guard<std::mutex> guard(upstream.lock);
+    if (upstream.pendingBytes > config_.maxPendingBytes) {
+      dropped_ += count;
+      return;
+    }
+    upstream.pendingBytes += entries.size();
+    PendingTelemetry& pending = upstream.telemetry[session.identity];
+    if (pending.count == 0) {
+      upstream.devices.push_back(session.identity);
+      pending.entries = std::move(entries);
+    } else {
+      pending.entries += ',';
+      pending.entries += entries;
+    }
+    pending.count += count;
+    return;
+  }
+
+  if (topic == ATTRIBUTES_TOPIC) {
+    std::string out = "{";
+    appendQuoted(out, session.identity);
+    out += ':';
+    out += payload;
+    out += '}';
+    queueUpstream(upstream, "v1/gateway/attributes", std::move(out));
+    return;
+  }
+
+  if (startsWith(topic, ATTRIBUTE_REQUEST_PREFIX)) {
+    // {"sharedKeys":"a,b"} or {"clientKeys":"a,b"}
+    AttributeRequest request;
+    request.device = session.identity;
+    request.localId = topic.substr(strlen(ATTRIBUTE_REQUEST_PREFIX));
+    request.client = false;
+    std::string keys;
+    if (!jsonString(payload, "sharedKeys", keys)) {
+      if (!jsonString(payload, "clientKeys", keys)) {
+        unrouted_++;
+        return;
+      }
+      request.client = true;
+    }
+
+    std::vector<std::string> names;
+    for (size_t start = 0; start <= keys.size();) {
+      size_t comma = keys.find(',', start);
+      if (comma == std::string::npos) comma = keys.size();
+      if (comma > start) names.push_back(keys.substr(start, comma - start));
+      start = comma + 1;
+    }
+    if (names.size() == 1) request.singleKey = names[0];
+
+    uint32_t id = nextRequest_++;
+    std::string out = "{\"id\":" + std::to_string(id) + ",\"device\":";
+    appendQuoted(out, session.identity);
+    out += request.client ? ",\"client\":true" : ",\"client\":false";
+    if (names.size() == 1) {
+      out += ",\"key\":";
+      appendQuoted(out, names[0]);
+    } else {
+      out += ",\"keys\":[";
+      for (size_t i = 0; i < names.size(); i++) {
+        if (i) out += ',';
+        appendQuoted(out, names[i]);
+      }
+      out += ']';
+    }
+    out += '}';
+    {
+      std::lock_guard<std::mutex> guard(upstream.lock);
+      upstream.requests[id] = request;
+    }
+    queueUpstream(upstream, "v1/gateway/attributes/request", std::move(out));
+    return;
+  }
+
+  if (startsWith(topic, RPC_RESPONSE_PREFIX)) {
+    std::string out = "{\"device\":";
+    appendQuoted(out, session.identity);
+    out += ",\"id\":";
+    appendId(out, topic.substr(strlen(RPC_RESPONSE_PREFIX)));
+    out += ",\"data\":";
+    out += payload.empty() ? std::string("{}") : payload;
+    out += '}';
+    queueUpstream(upstream, "v1/gateway/rpc", std::move(out));
+    return;
+  }
+
+  if (topic == BINARY_TOPIC) {
+    // Where bioreactor_ingest looks for per-device frames
+    std::string out = "bioreactor/" + session.identity + "/telemetry/bin";
+    std::lock_guard<std::mutex> guard(upstream.lock);
+    if (upstream.pendingBytes > config_.maxPendingBytes) {
+      dropped_++;
+      return;
+    }
+    upstream.pendingBytes += payload.size();
+    upstream.messages.emplace_back(std::move(out), std::move(payload));
+    return;
+  }
+
+  unrouted_++;
+}
+
+// -------------------------------------------------------------
+// Upstream connections
+// -------------------------------------------------------------
+bool MqttGateway::connectUpstream(Upstream& upstream) {
+  std::string clientId = config_.upstreamClientId;
+  if (upstreams_.size() > 1) clientId += "-" + std::to_string(upstream.index);
+  const char* user = config_.upstreamUser.empty() ? nullptr : config_.upstreamUser.c_str();
+  if (!upstream.client.connect(config_.upstreamHost.c_str(), config_.upstreamPort, clientId.c_str(), user)) {
+    return false;
+  }
+  const char* filters[] = {"v1/gateway/rpc", "v1/gateway/attributes", "v1/gateway/attributes/response"};
+  for (const char* filter : filters) {
+    if (!upstream.client.subscribe(filter, onUpstreamMessage, &upstream)) return false;
+  }
+  return true;
+}
+
+void MqttGateway::runUpstream(Upstream& upstream) {
+  int backoffMs = 1000;
+  uint64_t retryAtMs = 0;
+  bool everConnected = false;
+  uint64_t nextFlushMs = monotonicMs() + config_.batchMs;
+
+  while (upstreamRunning_) {
+    uint64_t now = monotonicMs();
+    if (!upstream.client.connected()) {
+      if (now < retryAtMs) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::min<uint64_t>(50, retryAtMs - now)));
+        continue;
+      }
+      if (!connectUpstream(upstream)) {
+        upstream.client.disconnect();
+        fprintf(stderr, "gateway: upstream %d: cannot connect to %s:%u, retrying in %d s\n", upstream.index,
+                config_.upstreamHost.c_str(), config_.upstreamPort, backoffMs / 1000);
+        retryAtMs = monotonicMs() + backoffMs;
+        backoffMs = std::min(backoffMs * 2, UPSTREAM_BACKOFF_MAX_MS);
+        continue;
+      }
+      backoffMs = 1000;
+      if (everConnected) {
+        // The new session has not seen the devices connect
+        upstreamReconnects_++;
+        std::lock_guard<std::mutex> guard(registryLock_);
+        for (auto& entry : registry_) {
+          if (&upstreamFor(entry.first) != &upstream) continue;
+          std::string payload = "{\"device\":";
+          appendQuoted(payload, entry.first);
+          payload += '}';
+          queueUpstream(upstream, "v1/gateway/connect", payload);
+        }
+      }
+      everConnected = true;
+    }
+
+    now = monotonicMs();
+    if (now < nextFlushMs) upstream.client.poll((int)(nextFlushMs - now)); // Downstream messages meanwhile
+    now = monotonicMs();
+    if (now >= nextFlushMs) {
+      flushUpstream(upstream);
+      nextFlushMs += config_.batchMs;
+      if (nextFlushMs < now) nextFlushMs = now + config_.batchMs;
+    }
+  }
+
+  if (upstream.client.connected()) {
+    flushUpstream(upstream);
+    upstream.client.disconnect();
+  }
+  cpuNs_ += threadCpuNs();
+}
+
+bool MqttGateway::flushUpstream(Upstream& upstream) {
+  std::vector<std::string> devices;
+  std::unordered_map<std::string, PendingTelemetry> telemetry;
+  std::vector<std::pair<std::string, std::string>> messages;
+  {
+    std::lock_guard<std::mutex> guard(upstream.lock);
+    if (!upstream.client.connected()) return false; // Keep it all until the connection is back
+    devices.swap(upstream.devices);
+    telemetry.swap(upstream.telemetry);
+    messages.swap(upstream.messages);
+    upstream.pendingBytes = 0;
+  }
+
+  size_t sent = 0;
+  for (; sent < messages.size(); sent++) {
+    const auto& m = messages[sent];
+    if (!upstream.client.publish(m.first.c_str(), (const uint8_t*)m.second.data(), m.second.size())) break;
+    upstreamPublishes_++;
+    upstreamBytes_ += m.second.size();
+  }
+  bool ok = sent == messages.size();
+
+  // {"<device>":[entries],...}, cut into messages of up to batchBytes
+  std::string doc;
+  uint32_t docEntries = 0;
+  size_t docStart = 0; // First device in doc; those before it have been sent
+  auto sendDoc = [&](size_t next) {
+    doc += '}';
+    if (upstream.client.publish("v1/gateway/telemetry", (const uint8_t*)doc.data(), doc.size())) {
+      upstreamPublishes_++;
+      upstreamEntries_ += docEntries;
+      upstreamBytes_ += doc.size();
+      docStart = next;
+    } else {
+      ok = false;
+    }
+    doc.clear();
+    docEntries = 0;
+  };
+  for (size_t i = 0; ok && i < devices.size(); i++) {
+    const PendingTelemetry& pending = telemetry[devices[i]];
+    size_t partBytes = devices[i].size() + pending.entries.size() + 8;
+    if (!doc.empty() && doc.size() + partBytes > config_.batchBytes) {
+      sendDoc(i);
+      if (!ok) break;
+    }
+    doc += doc.empty() ? '{' : ',';
+    appendQuoted(doc, devices[i]);
+    doc += ":[";
+    doc += pending.entries;
+    doc += ']';
+    docEntries += pending.count;
+  }
+  if (ok && !doc.empty()) sendDoc(devices.size());
+  if (ok) return true;
+
+  // The connection broke: what was not sent goes back in front of what was
+  // queued meanwhile, to be sent on the next connection, as far as
+  // maxPendingBytes allows. The rest is counted as dropped.
+  std::lock_guard<std::mutex> guard(upstream.lock);
+  std::vector<std::pair<std::string, std::string>> unsent;
+  for (size_t i = sent; i < messages.size(); i++) {
+    if (upstream.pendingBytes > config_.maxPendingBytes) {
+      dropped_++;
+      continue;
+    }
+    upstream.pendingBytes += messages[i].second.size();
+    unsent.push_back(std::move(messages[i]));
+  }
+  for (auto& m : upstream.messages) unsent.push_back(std::move(m));
+  upstream.messages.swap(unsent);
+
+  std::vector<std::string> order;
+  std::unordered_set<std::string> requeued;
+  for (size_t i = docStart; i < devices.size(); i++) {
+    PendingTelemetry& old = telemetry[devices[i]];
+    if (upstream.pendingBytes > config_.maxPendingBytes) {
+      dropped_ += old.count;
+      continue;
+    }
+    upstream.pendingBytes += old.entries.size();
+    PendingTelemetry& pending = upstream.telemetry[devices[i]];
+    if (pending.count > 0) {
+      old.entries += ',';
+      old.entries += pending.entries;
+      old.count += pending.count;
+    }
+    pending = std::move(old);
+    order.push_back(devices[i]);
+    requeued.insert(devices[i]);
+  }
+  for (auto& device : upstream.devices) {
+    if (!requeued.count(device)) order.push_back(std::move(device));
+  }
+  upstream.devices.swap(order);
+  return false;
+}
+
+void MqttGateway::onUpstreamMessage(const MqttPublish& message, void* ctx) {
+  Upstream* upstream = (Upstream*)ctx;
+  upstream->gateway->fromUpstream(*upstream, message);
+}
+
+void MqttGateway::fromUpstream(Upstream& upstream, const MqttPublish& message) {
+  std::string topic(message.topic, message.topicLength);
+  std::string payload((const char*)message.payload, message.payloadLength);
+
+  if (topic == "v1/gateway/attributes/response") {
+    std::string id, value;
+    if (!jsonField(payload, "id", id)) return;
+    AttributeRequest request;
+    {
+      std::lock_guard<std::mutex> guard(upstream.lock);
+      auto found = upstream.requests.find((uint32_t)strtoul(id.c_str(), nullptr, 10));
+      if (found == upstream.requests.end()) return; // Another connection's request
+      request = found->second;
+      upstream.requests.erase(found);
+    }
+    std::string values;
+    if (!jsonField(payload, "values", values)) {
+      if (!jsonField(payload, "value", value) || request.singleKey.empty()) return;
+      values = "{";
+      appendQuoted(values, request.singleKey);
+      values += ':' + value + '}';
+    }
+    std::string out = request.client ? "{\"client\":" : "{\"shared\":";
+    out += values + '}';
+    deliver(request.device, std::string("v1/devices/me/attributes/response/") + request.localId, std::move(out));
+    return;
+  }
+
+  // Both of these reach every upstream connection; the device's own one delivers
+  std::string device, data;
+  if (!jsonString(payload, "device", device) || !jsonField(payload, "data", data)) return;
+  if (&upstreamFor(device) != &upstream) return;
+
+  if (topic == "v1/gateway/rpc") {
+    // Requests carry data.method; our own responses come back with only data
+    std::string id, method;
+    if (!jsonField(data, "id", id) || !jsonField(data, "method", method)) return;
+    if (id.size() >= 2 && id[0] == '"') id = id.substr(1, id.size() - 2);
+    deliver(device, "v1/devices/me/rpc/request/" + id, std::move(data));
+  } else if (topic == "v1/gateway/attributes") {
+    deliver(device, ATTRIBUTES_TOPIC, std::move(data));
+  }
+}
+
+bool MqttGateway::deliver(const std::string& identity, const std::string& topic, std::string payload) {
+  Route route;
+  {
+    std::lock_guard<std::mutex> guard(registryLock_);
+    auto found = registry_.find(identity);
+    if (found == registry_.end()) {
+      undeliverable_++;
+      return false;
+    }
+    route = found->second;
+  }
+  post(route.worker, Delivery{route.session, topic, std::move(payload), false});
+  return true;
+}
@@ -0,0 +1,166 @@
+#ifndef MQTTGATEWAY_HPP
+#define MQTTGATEWAY_HPP
+
+#include "MqttCodec.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Edge gateway between the reactors and ThingsBoard (bioreactor_gateway).
+// The reactors connect to it as they would to the broker and keep speaking
+// the device API (v1/devices/me/...). Upstream it is one ThingsBoard gateway
+// device on a few connections, speaking the gateway API:
+//
+//   device -> gateway                     gateway -> upstream
+//   v1/devices/me/telemetry               v1/gateway/telemetry, batched:
+//                                           {"<device>":[{"ts":..,"values":{..}},..],..}
+//   v1/devices/me/attributes              v1/gateway/attributes {"<device>":{..}}
+//   v1/devices/me/attributes/request/N    v1/gateway/attributes/request
+//                                           {"id":..,"device":..,"client":false,"keys":[..]}
+//   v1/devices/me/rpc/response/N          v1/gateway/rpc {"device":..,"id":N,"data":{..}}
+//   bioreactor/telemetry/bin              bioreactor/<device>/telemetry/bin
+//   (connect, disconnect)                 v1/gateway/connect, v1/gateway/disconnect {"device":..}
+//
+//   upstream -> gateway                   gateway -> device
+//   v1/gateway/rpc                        v1/devices/me/rpc/request/N {"method":..,"params":..}
+//     {"device":..,"data":{"id":N,"method":..,"params":..}}
+//   v1/gateway/attributes                 v1/devices/me/attributes {..}
+//     {"device":..,"data":{..}}
+//   v1/gateway/attributes/response        v1/devices/me/attributes/response/N {"shared":{..}}
+//     {"id":..,"device":..,"values":{..}}
+//
+// It is not a general broker: device publishes only go upstream, and a
+// device only receives what upstream sends it.
+//
+// A device is known by its MQTT client ID (or, with identityFromUsername, by
+// its username: the access token). A second connection with the same
+// identity takes over and the older one is closed, as a broker does.
+//
+// Threads: the device side is ioThreads epoll loops. Each has its own
+// SO_REUSEPORT listening socket, so the kernel spreads new connections over
+// them, and a session stays on the thread that accepted it. Each upstream
+// connection has a thread of its own running an MqttClient; every batchMs it
+// sends what its devices have queued. A device always goes through the same
+// upstream connection (by a hash of its identity), so its messages stay in
+// order.
+
+struct MqttGatewayConfig {
+  std::string listenAddress = "0.0.0.0";
+  uint16_t listenPort = 1883; // 0 picks a free port (see MqttGateway::port())
+  std::string upstreamHost = "127.0.0.1";
+  uint16_t upstreamPort = 1883;
+  std::string upstreamUser;                       // The gateway device's access token
+  std::string upstreamClientId = "bioreactor-gateway"; // "-<n>" is appended per connection
+  int upstreamConnections = 2;
+  int ioThreads = 0; // 0: one per hardware thread
+  int batchMs = 100;
+  size_t batchBytes = 256 * 1024;              // Largest upstream telemetry message
+  size_t maxPendingBytes = 64 * 1024 * 1024;   // Per upstream connection while it is down
+  bool identityFromUsername = false;
+};
+
+struct MqttGatewayStats {
+  uint64_t accepted;           // Device connections
+  uint64_t devices;            // Connected right now
+  uint64_t takeovers;          // Connections that replaced one with the same identity
+  uint64_t received;           // PUBLISH packets from devices
+  uint64_t unrouted;           // ... on topics the gateway does not forward
+  uint64_t upstreamPublishes;  // PUBLISH packets sent upstream
+  uint64_t upstreamEntries;    // Telemetry messages inside them
+  uint64_t upstreamBytes;
+  uint64_t upstreamReconnects;
+  uint64_t dropped;            // Telemetry entries and messages dropped while upstream was down too long
+  uint64_t downstream;         // Messages delivered to devices
+  uint64_t undeliverable;      // ... for devices not connected or not subscribed
+  uint64_t protocolErrors;
+  double cpuS;                 // CPU time of the gateway threads (once stopped)
+};
+
+class MqttGateway {
+public:
+  MqttGateway();
+  ~MqttGateway(); // stop()
+
+  MqttGateway(const MqttGateway&) = delete;
+  MqttGateway& operator=(const MqttGateway&) = delete;
+
+  /**
+   * @brief Binds the device port and starts the threads. The upstream
+   * connections are (re)established in the background.
+   * @return false if the port cannot be bound.
+   */
+  bool start(const MqttGatewayConfig& config);
+
+  /**
+   * @brief Sends what is still queued upstream, then closes everything.
+   */
+  void stop();
+
+  uint16_t port() const { return port_; }
+  int ioThreads() const { return (int)workers_.size(); }
+
+  MqttGatewayStats stats() const;
+
+private:
+  struct Session;
+  struct Delivery;
+  struct Worker;
+  struct Upstream;
+
+  struct Route {
+    int worker;
+    uint64_t session;
+  };
+
+  void runWorker(Worker& worker);
+  void accept(Worker& worker);
+  bool serve(Worker& worker, Session& session);
+  bool handle(Worker& worker, Session& session, const MqttPacket& packet);
+  bool send(Worker& worker, Session& session, const std::vector<uint8_t>& bytes);
+  bool flushSession(Worker& worker, Session& session);
+  void closeSession(Worker& worker, uint64_t id);
+  void drainInbox(Worker& worker);
+  void post(int worker, Delivery delivery);
+
+  void runUpstream(Upstream& upstream);
+  bool connectUpstream(Upstream& upstream);
+  bool flushUpstream(Upstream& upstream);
+  static void onUpstreamMessage(const MqttPublish& message, void* ctx);
+  void fromDevice(Session& session, const MqttPublish& message);
+  void fromUpstream(Upstream& upstream, const MqttPublish& message);
+  Upstream& upstreamFor(const std::string& identity);
+  void queueUpstream(Upstream& upstream, const char* topic, std::string payload);
+  bool deliver(const std::string& identity, const std::string& topic, std::string payload);
+
+  MqttGatewayConfig config_;
+  uint16_t port_;
+  std::atomic<bool> running_;         // Device side
+  std::atomic<bool> upstreamRunning_; // Stopped after the device side, so the last messages go out
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::unique_ptr<Upstream>> upstreams_;
+  std::atomic<uint64_t> nextSession_;
+  std::atomic<uint32_t> nextRequest_;
+
+  mutable std::mutex registryLock_;
+  std::unordered_map<std::string, Route> registry_; // Identity -> its current session
+
+  std::atomic<uint64_t> accepted_;
+  std::atomic<uint64_t> takeovers_;
+  std::atomic<uint64_t> received_;
+  std::atomic<uint64_t> unrouted_;
+  std::atomic<uint64_t> upstreamPublishes_;
+  std::atomic<uint64_t> upstreamEntries_;
+  std::atomic<uint64_t> upstreamBytes_;
+  std::atomic<uint64_t> upstreamReconnects_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> downstream_;
+  std::atomic<uint64_t> undeliverable_;
+  std::atomic<uint64_t> protocolErrors_;
+  std::atomic<uint64_t> cpuNs_;
+};
+
+#endif // MQTTGATEWAY_HPP
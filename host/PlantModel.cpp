@@ -0,0 +1,152 @@
+#include "PlantModel.hpp"
+#include <math.h>
+
+static const char* FAULT_NAMES[FAULT_TYPE_COUNT] = {
+  "therm_bias",
+  "ph_drift",
+  "heater_loss",
+  "motor_loss",
+  "acid_blocked",
+  "base_blocked",
+  "hall_dropout",
+};
+
+const char* faultName(FaultType type) {
+  return type < FAULT_TYPE_COUNT ? FAULT_NAMES[type] : "unknown";
+}
+
+PlantModel::PlantModel(const PlantParams& params, uint32_t seed) : params_(params), probeBufferPH_(-1) {
+  state_.liquidC = params.startTempC;
+  state_.heaterC = params.startTempC;
+  state_.sensorC = params.startTempC;
+  state_.bulkPH = params.startPH;
+  state_.probePH = params.startPH;
+  state_.rpm = 0;
+  state_.probeDriftPH = 0;
+
+  for (int i = 0; i < FAULT_TYPE_COUNT; i++) {
+    faultActive_[i] = false;
+    faultMagnitude_[i] = 0;
+  }
+
+  rng_ = 0x9E3779B97F4A7C15ull ^ seed;
+  if (rng_ == 0) rng_ = 1;
+  haveSpare_ = false;
+}
+
+void PlantModel::step(double dtS, double heaterDuty, double motorDuty, double acidDuty, double baseDuty) {
+  const PlantParams& p = params_;
+
+  // --- Thermal: heater element -> liquid -> ambient ---
+  double heaterW = p.heaterPowerW * heaterDuty;
+  if (faultActive_[FAULT_HEATER_LOSS]) heaterW *= 1.0 - faultMagnitude_[FAULT_HEATER_LOSS];
+
+  double toLiquidW = (state_.heaterC - state_.liquidC) * p.heaterToLiquidWK;
+  double toAmbientW = (state_.liquidC - p.ambientC) * p.liquidToAmbientWK;
+  state_.heaterC += (heaterW - toLiquidW) * dtS / p.heaterHeatCapacity;
+  state_.liquidC += (toLiquidW - toAmbientW) * dtS / p.liquidHeatCapacity;
+  state_.sensorC += (state_.liquidC - state_.sensorC) * (1.0 - exp(-dtS / p.sensorTauS));
+
+  // --- pH: dosing and metabolism through the buffer capacity ---
+  double acidMol = p.metabolicAcidMolPerLS * p.volumeL * dtS;
+  if (!faultActive_[FAULT_ACID_BLOCKED]) acidMol += p.acidMolPerS * acidDuty * dtS;
+  if (!faultActive_[FAULT_BASE_BLOCKED]) acidMol -= p.baseMolPerS * baseDuty * dtS;
+  state_.bulkPH -= acidMol / (p.volumeL * bufferCapacity(state_.bulkPH));
+  if (state_.bulkPH < 0) state_.bulkPH = 0;
+  if (state_.bulkPH > 14) state_.bulkPH = 14;
+
+  // Mixing: the probe sees the bulk with a lag that shrinks with stirring speed
+  if (probeBufferPH_ >= 0) {
+    state_.probePH += (probeBufferPH_ - state_.probePH) * (1.0 - exp(-dtS / p.probeTauS));
+  } else {
+    double mixTau = p.mixingTauAt1000RpmS * 1000.0 / (state_.rpm > 100 ? state_.rpm : 100);
+    state_.probePH += (state_.bulkPH - state_.probePH) * (1.0 - exp(-dtS / mixTau));
+  }
+
+  if (faultActive_[FAULT_PH_DRIFT]) {
+    state_.probeDriftPH += faultMagnitude_[FAULT_PH_DRIFT] * dtS / 3600.0;
+  } else {
+    state_.probeDriftPH = 0;
+  }
+
+  // --- Motor: first-order response to the average armature voltage ---
+  double kv = p.motorKv;
+  if (faultActive_[FAULT_MOTOR_LOSS]) kv *= 1.0 - faultMagnitude_[FAULT_MOTOR_LOSS];
+  double targetRpm = kv * p.motorSupplyV * motorDuty;
+  state_.rpm += (targetRpm - state_.rpm) * (1.0 - exp(-dtS / p.motorTauS));
+}
+
+int PlantModel::adcCode(uint8_t pin) {
+  const PlantParams& p = params_;
+  double code;
+
+  if (pin == PLANT_THERMISTOR_PIN) {
+    double sensed = state_.sensorC;
+    if (faultActive_[FAULT_THERM_BIAS]) sensed += faultMagnitude_[FAULT_THERM_BIAS];
+
+    double kelvin = sensed + 273.15;
+    double ntc = p.ntcOhmAt35C * exp(p.ntcBeta * (1.0 / kelvin - 1.0 / 308.15));
+    code = ntc / (p.seriesOhm + ntc) * p.adcMax + gaussian() * p.adcNoiseLsb;
+  } else if (pin == PLANT_PH_SENSOR_PIN) {
+    double measured = state_.probePH + state_.probeDriftPH + gaussian() * p.phSensorNoise;
+    code = (measured - p.probeOffset) / p.probeSlope * 1024.0 / p.adcVref;
+  } else {
+    return 0;
+  }
+
+  if (code < 0) return 0;
+  if (code > p.adcMax) return p.adcMax;
+  return (int)lround(code);
+}
+
+double PlantModel::hallPulseRateHz() const {
+  return state_.rpm * params_.hallPulsesPerRev / 60.0;
+}
+
+bool PlantModel::deliverHallPulse() {
+  if (!faultActive_[FAULT_HALL_DROPOUT]) return true;
+  return uniform() >= faultMagnitude_[FAULT_HALL_DROPOUT];
+}
+
+void PlantModel::setFault(FaultType type, bool active, double magnitude) {
+  if (type >= FAULT_TYPE_COUNT) return;
+  faultActive_[type] = active;
+  faultMagnitude_[type] = active ? magnitude : 0;
+}
+
+double PlantModel::uniform() {
+  // xorshift64*
+  rng_ ^= rng_ >> 12;
+  rng_ ^= rng_ << 25;
+  rng_ ^= rng_ >> 27;
+  return (double)((rng_ * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double PlantModel::gaussian() {
+  // Marsaglia polar method: two values per log/sqrt and no trig. The firmware
+  // reads ADC bursts, so this is the simulator's hottest path.
+  if (haveSpare_) {
+    haveSpare_ = false;
+    return spareGaussian_;
+  }
+
+  double u, v, s;
+  do {
+    u = 2.0 * uniform() - 1.0;
+    v = 2.0 * uniform() - 1.0;
+    s = u * u + v * v;
+  } while (s >= 1.0 || s == 0.0);
+
+  double scale = sqrt(-2.0 * log(s) / s);
+  spareGaussian_ = v * scale;
+  haveSpare_ = true;
+  return u * scale;
+}
+
+double PlantModel::bufferCapacity(double pH) const {
+  // beta = 2.303 * (C * Ka * H / (Ka + H)^2 + H + Kw / H)   [mol / (L * pH)]
+  double h = pow(10.0, -pH);
+  double ka = pow(10.0, -params_.bufferPKa);
+  double beta = 2.303 * (params_.bufferMolar * ka * h / ((ka + h) * (ka + h)) + h + 1e-14 / h);
+  return beta > 1e-6 ? beta : 1e-6;
+}
@@ -0,0 +1,147 @@
+#ifndef PLANTMODEL_HPP
+#define PLANTMODEL_HPP
+
+#include <stdint.h>
+
+// Discrete-time model of the reactor vessel seen by the firmware:
+//  - Thermal: heater element -> liquid -> ambient, plus a lagged thermistor.
+//  - pH: buffered solution (single weak-acid buffer) dosed by the acid/base
+//    pumps, with metabolic acid production and a stirring-dependent mixing lag.
+//    The probe can be moved into a calibration buffer (setProbeBuffer()).
+//  - Motor: first-order speed response using the Kv and T constants that the
+//    stirring controller was designed for, producing Hall pulses.
+// Fault injection mirrors the fault classes of the bioreactor_sim streams.
+
+// --- Wiring (must match the subsystem pin definitions) ---
+const uint8_t PLANT_PH_SENSOR_PIN  = 14; // A4 on the host HAL
+const uint8_t PLANT_THERMISTOR_PIN = 15; // A5 on the host HAL
+const uint8_t PLANT_ACID_PIN       = 8;
+const uint8_t PLANT_BASE_PIN       = 9;
+const uint8_t PLANT_HEATER_PIN     = 6;
+const uint8_t PLANT_MOTOR_PIN      = 10;
+const uint8_t PLANT_ENCODER_PIN    = 2;
+
+enum FaultType : uint8_t {
+  FAULT_THERM_BIAS,       // Thermistor reads high/low by `magnitude` degC
+  FAULT_PH_DRIFT,         // pH probe drifts by `magnitude` pH per hour
+  FAULT_HEATER_LOSS,      // Heater delivers (1 - magnitude) of its power
+  FAULT_MOTOR_LOSS,       // Motor Kv reduced by `magnitude` (fraction)
+  FAULT_ACID_BLOCKED,     // Acid pump runs but delivers nothing
+  FAULT_BASE_BLOCKED,     // Base pump runs but delivers nothing
+  FAULT_HALL_DROPOUT,     // Fraction `magnitude` of Hall pulses are lost
+  FAULT_TYPE_COUNT
+};
+
+const char* faultName(FaultType type);
+
+struct PlantParams {
+  // Thermal
+  double ambientC = 20.0;
+  double liquidHeatCapacity = 4500.0; // J/K (about 1 L of medium plus vessel)
+  double heaterHeatCapacity = 200.0;  // J/K
+  double heaterPowerW = 40.0;         // At 100% duty
+  double heaterToLiquidWK = 5.0;      // W/K
+  double liquidToAmbientWK = 0.5;     // W/K
+  double sensorTauS = 5.0;            // Thermistor lag
+  double startTempC = 20.0;
+
+  // Thermistor (Beta model) in the divider R (Vcc -> pin) + NTC (pin -> GND)
+  double seriesOhm = 10000.0;
+  double ntcOhmAt35C = 5162.0;        // Same NTC as HEATING_THERMISTOR (heatingSubsystem.hpp)
+  double ntcBeta = 3950.0;
+
+  // pH
+  double volumeL = 1.0;
+  double bufferMolar = 0.01;          // Total buffer concentration
+  double bufferPKa = 6.8;
+  double acidMolPerS = 1.7e-6;        // Acid delivered while the pump is on
+  double baseMolPerS = 1.7e-6;        // Base delivered while the pump is on
+  double metabolicAcidMolPerLS = 2e-8;
+  double mixingTauAt1000RpmS = 5.0;   // Probe lag behind the bulk at 1000 RPM
+  double startPH = 6.5;
+  double phSensorNoise = 0.01;        // pH (1 sigma)
+  double pumpFlowMlPerS = 0.017;      // For reagent volume accounting
+  double probeTauS = 5.0;             // Glass electrode response in a calibration buffer
+
+  // pH probe front end: firmware computes pH = slope * (code * 3.3 / 1024) + offset
+  double probeSlope = 1.38;
+  double probeOffset = 0.76;
+
+  // Motor (see StirringSubsystem.cpp)
+  double motorKv = 250.0;             // RPM per volt
+  double motorTauS = 0.15;
+  double motorSupplyV = 5.0;
+  int hallPulsesPerRev = 70;
+
+  // ADC
+  int adcMax = 4095;
+  double adcVref = 3.3;
+  double adcNoiseLsb = 2.0;
+};
+
+struct PlantState {
+  double liquidC;
+  double heaterC;
+  double sensorC;   // What the thermistor currently senses
+  double bulkPH;
+  double probePH;   // Lagged by mixing
+  double rpm;
+  double probeDriftPH;
+};
+
+class PlantModel {
+public:
+  explicit PlantModel(const PlantParams& params, uint32_t seed);
+
+  /**
+   * @brief Integrates the plant over dt seconds with the given actuator inputs.
+   * @param heaterDuty 0..1
+   * @param motorDuty 0..1
+   * @param acidDuty 0..1, flow in proportion
+   * @param baseDuty 0..1
+   */
+  void step(double dtS, double heaterDuty, double motorDuty, double acidDuty, double baseDuty);
+
+  /**
+   * @brief Raw ADC code for a pin (pH probe or thermistor), including noise and faults.
+   */
+  int adcCode(uint8_t pin);
+
+  /**
+   * @brief Hall pulses per second at the current shaft speed.
+   */
+  double hallPulseRateHz() const;
+
+  /**
+   * @brief True if the next Hall pulse should be delivered (dropout fault).
+   */
+  bool deliverHallPulse();
+
+  /**
+   * @brief Puts the pH probe into a buffer of the given pH, or back into the
+   * vessel if pH is negative. The probe follows the buffer with probeTauS.
+   */
+  void setProbeBuffer(double pH) { probeBufferPH_ = pH; }
+
+  void setFault(FaultType type, bool active, double magnitude);
+  bool faultActive(FaultType type) const { return faultActive_[type]; }
+
+  const PlantState& state() const { return state_; }
+  const PlantParams& params() const { return params_; }
+
+private:
+  double uniform();  // [0, 1)
+  double gaussian(); // N(0, 1)
+  double bufferCapacity(double pH) const;
+
+  PlantParams params_;
+  PlantState state_;
+  double probeBufferPH_;
+  bool faultActive_[FAULT_TYPE_COUNT];
+  double faultMagnitude_[FAULT_TYPE_COUNT];
+  uint64_t rng_;
+  double spareGaussian_;
+  bool haveSpare_;
+};
+
+#endif // PLANTMODEL_HPP
@@ -0,0 +1,378 @@
+#include "Simulation.hpp"
+#include "ControlLoop.hpp"
+#include "HalLinux.hpp"
+#include "PHSubsystem.hpp"
+#include "StirringSubsystem.hpp"
+#include "heatingSubsystem.hpp"
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+static const double TEMP_BAND_C = 0.5;
+static const double RPM_BAND_FRAC = 0.05;
+// Newest Hall edges replayed before each firmware run: covers the 8 entries of
+// pulseT[] and, in capture mode, two whole captures of RPM_EDGES_PER_CAPTURE
+static const uint32_t HALL_REPLAY = 16;
+
+static PlantModel* activePlant = nullptr;
+
+static int plantAdc(uint8_t pin) {
+  return activePlant ? activePlant->adcCode(pin) : 0;
+}
+
+bool parseScenario(const char* name, Scenario* out) {
+  if (strcmp(name, "nofaults") == 0) *out = SCENARIO_NOFAULTS;
+  else if (strcmp(name, "single_fault") == 0) *out = SCENARIO_SINGLE_FAULT;
+  else if (strcmp(name, "three_faults") == 0) *out = SCENARIO_THREE_FAULTS;
+  else return false;
+  return true;
+}
+
+Simulation::Simulation(const SimConfig& config)
+    : config_(config), plant_(config.plant, config.seed), outbox_(outboxQueue_), rpcRequests_(0),
+      phTolerance_(PH_TOLERANCE_DEFAULT), speedup_(0) {
+  memset(&metrics_, 0, sizeof(metrics_));
+
+  halSimReset();
+  halSimSetLogEnabled(false);
+  activePlant = &plant_;
+  halSimSetAdcHook(plantAdc);
+
+  setupControl();
+  generateFaults();
+}
+
+bool Simulation::setAttributes(const char* json) {
+  StaticJsonDocument<512> doc;
+  if (deserializeJson(doc, json)) {
+    return false;
+  }
+
+  JsonObject shared = doc.as<JsonObject>();
+  if (shared.containsKey("pH_tolerance")) {
+    phTolerance_ = shared["pH_tolerance"];
+  }
+  dispatchAttributes(shared);
+  return true;
+}
+
+void Simulation::scheduleAttributes(double atS, const char* json) {
+  SimMessage message = {atS, "v1/devices/me/attributes", json};
+  auto at = std::upper_bound(scheduled_.begin(), scheduled_.end(), message,
+                             [](const SimMessage& a, const SimMessage& b) { return a.timeS < b.timeS; });
+  scheduled_.insert(at, message);
+}
+
+void Simulation::scheduleRpc(double atS, const char* json) {
+  char topic[MQTT_TOPIC_MAX];
+  snprintf(topic, sizeof(topic), "%s%u", RPC_REQUEST_PREFIX, (unsigned)++rpcRequests_);
+  SimMessage message = {atS, topic, json};
+  auto at = std::upper_bound(scheduled_.begin(), scheduled_.end(), message,
+                             [](const SimMessage& a, const SimMessage& b) { return a.timeS < b.timeS; });
+  scheduled_.insert(at, message);
+}
+
+void Simulation::scheduleProbeBuffer(double atS, double pH) {
+  auto change = std::make_pair(atS, pH);
+  probeBuffers_.insert(std::upper_bound(probeBuffers_.begin(), probeBuffers_.end(), change), change);
+}
+
+void Simulation::generateFaults() {
+  episodes_.clear();
+  if (config_.scenario == SCENARIO_NOFAULTS) return;
+
+  std::mt19937 rng(config_.seed * 7919u + 17u);
+  std::exponential_distribution<double> gap(1.0 / config_.faultGapMeanS);
+  std::uniform_real_distribution<double> length(config_.faultMinS, config_.faultMaxS);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::uniform_int_distribution<int> kind(0, FAULT_TYPE_COUNT - 1);
+
+  const int maxConcurrent = config_.scenario == SCENARIO_THREE_FAULTS ? 3 : 1;
+
+  // Independent lanes of episodes; a single lane never overlaps itself
+  for (int lane = 0; lane < maxConcurrent; lane++) {
+    double t = gap(rng);
+    while (t < config_.durationS) {
+      FaultEpisode e;
+      e.type = (FaultType)kind(rng);
+      e.startS = t;
+      e.endS = t + length(rng);
+      double sign = unit(rng) < 0.5 ? -1.0 : 1.0;
+
+      switch (e.type) {
+        case FAULT_THERM_BIAS:   e.magnitude = sign * (1.0 + 2.0 * unit(rng)); break; // degC
+        case FAULT_PH_DRIFT:     e.magnitude = sign * (0.5 + 1.5 * unit(rng)); break; // pH/h
+        case FAULT_HEATER_LOSS:  e.magnitude = 0.5 + 0.5 * unit(rng); break;
+        case FAULT_MOTOR_LOSS:   e.magnitude = 0.3 + 0.3 * unit(rng); break;
+        case FAULT_HALL_DROPOUT: e.magnitude = 0.2 + 0.3 * unit(rng); break;
+        default:                 e.magnitude = 1.0; break;
+      }
+
+      // Overlapping episodes of the same type would fight over the plant setting
+      bool clash = false;
+      for (const FaultEpisode& other : episodes_) {
+        if (other.type == e.type && other.startS < e.endS && e.startS < other.endS) clash = true;
+      }
+      if (!clash) episodes_.push_back(e);
+
+      t = e.endS + gap(rng);
+    }
+  }
+}
+
+double Simulation::applyFaults(double nowS) {
+  double nextChangeS = 1e300;
+  bool active[FAULT_TYPE_COUNT] = {};
+  double magnitude[FAULT_TYPE_COUNT] = {};
+
+  for (const FaultEpisode& e : episodes_) {
+    if (nowS >= e.startS && nowS < e.endS) {
+      active[e.type] = true;
+      magnitude[e.type] = e.magnitude;
+    }
+    if (e.startS > nowS && e.startS < nextChangeS) nextChangeS = e.startS;
+    if (e.endS > nowS && e.endS < nextChangeS) nextChangeS = e.endS;
+  }
+
+  for (int type = 0; type < FAULT_TYPE_COUNT; type++) {
+    if (active[type] != plant_.faultActive((FaultType)type)) {
+      plant_.setFault((FaultType)type, active[type], magnitude[type]);
+    }
+  }
+  return nextChangeS;
+}
+
+void Simulation::run(SummaryCallback callback, void* ctx) {
+  Scheduler scheduler(halMicros);
+  addControlTasks(scheduler);
+  scheduler.start();
+
+  const PlantParams& pp = config_.plant;
+  const uint64_t startUs = halSimTimeUs();
+  const uint64_t endUs = startUs + (uint64_t)(config_.durationS * 1e6);
+  const uint64_t plantStepUs = (uint64_t)(config_.plantStepS * 1e6);
+  const uint64_t sampleUs = (uint64_t)(config_.sampleS * 1e6);
+  const uint64_t summaryUs = (uint64_t)(config_.summaryS * 1e6);
+  const uint64_t NEVER = UINT64_MAX;
+  const double tailStartS = config_.durationS * 0.75; // Steady-state metrics window
+  double nextFaultChangeS = 0;
+
+  uint64_t now = startUs;
+  uint64_t nextTaskUs = now;
+  uint64_t nextPlantUs = now;
+  uint64_t nextSampleUs = now;
+  uint64_t nextSummaryUs = now + summaryUs;
+  uint64_t nextPulseUs = NEVER;
+  uint64_t recentPulses[HALL_REPLAY];
+  uint32_t pendingPulses = 0;
+  size_t nextMessage = 0;
+  size_t nextBuffer = 0;
+  static MqttMessage message; // Too big for the stack
+  published_.clear();
+
+  // Summary window accumulators
+  SimSummary row;
+  memset(&row, 0, sizeof(row));
+  int samples = 0;
+  int plantSteps = 0;
+  double heaterAcc = 0, motorAcc = 0, acidAcc = 0, baseAcc = 0;
+  double trueTempAcc = 0, truePhAcc = 0, trueRpmAcc = 0;
+
+  // Metrics state
+  memset(&metrics_, 0, sizeof(metrics_));
+  bool tempReached = false, rpmReached = false;
+  double tailTempMin = 1e9, tailTempMax = -1e9, tailTempAbs = 0, tailRpmSq = 0;
+  int tailSamples = 0, phInBand = 0, phSamples = 0;
+  double phAbs = 0;
+
+  auto wallStart = std::chrono::steady_clock::now();
+
+  while (now < endUs) {
+    double nowS = (now - startUs) * 1e-6;
+
+    // 1. Hall sensor edges since the last event. The shaft speed only changes at
+    // plant steps and the stirring task only looks at the newest HALL_REPLAY
+    // edges, so edges are counted off here and only the newest are fed through
+    // the ISR, right before the firmware next runs.
+    if (now >= nextPulseUs) {
+      uint64_t periodUs = (uint64_t)(1e6 / plant_.hallPulseRateHz());
+      if (periodUs == 0) periodUs = 1;
+      while (nextPulseUs <= now) {
+        if (plant_.deliverHallPulse()) recentPulses[pendingPulses++ % HALL_REPLAY] = nextPulseUs;
+        nextPulseUs += periodUs;
+      }
+    }
+
+    // 2. Firmware tasks
+    if (now >= nextTaskUs) {
+      if (pendingPulses > 0) {
+        for (uint32_t k = pendingPulses > HALL_REPLAY ? pendingPulses - HALL_REPLAY : 0; k < pendingPulses; k++) {
+          halSimSetTimeUs(recentPulses[k % HALL_REPLAY]);
+          halSimTriggerInterrupt(PLANT_ENCODER_PIN);
+        }
+        pendingPulses = 0;
+        halSimSetTimeUs(now);
+      }
+
+      // Messages from the "network task", applied before the control tasks as in loop()
+      while (nextMessage < scheduled_.size() && scheduled_[nextMessage].timeS <= nowS) {
+        const SimMessage& m = scheduled_[nextMessage++];
+        mqttEnqueue(inbox_, m.topic.c_str(), (const uint8_t*)m.payload.data(), m.payload.size());
+      }
+      processInbox(inbox_, outbox_);
+
+      while (scheduler.runOnce()) {
+      }
+      nextTaskUs = now + scheduler.untilNextReleaseUs();
+
+      while (outboxQueue_.pop(message)) {
+        published_.push_back(SimMessage{nowS, message.topic, std::string((const char*)message.payload, message.length)});
+      }
+    }
+
+    // 3. Plant integration with the actuator outputs currently driven by the firmware
+    if (now >= nextPlantUs) {
+      if (nowS >= nextFaultChangeS) nextFaultChangeS = applyFaults(nowS);
+      while (nextBuffer < probeBuffers_.size() && probeBuffers_[nextBuffer].first <= nowS) {
+        plant_.setProbeBuffer(probeBuffers_[nextBuffer++].second);
+      }
+
+      // Mean duties over the step, following a hardware fade as the LEDC puts it out
+      double heaterDuty = halSimPwmMeanFraction(PLANT_HEATER_PIN, plantStepUs);
+      double motorDuty = halSimPwmMeanFraction(PLANT_MOTOR_PIN, plantStepUs);
+      double acidDuty = halSimPwmMeanFraction(PLANT_ACID_PIN, plantStepUs);
+      double baseDuty = halSimPwmMeanFraction(PLANT_BASE_PIN, plantStepUs);
+      plant_.step(config_.plantStepS, heaterDuty, motorDuty, acidDuty, baseDuty);
+
+      heaterAcc += heaterDuty;
+      motorAcc += motorDuty;
+      acidAcc += acidDuty;
+      baseAcc += baseDuty;
+      plantSteps++;
+
+      metrics_.heaterWh += pp.heaterPowerW * heaterDuty * config_.plantStepS / 3600.0;
+      metrics_.acidMl += pp.pumpFlowMlPerS * acidDuty * config_.plantStepS;
+      metrics_.baseMl += pp.pumpFlowMlPerS * baseDuty * config_.plantStepS;
+
+      // Keep the Hall edge train in step with the new shaft speed. An edge
+      // scheduled at a slower speed (e.g. the first one after standstill)
+      // comes no later than one period at the new speed.
+      double rate = plant_.hallPulseRateHz();
+      if (rate <= 1.0) {
+        nextPulseUs = NEVER;
+      } else {
+        uint64_t periodUs = (uint64_t)(1e6 / rate);
+        if (nextPulseUs == NEVER || nextPulseUs > now + periodUs) nextPulseUs = now + periodUs;
+      }
+
+      nextPlantUs += plantStepUs;
+    }
+
+    // 4. Sample what the firmware would publish, and score against the truth
+    if (now >= nextSampleUs) {
+      StaticJsonDocument<512> doc;
+      JsonObject status = doc.to<JsonObject>();
+      getPHStatus(status);
+      getStirringStatus(status);
+      getHeatingStatus(status);
+
+      const PlantState& st = plant_.state();
+      float tset = status["target_temperature"];
+      float phSet = status["target_pH"];
+      float rpmSet = status["rpm_set"];
+
+      row.tempMean += (float)status["temperature"];
+      row.phMean += (float)status["pH"];
+      row.rpmMean += (float)status["rpm_measured"];
+      trueTempAcc += st.liquidC;
+      truePhAcc += st.bulkPH;
+      trueRpmAcc += st.rpm;
+      samples++;
+
+      double tErr = st.liquidC - tset;
+      if (!tempReached && tErr >= 0) tempReached = true;
+      if (tempReached && tErr > metrics_.tempOvershootC) metrics_.tempOvershootC = tErr;
+      if (fabs(tErr) > TEMP_BAND_C) metrics_.tempSettleS = nowS;
+
+      double rErr = st.rpm - rpmSet;
+      if (!rpmReached && rErr >= 0) rpmReached = true;
+      if (rpmReached && rErr > metrics_.rpmOvershoot) metrics_.rpmOvershoot = rErr;
+      if (fabs(rErr) > RPM_BAND_FRAC * rpmSet) metrics_.rpmSettleS = nowS;
+
+      if (phSet != 0) {
+        if (fabs(st.bulkPH - phSet) <= phTolerance_) phInBand++;
+        phAbs += fabs(st.bulkPH - phSet);
+        phSamples++;
+      }
+
+      if (nowS >= tailStartS) {
+        if (st.liquidC < tailTempMin) tailTempMin = st.liquidC;
+        if (st.liquidC > tailTempMax) tailTempMax = st.liquidC;
+        tailTempAbs += fabs(tErr);
+        tailRpmSq += rErr * rErr;
+        tailSamples++;
+      }
+
+      nextSampleUs += sampleUs;
+    }
+
+    // 5. Summary row
+    if (now >= nextSummaryUs) {
+      row.timeS = nowS;
+      if (samples > 0) {
+        row.tempMean /= samples;
+        row.phMean /= samples;
+        row.rpmMean /= samples;
+        row.trueTempMean = trueTempAcc / samples;
+        row.truePhMean = truePhAcc / samples;
+        row.trueRpmMean = trueRpmAcc / samples;
+      }
+      if (plantSteps > 0) {
+        row.heaterPwm = 100.0 * heaterAcc / plantSteps;
+        row.motorPwm = 100.0 * motorAcc / plantSteps;
+        row.acidPwm = 100.0 * acidAcc / plantSteps;
+        row.basePwm = 100.0 * baseAcc / plantSteps;
+      }
+
+      row.faults[0] = '\0';
+      for (int type = 0; type < FAULT_TYPE_COUNT; type++) {
+        if (!plant_.faultActive((FaultType)type)) continue;
+        if (row.faults[0]) strncat(row.faults, ";", sizeof(row.faults) - strlen(row.faults) - 1);
+        strncat(row.faults, faultName((FaultType)type), sizeof(row.faults) - strlen(row.faults) - 1);
+      }
+      if (!row.faults[0]) strcpy(row.faults, "None");
+
+      if (callback) callback(row, ctx);
+
+      memset(&row, 0, sizeof(row));
+      samples = plantSteps = 0;
+      heaterAcc = motorAcc = acidAcc = baseAcc = 0;
+      trueTempAcc = truePhAcc = trueRpmAcc = 0;
+      nextSummaryUs += summaryUs;
+    }
+
+    // Jump to the next event
+    uint64_t next = nextTaskUs;
+    if (nextPlantUs < next) next = nextPlantUs;
+    if (nextSampleUs < next) next = nextSampleUs;
+    if (nextSummaryUs < next) next = nextSummaryUs;
+    now = next > now ? next : now + 1;
+    halSimSetTimeUs(now);
+  }
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  speedup_ = wall > 0 ? config_.durationS / wall : 0;
+
+  if (tailSamples > 0) {
+    metrics_.tempRippleC = tailTempMax - tailTempMin;
+    metrics_.tempMaeC = tailTempAbs / tailSamples;
+    metrics_.rpmRmsError = sqrt(tailRpmSq / tailSamples);
+  }
+  metrics_.phInBandFrac = phSamples > 0 ? (double)phInBand / phSamples : 0;
+  metrics_.phMae = phSamples > 0 ? phAbs / phSamples : 0;
+  metrics_.faultEpisodes = (int)episodes_.size();
+}
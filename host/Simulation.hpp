@@ -0,0 +1,154 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include "MqttQueue.hpp"
+#include "PlantModel.hpp"
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Closed-loop simulation: the real subsystem tasks run on the host HAL's
+// simulated clock against PlantModel. Time jumps from event to event (task
+// release, plant step, Hall pulse). The 10 ms stirring task and the Hall
+// edges dominate, so it runs at roughly 3000x real time: a 72-hour run takes
+// a little over a minute.
+//
+// The firmware keeps its state in globals, so only one Simulation may run
+// per process.
+
+enum Scenario : uint8_t {
+  SCENARIO_NOFAULTS,
+  SCENARIO_SINGLE_FAULT, // One fault at a time
+  SCENARIO_THREE_FAULTS  // Up to three overlapping faults
+};
+
+bool parseScenario(const char* name, Scenario* out);
+
+struct FaultEpisode {
+  FaultType type;
+  double startS;
+  double endS;
+  double magnitude;
+};
+
+struct SimConfig {
+  double durationS = 3600;
+  double plantStepS = 0.01;
+  double sampleS = 0.1;     // How often the firmware status is sampled
+  double summaryS = 1.0;    // Window of each summary row
+  uint32_t seed = 1;
+  Scenario scenario = SCENARIO_NOFAULTS;
+  double faultGapMeanS = 1200;
+  double faultMinS = 120;
+  double faultMaxS = 600;
+  PlantParams plant;
+};
+
+// One row per summary window, in the column layout of data-analysis/logs/*.csv
+struct SimSummary {
+  double timeS;
+  double tempMean;   // As reported by the firmware
+  double phMean;
+  double rpmMean;
+  double heaterPwm;  // % duty / % on-time
+  double motorPwm;
+  double acidPwm;
+  double basePwm;
+  double trueTempMean;
+  double truePhMean;
+  double trueRpmMean;
+  char faults[96];   // ';'-separated names, or "None"
+};
+
+// Performance against the final setpoints, computed on true plant values
+struct SimMetrics {
+  double tempSettleS;     // Last time |T - Tset| exceeded the band
+  double tempOvershootC;  // Max T - Tset after first reaching Tset
+  double tempRippleC;     // Peak-to-peak T after settling
+  double tempMaeC;        // Mean |T - Tset| after settling
+  double phInBandFrac;    // Fraction of time with |pH - target| <= tolerance
+  double phMae;           // Mean |pH - target| while a target is set
+  double acidMl;
+  double baseMl;
+  double rpmSettleS;      // Last time |rpm - set| exceeded 5% of set
+  double rpmOvershoot;
+  double rpmRmsError;     // After settling
+  double heaterWh;
+  int faultEpisodes;
+};
+
+// A message to or from the firmware, at a simulated time
+struct SimMessage {
+  double timeS;
+  std::string topic;
+  std::string payload;
+};
+
+typedef void (*SummaryCallback)(const SimSummary& row, void* ctx);
+
+class Simulation {
+public:
+  explicit Simulation(const SimConfig& config);
+
+  /**
+   * @brief Applies a shared-attribute JSON object through the subsystem handlers,
+   * e.g. {"target_pH": 5.0, "target_temperature": 30, "target_rpm": 1000}.
+   * @return false if the JSON could not be parsed.
+   */
+  bool setAttributes(const char* json);
+
+  /**
+   * @brief Queues a shared-attribute update or an RPC request (JSON with
+   * "method" and "params") for the firmware's inbox at atS into the run.
+   * processInbox() applies it at the next task release, as on the device.
+   */
+  void scheduleAttributes(double atS, const char* json);
+  void scheduleRpc(double atS, const char* json);
+
+  /**
+   * @brief Moves the pH probe into a calibration buffer at atS (pH < 0: back
+   * into the vessel), as the operator would during a calibratePH session.
+   */
+  void scheduleProbeBuffer(double atS, double pH);
+
+  /**
+   * @brief Runs the configured duration, reporting each summary window.
+   */
+  void run(SummaryCallback callback, void* ctx);
+
+  const SimMetrics& metrics() const { return metrics_; }
+  const std::vector<FaultEpisode>& episodes() const { return episodes_; }
+  const PlantModel& plant() const { return plant_; }
+
+  /**
+   * @brief Everything the firmware published through its outbox (RPC
+   * responses, client attributes) during the last run.
+   */
+  const std::vector<SimMessage>& published() const { return published_; }
+
+  /**
+   * @brief Wall-clock speed of the last run (simulated seconds per second).
+   */
+  double speedup() const { return speedup_; }
+
+private:
+  void generateFaults();
+  double applyFaults(double nowS); // Returns the time of the next fault change
+
+  SimConfig config_;
+  PlantModel plant_;
+  std::vector<FaultEpisode> episodes_;
+  std::vector<SimMessage> scheduled_; // Sorted by time
+  std::vector<SimMessage> published_;
+  std::vector<std::pair<double, double>> probeBuffers_; // (time, pH), sorted
+  MqttQueue inbox_;
+  MqttQueue outboxQueue_;
+  MqttOutbox outbox_;
+  uint32_t rpcRequests_;
+  SimMetrics metrics_;
+  double phTolerance_; // Mirrors pH_tolerance for the in-band metric
+  double speedup_;
+};
+
+#endif // SIMULATION_HPP
@@ -0,0 +1,526 @@
+#include "TelemetryStore.hpp"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* const STORE_COLUMN_NAMES[STORE_COLUMN_COUNT] = {
+  "time", "temp", "ph", "rpm", "heater", "motor", "flags", "temp_set", "ph_set", "rpm_set",
+};
+
+static const char HEADER_MAGIC[8] = {'B', 'R', 'T', 'S', 'E', 'G', '0', '1'};
+static const char TRAILER_MAGIC[8] = {'B', 'R', 'T', 'I', 'D', 'X', '0', '1'};
+static const uint32_t BLOCK_MAGIC = 0x314B4C42; // "BLK1"
+static const uint16_t STORE_VERSION = 1;
+
+static const size_t BLOCK_HEADER_BYTES = 24 + 4 * STORE_COLUMN_COUNT;
+static const size_t INDEX_ENTRY_BYTES = 28;
+static const size_t TRAILER_BYTES = 24;
+
+static const uint8_t COLUMN_ENCODINGS[STORE_COLUMN_COUNT] = {
+  STORE_ENC_DELTA_DELTA, STORE_ENC_DELTA, STORE_ENC_DELTA, STORE_ENC_DELTA, STORE_ENC_DELTA,
+  STORE_ENC_DELTA,       STORE_ENC_RUNS,  STORE_ENC_RUNS,  STORE_ENC_RUNS,  STORE_ENC_RUNS,
+};
+
+// Worst case per row and column: a 10-byte varint, plus a 1-byte run length
+static const size_t MAX_COLUMN_BYTES = 11 * STORE_BLOCK_ROWS;
+
+// -------------------------------------------------------------
+// Byte helpers
+// -------------------------------------------------------------
+static inline uint64_t zigzag64(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag64(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline uint8_t* putVarint(uint8_t* p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 70; shift += 7) {
+    if (p >= end) return false;
+    uint8_t b = *p++;
+    result |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline uint8_t* putLittleEndian(uint8_t* p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) *p++ = (uint8_t)(v >> (8 * i));
+  return p;
+}
+
+static inline uint64_t getLittleEndian(const uint8_t* p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+static bool writeAll(int fd, const uint8_t* p, size_t length) {
+  while (length > 0) {
+    ssize_t n = ::write(fd, p, length);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+// -------------------------------------------------------------
+// Column codecs
+// -------------------------------------------------------------
+static int64_t fieldOf(const TelemetrySample& s, int column) {
+  switch (column) {
+  case STORE_COL_TIME: return (int64_t)s.timeUs;
+  case STORE_COL_TEMP: return s.tempCentiC;
+  case STORE_COL_PH: return s.phMilli;
+  case STORE_COL_RPM: return s.rpm;
+  case STORE_COL_HEATER: return s.heaterDuty;
+  case STORE_COL_MOTOR: return s.motorDuty;
+  case STORE_COL_FLAGS: return s.flags;
+  case STORE_COL_TEMP_SET: return s.tempSetCentiC;
+  case STORE_COL_PH_SET: return s.phSetMilli;
+  default: return s.rpmSet;
+  }
+}
+
+static void setField(TelemetrySample& s, int column, int64_t v) {
+  switch (column) {
+  case STORE_COL_TIME: s.timeUs = (uint64_t)v; break;
+  case STORE_COL_TEMP: s.tempCentiC = (int16_t)v; break;
+  case STORE_COL_PH: s.phMilli = (int16_t)v; break;
+  case STORE_COL_RPM: s.rpm = (int16_t)v; break;
+  case STORE_COL_HEATER: s.heaterDuty = (uint16_t)v; break;
+  case STORE_COL_MOTOR: s.motorDuty = (uint16_t)v; break;
+  case STORE_COL_FLAGS: s.flags = (uint8_t)v; break;
+  case STORE_COL_TEMP_SET: s.tempSetCentiC = (int16_t)v; break;
+  case STORE_COL_PH_SET: s.phSetMilli = (int16_t)v; break;
+  default: s.rpmSet = (int16_t)v; break;
+  }
+}
+
+static uint8_t* encodeColumn(uint8_t* p, const TelemetrySample* rows, size_t count, int column) {
+  switch (COLUMN_ENCODINGS[column]) {
+  case STORE_ENC_DELTA_DELTA: {
+    int64_t prev = 0, prevDelta = 0;
+    for (size_t i = 0; i < count; i++) {
+      int64_t v = fieldOf(rows[i], column);
+      int64_t delta = v - prev;
+      p = putVarint(p, zigzag64(delta - prevDelta));
+      prevDelta = delta;
+      prev = v;
+    }
+    break;
+  }
+  case STORE_ENC_DELTA: {
+    int64_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+      int64_t v = fieldOf(rows[i], column);
+      p = putVarint(p, zigzag64(v - prev));
+      prev = v;
+    }
+    break;
+  }
+  default: { // STORE_ENC_RUNS
+    int64_t prev = 0;
+    size_t i = 0;
+    while (i < count) {
+      int64_t v = fieldOf(rows[i], column);
+      size_t run = 1;
+      while (i + run < count && fieldOf(rows[i + run], column) == v) run++;
+      p = putVarint(p, zigzag64(v - prev));
+      p = putVarint(p, run);
+      prev = v;
+      i += run;
+    }
+    break;
+  }
+  }
+  return p;
+}
+
+static bool decodeColumn(const uint8_t* p, const uint8_t* end, TelemetrySample* rows, size_t count, int column) {
+  uint64_t raw;
+  switch (COLUMN_ENCODINGS[column]) {
+  case STORE_ENC_DELTA_DELTA: {
+    int64_t prev = 0, prevDelta = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (!getVarint(p, end, &raw)) return false;
+      prevDelta += unzigzag64(raw);
+      prev += prevDelta;
+      setField(rows[i], column, prev);
+    }
+    break;
+  }
+  case STORE_ENC_DELTA: {
+    int64_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (!getVarint(p, end, &raw)) return false;
+      prev += unzigzag64(raw);
+      setField(rows[i], column, prev);
+    }
+    break;
+  }
+  default: {
+    int64_t prev = 0;
+    size_t i = 0;
+    while (i < count) {
+      uint64_t run;
+      if (!getVarint(p, end, &raw) || !getVarint(p, end, &run) || run == 0 || run > count - i) return false;
+      prev += unzigzag64(raw);
+      for (uint64_t k = 0; k < run; k++) setField(rows[i++], column, prev);
+    }
+    break;
+  }
+  }
+  return p == end;
+}
+
+// -------------------------------------------------------------
+// SegmentWriter
+// -------------------------------------------------------------
+SegmentWriter::SegmentWriter() : fd_(-1), offset_(0), rows_(0) {
+}
+
+SegmentWriter::~SegmentWriter() {
+  close();
+}
+
+bool SegmentWriter::open(const std::string& path, const char* device) {
+  close();
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd_ < 0) return false;
+  path_ = path;
+  offset_ = 0;
+  rows_ = 0;
+  pending_.clear();
+  pending_.reserve(STORE_BLOCK_ROWS);
+  blocks_.clear();
+  buffer_.resize(BLOCK_HEADER_BYTES + STORE_COLUMN_COUNT * MAX_COLUMN_BYTES);
+
+  uint8_t header[STORE_HEADER_BYTES] = {};
+  memcpy(header, HEADER_MAGIC, 8);
+  putLittleEndian(header + 8, STORE_VERSION, 2);
+  header[10] = STORE_COLUMN_COUNT;
+  strncpy((char*)header + 16, device, STORE_DEVICE_BYTES - 1);
+  memcpy(header + 48, COLUMN_ENCODINGS, STORE_COLUMN_COUNT);
+  if (!writeAll(fd_, header, sizeof(header))) {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  offset_ = sizeof(header);
+  return true;
+}
+
+bool SegmentWriter::append(const TelemetrySample* samples, int count) {
+  if (fd_ < 0) return false;
+  bool ok = true;
+  for (int i = 0; i < count; i++) {
+    pending_.push_back(samples[i]);
+    if (pending_.size() == (size_t)STORE_BLOCK_ROWS) ok = writeBlock() && ok;
+  }
+  return ok;
+}
+
+bool SegmentWriter::writeBlock() {
+  if (pending_.empty()) return true;
+  const TelemetrySample* rows = pending_.data();
+  size_t count = pending_.size();
+
+  uint64_t minUs = rows[0].timeUs, maxUs = rows[0].timeUs;
+  for (size_t i = 1; i < count; i++) {
+    minUs = std::min(minUs, rows[i].timeUs);
+    maxUs = std::max(maxUs, rows[i].timeUs);
+  }
+
+  uint8_t* header = buffer_.data();
+  uint8_t* p = header + BLOCK_HEADER_BYTES;
+  for (int c = 0; c < STORE_COLUMN_COUNT; c++) {
+    uint8_t* start = p;
+    p = encodeColumn(p, rows, count, c);
+    putLittleEndian(header + 24 + 4 * c, p - start, 4);
+  }
+  putLittleEndian(header, BLOCK_MAGIC, 4);
+  putLittleEndian(header + 4, count, 4);
+  putLittleEndian(header + 8, minUs, 8);
+  putLittleEndian(header + 16, maxUs, 8);
+
+  size_t length = p - header;
+  pending_.clear();
+  if (!writeAll(fd_, header, length)) {
+    // A torn block is ignored by readers; keep appending after it would
+    // hide the later blocks, so stop here
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  blocks_.push_back(StoreBlockInfo{offset_, (uint32_t)count, minUs, maxUs});
+  offset_ += length;
+  rows_ += count;
+  return true;
+}
+
+bool SegmentWriter::flush(bool sync) {
+  if (fd_ < 0) return false;
+  if (!writeBlock()) return false;
+  return !sync || fdatasync(fd_) == 0;
+}
+
+bool SegmentWriter::close() {
+  if (fd_ < 0) return false;
+  bool ok = writeBlock();
+  if (ok) {
+    std::vector<uint8_t> footer(blocks_.size() * INDEX_ENTRY_BYTES + TRAILER_BYTES);
+    uint8_t* p = footer.data();
+    for (const StoreBlockInfo& b : blocks_) {
+      p = putLittleEndian(p, b.offset, 8);
+      p = putLittleEndian(p, b.rows, 4);
+      p = putLittleEndian(p, b.minUs, 8);
+      p = putLittleEndian(p, b.maxUs, 8);
+    }
+    p = putLittleEndian(p, offset_, 8);
+    p = putLittleEndian(p, blocks_.size(), 4);
+    p = putLittleEndian(p, rows_, 4);
+    memcpy(p, TRAILER_MAGIC, 8);
+    ok = writeAll(fd_, footer.data(), footer.size()) && fdatasync(fd_) == 0;
+  }
+  ok = ::close(fd_) == 0 && ok;
+  fd_ = -1;
+  return ok;
+}
+
+// -------------------------------------------------------------
+// SegmentReader
+// -------------------------------------------------------------
+SegmentReader::SegmentReader()
+    : fd_(-1), data_(nullptr), size_(0), device_(), sealed_(false), rows_(0), minUs_(0), maxUs_(0) {
+}
+
+SegmentReader::~SegmentReader() {
+  close();
+}
+
+void SegmentReader::close() {
+  if (data_) munmap((void*)data_, size_);
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+  data_ = nullptr;
+  size_ = 0;
+  blocks_.clear();
+  rows_ = 0;
+}
+
+bool SegmentReader::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) return false;
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || (uint64_t)st.st_size < STORE_HEADER_BYTES) {
+    close();
+    return false;
+  }
+  size_ = st.st_size;
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    size_ = 0;
+    close();
+    return false;
+  }
+  data_ = (const uint8_t*)map;
+  madvise(map, size_, MADV_SEQUENTIAL);
+
+  if (memcmp(data_, HEADER_MAGIC, 8) != 0 || getLittleEndian(data_ + 8, 2) != STORE_VERSION ||
+      data_[10] != STORE_COLUMN_COUNT || memcmp(data_ + 48, COLUMN_ENCODINGS, STORE_COLUMN_COUNT) != 0) {
+    close();
+    return false;
+  }
+  memcpy(device_, data_ + 16, STORE_DEVICE_BYTES);
+  device_[STORE_DEVICE_BYTES - 1] = 0;
+
+  sealed_ = loadFooter();
+  if (!sealed_) scanBlocks();
+
+  rows_ = 0;
+  minUs_ = UINT64_MAX;
+  maxUs_ = 0;
+  for (const StoreBlockInfo& b : blocks_) {
+    rows_ += b.rows;
+    minUs_ = std::min(minUs_, b.minUs);
+    maxUs_ = std::max(maxUs_, b.maxUs);
+  }
+  if (blocks_.empty()) minUs_ = 0;
+  return true;
+}
+
+bool SegmentReader::loadFooter() {
+  if (size_ < STORE_HEADER_BYTES + TRAILER_BYTES) return false;
+  const uint8_t* trailer = data_ + size_ - TRAILER_BYTES;
+  if (memcmp(trailer + 16, TRAILER_MAGIC, 8) != 0) return false;
+  uint64_t indexOffset = getLittleEndian(trailer, 8);
+  uint32_t count = (uint32_t)getLittleEndian(trailer + 8, 4);
+  if (indexOffset < STORE_HEADER_BYTES || indexOffset + (uint64_t)count * INDEX_ENTRY_BYTES + TRAILER_BYTES != size_) {
+    return false;
+  }
+  blocks_.resize(count);
+  const uint8_t* p = data_ + indexOffset;
+  for (uint32_t i = 0; i < count; i++, p += INDEX_ENTRY_BYTES) {
+    StoreBlockInfo& b = blocks_[i];
+    b.offset = getLittleEndian(p, 8);
+    b.rows = (uint32_t)getLittleEndian(p + 8, 4);
+    b.minUs = getLittleEndian(p + 12, 8);
+    b.maxUs = getLittleEndian(p + 20, 8);
+    if (b.offset + BLOCK_HEADER_BYTES > indexOffset) {
+      blocks_.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+void SegmentReader::scanBlocks() {
+  blocks_.clear();
+  uint64_t offset = STORE_HEADER_BYTES;
+  while (offset + BLOCK_HEADER_BYTES <= size_) {
+    const uint8_t* h = data_ + offset;
+    if (getLittleEndian(h, 4) != BLOCK_MAGIC) break;
+    uint64_t length = BLOCK_HEADER_BYTES;
+    for (int c = 0; c < STORE_COLUMN_COUNT; c++) length += getLittleEndian(h + 24 + 4 * c, 4);
+    uint32_t rows = (uint32_t)getLittleEndian(h + 4, 4);
+    if (offset + length > size_ || rows == 0 || rows > (uint32_t)STORE_BLOCK_ROWS) break; // Torn last block
+    blocks_.push_back(StoreBlockInfo{offset, rows, getLittleEndian(h + 8, 8), getLittleEndian(h + 16, 8)});
+    offset += length;
+  }
+}
+
+void SegmentReader::columnBytes(uint64_t bytes[STORE_COLUMN_COUNT]) const {
+  for (int c = 0; c < STORE_COLUMN_COUNT; c++) bytes[c] = 0;
+  for (const StoreBlockInfo& b : blocks_) {
+    for (int c = 0; c < STORE_COLUMN_COUNT; c++) bytes[c] += getLittleEndian(data_ + b.offset + 24 + 4 * c, 4);
+  }
+}
+
+bool SegmentReader::readBlock(size_t block, std::vector<TelemetrySample>& out) const {
+  if (block >= blocks_.size()) return false;
+  const StoreBlockInfo& b = blocks_[block];
+  const uint8_t* h = data_ + b.offset;
+  if (getLittleEndian(h, 4) != BLOCK_MAGIC || getLittleEndian(h + 4, 4) != b.rows) return false;
+
+  out.resize(b.rows);
+  const uint8_t* p = h + BLOCK_HEADER_BYTES;
+  const uint8_t* fileEnd = data_ + size_;
+  for (int c = 0; c < STORE_COLUMN_COUNT; c++) {
+    uint32_t length = (uint32_t)getLittleEndian(h + 24 + 4 * c, 4);
+    if (length > (uint64_t)(fileEnd - p) || !decodeColumn(p, p + length, out.data(), b.rows, c)) return false;
+    p += length;
+  }
+  return true;
+}
+
+long SegmentReader::read(uint64_t fromUs, uint64_t toUs, std::vector<TelemetrySample>& out) const {
+  std::vector<TelemetrySample> rows;
+  long added = 0;
+  for (size_t i = 0; i < blocks_.size(); i++) {
+    const StoreBlockInfo& b = blocks_[i];
+    if (b.maxUs < fromUs || b.minUs >= toUs) continue;
+    if (!readBlock(i, rows)) return -1;
+    if (b.minUs >= fromUs && b.maxUs < toUs) {
+      out.insert(out.end(), rows.begin(), rows.end());
+      added += rows.size();
+      continue;
+    }
+    for (const TelemetrySample& s : rows) {
+      if (s.timeUs >= fromUs && s.timeUs < toUs) {
+        out.push_back(s);
+        added++;
+      }
+    }
+  }
+  return added;
+}
+
+// -------------------------------------------------------------
+// Store directory
+// -------------------------------------------------------------
+static std::vector<std::string> listDirectory(const std::string& dir, bool directories) {
+  std::vector<std::string> names;
+  DIR* d = opendir(dir.c_str());
+  if (!d) return names;
+  while (dirent* e = readdir(d)) {
+    if (e->d_name[0] == '.') continue;
+    std::string path = dir + "/" + e->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) continue;
+    if (directories ? S_ISDIR(st.st_mode) : S_ISREG(st.st_mode)) names.push_back(e->d_name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+std::vector<std::string> storeListSegments(const std::string& dir, const char* device) {
+  std::vector<std::string> devices;
+  if (device) {
+    devices.push_back(device);
+  } else {
+    devices = listDirectory(dir, true);
+  }
+
+  std::vector<std::string> segments;
+  for (const std::string& d : devices) {
+    // Zero-padded start times: name order is time order
+    for (const std::string& name : listDirectory(dir + "/" + d, false)) {
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0) {
+        segments.push_back(dir + "/" + d + "/" + name);
+      }
+    }
+  }
+  return segments;
+}
+
+std::string storeSegmentPath(const std::string& dir, const char* device, uint64_t firstUs) {
+  std::string deviceDir = dir + "/" + device;
+  mkdir(dir.c_str(), 0755);
+  mkdir(deviceDir.c_str(), 0755);
+  char name[32];
+  snprintf(name, sizeof(name), "/%020llu.seg", (unsigned long long)firstUs);
+  return deviceDir + name;
+}
+
+void storeWriteCsvHeader(FILE* out) {
+  fprintf(out, "timestamp,temp_mean,ph_mean,rpm_mean,heater_pwm,motor_pwm,acid_pwm,base_pwm,faults\n");
+}
+
+void storeWriteCsvRows(FILE* out, const TelemetrySample* samples, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const TelemetrySample& s = samples[i];
+    int acid = s.flags & TELEMETRY_FLAG_ACID ? 100 : 0;
+    int base = s.flags & TELEMETRY_FLAG_BASE ? 100 : 0;
+    if (s.flags & STORE_FLAG_NO_DUTY) {
+      fprintf(out, "%.3f,%.2f,%.3f,%d,,,%d,%d,None\n", s.timeUs / 1e6, s.tempCentiC / 100.0, s.phMilli / 1000.0,
+              s.rpm, acid, base);
+    } else {
+      fprintf(out, "%.3f,%.2f,%.3f,%d,%.1f,%.1f,%d,%d,None\n", s.timeUs / 1e6, s.tempCentiC / 100.0,
+              s.phMilli / 1000.0, s.rpm, 100.0 * s.heaterDuty / 1023, 100.0 * s.motorDuty / 1023, acid, base);
+    }
+  }
+}
@@ -0,0 +1,212 @@
+#ifndef TELEMETRYSTORE_HPP
+#define TELEMETRYSTORE_HPP
+
+#include "TelemetryFrame.hpp"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Columnar, append-only segment files for logged telemetry
+// (bioreactor_ingest writes them, bioreactor_segments reads them).
+//
+// A segment holds the samples of one device in the order they arrived.
+// Samples are grouped in blocks of up to STORE_BLOCK_ROWS rows, and inside a
+// block every TelemetrySample field is a column of its own, compressed on
+// its own:
+//   time        zigzag varint delta of delta (constant rate: 1 byte per row)
+//   measured    zigzag varint delta from the previous row
+//   flags and   runs: (zigzag varint delta, varint run length), a few bytes
+//   setpoints   per change
+// Each block decodes on its own, so the block headers are the time index: a
+// reader skips every block whose time range misses the query.
+//
+// File layout (little endian):
+//   header   64 bytes: magic "BRTSEG01", version, column count, device name,
+//            the encoding of each column
+//   blocks   "BLK1", rows, min/max time (us), the byte count of each
+//            column, then the columns one after the other
+//   footer   only once sealed: an index entry per block (file offset, rows,
+//            min/max time), then a 24-byte trailer (index offset, blocks,
+//            rows, magic "BRTIDX01")
+// Blocks are only ever appended. A segment that was never sealed (the writer
+// died) is read by walking the block headers up to the last complete block.
+
+const int STORE_BLOCK_ROWS = 1024;
+const size_t STORE_HEADER_BYTES = 64;
+const size_t STORE_DEVICE_BYTES = 32; // Device name, NUL padded
+
+// Store-only sample flags, above the TELEMETRY_FLAG_* bits
+const uint8_t STORE_FLAG_NO_DUTY = 0x40;      // JSON telemetry: heater/motor duty not reported
+const uint8_t STORE_FLAG_ARRIVAL_TIME = 0x80; // Stamped on arrival, not at acquisition
+
+enum StoreColumn : uint8_t {
+  STORE_COL_TIME,
+  STORE_COL_TEMP,
+  STORE_COL_PH,
+  STORE_COL_RPM,
+  STORE_COL_HEATER,
+  STORE_COL_MOTOR,
+  STORE_COL_FLAGS,
+  STORE_COL_TEMP_SET,
+  STORE_COL_PH_SET,
+  STORE_COL_RPM_SET,
+  STORE_COLUMN_COUNT
+};
+
+enum StoreEncoding : uint8_t {
+  STORE_ENC_DELTA_DELTA,
+  STORE_ENC_DELTA,
+  STORE_ENC_RUNS,
+};
+
+extern const char* const STORE_COLUMN_NAMES[STORE_COLUMN_COUNT];
+
+struct StoreBlockInfo {
+  uint64_t offset; // Of the block header in the file
+  uint32_t rows;
+  uint64_t minUs;
+  uint64_t maxUs;
+};
+
+/**
+ * @brief Appends blocks to a new segment file. Rows are buffered until a
+ * block is full or flush() is called; each block is one write().
+ */
+class SegmentWriter {
+public:
+  SegmentWriter();
+  ~SegmentWriter(); // close()
+
+  SegmentWriter(const SegmentWriter&) = delete;
+  SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+  /**
+   * @brief Creates the file (it must not exist) and writes the header.
+   * @param device Up to STORE_DEVICE_BYTES - 1 characters (longer is cut).
+   */
+  bool open(const std::string& path, const char* device);
+
+  /**
+   * @brief Buffers samples, writing every block that fills up.
+   * @return false if a write failed (the segment stays readable up to the
+   * last complete block).
+   */
+  bool append(const TelemetrySample* samples, int count);
+
+  /**
+   * @brief Writes the buffered rows as a (short) block.
+   * @param sync Also fdatasync() the file.
+   */
+  bool flush(bool sync = false);
+
+  /**
+   * @brief Flushes, writes the index footer and closes. A sealed segment
+   * takes no more rows.
+   */
+  bool close();
+
+  bool isOpen() const { return fd_ >= 0; }
+  const std::string& path() const { return path_; }
+  uint32_t rows() const { return rows_ + (uint32_t)pending_.size(); }
+  uint64_t bytes() const { return offset_; }
+
+private:
+  bool writeBlock();
+
+  int fd_;
+  std::string path_;
+  uint64_t offset_; // File size so far
+  uint32_t rows_;   // Rows in written blocks
+  std::vector<TelemetrySample> pending_;
+  std::vector<StoreBlockInfo> blocks_;
+  std::vector<uint8_t> buffer_;
+};
+
+/**
+ * @brief Read-only view of a segment through mmap(). Decoding reads
+ * straight from the mapping; nothing is copied until rows are decoded.
+ */
+class SegmentReader {
+public:
+  SegmentReader();
+  ~SegmentReader();
+
+  SegmentReader(const SegmentReader&) = delete;
+  SegmentReader& operator=(const SegmentReader&) = delete;
+
+  /**
+   * @brief Maps the file and loads its block index (from the footer if
+   * sealed, else by walking the blocks).
+   * @return false if it is not a segment or cannot be mapped.
+   */
+  bool open(const std::string& path);
+  void close();
+
+  const char* device() const { return device_; }
+  bool sealed() const { return sealed_; }
+  uint32_t rows() const { return rows_; }
+  uint64_t bytes() const { return size_; }
+  uint64_t minUs() const { return minUs_; }
+  uint64_t maxUs() const { return maxUs_; }
+  const std::vector<StoreBlockInfo>& blocks() const { return blocks_; }
+
+  /**
+   * @brief Bytes each column takes over all blocks (compressed).
+   */
+  void columnBytes(uint64_t bytes[STORE_COLUMN_COUNT]) const;
+
+  /**
+   * @brief Decodes one block into out (resized to its rows).
+   * @return false if the block is corrupt.
+   */
+  bool readBlock(size_t block, std::vector<TelemetrySample>& out) const;
+
+  /**
+   * @brief Appends the rows with fromUs <= time < toUs, in file order,
+   * skipping blocks whose time range misses.
+   * @return Rows appended, or -1 if a block in range is corrupt.
+   */
+  long read(uint64_t fromUs, uint64_t toUs, std::vector<TelemetrySample>& out) const;
+
+private:
+  bool loadFooter();
+  void scanBlocks();
+
+  int fd_;
+  const uint8_t* data_;
+  uint64_t size_;
+  char device_[STORE_DEVICE_BYTES];
+  bool sealed_;
+  uint32_t rows_;
+  uint64_t minUs_;
+  uint64_t maxUs_;
+  std::vector<StoreBlockInfo> blocks_;
+};
+
+/**
+ * @brief Segment files of a store directory: DIR/<device>/<first time>.seg,
+ * oldest first. device nullptr lists every device.
+ */
+std::vector<std::string> storeListSegments(const std::string& dir, const char* device = nullptr);
+
+/**
+ * @brief Path for a new segment of device starting at firstUs (creates the
+ * device directory).
+ */
+std::string storeSegmentPath(const std::string& dir, const char* device, uint64_t firstUs);
+
+/**
+ * @brief Header of the CSV layout anomaly_analysis.py reads (data-analysis/logs).
+ */
+void storeWriteCsvHeader(FILE* out);
+
+/**
+ * @brief One CSV row per sample, as telemetry_logger.py writes them:
+ * timestamp (s), means, duties and pump states in percent. Duties a JSON
+ * sample did not report are left empty.
+ */
+void storeWriteCsvRows(FILE* out, const TelemetrySample* samples, size_t count);
+
+#endif // TELEMETRYSTORE_HPP
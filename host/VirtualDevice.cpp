@@ -0,0 +1,53 @@
+#include "VirtualDevice.hpp"
+#include "ControlLoop.hpp"
+#include "Hal.hpp"
+#include "SampleHistory.hpp"
+#include <new>
+
+// Everything below is per device (swapped with the rest of the image)
+static Scheduler scheduler(halMicros);
+static std::atomic<bool> mqttOnline(false);
+static SampleHistory* history = nullptr;
+static uint32_t frameSequence = 0;
+
+void virtualDeviceSetup(uint32_t publishPeriodUs, MqttOutbox& outbox) {
+  setupControl();
+  addControlTasks(scheduler);
+  addTelemetryTasks(scheduler, outbox, mqttOnline, publishPeriodUs);
+}
+
+bool virtualDeviceEnableHistory() {
+  history = new (std::nothrow) SampleHistory();
+  return history && addSampleTask(scheduler, *history);
+}
+
+void virtualDeviceStart() {
+  scheduler.start();
+}
+
+void virtualDeviceLoop(MqttQueue& inbox, MqttOutbox& outbox, bool online) {
+  mqttOnline = online;
+
+  processInbox(inbox, outbox);
+  while (scheduler.runOnce()) {
+  }
+}
+
+uint32_t virtualDeviceIdleUs() {
+  return scheduler.untilNextReleaseUs();
+}
+
+size_t virtualDeviceFrame(uint8_t* frame, bool online) {
+  if (!history) return 0;
+  history->age();
+  if (!online) return 0;
+
+  TelemetrySample batch[TELEMETRY_BATCH_SAMPLES];
+  int count;
+  size_t length = nextTelemetryFrame(*history, batch, frame, frameSequence, count);
+  if (length > 0) {
+    frameSequence++;
+    history->discard(count);
+  }
+  return length;
+}
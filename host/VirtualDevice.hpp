@@ -0,0 +1,58 @@
+#ifndef VIRTUALDEVICE_HPP
+#define VIRTUALDEVICE_HPP
+
+#include "MqttQueue.hpp"
+#include <stddef.h>
+#include <stdint.h>
+
+// main.ino's side of one device, for the firmware image that
+// bioreactor_loadgen runs many times over (FirmwareImage.hpp): the scheduler
+// with the tasks main.ino registers (addControlTasks(), addTelemetryTasks(),
+// addSampleTask() in ControlLoop.hpp), and the body of loop(). Its state is
+// in globals like the rest of the firmware, so it belongs to whichever
+// device is loaded. The network task is the caller's: it fills the inbox,
+// sends the outbox, and takes the binary frames.
+
+/**
+ * @brief setup() without the network: sets up the subsystems and registers
+ * the tasks. Call once, before the first device is saved.
+ * @param publishPeriodUs Period of the JSON status ("telemetry" task).
+ * @param outbox Where every device's tasks queue their messages.
+ */
+void virtualDeviceSetup(uint32_t publishPeriodUs, MqttOutbox& outbox);
+
+/**
+ * @brief Gives the loaded device a SampleHistory of its own and the 10 Hz
+ * "sample" task, so it also publishes binary frames (virtualDeviceFrame()).
+ * @return false if there is no memory for it.
+ */
+bool virtualDeviceEnableHistory();
+
+/**
+ * @brief Aligns the loaded device's task releases to the current time.
+ */
+void virtualDeviceStart();
+
+/**
+ * @brief One pass of loop(): applies the inbox, then runs every task that is due.
+ * @param outbox For the RPC responses; the same one as virtualDeviceSetup()'s.
+ * @param online Whether the network task is connected (JSON status is only
+ * taken while it is, as on the device).
+ */
+void virtualDeviceLoop(MqttQueue& inbox, MqttOutbox& outbox, bool online);
+
+/**
+ * @brief Microseconds until the loaded device's next task release.
+ */
+uint32_t virtualDeviceIdleUs();
+
+/**
+ * @brief publishHistory() for the loaded device: the next binary frame for
+ * TELEMETRY_BIN_TOPIC (nextTelemetryFrame()) if a batch is ready. The samples are then taken as
+ * sent. Offline, only ages the history.
+ * @param frame At least TELEMETRY_FRAME_MAX bytes.
+ * @return Frame length, 0 if there is nothing to send.
+ */
+size_t virtualDeviceFrame(uint8_t* frame, bool online);
+
+#endif // VIRTUALDEVICE_HPP
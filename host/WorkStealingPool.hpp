@@ -0,0 +1,95 @@
+#ifndef WORKSTEALINGPOOL_HPP
+#define WORKSTEALINGPOOL_HPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool for the offline host tools: run() deals a batch of
+// independent, coarse tasks (files, segments, parameter sets) round-robin to
+// one queue per worker. A worker takes its own tasks from the front, in the
+// order given, and when its queue is empty it steals from the back of the
+// others'. Give the biggest tasks first: they are then started first, and the
+// small ones left at the back even out the end of the batch.
+
+class WorkStealingPool {
+public:
+  /**
+   * @param threads Worker count; 0 uses every hardware thread.
+   */
+  explicit WorkStealingPool(unsigned threads = 0) : steals_(0) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    threads_ = threads ? threads : 1;
+  }
+
+  /**
+   * @brief Runs task(index, worker) for every index in [0, count) and
+   * returns once all are done. worker is in [0, threads()), so per-worker
+   * state can be indexed by it without locking.
+   */
+  template <typename Task>
+  void run(size_t count, Task task) {
+    unsigned workers = count < threads_ ? (unsigned)count : threads_;
+    if (workers <= 1) {
+      for (size_t i = 0; i < count; i++) task(i, 0u);
+      return;
+    }
+
+    std::vector<Queue> queues(workers);
+    for (size_t i = 0; i < count; i++) queues[i % workers].tasks.push_back(i);
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < workers; w++) {
+      threads.emplace_back([&, w] {
+        size_t index;
+        while (take(queues, w, index)) task(index, w);
+      });
+    }
+    for (std::thread& t : threads) t.join();
+  }
+
+  unsigned threads() const { return threads_; }
+
+  /**
+   * @brief Tasks taken from another worker's queue, over every run().
+   */
+  uint64_t steals() const { return steals_.load(); }
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  };
+
+  // No task ever adds tasks, so a worker that finds every queue empty is done
+  bool take(std::vector<Queue>& queues, unsigned self, size_t& index) {
+    {
+      std::lock_guard<std::mutex> guard(queues[self].lock);
+      if (!queues[self].tasks.empty()) {
+        index = queues[self].tasks.front();
+        queues[self].tasks.pop_front();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+      Queue& victim = queues[(self + i) % queues.size()];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (!victim.tasks.empty()) {
+        index = victim.tasks.back();
+        victim.tasks.pop_back();
+        steals_++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  unsigned threads_;
+  std::atomic<uint64_t> steals_;
+};
+
+#endif // WORKSTEALINGPOOL_HPP
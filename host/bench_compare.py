@@ -0,0 +1,66 @@
+"""Compare two bioreactor_bench JSON result files.
+
+    python3 host/bench_compare.py before.json after.json [--threshold 10]
+
+Prints each benchmark's CPU time in both files and the change. With
+repetitions, the median aggregate is used. Exits with 1 if any benchmark got
+slower by more than the threshold (percent), so it can gate a change.
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Benchmark name -> CPU time in ns (the median when repeated)."""
+    with open(path) as f:
+        results = json.load(f)
+    times = {}
+    medians = {}
+    scale = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+    for b in results["benchmarks"]:
+        ns = b["cpu_time"] * scale[b.get("time_unit", "ns")]
+        name = b.get("run_name", b["name"])
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "median":
+                medians[name] = ns
+        else:
+            times.setdefault(name, ns)
+    times.update(medians)
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="slowdown in percent that counts as a regression")
+    args = parser.parse_args()
+
+    before = load(args.before)
+    after = load(args.after)
+
+    regressions = []
+    print(f"{'benchmark':32} {'before ns':>12} {'after ns':>12} {'change':>8}")
+    for name in before:
+        if name not in after:
+            print(f"{name:32} {before[name]:12.1f} {'-':>12} {'gone':>8}")
+            continue
+        change = 100.0 * (after[name] - before[name]) / before[name]
+        mark = " <" if change > args.threshold else ""
+        print(f"{name:32} {before[name]:12.1f} {after[name]:12.1f} {change:+7.1f}%{mark}")
+        if change > args.threshold:
+            regressions.append(name)
+    for name in after:
+        if name not in before:
+            print(f"{name:32} {'-':>12} {after[name]:12.1f} {'new':>8}")
+
+    if regressions:
+        print(f"{len(regressions)} regression(s) over {args.threshold:g}%: {', '.join(regressions)}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
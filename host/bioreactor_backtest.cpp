@@ -0,0 +1,755 @@
+// Offline back-test of the anomaly detectors (main/Detectors.hpp, and the
+// One-Class SVM when main/svm_model.h exists) over recorded runs: summary
+// CSVs (bioreactor_sim --csv, data-analysis/logs/*.csv) and the segment files
+// bioreactor_ingest writes. Each file is a shard, and a work-stealing pool
+// (WorkStealingPool.hpp) runs the shards on every core. A shard is read once:
+// each block of rows goes through every configuration of the grid before the
+// next block is decoded. The per-worker results are merged at the end into one
+// confusion matrix per configuration and, per fault type, how many episodes
+// each configuration caught and how long after the fault started.
+//
+// Usage: bioreactor_backtest [--train NOFAULTS.csv] [--train-samples N] [--skip N] [--labels FILE]
+//                            [--threads N] [--csv OUT] PATH...
+//
+// PATH is a CSV, a .seg file, or a directory (its *.csv files and every
+// segment below it). Without --train every shard learns its baselines from its
+// own first --train-samples fault-free rows, which are then not scored.
+// --skip drops the first N rows of every shard (the start-up transient).
+// A CSV row is faulty when its faults column is not "None" (or empty). Segment
+// rows carry no fault column: --labels gives the episodes as
+// "device,start_s,end_s,fault" lines (the device of a CSV is its file name
+// without .csv); without labels a segment is scored as fault-free, so only
+// its false positives count.
+
+#include "Detectors.hpp"
+#include "OneClassSvm.hpp"
+#include "TelemetryStore.hpp"
+#include "WorkStealingPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <map>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#if __has_include("svm_model.h")
+#include "svm_model.h"
+#define BACKTEST_SVM 1
+static OneClassSvm<N_FEATURES, N_SUPPORT_VECTORS> svm; // Read-only once loaded, shared by the workers
+#else
+#define BACKTEST_SVM 0
+#endif
+
+static const char* SIGNALS[] = {"temp_mean", "ph_mean", "rpm_mean"};
+static const int SIGNAL_COUNT = 3;
+static const int SCOPES = SIGNAL_COUNT + 1; // Each signal, then any of them
+static const int MAX_FAULTS = 32;           // Fault types are bits of Row::faults
+static const size_t CHUNK_ROWS = STORE_BLOCK_ROWS;
+
+// --- Detector grid ---
+
+enum Kind { KIND_ZSCORE, KIND_HYSTERESIS, KIND_SLIDING, KIND_SVM, KIND_COUNT };
+
+static const float ZSCORE_THRESHOLDS[] = {2.0f, 2.5f, 3.0f, 3.5f, 4.0f};
+static const float BAND_K[] = {2.0f, 3.0f, 4.0f};
+static const float BAND_HYSTERESIS[] = {0.25f, 0.5f, 1.0f};
+static const uint16_t DRIFT_WINDOWS[] = {15, 30, 60};
+static const float DRIFT_K[] = {1.0f, 2.0f, 3.0f};
+typedef BaselineDriftDetector<64> DriftDetector;
+
+struct Config {
+  Kind kind;
+  float a; // zscore: threshold; hysteresis: k; sliding: window
+  float b; // hysteresis: hysteresis factor; sliding: k
+  std::string name;
+};
+
+static std::vector<Config> buildGrid() {
+  std::vector<Config> grid;
+  char name[64];
+  for (float z : ZSCORE_THRESHOLDS) {
+    snprintf(name, sizeof(name), "zscore z=%g", z);
+    grid.push_back({KIND_ZSCORE, z, 0, name});
+  }
+  for (float k : BAND_K) {
+    for (float h : BAND_HYSTERESIS) {
+      snprintf(name, sizeof(name), "hysteresis k=%g h=%g", k, h);
+      grid.push_back({KIND_HYSTERESIS, k, h, name});
+    }
+  }
+  for (uint16_t w : DRIFT_WINDOWS) {
+    for (float k : DRIFT_K) {
+      snprintf(name, sizeof(name), "sliding w=%u k=%g", w, k);
+      grid.push_back({KIND_SLIDING, (float)w, k, name});
+    }
+  }
+#if BACKTEST_SVM
+  grid.push_back({KIND_SVM, 0, 0, "svm"});
+#endif
+  return grid;
+}
+
+// --- Fault types ---
+
+// Names seen so far; shards register them as they find them
+static std::mutex faultLock;
+static std::vector<std::string> faultNames;
+
+static uint32_t faultBit(const char* name, size_t length) {
+  std::lock_guard<std::mutex> guard(faultLock);
+  for (size_t i = 0; i < faultNames.size(); i++) {
+    if (faultNames[i].size() == length && !memcmp(faultNames[i].data(), name, length)) return 1u << i;
+  }
+  if (faultNames.size() == MAX_FAULTS) return 0;
+  faultNames.push_back(std::string(name, length));
+  return 1u << (faultNames.size() - 1);
+}
+
+// "None" or "" is healthy; several faults are joined by ';'
+static uint32_t parseFaults(const char* field) {
+  if (!field[0] || !strcmp(field, "None")) return 0;
+  uint32_t mask = 0;
+  while (*field) {
+    size_t length = strcspn(field, ";");
+    if (length) mask |= faultBit(field, length);
+    field += length;
+    if (*field) field++;
+  }
+  return mask;
+}
+
+struct Label {
+  double startS;
+  double endS;
+  uint32_t faults;
+};
+
+static std::map<std::string, std::vector<Label>> labels;
+
+static uint32_t labelledFaults(const std::vector<Label>* episodes, double timeS) {
+  uint32_t mask = 0;
+  if (episodes) {
+    for (const Label& l : *episodes) {
+      if (l.startS <= timeS && timeS < l.endS) mask |= l.faults;
+    }
+  }
+  return mask;
+}
+
+static bool readLabels(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char line[512];
+  int lineNumber = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNumber++;
+    char device[128], fault[128];
+    Label l;
+    if (sscanf(line, " %127[^,],%lf,%lf,%127[^,\r\n]", device, &l.startS, &l.endS, fault) != 4) {
+      // A header line is fine, anything else is not
+      if (lineNumber == 1) continue;
+      fprintf(stderr, "%s:%d: expected device,start_s,end_s,fault\n", path, lineNumber);
+      fclose(f);
+      return false;
+    }
+    l.faults = parseFaults(fault);
+    labels[device].push_back(l);
+  }
+  fclose(f);
+  return true;
+}
+
+// --- Shards ---
+
+struct Row {
+  double timeS;
+  float values[SIGNAL_COUNT];
+  uint32_t faults; // Bit per faultNames entry
+};
+
+struct Shard {
+  std::string path;
+  bool segment;
+  uint64_t bytes;
+};
+
+/**
+ * @brief What one worker has seen over all its shards; merged at the end.
+ */
+struct Result {
+  std::vector<ConfusionMatrix> matrices;     // config x SCOPES
+  std::vector<std::vector<float>> latencies; // config x MAX_FAULTS, seconds to the first flag
+  std::vector<uint32_t> missed;              // config x MAX_FAULTS
+  uint32_t episodes[MAX_FAULTS] = {};
+  uint64_t rows = 0;
+  uint64_t trainRows = 0;
+  uint32_t untrained = 0; // Shards that ended before their baselines were learned
+  uint32_t failed = 0;
+
+  explicit Result(size_t configs)
+      : matrices(configs * SCOPES), latencies(configs * MAX_FAULTS), missed(configs * MAX_FAULTS) {}
+
+  Result& operator+=(const Result& other) {
+    for (size_t i = 0; i < matrices.size(); i++) matrices[i] += other.matrices[i];
+    for (size_t i = 0; i < latencies.size(); i++) {
+      latencies[i].insert(latencies[i].end(), other.latencies[i].begin(), other.latencies[i].end());
+      missed[i] += other.missed[i];
+    }
+    for (int f = 0; f < MAX_FAULTS; f++) episodes[f] += other.episodes[f];
+    rows += other.rows;
+    trainRows += other.trainRows;
+    untrained += other.untrained;
+    failed += other.failed;
+    return *this;
+  }
+};
+
+/**
+ * @brief Runs every configuration over the rows of one shard, a chunk at a
+ * time, and adds the outcome to a worker's Result.
+ *
+ * A z-score or sliding configuration only sets a threshold on a score that
+ * does not depend on it (|z|, the window mean's deviation), so those run one
+ * detector per signal (and window) and apply every threshold of the grid to
+ * its scores. The flags are the ones each configuration's own detector would
+ * raise.
+ */
+class ShardEvaluator {
+public:
+  ShardEvaluator(const std::vector<Config>& configs, const RunningStats* sharedBaseline, size_t trainSamples,
+                 size_t skip, Result& result)
+      : configs_(configs), trainSamples_(trainSamples), skipLeft_(skip), trained_(false), started_(false),
+        active_(0), ignored_(0), result_(result), hits_(configs.size() * CHUNK_ROWS),
+        detected_(configs.size()), latency_(configs.size() * MAX_FAULTS) {
+    for (const Config& c : configs) {
+      if (c.kind == KIND_HYSTERESIS) {
+        for (int s = 0; s < SIGNAL_COUNT; s++) band_.emplace_back(c.a, c.b);
+      } else if (c.kind == KIND_SLIDING &&
+                 std::find(windows_.begin(), windows_.end(), (uint16_t)c.a) == windows_.end()) {
+        windows_.push_back((uint16_t)c.a);
+        for (int s = 0; s < SIGNAL_COUNT; s++) drift_.emplace_back((uint16_t)c.a, 1.0f);
+      }
+    }
+    if (sharedBaseline) train(sharedBaseline);
+  }
+
+  void feed(const Row* rows, size_t count) {
+    size_t r = 0;
+    for (; r < count && skipLeft_; r++) skipLeft_--;
+    for (; r < count && !trained_; r++) {
+      if (rows[r].faults) continue;
+      for (int s = 0; s < SIGNAL_COUNT; s++) baseline_[s].add(rows[r].values[s]);
+      result_.trainRows++;
+      if (baseline_[0].count() >= trainSamples_) train(baseline_);
+    }
+    while (r < count) {
+      size_t n = std::min(count - r, CHUNK_ROWS);
+      score(rows + r, n);
+      r += n;
+    }
+  }
+
+  /**
+   * @brief Closes the episodes still open when the shard ends.
+   */
+  void finish() {
+    if (!trained_) result_.untrained++;
+    endEpisodes(active_ & ~ignored_);
+  }
+
+private:
+  void train(const RunningStats* baseline) {
+    for (int s = 0; s < SIGNAL_COUNT; s++) {
+      zscore_[s].train(baseline[s]);
+      stddev_[s] = baseline[s].stddev();
+    }
+    for (size_t i = 0; i < band_.size(); i++) band_[i].train(baseline[i % SIGNAL_COUNT]);
+    for (size_t i = 0; i < drift_.size(); i++) drift_[i].train(baseline[i % SIGNAL_COUNT]);
+    trained_ = true;
+  }
+
+  // Sets bit s of hit[r] where flagged(score[r]), for each configuration of kind
+  template <typename Flagged>
+  void threshold(Kind kind, float window, int s, size_t n, Flagged flagged) {
+    for (size_t c = 0; c < configs_.size(); c++) {
+      if (configs_[c].kind != kind || (kind == KIND_SLIDING && configs_[c].a != window)) continue;
+      uint8_t* hit = &hits_[c * CHUNK_ROWS];
+      for (size_t r = 0; r < n; r++) hit[r] |= flagged(configs_[c], scores_[r]) << s;
+    }
+  }
+
+  void score(const Row* rows, size_t n) {
+    // --- Detection: hit bit s set when signal s is flagged ---
+    memset(hits_.data(), 0, hits_.size());
+    for (int s = 0; s < SIGNAL_COUNT; s++) {
+      for (size_t r = 0; r < n; r++) scores_[r] = zscore_[s].update(rows[r].values[s]).score;
+      threshold(KIND_ZSCORE, 0, s, n, [](const Config& c, float z) { return z > c.a; });
+
+      for (size_t w = 0; w < windows_.size(); w++) {
+        DriftDetector& detector = drift_[w * SIGNAL_COUNT + s];
+        for (size_t r = 0; r < n; r++) scores_[r] = detector.update(rows[r].values[s]).score;
+        // BaselineDriftDetector: |deviation| > k * baseline std
+        double stddev = stddev_[s];
+        threshold(KIND_SLIDING, windows_[w], s, n,
+                  [stddev](const Config& c, float deviation) { return fabs(deviation) > c.b * stddev; });
+      }
+    }
+    size_t h = 0;
+    for (size_t c = 0; c < configs_.size(); c++) {
+      uint8_t* hit = &hits_[c * CHUNK_ROWS];
+      if (configs_[c].kind == KIND_HYSTERESIS) {
+        for (int s = 0; s < SIGNAL_COUNT; s++, h++) {
+          BandHysteresisDetector& detector = band_[h];
+          for (size_t r = 0; r < n; r++) hit[r] |= detector.update(rows[r].values[s]) << s;
+        }
+      }
+#if BACKTEST_SVM
+      // The SVM scores the triple: a hit counts for every signal
+      if (configs_[c].kind == KIND_SVM) {
+        for (size_t r = 0; r < n; r++) hit[r] = svm.isAnomaly(rows[r].values) ? 0x07 : 0;
+      }
+#endif
+    }
+
+    // --- Scoring: predicted, actual and both counted without branches ---
+    for (size_t r = 0; r < n; r++) faulty_[r] = rows[r].faults != 0;
+    uint64_t actual = 0;
+    for (size_t r = 0; r < n; r++) actual += faulty_[r];
+    for (size_t c = 0; c < configs_.size(); c++) {
+      const uint8_t* hit = &hits_[c * CHUNK_ROWS];
+      ConfusionMatrix* m = &result_.matrices[c * SCOPES];
+      for (int scope = 0; scope < SCOPES; scope++) {
+        uint8_t mask = scope < SIGNAL_COUNT ? (uint8_t)(1 << scope) : 0x07;
+        uint64_t predicted = 0, both = 0;
+        for (size_t r = 0; r < n; r++) {
+          uint8_t p = (hit[r] & mask) != 0;
+          predicted += p;
+          both += p & faulty_[r];
+        }
+        m[scope].tp += both;
+        m[scope].fp += predicted - both;
+        m[scope].fn += actual - both;
+        m[scope].tn += n - predicted - actual + both;
+      }
+    }
+    result_.rows += n;
+
+    // --- Episodes: first flag of each configuration after each fault starts ---
+    for (size_t r = 0; r < n; r++) {
+      uint32_t faults = rows[r].faults;
+      if (!started_) {
+        // Faults already running when scoring starts have no start time
+        started_ = true;
+        active_ = ignored_ = faults;
+      }
+      if (faults != active_) {
+        endEpisodes(active_ & ~faults & ~ignored_);
+        startEpisodes(faults & ~active_, rows[r].timeS);
+        ignored_ &= faults;
+        active_ = faults;
+      }
+      uint32_t open = active_ & ~ignored_;
+      if (!open) continue;
+      for (size_t c = 0; c < configs_.size(); c++) {
+        uint32_t pending = open & ~detected_[c];
+        if (!pending || !hits_[c * CHUNK_ROWS + r]) continue;
+        for (int f = 0; f < MAX_FAULTS; f++) {
+          if (pending & (1u << f)) latency_[c * MAX_FAULTS + f] = (float)(rows[r].timeS - startS_[f]);
+        }
+        detected_[c] |= pending;
+      }
+    }
+  }
+
+  void startEpisodes(uint32_t faults, double timeS) {
+    for (int f = 0; f < MAX_FAULTS; f++) {
+      if (!(faults & (1u << f))) continue;
+      startS_[f] = timeS;
+      for (uint32_t& d : detected_) d &= ~(1u << f);
+    }
+  }
+
+  void endEpisodes(uint32_t faults) {
+    for (int f = 0; f < MAX_FAULTS; f++) {
+      if (!(faults & (1u << f))) continue;
+      result_.episodes[f]++;
+      for (size_t c = 0; c < configs_.size(); c++) {
+        if (detected_[c] & (1u << f)) {
+          result_.latencies[c * MAX_FAULTS + f].push_back(latency_[c * MAX_FAULTS + f]);
+        } else {
+          result_.missed[c * MAX_FAULTS + f]++;
+        }
+      }
+    }
+  }
+
+  const std::vector<Config>& configs_;
+  size_t trainSamples_;
+  size_t skipLeft_;
+  bool trained_;
+  bool started_;
+  uint32_t active_;  // Faults of the previous scored row
+  uint32_t ignored_; // Active since before scoring started
+  Result& result_;
+  RunningStats baseline_[SIGNAL_COUNT];
+  double stddev_[SIGNAL_COUNT] = {};
+  BaselineZScoreDetector zscore_[SIGNAL_COUNT];
+  std::vector<uint16_t> windows_;            // Distinct sliding windows of the grid
+  std::vector<DriftDetector> drift_;         // window x SIGNAL_COUNT
+  std::vector<BandHysteresisDetector> band_; // SIGNAL_COUNT per hysteresis configuration
+  std::vector<uint8_t> hits_;                // config x CHUNK_ROWS
+  float scores_[CHUNK_ROWS];
+  uint8_t faulty_[CHUNK_ROWS];
+  std::vector<uint32_t> detected_; // Per configuration: open episodes already flagged
+  std::vector<float> latency_;     // config x MAX_FAULTS
+  double startS_[MAX_FAULTS] = {};
+};
+
+static std::string deviceOfCsv(const std::string& path) {
+  size_t slash = path.rfind('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) name.resize(name.size() - 4);
+  return name;
+}
+
+/**
+ * @brief Streams a summary CSV to sink(rows, count), CHUNK_ROWS at a time.
+ * Needs the signal columns; timestamp and faults are optional.
+ */
+template <typename Sink>
+static bool readCsv(const std::string& path, Sink sink) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    perror(path.c_str());
+    return false;
+  }
+
+  char line[1024];
+  int columns[SIGNAL_COUNT] = {-1, -1, -1};
+  int timeColumn = -1, faultsColumn = -1;
+  if (fgets(line, sizeof(line), f)) {
+    int column = 0;
+    for (char* field = strtok(line, ",\r\n"); field; field = strtok(nullptr, ",\r\n"), column++) {
+      for (int s = 0; s < SIGNAL_COUNT; s++) {
+        if (!strcmp(field, SIGNALS[s])) columns[s] = column;
+      }
+      if (!strcmp(field, "timestamp")) timeColumn = column;
+      if (!strcmp(field, "faults")) faultsColumn = column;
+    }
+  }
+  for (int s = 0; s < SIGNAL_COUNT; s++) {
+    if (columns[s] < 0) {
+      fprintf(stderr, "%s: no %s column\n", path.c_str(), SIGNALS[s]);
+      fclose(f);
+      return false;
+    }
+  }
+
+  // Without a faults column the labels (if any) say which rows are faulty
+  auto found = labels.find(deviceOfCsv(path));
+  const std::vector<Label>* episodes = faultsColumn < 0 && found != labels.end() ? &found->second : nullptr;
+
+  std::vector<Row> chunk;
+  chunk.reserve(CHUNK_ROWS);
+  std::string lastFaults = "None";
+  uint32_t lastMask = 0;
+  size_t index = 0;
+  while (fgets(line, sizeof(line), f)) {
+    Row row = {(double)index++, {0, 0, 0}, 0};
+    int column = 0;
+    char* cursor = line;
+    for (char* field = strsep(&cursor, ",\r\n"); field; field = strsep(&cursor, ",\r\n"), column++) {
+      for (int s = 0; s < SIGNAL_COUNT; s++) {
+        if (column == columns[s]) row.values[s] = strtof(field, nullptr);
+      }
+      if (column == timeColumn) row.timeS = strtod(field, nullptr);
+      if (column == faultsColumn) {
+        // Consecutive rows mostly share their faults field
+        if (lastFaults != field) {
+          lastFaults = field;
+          lastMask = parseFaults(field);
+        }
+        row.faults = lastMask;
+      }
+    }
+    if (episodes) row.faults = labelledFaults(episodes, row.timeS);
+    chunk.push_back(row);
+    if (chunk.size() == CHUNK_ROWS) {
+      sink(chunk.data(), chunk.size());
+      chunk.clear();
+    }
+  }
+  if (!chunk.empty()) sink(chunk.data(), chunk.size());
+
+  fclose(f);
+  return true;
+}
+
+/**
+ * @brief Streams a segment to sink(rows, count), one block at a time.
+ */
+template <typename Sink>
+static bool readSegment(const std::string& path, Sink sink) {
+  SegmentReader reader;
+  if (!reader.open(path)) {
+    fprintf(stderr, "%s: not a segment file\n", path.c_str());
+    return false;
+  }
+  auto found = labels.find(reader.device());
+  const std::vector<Label>* episodes = found != labels.end() ? &found->second : nullptr;
+
+  std::vector<TelemetrySample> samples;
+  std::vector<Row> rows;
+  for (size_t b = 0; b < reader.blocks().size(); b++) {
+    if (!reader.readBlock(b, samples)) {
+      fprintf(stderr, "%s: block %zu is corrupt\n", path.c_str(), b);
+      return false;
+    }
+    rows.resize(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+      const TelemetrySample& s = samples[i];
+      rows[i].timeS = s.timeUs / 1e6;
+      rows[i].values[0] = s.tempCentiC / 100.0f;
+      rows[i].values[1] = s.phMilli / 1000.0f;
+      rows[i].values[2] = s.rpm;
+      rows[i].faults = labelledFaults(episodes, rows[i].timeS);
+    }
+    sink(rows.data(), rows.size());
+  }
+  return true;
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static uint64_t fileBytes(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static bool addShards(const char* path, std::vector<Shard>& shards) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    perror(path);
+    return false;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    shards.push_back({path, endsWith(path, ".seg"), (uint64_t)st.st_size});
+    return true;
+  }
+
+  DIR* dir = opendir(path);
+  if (dir) {
+    std::vector<std::string> csvs;
+    while (struct dirent* entry = readdir(dir)) {
+      if (endsWith(entry->d_name, ".csv")) csvs.push_back(std::string(path) + "/" + entry->d_name);
+    }
+    closedir(dir);
+    std::sort(csvs.begin(), csvs.end());
+    for (const std::string& csv : csvs) shards.push_back({csv, false, fileBytes(csv)});
+  }
+  for (const std::string& segment : storeListSegments(path)) shards.push_back({segment, true, fileBytes(segment)});
+  return true;
+}
+
+// --- Report ---
+
+static double percentile(std::vector<float>& values, double p) {
+  if (values.empty()) return 0;
+  size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + i, values.end());
+  return values[i];
+}
+
+static void writeCsv(FILE* out, const std::vector<Config>& configs, Result& total) {
+  fprintf(out, "config,scope,tp,fp,fn,tn,precision,recall,f1,fpr,episodes,detected,latency_p50_s,latency_p90_s\n");
+  for (size_t c = 0; c < configs.size(); c++) {
+    for (int s = 0; s < SCOPES; s++) {
+      if (configs[c].kind == KIND_SVM && s < SIGNAL_COUNT) continue;
+      const ConfusionMatrix& m = total.matrices[c * SCOPES + s];
+      fprintf(out, "%s,%s,%llu,%llu,%llu,%llu,%.4f,%.4f,%.4f,%.6f,,,,\n", configs[c].name.c_str(),
+              s < SIGNAL_COUNT ? SIGNALS[s] : "any", (unsigned long long)m.tp, (unsigned long long)m.fp,
+              (unsigned long long)m.fn, (unsigned long long)m.tn, m.precision(), m.recall(), m.f1(),
+              m.falsePositiveRate());
+    }
+    for (size_t f = 0; f < faultNames.size(); f++) {
+      std::vector<float>& latencies = total.latencies[c * MAX_FAULTS + f];
+      fprintf(out, "%s,fault:%s,,,,,,,,,%u,%zu,%.1f,%.1f\n", configs[c].name.c_str(), faultNames[f].c_str(),
+              total.episodes[f], latencies.size(), percentile(latencies, 0.5), percentile(latencies, 0.9));
+    }
+  }
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--train NOFAULTS.csv] [--train-samples N] [--skip N] [--labels FILE] [--threads N]\n"
+          "          [--csv OUT] PATH...\n",
+          argv0);
+}
+
+int main(int argc, char** argv) {
+  const char* trainPath = nullptr;
+  const char* labelsPath = nullptr;
+  const char* csvPath = nullptr;
+  size_t trainSamples = 500;
+  size_t skip = 0;
+  unsigned threads = 0;
+  std::vector<const char*> paths;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--train") && hasValue) trainPath = argv[++i];
+    else if (!strcmp(argv[i], "--train-samples") && hasValue) trainSamples = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--skip") && hasValue) skip = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--labels") && hasValue) labelsPath = argv[++i];
+    else if (!strcmp(argv[i], "--threads") && hasValue) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--csv") && hasValue) csvPath = argv[++i];
+    else if (argv[i][0] != '-') paths.push_back(argv[i]);
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (paths.empty() || trainSamples < 2) {
+    usage(argv[0]);
+    return 2;
+  }
+
+#if BACKTEST_SVM
+  static_assert(N_FEATURES == SIGNAL_COUNT, "svm_model.h must use the three telemetry features");
+  svm.load(SUPPORT_VECTORS, DUAL_COEF, N_SUPPORT_VECTORS, SCALER_MEAN, SCALER_SCALE, SVM_GAMMA, SVM_INTERCEPT);
+#endif
+
+  if (labelsPath && !readLabels(labelsPath)) return 1;
+
+  std::vector<Shard> shards;
+  for (const char* path : paths) {
+    if (!addShards(path, shards)) return 1;
+  }
+  if (shards.empty()) {
+    fprintf(stderr, "no CSV or segment files found\n");
+    return 1;
+  }
+  // Biggest first, so the small shards are left to even out the end
+  std::stable_sort(shards.begin(), shards.end(), [](const Shard& a, const Shard& b) { return a.bytes > b.bytes; });
+
+  // A shared baseline from the fault-free rows of --train
+  RunningStats shared[SIGNAL_COUNT];
+  if (trainPath) {
+    size_t skipLeft = skip;
+    bool ok = readCsv(trainPath, [&](const Row* rows, size_t count) {
+      for (size_t r = 0; r < count; r++) {
+        if (skipLeft) {
+          skipLeft--;
+          continue;
+        }
+        if (rows[r].faults || shared[0].count() >= trainSamples) continue;
+        for (int s = 0; s < SIGNAL_COUNT; s++) shared[s].add(rows[r].values[s]);
+      }
+    });
+    if (!ok) return 1;
+    if (shared[0].count() < 2) {
+      fprintf(stderr, "%s: not enough fault-free rows to train on\n", trainPath);
+      return 1;
+    }
+  }
+
+  const std::vector<Config> configs = buildGrid();
+  WorkStealingPool pool(threads);
+  std::vector<Result> results(pool.threads(), Result(configs.size()));
+
+  auto t0 = std::chrono::steady_clock::now();
+  pool.run(shards.size(), [&](size_t index, unsigned worker) {
+    const Shard& shard = shards[index];
+    Result& result = results[worker];
+    ShardEvaluator evaluator(configs, trainPath ? shared : nullptr, trainSamples, skip, result);
+    auto sink = [&](const Row* rows, size_t count) { evaluator.feed(rows, count); };
+    bool ok = shard.segment ? readSegment(shard.path, sink) : readCsv(shard.path, sink);
+    evaluator.finish();
+    if (!ok) result.failed++;
+  });
+  auto t1 = std::chrono::steady_clock::now();
+
+  Result total(configs.size());
+  for (const Result& r : results) total += r;
+  double seconds = std::chrono::duration<double>(t1 - t0).count();
+  uint64_t bytes = 0;
+  for (const Shard& s : shards) bytes += s.bytes;
+
+  printf("%zu shards (%.1f MB), %u threads, %llu steals: %llu rows scored, %llu training rows, %.2f s "
+         "(%.2f M rows/s, %zu configurations)\n",
+         shards.size(), bytes / 1e6, pool.threads(), (unsigned long long)pool.steals(),
+         (unsigned long long)total.rows, (unsigned long long)total.trainRows, seconds,
+         (total.rows + total.trainRows) / seconds / 1e6, configs.size());
+  if (total.untrained) printf("%u shards ended before --train-samples fault-free rows\n", total.untrained);
+  if (total.failed) printf("%u shards could not be read\n", total.failed);
+
+  // --- Confusion matrices (any signal flagged) ---
+  printf("\n| Configuration | TP | FP | FN | TN | Precision | Recall | F1 | FPR |\n");
+  printf("| :--- | ---: | ---: | ---: | ---: | ---: | ---: | ---: | ---: |\n");
+  size_t best[KIND_COUNT];
+  bool hasBest[KIND_COUNT] = {};
+  for (size_t c = 0; c < configs.size(); c++) {
+    const ConfusionMatrix& m = total.matrices[c * SCOPES + SIGNAL_COUNT];
+    printf("| %s | %llu | %llu | %llu | %llu | %.1f%% | %.1f%% | %.1f%% | %.2f%% |\n", configs[c].name.c_str(),
+           (unsigned long long)m.tp, (unsigned long long)m.fp, (unsigned long long)m.fn, (unsigned long long)m.tn,
+           100 * m.precision(), 100 * m.recall(), 100 * m.f1(), 100 * m.falsePositiveRate());
+    Kind kind = configs[c].kind;
+    if (!hasBest[kind] || m.f1() > total.matrices[best[kind] * SCOPES + SIGNAL_COUNT].f1()) {
+      best[kind] = c;
+      hasBest[kind] = true;
+    }
+  }
+
+  // --- Detection latency of the best configuration of each kind ---
+  if (faultNames.empty()) {
+    printf("\nNo faults in the data: only false positives were scored.\n");
+  } else {
+    printf("\nPer fault: episodes caught and median/p90 seconds to the first flag, best F1 of each kind\n\n");
+    printf("| Fault | Episodes |");
+    for (int k = 0; k < KIND_COUNT; k++) {
+      if (hasBest[k]) printf(" %s |", configs[best[k]].name.c_str());
+    }
+    printf("\n| :--- | ---: |");
+    for (int k = 0; k < KIND_COUNT; k++) {
+      if (hasBest[k]) printf(" ---: |");
+    }
+    printf("\n");
+    for (size_t f = 0; f < faultNames.size(); f++) {
+      printf("| %s | %u |", faultNames[f].c_str(), total.episodes[f]);
+      for (int k = 0; k < KIND_COUNT; k++) {
+        if (!hasBest[k]) continue;
+        std::vector<float>& latencies = total.latencies[best[k] * MAX_FAULTS + f];
+        if (latencies.empty()) printf(" 0/%u |", total.episodes[f]);
+        else {
+          printf(" %zu/%u, %.0f/%.0f s |", latencies.size(), total.episodes[f], percentile(latencies, 0.5),
+                 percentile(latencies, 0.9));
+        }
+      }
+      printf("\n");
+    }
+  }
+
+  if (csvPath) {
+    FILE* out = fopen(csvPath, "w");
+    if (!out) {
+      perror(csvPath);
+      return 1;
+    }
+    writeCsv(out, configs, total);
+    fclose(out);
+    printf("\nEvery configuration, per signal and per fault: %s\n", csvPath);
+  }
+  return total.failed ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+// Google Benchmark suite for the firmware's hot paths, built on the host
+// against the Linux HAL's simulated clock. Every control-path function that
+// runs per step, per interrupt or per message has a case here, so a
+// regression shows up as a diff between two result files:
+//
+//   bioreactor_bench --benchmark_out=before.json --benchmark_out_format=json
+//   (change, rebuild)
+//   bioreactor_bench --benchmark_out=after.json --benchmark_out_format=json
+//   python3 host/bench_compare.py before.json after.json
+//
+// `cmake --build build --target bench_json` writes build/bench.json (five
+// repetitions, aggregates only).
+// JSON cases time the ArduinoJson the host build was configured with.
+
+#include "ControlLoop.hpp"
+#include "Controller.hpp"
+#include "Filters.hpp"
+#include "HalLinux.hpp"
+#include "MqttQueue.hpp"
+#include "PHSubsystem.hpp"
+#include "PhCalibration.hpp"
+#include "StirringSubsystem.hpp"
+#include "TelemetryFrame.hpp"
+#include "heatingSubsystem.hpp"
+#include <ArduinoJson.h>
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+// Hall edge spacing at 1000 rpm and 70 pulses per revolution
+static const uint64_t HALL_PERIOD_US = 857;
+
+// -------------------------------------------------------------
+// Filters and fits
+// -------------------------------------------------------------
+
+// One pH step's burst: 16 raw readings, quartiles trimmed (was get_average())
+static void BM_PhBurstTrimmedMean(benchmark::State& state) {
+  static const uint16_t RAW[16] = {512, 515, 509, 511, 530, 508, 512, 514, 490, 513, 511, 512, 516, 510, 509, 513};
+  uint16_t burst[16];
+  for (auto _ : state) {
+    memcpy(burst, RAW, sizeof(burst));
+    benchmark::DoNotOptimize(trimmedMean(burst, 16, 4));
+  }
+}
+BENCHMARK(BM_PhBurstTrimmedMean);
+
+static void BM_PhRunningMedian(benchmark::State& state) {
+  RunningMedian<float, 5> median;
+  float v = 1.6f;
+  for (auto _ : state) {
+    v = v < 1.7f ? v + 0.013f : 1.6f;
+    benchmark::DoNotOptimize(median.update(v));
+  }
+}
+BENCHMARK(BM_PhRunningMedian);
+
+// pH calibration fit over 2..5 points (was simpLinReg())
+static void BM_WeightedLinReg(benchmark::State& state) {
+  const int n = (int)state.range(0);
+  float x[PH_CAL_MAX_POINTS] = {2.95f, 2.49f, 1.98f, 1.52f, 1.01f};
+  float y[PH_CAL_MAX_POINTS] = {4.0f, 5.0f, 7.0f, 9.0f, 10.0f};
+  float w[PH_CAL_MAX_POINTS] = {1e6f, 2e6f, 1e6f, 5e5f, 1e6f};
+  float slope, offset;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(weightedLinReg(x, y, w, n, slope, offset));
+    benchmark::DoNotOptimize(slope);
+  }
+}
+BENCHMARK(BM_WeightedLinReg)->DenseRange(2, PH_CAL_MAX_POINTS);
+
+// The stability judgement of a calibration point: a fit over a full window
+static void BM_PhCalibrationWindow(benchmark::State& state) {
+  static PhCalibration cal;
+  cal.start(PhCalConfig{100, 1e-9f, 1e-9f, 0xFFFFFFFF}); // Limits never met: the window is judged every sample
+  cal.beginPoint(7.0f, 0);
+  uint32_t nowMs = 0;
+  for (int i = 0; i < PH_CAL_WINDOW; i++) cal.update(1.5f + 0.001f * (i % 7), nowMs += 100);
+  for (auto _ : state) {
+    nowMs += 100;
+    benchmark::DoNotOptimize(cal.update(1.5f + 0.001f * (nowMs % 7), nowMs));
+  }
+}
+BENCHMARK(BM_PhCalibrationWindow);
+
+// -------------------------------------------------------------
+// Conversions and controllers
+// -------------------------------------------------------------
+
+// ADC code to degC through the thermistor table, across its range
+static void BM_ThermistorConvert(benchmark::State& state) {
+  float code = (float)HEATING_THERMISTOR.minCode();
+  const float maxCode = (float)HEATING_THERMISTOR.maxCode();
+  for (auto _ : state) {
+    float celsius = 0;
+    benchmark::DoNotOptimize(HEATING_THERMISTOR.convert(code, celsius));
+    benchmark::DoNotOptimize(celsius);
+    code += 7.3f;
+    if (code > maxCode) code = (float)HEATING_THERMISTOR.minCode(); // Stays in range, no out-of-range path
+  }
+}
+BENCHMARK(BM_ThermistorConvert);
+
+// The shape of the stirring loop: PI with soft-start slew and anti-windup
+struct BenchPiPolicy {
+  typedef float Value;
+  static constexpr float KP = 0.004f;
+  static constexpr float KI = 0.027f;
+  static constexpr float KD = 0;
+  static constexpr float OUT_MIN = 0;
+  static constexpr float OUT_MAX = 5.0f;
+  static constexpr float SLEW = 24.4f;
+  static constexpr float TRACKING = 6.7f;
+};
+
+static void BM_PiStep(benchmark::State& state) {
+  Controller<BenchPiPolicy> pi;
+  float measurement = 900;
+  for (auto _ : state) {
+    float out = pi.update(1000, measurement, 0.01f);
+    measurement += (out * 250 - measurement) * 0.066f;
+    benchmark::DoNotOptimize(out);
+  }
+}
+BENCHMARK(BM_PiStep);
+
+// -------------------------------------------------------------
+// Interrupt and control tasks
+// -------------------------------------------------------------
+
+// Hall sensor ISR body, one edge per call
+static void BM_Tsense(benchmark::State& state) {
+  for (auto _ : state) {
+    halSimAdvanceUs(HALL_PERIOD_US);
+    Tsense();
+  }
+}
+BENCHMARK(BM_Tsense);
+
+// One 10 ms stirring step: RPM estimate and PI. Includes the Hall edges of
+// those 10 ms (about 12 Tsense() calls; see BM_Tsense for their share).
+static void BM_ExecuteStirring(benchmark::State& state) {
+  setspeed = 1000;
+  for (auto _ : state) {
+    for (uint64_t t = 0; t < 10000; t += HALL_PERIOD_US) {
+      halSimAdvanceUs(HALL_PERIOD_US);
+      Tsense();
+    }
+    executeStirring();
+  }
+}
+BENCHMARK(BM_ExecuteStirring);
+
+// One 10 ms pH step: ADC burst, filters, voltage to pH, pump decision every tenth
+static void BM_ExecutePH(benchmark::State& state) {
+  for (auto _ : state) {
+    halSimAdvanceUs(10000);
+    executePH();
+  }
+}
+BENCHMARK(BM_ExecutePH);
+
+// One 100 ms heating step: ADC burst, thermistor conversion, PI
+static void BM_ExecuteHeating(benchmark::State& state) {
+  for (auto _ : state) {
+    halSimAdvanceUs(100000);
+    executeHeating();
+  }
+}
+BENCHMARK(BM_ExecuteHeating);
+
+static void BM_TelemetrySample(benchmark::State& state) {
+  TelemetrySample sample;
+  for (auto _ : state) {
+    getTelemetrySample(sample);
+    benchmark::DoNotOptimize(sample);
+  }
+}
+BENCHMARK(BM_TelemetrySample);
+
+// -------------------------------------------------------------
+// Messages
+// -------------------------------------------------------------
+
+// The subsystems' part of the JSON status, as publishTelemetry() builds it
+static void BM_StatusJsonBuild(benchmark::State& state) {
+  for (auto _ : state) {
+    StaticJsonDocument<1024> doc;
+    JsonObject root = doc.to<JsonObject>();
+    getPHStatus(root);
+    getStirringStatus(root);
+    getHeatingStatus(root);
+    root["operational_mode"] = is_system_active;
+    benchmark::DoNotOptimize(doc);
+  }
+}
+BENCHMARK(BM_StatusJsonBuild);
+
+static void BM_StatusJsonSerialize(benchmark::State& state) {
+  StaticJsonDocument<1024> doc;
+  JsonObject root = doc.to<JsonObject>();
+  getPHStatus(root);
+  getStirringStatus(root);
+  getHeatingStatus(root);
+  root["operational_mode"] = is_system_active;
+  char buffer[1024];
+  size_t bytes = 0;
+  for (auto _ : state) {
+    bytes = serializeJson(doc, buffer, sizeof(buffer));
+    benchmark::DoNotOptimize(buffer);
+  }
+  state.SetBytesProcessed((int64_t)state.iterations() * bytes);
+}
+BENCHMARK(BM_StatusJsonSerialize);
+
+// A batch of 50 samples into one binary frame, as publishHistory() does
+static void BM_TelemetryFrameEncode(benchmark::State& state) {
+  TelemetrySample samples[50];
+  for (int i = 0; i < 50; i++) {
+    getTelemetrySample(samples[i]);
+    samples[i].timeUs = 1700000000000000ULL + i * 100000ULL + (i % 3) * 7;
+    samples[i].tempCentiC = (int16_t)(3500 + i % 4);
+    samples[i].rpm = (int16_t)(1000 + (i * 7) % 11 - 5);
+  }
+  uint8_t frame[telemetryFrameCapacity(50)];
+  size_t length = 0;
+  for (auto _ : state) {
+    length = encodeTelemetryFrame(samples, 50, frame, sizeof(frame));
+    benchmark::DoNotOptimize(frame);
+  }
+  state.SetItemsProcessed(state.iterations() * 50);
+  state.counters["bytes_per_sample"] = length / 50.0;
+}
+BENCHMARK(BM_TelemetryFrameEncode);
+
+// Deserialize only: the parse processInbox() does before dispatch
+static void BM_AttributeDeserialize(benchmark::State& state) {
+  static const char PAYLOAD[] =
+      "{\"operational_mode\": true, \"target_pH\": 6.5, \"target_rpm\": 800, "
+      "\"target_temperature\": 35.0}";
+  for (auto _ : state) {
+    StaticJsonDocument<512> doc;
+    benchmark::DoNotOptimize(deserializeJson(doc, PAYLOAD, sizeof(PAYLOAD) - 1));
+    benchmark::DoNotOptimize(doc);
+  }
+}
+BENCHMARK(BM_AttributeDeserialize);
+
+static MqttQueue inbox;
+static MqttQueue outboxQueue;
+static MqttOutbox outbox(outboxQueue);
+static MqttMessage drained;
+
+// One message as the control loop sees it; the response is drained as the
+// network task would
+static void deliver(const char* topic, const char* payload, size_t length) {
+  mqttEnqueue(inbox, topic, (const uint8_t*)payload, length);
+  processInbox(inbox, outbox);
+  while (outboxQueue.pop(drained)) {
+  }
+}
+
+// A whole shared-attribute update: queued, parsed and dispatched to the subsystems
+static void BM_AttributeUpdate(benchmark::State& state) {
+  static const char PAYLOAD[] =
+      "{\"operational_mode\": true, \"target_pH\": 6.5, \"target_rpm\": 800, "
+      "\"target_temperature\": 35.0}";
+  for (auto _ : state) deliver("v1/devices/me/attributes", PAYLOAD, sizeof(PAYLOAD) - 1);
+}
+BENCHMARK(BM_AttributeUpdate);
+
+// An RPC with its response
+static void BM_RpcSetPump(benchmark::State& state) {
+  static const char PAYLOAD[] = "{\"method\": \"setPump\", \"params\": {\"pump\": \"base\", \"duration\": 200}}";
+  for (auto _ : state) deliver("v1/devices/me/rpc/request/7", PAYLOAD, sizeof(PAYLOAD) - 1);
+}
+BENCHMARK(BM_RpcSetPump);
+
+int main(int argc, char** argv) {
+  halSimSetLogEnabled(false);
+  // Mid-scale pH probe and a thermistor near 35 C, as in bioreactor_host
+  halSimSetAdc(A4, 512);
+  halSimSetAdc(A5, 1394);
+  setupControl();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
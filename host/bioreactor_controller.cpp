@@ -0,0 +1,107 @@
+// Controller<Policy> step test: drives a first-order motor model (the
+// nominal Kv and T of StirringSubsystem.cpp) through a 0 -> 1000 RPM step
+// and a 1000 -> 500 RPM step with P, PI and PID policies, in float and in
+// Q15.16 fixed point, and reports settling time, overshoot and steady-state
+// error. The "no tracking" rows show the windup that back-calculation removes.
+//
+// Usage: bioreactor_controller
+
+#include "Controller.hpp"
+#include <cmath>
+#include <cstdio>
+
+constexpr float KV = 250;   // RPM per volt
+constexpr float TAU = 0.15; // s
+constexpr float DT = 0.01;  // 10 ms control step
+constexpr float SUPPLY_V = 5;
+
+template <typename V>
+struct PiBase {
+  typedef V Value;
+  static constexpr Value KP = 0.004;  // Gains of StirringSubsystem.cpp
+  static constexpr Value KI = 0.02667;
+  static constexpr Value KD = 0;
+  static constexpr Value OUT_MIN = 0;
+  static constexpr Value OUT_MAX = SUPPLY_V;
+  static constexpr Value SLEW = 24.4;
+  static constexpr Value TRACKING = 1 / TAU;
+};
+
+template <typename V>
+struct PBase : PiBase<V> {
+  static constexpr V KP = 0.04;
+  static constexpr V KI = 0;
+};
+
+template <typename V>
+struct PidBase : PiBase<V> {
+  static constexpr V KD = 0.0002;
+};
+
+template <typename V>
+struct PiNoTracking : PiBase<V> {
+  static constexpr V TRACKING = 0;
+};
+
+template <typename V>
+static float toFloat(V v) {
+  return (float)v;
+}
+
+struct StepResult {
+  float settleS;
+  float overshoot;
+  float finalError;
+};
+
+// Runs one setpoint step from the steady state at `from` and scores it.
+template <typename Policy>
+static StepResult runStep(float from, float to, float* trace, int steps) {
+  typedef typename Policy::Value V;
+  Controller<Policy> controller;
+  float rpm = from;
+  controller.reset(V(from / KV)); // Bumpless start at the old speed
+
+  StepResult r = {0, 0, 0};
+  float band = 0.02f * fabsf(to - from);
+  for (int i = 0; i < steps; i++) {
+    float volts = toFloat(controller.update(V(to), V(rpm), V(DT)));
+    rpm += (KV * volts - rpm) * (DT / TAU);
+    trace[i] = volts;
+
+    float past = (to > from) ? rpm - to : to - rpm;
+    if (past > r.overshoot) r.overshoot = past;
+    if (fabsf(rpm - to) > band) r.settleS = (i + 1) * DT;
+  }
+  r.finalError = rpm - to;
+  return r;
+}
+
+template <template <typename> class Policy>
+static void compare(const char* name, float from, float to) {
+  const int steps = 500; // 5 s
+  static float floatTrace[steps];
+  static float fixedTrace[steps];
+  StepResult f = runStep<Policy<float>>(from, to, floatTrace, steps);
+  StepResult q = runStep<Policy<Fixed<16>>>(from, to, fixedTrace, steps);
+
+  float maxDiff = 0;
+  for (int i = 0; i < steps; i++) maxDiff = fmaxf(maxDiff, fabsf(floatTrace[i] - fixedTrace[i]));
+
+  printf("%-14s %5.0f->%-5.0f %8.2f %8.2f %9.1f %9.1f %9.2f %9.2f %10.4f\n", name, from, to,
+         f.settleS, q.settleS, f.overshoot, q.overshoot, f.finalError, q.finalError, maxDiff);
+}
+
+int main() {
+  printf("%-14s %11s %8s %8s %9s %9s %9s %9s %10s\n", "policy", "step rpm", "settle", "(Q16)",
+         "overshoot", "(Q16)", "error", "(Q16)", "max |dV|");
+  for (int dir = 0; dir < 2; dir++) {
+    float from = dir == 0 ? 0 : 1000;
+    float to = dir == 0 ? 1000 : 500;
+    compare<PBase>("P", from, to);
+    compare<PiBase>("PI", from, to);
+    compare<PidBase>("PID", from, to);
+    compare<PiNoTracking>("PI no tracking", from, to);
+  }
+  return 0;
+}
@@ -0,0 +1,179 @@
+// Attribute/RPC dispatch benchmark: pushes ThingsBoard messages through
+// processInbox() exactly as the network task queues them and reports
+// messages per second, next to the containsKey() chain the subsystems used
+// before the dispatch tables. Also counts heap allocations (glibc malloc is
+// interposed) and fails if dispatchAttributes()/dispatchRpc(), including the
+// response formatting and the outbox, allocate at all.
+//
+// Usage: bioreactor_dispatch [--seconds S]   (per case, default 0.2)
+//
+// Parsing is reported separately: ArduinoJson's StaticJsonDocument parses
+// into its own pool, so any allocation there comes from the ArduinoJson build
+// the host was configured with.
+
+#include "ControlLoop.hpp"
+#include "HalLinux.hpp"
+#include "MqttQueue.hpp"
+#include "PHSubsystem.hpp"
+#include "StirringSubsystem.hpp"
+#include "heatingSubsystem.hpp"
+#include <ArduinoJson.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- Allocation counter ---
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static bool counting = false;
+static long allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+  if (counting) allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  if (counting) allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+  if (counting) allocations++;
+  return __libc_realloc(ptr, size);
+}
+
+// --- Messages ---
+struct Case {
+  const char* name;
+  const char* topic;
+  const char* payload;
+};
+
+static const Case CASES[] = {
+  {"attributes (6 keys)", "v1/devices/me/attributes",
+   "{\"operational_mode\": true, \"target_pH\": 6.5, \"pH_tolerance\": 0.3, \"target_rpm\": 800, "
+   "\"target_temperature\": 35.0, \"temp_tolerance\": 0.5}"},
+  {"attributes (shared response)", "v1/devices/me/attributes/response/1",
+   "{\"shared\": {\"target_pH\": 6.5, \"target_rpm\": 800, \"target_temperature\": 35.0}}"},
+  {"attributes (1 key)", "v1/devices/me/attributes", "{\"target_rpm\": 1000}"},
+  {"attributes (unknown keys)", "v1/devices/me/attributes", "{\"colour\": \"blue\", \"owner\": 7}"},
+  {"rpc setPump", "v1/devices/me/rpc/request/41", "{\"method\": \"setPump\", \"params\": {\"pump\": \"acid\", \"duration\": 200}}"},
+  {"rpc cancelPump", "v1/devices/me/rpc/request/42", "{\"method\": \"cancelPump\", \"params\": {\"pump\": \"all\"}}"},
+  {"rpc setTemperature", "v1/devices/me/rpc/request/43", "{\"method\": \"setTemperature\", \"params\": 36.5}"},
+  {"rpc unknown method", "v1/devices/me/rpc/request/44", "{\"method\": \"reboot\", \"params\": {}}"},
+};
+
+static MqttQueue inbox;
+static MqttQueue outboxQueue;
+static MqttOutbox outbox(outboxQueue);
+static MqttMessage drained;
+
+static bool isRpc(const Case& c) {
+  return strncmp(c.topic, RPC_REQUEST_PREFIX, sizeof(RPC_REQUEST_PREFIX) - 1) == 0;
+}
+
+// One message as the control loop sees it; the response is drained as the
+// network task would
+static void deliver(const Case& c) {
+  mqttEnqueue(inbox, c.topic, (const uint8_t*)c.payload, strlen(c.payload));
+  processInbox(inbox, outbox);
+  while (outboxQueue.pop(drained)) {
+  }
+}
+
+// The dispatch before the tables: every subsystem probes its keys in turn
+static void containsKeyChain(JsonObject& doc) {
+  if (doc.containsKey("operational_mode")) is_system_active = doc["operational_mode"];
+  if (doc.containsKey("target_pH")) onTargetPH(doc["target_pH"]);
+  if (doc.containsKey("pH_tolerance")) onPHTolerance(doc["pH_tolerance"]);
+  if (doc.containsKey("target_rpm")) onTargetRpm(doc["target_rpm"]);
+  if (doc.containsKey("target_temperature")) onTargetTemperature(doc["target_temperature"]);
+}
+
+template <typename F>
+static double ratePerSecond(double seconds, F&& run) {
+  using Clock = std::chrono::steady_clock;
+  long n = 0;
+  auto start = Clock::now();
+  double elapsed = 0;
+  while (elapsed < seconds) {
+    for (int i = 0; i < 256; i++) run();
+    n += 256;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return n / elapsed;
+}
+
+int main(int argc, char** argv) {
+  double seconds = 0.2;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [--seconds S]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  halSimReset();
+  halSimSetLogEnabled(false);
+  setupControl();
+  is_system_active = true;
+
+  printf("%-30s %12s %12s %14s %14s\n", "message", "msgs/s", "chain msgs/s", "allocs parse", "allocs dispatch");
+
+  long dispatchAllocations = 0;
+  for (const Case& c : CASES) {
+    double rate = ratePerSecond(seconds, [&] { deliver(c); });
+
+    // Allocations, parse and dispatch counted apart
+    StaticJsonDocument<500> doc;
+    counting = true;
+    allocations = 0;
+    deserializeJson(doc, c.payload);
+    long parse = allocations;
+
+    allocations = 0;
+    if (isRpc(c)) {
+      RpcContext rpc(outbox, c.topic + sizeof(RPC_REQUEST_PREFIX) - 1);
+      dispatchRpc(rpc, doc.as<JsonObject>());
+    } else {
+      JsonObject shared = doc["shared"];
+      dispatchAttributes(shared.isNull() ? doc.as<JsonObject>() : shared);
+    }
+    long dispatch = allocations;
+    counting = false;
+    while (outboxQueue.pop(drained)) {
+    }
+    dispatchAllocations += dispatch;
+
+    char chain[16] = "-";
+    if (!isRpc(c) && strcmp(c.topic, "v1/devices/me/attributes") == 0) {
+      double chainRate = ratePerSecond(seconds, [&] {
+        mqttEnqueue(inbox, c.topic, (const uint8_t*)c.payload, strlen(c.payload));
+        inbox.pop(drained);
+        StaticJsonDocument<500> chainDoc;
+        deserializeJson(chainDoc, drained.payload, drained.length);
+        JsonObject shared = chainDoc.as<JsonObject>();
+        containsKeyChain(shared);
+      });
+      snprintf(chain, sizeof(chain), "%.0f", chainRate);
+    }
+    printf("%-30s %12.0f %12s %14ld %14ld\n", c.name, rate, chain, parse, dispatch);
+  }
+
+  if (outbox.dropped()) {
+    printf("FAIL: %u responses dropped\n", (unsigned)outbox.dropped());
+    return 1;
+  }
+  if (dispatchAllocations) {
+    printf("FAIL: the dispatch path allocated %ld times\n", dispatchAllocations);
+    return 1;
+  }
+  printf("dispatch path: no heap allocations\n");
+  return 0;
+}
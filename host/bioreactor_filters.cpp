@@ -0,0 +1,179 @@
+// ADC filter benchmark: feeds the filter chains of main/Filters.hpp with a
+// synthetic sensor signal (slow sine + Gaussian noise + occasional spikes) and
+// reports the error against the noise-free signal and the CPU cost per
+// filtered value, next to the single read and the old 10-sample average.
+//
+// Usage: bioreactor_filters [--steps N] [--noise LSB] [--spikes P] [--seed S]
+//
+// One step is one control call (10 ms for pH); a chain reading a burst of k
+// samples consumes k raw samples per step.
+
+#include "Filters.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static const int MAX_BURST = 32;
+
+struct Input {
+  std::vector<float> truth;     // Noise-free ADC code per step
+  std::vector<uint16_t> raw;    // MAX_BURST raw samples per step
+};
+
+struct Result {
+  const char* name;
+  int samplesPerStep;
+  double ns;
+  std::vector<float> out;
+};
+
+// Old PHSubsystem get_average(): mean of 10 without one min and one max
+static float dropMinMaxAverage(const float* arr, int length) {
+  float min = arr[0] < arr[1] ? arr[0] : arr[1];
+  float max = arr[0] < arr[1] ? arr[1] : arr[0];
+  float amount = 0;
+  for (int i = 2; i < length; i++) {
+    if (arr[i] < min) {
+      amount += min;
+      min = arr[i];
+    } else if (arr[i] > max) {
+      amount += max;
+      max = arr[i];
+    } else {
+      amount += arr[i];
+    }
+  }
+  return amount / (length - 2);
+}
+
+template <typename F>
+static Result run(const char* name, int samplesPerStep, const Input& in, F filter) {
+  size_t steps = in.truth.size();
+  Result r{name, samplesPerStep, 0, std::vector<float>(steps)};
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < steps; i++) {
+    r.out[i] = filter(&in.raw[i * MAX_BURST]);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  r.ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / steps;
+  return r;
+}
+
+int main(int argc, char** argv) {
+  long steps = 200000;
+  double noiseLsb = 4;
+  double spikeP = 0.002;
+  unsigned seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--steps") && hasValue) steps = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--noise") && hasValue) noiseLsb = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--spikes") && hasValue) spikeP = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && hasValue) seed = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--steps N] [--noise LSB] [--spikes P] [--seed S]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (steps < 100) steps = 100;
+
+  // --- Input: a 10-minute sine around mid-scale, sampled at 10 ms steps ---
+  Input in;
+  in.truth.resize(steps);
+  in.raw.resize(steps * MAX_BURST);
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0, noiseLsb);
+  std::uniform_real_distribution<double> unit(0, 1);
+
+  for (long i = 0; i < steps; i++) {
+    double truth = 2000 + 300 * sin(2 * M_PI * i / 60000.0);
+    in.truth[i] = (float)truth;
+    for (int k = 0; k < MAX_BURST; k++) {
+      double code = truth + noise(rng);
+      if (unit(rng) < spikeP) code += (unit(rng) < 0.5 ? -1 : 1) * (100 + 700 * unit(rng));
+      code = code < 0 ? 0 : (code > 4095 ? 4095 : code);
+      in.raw[i * MAX_BURST + k] = (uint16_t)lround(code);
+    }
+  }
+
+  // --- Chains ---
+  std::vector<Result> results;
+
+  results.push_back(run("single read", 1, in, [](const uint16_t* s) { return (float)s[0]; }));
+
+  {
+    float window[10];
+    int index = 0;
+    float held = 0;
+    results.push_back(run("old: 10 reads, drop min/max", 1, in, [&](const uint16_t* s) {
+      window[index++] = s[0];
+      if (index == 10) {
+        held = dropMinMaxAverage(window, 10);
+        index = 0;
+      }
+      return held;
+    }));
+  }
+
+  results.push_back(run("burst 16, IQ mean", 16, in, [](const uint16_t* s) {
+    uint16_t burst[16];
+    memcpy(burst, s, sizeof(burst));
+    return trimmedMean(burst, 16, 4);
+  }));
+
+  {
+    RunningMedian<float, 5> median;
+    results.push_back(run("pH: burst 16, IQ mean, median 5", 16, in, [&](const uint16_t* s) {
+      uint16_t burst[16];
+      memcpy(burst, s, sizeof(burst));
+      return median.update(trimmedMean(burst, 16, 4));
+    }));
+  }
+
+  {
+    Ema ema(0.5f);
+    results.push_back(run("heating: burst 32, IQ mean, EMA 0.5", 32, in, [&](const uint16_t* s) {
+      uint16_t burst[32];
+      memcpy(burst, s, sizeof(burst));
+      return ema.update(trimmedMean(burst, 32, 8));
+    }));
+  }
+
+  {
+    RunningMedian<uint16_t, 31> median;
+    results.push_back(run("running median 31", 1, in, [&](const uint16_t* s) { return median.update(s[0]); }));
+  }
+
+  {
+    RunningTrimmedMean<uint16_t, 32, 8> trimmed;
+    results.push_back(run("running trimmed mean 32/8", 1, in, [&](const uint16_t* s) { return trimmed.update(s[0]); }));
+  }
+
+  {
+    Ema ema(0.1f);
+    results.push_back(run("EMA 0.1", 1, in, [&](const uint16_t* s) { return ema.update(s[0]); }));
+  }
+
+  // --- Report (the first 100 steps are start-up and not scored) ---
+  printf("%ld steps, noise %.1f LSB (1 sigma), spike probability %.4f per sample\n", steps, noiseLsb, spikeP);
+  printf("%-38s %8s %9s %9s %10s %14s\n", "chain", "samples", "rms_lsb", "max_lsb", "ns/value", "samples/s");
+  for (const Result& r : results) {
+    double sumSq = 0, maxErr = 0;
+    for (long i = 100; i < steps; i++) {
+      double err = fabs(r.out[i] - in.truth[i]);
+      sumSq += err * err;
+      if (err > maxErr) maxErr = err;
+    }
+    printf("%-38s %8d %9.2f %9.1f %10.1f %14.3g\n", r.name, r.samplesPerStep, sqrt(sumSq / (steps - 100)), maxErr,
+           r.ns, r.samplesPerStep * 1e9 / r.ns);
+  }
+
+  return 0;
+}
@@ -0,0 +1,563 @@
+// Edge gateway for a fleet of reactors (MqttGateway.hpp): the reactors
+// connect to it instead of ThingsBoard, and it forwards their telemetry,
+// attributes and RPC over a few batched connections as one ThingsBoard
+// gateway device.
+//
+//   run   (default) serves the reactors until SIGINT/SIGTERM, printing
+//         throughput every --stats-s
+//   bench runs the gateway in-process between --devices simulated reactors
+//         publishing JSON telemetry at --hz and the MqttBroker stand-in, with
+//         a subscriber that sends RPCs to the reactors and times everything
+//         that comes out upstream
+//
+// Usage: bioreactor_gateway --upstream HOST:PORT [--listen [ADDR:]PORT] [--user TOKEN] [--client-id ID]
+//                           [--connections K] [--threads N] [--batch-ms MS] [--identity client-id|username]
+//                           [--stats-s S]
+//        bioreactor_gateway bench [--devices N] [--hz F] [--seconds S] [--rpc-hz F] [--duplicates N]
+//                           [--connections K] [--threads N] [--batch-ms MS]
+//
+// --upstream is ThingsBoard (or any broker) and --user the access token of
+// the gateway device there. The reactors need their own identity: their
+// MQTT client ID (main.ino derives it from the MAC), or with
+// --identity username their access token.
+
+#include "MqttBroker.hpp"
+#include "MqttClient.hpp"
+#include "MqttGateway.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static std::atomic<bool> running(true);
+
+static void onSignal(int) {
+  running = false;
+}
+
+static uint64_t monotonicUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s --upstream HOST:PORT [--listen [ADDR:]PORT] [--user TOKEN] [--client-id ID]\n"
+          "          [--connections K] [--threads N] [--batch-ms MS] [--identity client-id|username]\n"
+          "          [--stats-s S]\n"
+          "       %s bench [--devices N] [--hz F] [--seconds S] [--rpc-hz F] [--duplicates N]\n"
+          "          [--connections K] [--threads N] [--batch-ms MS]\n",
+          argv0, argv0);
+}
+
+// -------------------------------------------------------------
+// run
+// -------------------------------------------------------------
+static int runGateway(int argc, char** argv) {
+  MqttGatewayConfig config;
+  const char* upstream = nullptr;
+  const char* listenOn = "0.0.0.0:1883";
+  double statsS = 10;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--upstream") && hasValue) upstream = argv[++i];
+    else if (!strcmp(argv[i], "--listen") && hasValue) listenOn = argv[++i];
+    else if (!strcmp(argv[i], "--user") && hasValue) config.upstreamUser = argv[++i];
+    else if (!strcmp(argv[i], "--client-id") && hasValue) config.upstreamClientId = argv[++i];
+    else if (!strcmp(argv[i], "--connections") && hasValue) config.upstreamConnections = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && hasValue) config.ioThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--batch-ms") && hasValue) config.batchMs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--stats-s") && hasValue) statsS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--identity") && hasValue) {
+      i++;
+      if (!strcmp(argv[i], "username")) config.identityFromUsername = true;
+      else if (strcmp(argv[i], "client-id") != 0) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  const char* colon = upstream ? strrchr(upstream, ':') : nullptr;
+  if (!colon || config.batchMs < 1 || config.upstreamConnections < 1 || statsS <= 0) {
+    usage(argv[0]);
+    return 2;
+  }
+  config.upstreamHost.assign(upstream, colon - upstream);
+  config.upstreamPort = (uint16_t)atoi(colon + 1);
+  const char* listenColon = strrchr(listenOn, ':');
+  if (listenColon) config.listenAddress.assign(listenOn, listenColon - listenOn);
+  config.listenPort = (uint16_t)atoi(listenColon ? listenColon + 1 : listenOn);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  MqttGateway gateway;
+  if (!gateway.start(config)) {
+    perror("listen");
+    return 1;
+  }
+  printf("gateway on %s:%u, %d I/O threads, %d upstream connections to %s:%u\n", config.listenAddress.c_str(),
+         gateway.port(), gateway.ioThreads(), config.upstreamConnections, config.upstreamHost.c_str(),
+         config.upstreamPort);
+
+  MqttGatewayStats last = gateway.stats();
+  auto lastTime = std::chrono::steady_clock::now();
+  while (running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - lastTime).count();
+    if (elapsed < statsS) continue;
+    MqttGatewayStats s = gateway.stats();
+    printf("%llu devices (%llu takeovers), %.0f msg/s in, %.1f publishes/s up (%.0f msg/s), %llu down, "
+           "%llu undeliverable, %llu dropped\n",
+           (unsigned long long)s.devices, (unsigned long long)s.takeovers, (s.received - last.received) / elapsed,
+           (s.upstreamPublishes - last.upstreamPublishes) / elapsed,
+           (s.upstreamEntries - last.upstreamEntries) / elapsed, (unsigned long long)s.downstream,
+           (unsigned long long)s.undeliverable, (unsigned long long)s.dropped);
+    fflush(stdout);
+    last = s;
+    lastTime = now;
+  }
+
+  gateway.stop();
+  MqttGatewayStats s = gateway.stats();
+  printf("stopped: %llu connections, %llu messages in, %llu publishes up, %llu messages down\n",
+         (unsigned long long)s.accepted, (unsigned long long)s.received, (unsigned long long)s.upstreamPublishes,
+         (unsigned long long)s.downstream);
+  return 0;
+}
+
+// -------------------------------------------------------------
+// bench: simulated reactors
+// -------------------------------------------------------------
+struct BenchDevice {
+  int fd = -1;
+  char id[24];
+  uint32_t seq = 0;
+  uint64_t nextUs = 0;
+  std::vector<uint8_t> rx;
+};
+
+static int connectLocal(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+static bool sendAll(int fd, const std::vector<uint8_t>& bytes) {
+  size_t sent = 0;
+  while (sent < bytes.size()) {
+    ssize_t n = send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    sent += (size_t)n;
+  }
+  return true;
+}
+
+/**
+ * @brief One thread's share of the reactors: publishes each one's telemetry
+ * on its own phase of the period, and answers RPC requests by echoing the
+ * params.
+ */
+struct Fleet {
+  std::vector<BenchDevice> devices;
+  std::atomic<uint64_t> published{0};
+  std::atomic<uint64_t> rpcAnswered{0};
+  std::atomic<uint32_t> failed{0};
+
+  bool connectAll(uint16_t port) {
+    std::vector<uint8_t> tx;
+    for (BenchDevice& d : devices) {
+      d.fd = connectLocal(port);
+      if (d.fd < 0) return false;
+      tx.clear();
+      mqttEncodeConnect(tx, d.id, nullptr, nullptr, 60);
+      mqttEncodeSubscribe(tx, 1, "v1/devices/me/rpc/request/+");
+      if (!sendAll(d.fd, tx)) return false;
+    }
+    return true;
+  }
+
+  void run(const std::atomic<bool>& publishing, uint64_t periodUs) {
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < devices.size(); i++) {
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.u64 = i;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, devices[i].fd, &event);
+    }
+
+    // Same period for every device, so the round-robin order stays the due order
+    uint64_t start = monotonicUs();
+    for (size_t i = 0; i < devices.size(); i++) {
+      devices[i].nextUs = start + periodUs * i / devices.size();
+    }
+    size_t next = 0;
+    std::vector<uint8_t> tx;
+    char payload[256];
+    epoll_event events[64];
+
+    while (publishing) {
+      uint64_t now = monotonicUs();
+      while (!devices.empty() && devices[next].nextUs <= now) {
+        BenchDevice& d = devices[next];
+        int length = snprintf(payload, sizeof(payload),
+                              "{\"seq\":%u,\"sent_us\":%llu,\"temperature\":30.02,\"pH\":5.01,\"rpm\":1000,"
+                              "\"heater_pwm\":41.2,\"motor_pwm\":55.0,\"acid_pump\":0,\"base_pump\":0}",
+                              d.seq++, (unsigned long long)monotonicUs());
+        tx.clear();
+        mqttEncodePublish(tx, "v1/devices/me/telemetry", 23, (const uint8_t*)payload, (size_t)length);
+        if (sendAll(d.fd, tx)) published++;
+        else failed++;
+        d.nextUs += periodUs;
+        next = (next + 1) % devices.size();
+      }
+
+      uint64_t waitUs = devices.empty() ? 1000 : devices[next].nextUs - std::min(devices[next].nextUs, monotonicUs());
+      int n = epoll_wait(epollFd, events, 64, (int)std::min<uint64_t>(waitUs / 1000, 5));
+      for (int i = 0; i < n; i++) answer(devices[events[i].data.u64]);
+    }
+    close(epollFd);
+  }
+
+  void answer(BenchDevice& d) {
+    uint8_t chunk[4096];
+    ssize_t n = recv(d.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+    if (n <= 0) return;
+    d.rx.insert(d.rx.end(), chunk, chunk + n);
+
+    size_t pos = 0;
+    std::vector<uint8_t> tx;
+    for (;;) {
+      MqttPacket packet;
+      long used = mqttParsePacket(d.rx.data() + pos, d.rx.size() - pos, packet);
+      if (used <= 0) break;
+      pos += (size_t)used;
+      MqttPublish message;
+      if (packet.type != MQTT_PUBLISH || !mqttParsePublish(packet, message)) continue;
+
+      // v1/devices/me/rpc/request/N -> .../response/N with the params
+      std::string topic(message.topic, message.topicLength);
+      std::string body((const char*)message.payload, message.payloadLength);
+      size_t slash = topic.rfind('/');
+      size_t params = body.find("\"params\":");
+      size_t close = params == std::string::npos ? std::string::npos : body.find('}', params);
+      if (slash == std::string::npos || close == std::string::npos) continue;
+      std::string response = "v1/devices/me/rpc/response/" + topic.substr(slash + 1);
+      std::string result = body.substr(params + 9, close + 1 - (params + 9));
+      mqttEncodePublish(tx, response.c_str(), response.size(), (const uint8_t*)result.data(), result.size());
+      rpcAnswered++;
+    }
+    d.rx.erase(d.rx.begin(), d.rx.begin() + pos);
+    if (!tx.empty() && !sendAll(d.fd, tx)) failed++;
+  }
+};
+
+// -------------------------------------------------------------
+// bench: the ThingsBoard side
+// -------------------------------------------------------------
+struct Cloud {
+  std::mutex lock;
+  std::vector<double> latencyMs; // Device publish -> upstream subscriber
+  std::vector<double> rpcMs;     // RPC request -> response, both upstream
+  uint64_t entries = 0;
+  uint64_t batches = 0;
+  uint64_t rpcSent = 0;
+  uint64_t connects = 0;
+};
+
+static void onCloudMessage(const MqttPublish& message, void* ctx) {
+  Cloud* cloud = (Cloud*)ctx;
+  uint64_t now = monotonicUs();
+  std::string topic(message.topic, message.topicLength);
+  const char* body = (const char*)message.payload;
+  const char* end = body + message.payloadLength;
+  std::lock_guard<std::mutex> guard(cloud->lock);
+
+  if (topic == "v1/gateway/telemetry") {
+    cloud->batches++;
+    static const char KEY[] = "\"sent_us\":";
+    for (const char* p = body; (p = (const char*)memmem(p, end - p, KEY, sizeof(KEY) - 1)); p++) {
+      uint64_t sent = strtoull(p + sizeof(KEY) - 1, nullptr, 10);
+      cloud->latencyMs.push_back((now - sent) / 1000.0);
+      cloud->entries++;
+    }
+  } else if (topic == "v1/gateway/rpc") {
+    // Our own requests come back too; responses have no method
+    if (memmem(body, end - body, "\"method\"", 8)) return;
+    const char* p = (const char*)memmem(body, end - body, "\"sent_us\":", 10);
+    if (p) cloud->rpcMs.push_back((now - strtoull(p + 10, nullptr, 10)) / 1000.0);
+  } else if (topic == "v1/gateway/connect") {
+    cloud->connects++;
+  }
+}
+
+static double percentile(std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+static int runBench(int argc, char** argv) {
+  int deviceCount = 1000;
+  double hz = 10;
+  double seconds = 10;
+  double rpcHz = 100;
+  int duplicates = 10;
+  MqttGatewayConfig config;
+  config.listenAddress = "127.0.0.1";
+  config.listenPort = 0;
+  config.ioThreads = 2;
+
+  for (int i = 0; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--devices") && hasValue) deviceCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--hz") && hasValue) hz = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seconds") && hasValue) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--rpc-hz") && hasValue) rpcHz = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--duplicates") && hasValue) duplicates = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--connections") && hasValue) config.upstreamConnections = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && hasValue) config.ioThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--batch-ms") && hasValue) config.batchMs = atoi(argv[++i]);
+    else {
+      return -1;
+    }
+  }
+  if (deviceCount < 1 || hz <= 0 || seconds <= 0 || duplicates < 0 || duplicates > deviceCount ||
+      config.batchMs < 1) {
+    return -1;
+  }
+
+  // Two sockets per reactor in this process, plus the duplicates
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)(2 * (deviceCount + duplicates) + 64)) {
+    fprintf(stderr, "open file limit %llu is too low for %d devices\n", (unsigned long long)limit.rlim_cur,
+            deviceCount);
+    return 1;
+  }
+
+  // ThingsBoard stand-in, the gateway, and a subscriber on the cloud side
+  MqttBroker broker;
+  if (!broker.listen("127.0.0.1", 0)) {
+    perror("broker");
+    return 1;
+  }
+  std::atomic<bool> brokerRunning(true);
+  std::thread brokerThread([&] { broker.run(brokerRunning); });
+
+  config.upstreamHost = "127.0.0.1";
+  config.upstreamPort = broker.port();
+  MqttGateway gateway;
+  if (!gateway.start(config)) {
+    perror("gateway");
+    return 1;
+  }
+
+  Cloud cloud;
+  MqttClient subscriber;
+  if (!subscriber.connect("127.0.0.1", broker.port(), "bench-cloud") ||
+      !subscriber.subscribe("v1/gateway/telemetry", onCloudMessage, &cloud) ||
+      !subscriber.subscribe("v1/gateway/rpc", onCloudMessage, &cloud) ||
+      !subscriber.subscribe("v1/gateway/connect", onCloudMessage, &cloud)) {
+    fprintf(stderr, "subscriber cannot connect\n");
+    return 1;
+  }
+
+  auto waitFor = [&](uint64_t devices, double timeoutS) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeoutS);
+    while (gateway.stats().devices != devices && std::chrono::steady_clock::now() < deadline) {
+      subscriber.poll(10);
+    }
+    return gateway.stats().devices == devices;
+  };
+
+  // First connections under the identities of the first reactors: the
+  // reactors' own connections must take them over
+  std::vector<int> stale;
+  for (int i = 0; i < duplicates; i++) {
+    char id[24];
+    snprintf(id, sizeof(id), "reactor-%04d", i);
+    std::vector<uint8_t> tx;
+    mqttEncodeConnect(tx, id, nullptr, nullptr, 60);
+    int fd = connectLocal(gateway.port());
+    if (fd < 0 || !sendAll(fd, tx)) {
+      fprintf(stderr, "cannot connect to the gateway\n");
+      return 1;
+    }
+    stale.push_back(fd);
+  }
+  waitFor((uint64_t)duplicates, 5);
+
+  int fleetThreads = std::max(1, std::min(4, deviceCount / 250));
+  std::vector<std::unique_ptr<Fleet>> fleets;
+  for (int t = 0; t < fleetThreads; t++) fleets.emplace_back(new Fleet());
+  for (int i = 0; i < deviceCount; i++) {
+    BenchDevice d;
+    snprintf(d.id, sizeof(d.id), "reactor-%04d", i);
+    fleets[i % fleetThreads]->devices.push_back(d);
+  }
+  auto connectStart = std::chrono::steady_clock::now();
+  for (auto& fleet : fleets) {
+    if (!fleet->connectAll(gateway.port())) {
+      fprintf(stderr, "cannot connect %d devices to the gateway\n", deviceCount);
+      return 1;
+    }
+  }
+  bool allConnected = waitFor((uint64_t)deviceCount, 30);
+  // ... and announced upstream, so the connect messages are not counted as load
+  auto announced = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (std::chrono::steady_clock::now() < announced) {
+    subscriber.poll(10);
+    std::lock_guard<std::mutex> guard(cloud.lock);
+    if (cloud.connects >= (uint64_t)deviceCount) break;
+  }
+  double connectS = std::chrono::duration<double>(std::chrono::steady_clock::now() - connectStart).count();
+
+  // The stale connections should all have been closed by now
+  int kicked = 0;
+  for (int fd : stale) {
+    char byte;
+    timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (recv(fd, &byte, 1, 0) > 0) {
+    }
+    kicked += errno != EAGAIN;
+    close(fd);
+  }
+
+  // --- Load ---
+  std::atomic<bool> publishing(true);
+  uint64_t periodUs = (uint64_t)(1e6 / hz);
+  MqttGatewayStats before = gateway.stats();
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (auto& fleet : fleets) {
+    Fleet* f = fleet.get();
+    threads.emplace_back([f, &publishing, periodUs] { f->run(publishing, periodUs); });
+  }
+
+  // RPCs to random reactors from the cloud side, while reading what arrives
+  std::mt19937 rng(1);
+  uint64_t rpcPeriodUs = rpcHz > 0 ? (uint64_t)(1e6 / rpcHz) : 0;
+  uint64_t nextRpcUs = monotonicUs();
+  uint32_t rpcId = 1;
+  auto endLoad = t0 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                          std::chrono::duration<double>(seconds));
+  while (std::chrono::steady_clock::now() < endLoad) {
+    subscriber.poll(1);
+    uint64_t now = monotonicUs();
+    while (rpcPeriodUs && nextRpcUs <= now) {
+      char request[200];
+      int length = snprintf(request, sizeof(request),
+                            "{\"device\":\"reactor-%04d\",\"data\":{\"id\":%u,\"method\":\"ping\","
+                            "\"params\":{\"sent_us\":%llu}}}",
+                            (int)(rng() % deviceCount), rpcId++, (unsigned long long)now);
+      subscriber.publish("v1/gateway/rpc", (const uint8_t*)request, (size_t)length);
+      {
+        std::lock_guard<std::mutex> guard(cloud.lock);
+        cloud.rpcSent++;
+      }
+      nextRpcUs += rpcPeriodUs;
+    }
+  }
+  publishing = false;
+  for (std::thread& t : threads) t.join();
+  double loadS = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // Drain: a few batch periods for the last messages to come out
+  auto drainUntil = std::chrono::steady_clock::now() + std::chrono::milliseconds(3 * config.batchMs + 500);
+  while (std::chrono::steady_clock::now() < drainUntil) subscriber.poll(10);
+  MqttGatewayStats after = gateway.stats();
+  subscriber.disconnect();
+  gateway.stop();
+  MqttGatewayStats final = gateway.stats();
+  brokerRunning = false;
+  brokerThread.join();
+
+  // --- Report ---
+  uint64_t published = 0, answered = 0, failed = 0;
+  for (auto& fleet : fleets) {
+    published += fleet->published;
+    answered += fleet->rpcAnswered;
+    failed += fleet->failed;
+  }
+  std::sort(cloud.latencyMs.begin(), cloud.latencyMs.end());
+  std::sort(cloud.rpcMs.begin(), cloud.rpcMs.end());
+  uint64_t upstreamPublishes = after.upstreamPublishes - before.upstreamPublishes;
+  uint64_t lost = published > cloud.entries ? published - cloud.entries : 0;
+
+  printf("%d reactors at %g Hz for %.1f s: %d gateway I/O threads, %d upstream connections, %d ms batches\n",
+         deviceCount, hz, loadS, gateway.ioThreads(), config.upstreamConnections, config.batchMs);
+  printf("connected in %.2f s, %d of %d duplicate identities taken over (gateway counted %llu)\n\n", connectS,
+         kicked, duplicates, (unsigned long long)final.takeovers);
+  printf("| Metric | Value |\n");
+  printf("| :--- | ---: |\n");
+  printf("| Telemetry offered | %.0f msg/s |\n", published / loadS);
+  printf("| Telemetry delivered upstream | %.0f msg/s (%llu lost) |\n", cloud.entries / loadS,
+         (unsigned long long)lost);
+  printf("| Upstream publishes | %.1f /s, %.0f messages each |\n", upstreamPublishes / loadS,
+         upstreamPublishes ? (double)cloud.entries / cloud.batches : 0.0);
+  printf("| Upstream bytes | %.2f MB/s |\n", (after.upstreamBytes - before.upstreamBytes) / loadS / 1e6);
+  printf("| Device -> upstream latency p50 / p99 / max | %.1f / %.1f / %.1f ms |\n",
+         percentile(cloud.latencyMs, 0.5), percentile(cloud.latencyMs, 0.99),
+         cloud.latencyMs.empty() ? 0.0 : cloud.latencyMs.back());
+  printf("| RPC round trip p50 / p99 | %.1f / %.1f ms (%zu of %llu answered) |\n", percentile(cloud.rpcMs, 0.5),
+         percentile(cloud.rpcMs, 0.99), cloud.rpcMs.size(), (unsigned long long)cloud.rpcSent);
+  printf("| Gateway CPU | %.1f%% of one core |\n", 100 * final.cpuS / loadS);
+
+  bool ok = allConnected && lost == 0 && failed == 0 && kicked == duplicates &&
+            final.takeovers == (uint64_t)duplicates && answered == cloud.rpcMs.size();
+  if (!ok) {
+    printf("\nFAILED: %s%s%s%s\n", allConnected ? "" : "not every reactor connected; ", lost ? "telemetry lost; " : "",
+           failed ? "publishes failed; " : "",
+           kicked == duplicates && final.takeovers == (uint64_t)duplicates ? "" : "takeovers missing; ");
+  }
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 2 && !strcmp(argv[1], "bench")) {
+    signal(SIGPIPE, SIG_IGN);
+    int result = runBench(argc - 2, argv + 2);
+    if (result < 0) {
+      usage(argv[0]);
+      return 2;
+    }
+    return result;
+  }
+  return runGateway(argc, argv);
+}
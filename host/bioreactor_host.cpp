@@ -0,0 +1,206 @@
+// Runs the real subsystem control code on Linux against the HAL's simulated
+// clock (or the real clock with --realtime) and reports scheduler statistics.
+//
+// With --net it also runs the firmware's two-core split: a std::thread plays
+// the network task (draining the outbox and the sample history, injecting
+// attribute updates and RPCs into the inbox) while the main thread runs the
+// control loop, so a stalled network side can be checked for missed deadlines.
+//
+// Usage: bioreactor_host [--seconds N] [--rpm R] [--realtime] [--verbose]
+//                        [--net] [--stall S]
+
+#include "ControlLoop.hpp"
+#include "HalLinux.hpp"
+#include "SampleHistory.hpp"
+#include "StirringSubsystem.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static Scheduler scheduler(halMicros);
+
+// --- Network side (--net) ---
+static MqttQueue inbox;
+static MqttQueue outboxQueue;
+static MqttOutbox outbox(outboxQueue);
+static SampleHistory history;
+
+struct NetStats {
+  uint32_t messages = 0;
+  uint32_t responses = 0;
+  uint32_t frames = 0;
+  uint32_t samples = 0;
+  uint32_t injected = 0;
+  uint32_t inboxFull = 0;
+};
+
+static void sampleTelemetry() {
+  TelemetrySample sample;
+  getTelemetrySample(sample);
+  history.push(sample);
+}
+
+static void inject(NetStats& stats, const char* topic, const char* payload) {
+  if (mqttEnqueue(inbox, topic, (const uint8_t*)payload, strlen(payload))) {
+    stats.injected++;
+  } else {
+    stats.inboxFull++;
+  }
+}
+
+/**
+ * @brief Stand-in for the firmware's networkTask(): polls every 10 ms, sends
+ * (counts) whatever the control side queued, and once a second feeds it an
+ * attribute update and a pump RPC. Sleeps for stallS once, a third of the way
+ * in, the way a blocking WiFi/MQTT reconnect would.
+ */
+static void networkLoop(const std::atomic<bool>& running, double seconds, double stallS, NetStats& stats) {
+  static TelemetrySample batch[50];
+  const auto start = std::chrono::steady_clock::now();
+  auto nextCommand = start + std::chrono::seconds(1);
+  bool stalled = stallS <= 0;
+  int request = 0;
+
+  while (running) {
+    auto now = std::chrono::steady_clock::now();
+
+    if (!stalled && now - start >= std::chrono::duration<double>(seconds / 3)) {
+      stalled = true;
+      std::this_thread::sleep_for(std::chrono::duration<double>(stallS));
+      continue;
+    }
+
+    while (!outboxQueue.empty()) {
+      const MqttMessage& message = outboxQueue.at(0);
+      stats.messages++;
+      if (!strncmp(message.topic, "v1/devices/me/rpc/response/", 27)) stats.responses++;
+      outboxQueue.discard(1);
+    }
+
+    history.age();
+    while (history.archived() > 0 || history.backlog() >= 50) {
+      int count = history.read(batch, 50);
+      history.discard(count);
+      stats.frames++;
+      stats.samples += count;
+    }
+
+    if (now >= nextCommand) {
+      char topic[64];
+      snprintf(topic, sizeof(topic), "v1/devices/me/rpc/request/%d", ++request);
+      inject(stats, "v1/devices/me/attributes", request % 2 ? "{\"target_rpm\": 900}" : "{\"target_rpm\": 1100}");
+      inject(stats, topic, "{\"method\": \"setPump\", \"params\": {\"pump\": \"base\", \"duration\": 200}}");
+      nextCommand += std::chrono::seconds(1);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+int main(int argc, char** argv) {
+  double seconds = 60;
+  double encoderRpm = 1000;
+  bool realtime = false;
+  bool verbose = false;
+  bool net = false;
+  double stallS = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--rpm") && i + 1 < argc) encoderRpm = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--realtime")) realtime = true;
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+    else if (!strcmp(argv[i], "--net")) net = true;
+    else if (!strcmp(argv[i], "--stall") && i + 1 < argc) stallS = atof(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seconds N] [--rpm R] [--realtime] [--verbose] [--net] [--stall S]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (net) realtime = true; // The network thread runs on the wall clock
+
+  halSimUseRealClock(realtime);
+  halSimSetLogEnabled(verbose);
+
+  // Constant sensor inputs: mid-scale pH probe and a thermistor near 35 C
+  halSimSetAdc(A4, 512);
+  halSimSetAdc(A5, 1394);
+
+  setupControl();
+  addControlTasks(scheduler);
+  if (net) scheduler.addTask("sample", sampleTelemetry, 100000, 50000, 3);
+  setspeed = encoderRpm;
+  scheduler.start();
+
+  std::atomic<bool> running(true);
+  NetStats netStats;
+  std::thread network;
+  if (net) network = std::thread(networkLoop, std::cref(running), seconds, stallS, std::ref(netStats));
+
+  // Hall sensor: one rising edge per 1/Npulses revolution at a fixed speed
+  const uint64_t pulsePeriodUs = encoderRpm > 0 ? (uint64_t)(60e6 / (encoderRpm * 70)) : 0;
+  const uint64_t endUs = halSimTimeUs() + (uint64_t)(seconds * 1e6);
+  uint64_t nextPulseUs = halSimTimeUs() + pulsePeriodUs;
+
+  auto wallStart = std::chrono::steady_clock::now();
+
+  while (halSimTimeUs() < endUs) {
+    if (net) processInbox(inbox, outbox);
+
+    while (scheduler.runOnce()) {
+    }
+
+    uint64_t now = halSimTimeUs();
+    if (pulsePeriodUs && now >= nextPulseUs) {
+      halSimTriggerInterrupt(ENCODER_PIN);
+      nextPulseUs += pulsePeriodUs;
+    }
+
+    if (!realtime) {
+      // Jump straight to the next event: a task release or an encoder pulse
+      uint64_t next = now + scheduler.untilNextReleaseUs();
+      if (pulsePeriodUs && nextPulseUs < next) next = nextPulseUs;
+      halSimSetTimeUs(next > now ? next : now + 1);
+    } else if (net) {
+      // Sleep like the firmware's loop(), waking for pulses and the inbox
+      uint64_t idleUs = scheduler.untilNextReleaseUs();
+      if (pulsePeriodUs && nextPulseUs - now < idleUs) idleUs = nextPulseUs - now;
+      if (idleUs >= 2000) halDelayMs(idleUs / 1000 - 1);
+    }
+  }
+
+  if (net) {
+    running = false;
+    network.join();
+  }
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printf("simulated %.1f s in %.3f s wall (%.0fx real time)\n", seconds, wall, seconds / wall);
+  printf("%-10s %10s %8s %8s %12s %10s\n", "task", "runs", "missed", "skipped", "jitter_us", "exec_us");
+  for (int i = 0; i < scheduler.taskCount(); i++) {
+    const Task& t = scheduler.task(i);
+    printf("%-10s %10u %8u %8u %12u %10u\n", t.name, t.stats.runs, t.stats.missedDeadlines,
+           t.stats.skippedReleases, t.stats.maxJitterUs, t.stats.maxExecUs);
+  }
+  printf("measured rpm: %.1f (set %.0f)\n", meanmeasspeed, setspeed);
+  {
+    StaticJsonDocument<256> doc;
+    JsonObject status = doc.to<JsonObject>();
+    getStirringStatus(status); // Interrupt rate over the whole run
+    printf("hall: %s backend, %d interrupts/s\n", status["rpm_sensor"].as<const char*>(),
+           status["hall_irq_per_s"].as<int>());
+  }
+  if (net) {
+    HistoryStats h = history.stats();
+    printf("net: injected %u (inbox full %u), outbox %u messages (%u rpc responses, %u dropped)\n",
+           netStats.injected, netStats.inboxFull, netStats.messages, netStats.responses, outbox.dropped());
+    printf("net: %u frames / %u samples sent, history overruns %u decimated %u dropped %u\n",
+           netStats.frames, netStats.samples, h.overruns, h.decimated, h.dropped);
+  }
+
+  return 0;
+}
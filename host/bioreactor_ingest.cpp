@@ -0,0 +1,388 @@
+// Telemetry ingest daemon: subscribes to the reactors' telemetry on an MQTT
+// broker and appends it to columnar segment files (TelemetryStore.hpp), one
+// directory per device:
+//   DIR/<device>/<first sample time>.seg
+// Replaces telemetry_logger.py's open/append/close of a CSV file per message.
+//
+// Topics (--topic replaces the defaults, and may be repeated):
+//   bioreactor/telemetry/bin         binary frames of the --device reactor
+//   bioreactor/<id>/telemetry/bin    binary frames of reactor <id>
+//   v1/devices/me/telemetry          flat JSON telemetry of the --device reactor
+// Binary samples keep their acquisition time. Until the device clock is
+// synchronised it is mapped to arrival time through the newest live frame,
+// as telemetry_logger.py does. JSON samples are stamped on arrival; they
+// carry no duties, and are flagged so rather than given made-up ones.
+//
+// Rows are buffered per device and written a block at a time: when a block
+// fills (STORE_BLOCK_ROWS) or every --flush-ms. A segment is sealed after
+// --segment-rows rows, and every open segment on SIGINT/SIGTERM. Lost the
+// broker, it reconnects with a growing delay.
+//
+// --listen PORT also runs the MqttBroker stand-in on that port, for a
+// self-contained setup without mosquitto.
+//
+// Usage: bioreactor_ingest [--connect HOST:PORT] [--user TOKEN] [--client-id ID]
+//                          [--dir DIR] [--topic FILTER]... [--device NAME]
+//                          [--flush-ms MS] [--segment-rows N] [--sync] [--stats-s S]
+//                          [--listen PORT]
+
+#include "Hal.hpp"
+#include "MqttBroker.hpp"
+#include "MqttClient.hpp"
+#include "TelemetryFrame.hpp"
+#include "TelemetryStore.hpp"
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <map>
+#include <memory>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* const DEFAULT_TOPICS[] = {
+  "bioreactor/telemetry/bin",   // TELEMETRY_BIN_TOPIC
+  "bioreactor/+/telemetry/bin",
+  "v1/devices/me/telemetry",
+};
+
+static std::atomic<bool> running(true);
+
+static void onSignal(int) {
+  running = false;
+}
+
+static uint64_t wallUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// -------------------------------------------------------------
+// Per-device state
+// -------------------------------------------------------------
+struct DeviceLog {
+  std::string name;
+  SegmentWriter writer;
+  bool sequenceStarted = false;
+  uint32_t nextSequence = 0;
+  bool haveOffset = false;
+  int64_t offsetUs = 0; // Arrival minus device time, for unsynchronised clocks
+};
+
+struct Ingest {
+  std::string dir;
+  std::string defaultDevice = "default";
+  uint32_t segmentRows = 864000; // A day at 10 Hz
+  std::map<std::string, std::unique_ptr<DeviceLog>> devices;
+
+  // Totals for the periodic report
+  uint64_t messages = 0;
+  uint64_t samples = 0;
+  uint64_t malformed = 0;
+  uint64_t lostFrames = 0;
+  uint64_t writeErrors = 0;
+};
+
+// Keeps device names usable as directory names
+static std::string sanitise(const char* name, size_t length) {
+  std::string out;
+  for (size_t i = 0; i < length && out.size() < STORE_DEVICE_BYTES - 1; i++) {
+    char c = name[i];
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+    out += ok ? c : '_';
+  }
+  return out.empty() ? "_" : out;
+}
+
+static DeviceLog& deviceFor(Ingest& ingest, const std::string& name) {
+  std::unique_ptr<DeviceLog>& slot = ingest.devices[name];
+  if (!slot) {
+    slot.reset(new DeviceLog);
+    slot->name = name;
+  }
+  return *slot;
+}
+
+static void appendRows(Ingest& ingest, DeviceLog& device, const TelemetrySample* rows, int count) {
+  if (count <= 0) return;
+  if (device.writer.isOpen() && device.writer.rows() >= ingest.segmentRows) {
+    if (!device.writer.close()) ingest.writeErrors++;
+  }
+  if (!device.writer.isOpen()) {
+    // Never reopen an existing segment: a second start in the same
+    // microsecond gets the next name
+    uint64_t first = rows[0].timeUs;
+    while (!device.writer.open(storeSegmentPath(ingest.dir, device.name.c_str(), first), device.name.c_str())) {
+      if (errno != EEXIST) {
+        perror(ingest.dir.c_str());
+        ingest.writeErrors++;
+        return;
+      }
+      first++;
+    }
+  }
+  if (!device.writer.append(rows, count)) ingest.writeErrors++;
+  ingest.samples += count;
+}
+
+// -------------------------------------------------------------
+// Binary frames
+// -------------------------------------------------------------
+static void onFrame(Ingest& ingest, DeviceLog& device, const MqttPublish& message, uint64_t arrivalUs) {
+  static TelemetrySample rows[TELEMETRY_MAX_SAMPLES];
+  TelemetryFrameInfo info;
+  int count = decodeTelemetryFrame(message.payload, message.payloadLength, rows, TELEMETRY_MAX_SAMPLES, &info);
+  if (count <= 0) {
+    ingest.malformed++;
+    return;
+  }
+
+  if (device.sequenceStarted && info.sequence != device.nextSequence && info.sequence != 0 &&
+      info.sequence - device.nextSequence < 0x80000000u) {
+    ingest.lostFrames += info.sequence - device.nextSequence;
+  }
+  device.sequenceStarted = true;
+  device.nextSequence = info.sequence + 1;
+
+  // A live frame ends with the newest sample; back-filled ones reuse its mapping
+  if (!device.haveOffset || !(info.flags & TELEMETRY_FRAME_BACKFILL)) {
+    device.offsetUs = (int64_t)(arrivalUs - rows[count - 1].timeUs);
+    device.haveOffset = true;
+  }
+  for (int i = 0; i < count; i++) {
+    if (rows[i].timeUs < HAL_EPOCH_VALID_US) {
+      rows[i].timeUs += device.offsetUs;
+      rows[i].flags |= STORE_FLAG_ARRIVAL_TIME;
+    }
+  }
+  appendRows(ingest, device, rows, count);
+}
+
+// -------------------------------------------------------------
+// JSON telemetry (flat object of numbers and booleans)
+// -------------------------------------------------------------
+static bool jsonValue(const char* json, size_t length, const char* key, double& out) {
+  size_t keyLength = strlen(key);
+  const char* end = json + length;
+  for (const char* p = json; p + keyLength + 2 <= end; p++) {
+    if (*p != '"' || memcmp(p + 1, key, keyLength) != 0 || p[keyLength + 1] != '"') continue;
+    const char* v = p + keyLength + 2;
+    while (v < end && (*v == ' ' || *v == '\t' || *v == '\n' || *v == '\r')) v++;
+    if (v >= end || *v++ != ':') continue; // A string value equal to the key
+    while (v < end && (*v == ' ' || *v == '\t' || *v == '\n' || *v == '\r')) v++;
+    if (end - v >= 4 && memcmp(v, "true", 4) == 0) {
+      out = 1;
+      return true;
+    }
+    if (end - v >= 5 && memcmp(v, "false", 5) == 0) {
+      out = 0;
+      return true;
+    }
+    char number[32];
+    size_t n = 0;
+    while (v < end && n < sizeof(number) - 1 && *v && strchr("+-.0123456789eE", *v)) number[n++] = *v++;
+    number[n] = 0;
+    char* stop;
+    out = strtod(number, &stop);
+    return n > 0 && *stop == 0;
+  }
+  return false;
+}
+
+static int16_t fixedOrZero(const char* json, size_t length, const char* key, double scale) {
+  double v;
+  if (!jsonValue(json, length, key, v)) return 0;
+  v *= scale;
+  return (int16_t)(v < -32768 ? -32768 : v > 32767 ? 32767 : v + (v < 0 ? -0.5 : 0.5));
+}
+
+static void onJson(Ingest& ingest, DeviceLog& device, const MqttPublish& message, uint64_t arrivalUs) {
+  const char* json = (const char*)message.payload;
+  size_t length = message.payloadLength;
+  double v;
+  if (!jsonValue(json, length, "temperature", v) && !jsonValue(json, length, "pH", v) &&
+      !jsonValue(json, length, "rpm_measured", v)) {
+    ingest.malformed++; // Not a status payload
+    return;
+  }
+
+  TelemetrySample s = {};
+  s.timeUs = arrivalUs;
+  s.tempCentiC = fixedOrZero(json, length, "temperature", 100);
+  s.phMilli = fixedOrZero(json, length, "pH", 1000);
+  s.rpm = fixedOrZero(json, length, "rpm_measured", 1);
+  s.tempSetCentiC = fixedOrZero(json, length, "target_temperature", 100);
+  s.phSetMilli = fixedOrZero(json, length, "target_pH", 1000);
+  s.rpmSet = fixedOrZero(json, length, "rpm_set", 1);
+  s.flags = STORE_FLAG_NO_DUTY | STORE_FLAG_ARRIVAL_TIME;
+  if (jsonValue(json, length, "acid_pump", v) && v) s.flags |= TELEMETRY_FLAG_ACID;
+  if (jsonValue(json, length, "base_pump", v) && v) s.flags |= TELEMETRY_FLAG_BASE;
+  if (jsonValue(json, length, "heater_state", v) && v) s.flags |= TELEMETRY_FLAG_HEATER;
+  if (jsonValue(json, length, "operational_mode", v) && v) s.flags |= TELEMETRY_FLAG_ACTIVE;
+  appendRows(ingest, device, &s, 1);
+}
+
+static void onMessage(const MqttPublish& message, void* ctx) {
+  Ingest& ingest = *(Ingest*)ctx;
+  uint64_t arrivalUs = wallUs();
+  ingest.messages++;
+
+  // bioreactor/<id>/telemetry/bin names its device; the other topics are --device's
+  std::string topic(message.topic, message.topicLength);
+  const std::string prefix = "bioreactor/", suffix = "/telemetry/bin";
+  std::string name = ingest.defaultDevice;
+  if (topic.size() > prefix.size() + suffix.size() && topic.compare(0, prefix.size(), prefix) == 0 &&
+      topic.compare(topic.size() - suffix.size(), suffix.size(), suffix) == 0) {
+    name = sanitise(topic.c_str() + prefix.size(), topic.size() - prefix.size() - suffix.size());
+  }
+  DeviceLog& device = deviceFor(ingest, name);
+
+  if (message.payloadLength > 0 && message.payload[0] == TELEMETRY_MAGIC) {
+    onFrame(ingest, device, message, arrivalUs);
+  } else {
+    onJson(ingest, device, message, arrivalUs);
+  }
+}
+
+// -------------------------------------------------------------
+// Main loop
+// -------------------------------------------------------------
+static void flushAll(Ingest& ingest, bool sync) {
+  for (auto& entry : ingest.devices) {
+    SegmentWriter& writer = entry.second->writer;
+    if (writer.isOpen() && !writer.flush(sync)) ingest.writeErrors++;
+  }
+}
+
+static void closeAll(Ingest& ingest) {
+  for (auto& entry : ingest.devices) {
+    SegmentWriter& writer = entry.second->writer;
+    if (writer.isOpen() && !writer.close()) ingest.writeErrors++;
+  }
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--connect HOST:PORT] [--user TOKEN] [--client-id ID]\n"
+          "          [--dir DIR] [--topic FILTER]... [--device NAME]\n"
+          "          [--flush-ms MS] [--segment-rows N] [--sync] [--stats-s S]\n"
+          "          [--listen PORT]\n",
+          argv0);
+}
+
+int main(int argc, char** argv) {
+  const char* connectTo = "127.0.0.1:1883";
+  const char* user = nullptr;
+  const char* clientId = "bioreactor_ingest";
+  std::vector<const char*> topics;
+  int flushMs = 10000;
+  bool sync = false;
+  double statsS = 60;
+  int listenPort = -1;
+
+  Ingest ingest;
+  ingest.dir = "segments";
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--connect") && hasValue) connectTo = argv[++i];
+    else if (!strcmp(argv[i], "--user") && hasValue) user = argv[++i];
+    else if (!strcmp(argv[i], "--client-id") && hasValue) clientId = argv[++i];
+    else if (!strcmp(argv[i], "--dir") && hasValue) ingest.dir = argv[++i];
+    else if (!strcmp(argv[i], "--topic") && hasValue) topics.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--device") && hasValue) {
+      i++;
+      ingest.defaultDevice = sanitise(argv[i], strlen(argv[i]));
+    }
+    else if (!strcmp(argv[i], "--flush-ms") && hasValue) flushMs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--segment-rows") && hasValue) ingest.segmentRows = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--sync")) sync = true;
+    else if (!strcmp(argv[i], "--stats-s") && hasValue) statsS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--listen") && hasValue) listenPort = atoi(argv[++i]);
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  const char* colon = strrchr(connectTo, ':');
+  if (!colon || flushMs < 1 || ingest.segmentRows < 1 || listenPort > 65535) {
+    usage(argv[0]);
+    return 2;
+  }
+  std::string host(connectTo, colon - connectTo);
+  uint16_t port = (uint16_t)atoi(colon + 1);
+  if (topics.empty()) topics.assign(DEFAULT_TOPICS, DEFAULT_TOPICS + sizeof(DEFAULT_TOPICS) / sizeof(DEFAULT_TOPICS[0]));
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  MqttBroker broker;
+  std::thread brokerThread;
+  if (listenPort >= 0) {
+    if (!broker.listen("0.0.0.0", (uint16_t)listenPort)) {
+      perror("broker");
+      return 1;
+    }
+    host = "127.0.0.1";
+    port = broker.port();
+    brokerThread = std::thread([&] { broker.run(running); });
+    printf("broker stand-in on port %u\n", port);
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point nextFlush = Clock::now() + std::chrono::milliseconds(flushMs);
+  Clock::time_point nextStats = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(statsS));
+  int retryMs = 1000;
+  uint64_t reportedSamples = 0;
+
+  while (running) {
+    MqttClient client;
+    bool subscribed = client.connect(host.c_str(), port, clientId, user);
+    for (size_t i = 0; subscribed && i < topics.size(); i++) {
+      subscribed = client.subscribe(topics[i], onMessage, &ingest);
+    }
+    if (!subscribed) {
+      fprintf(stderr, "cannot subscribe on %s:%u, retrying in %d s\n", host.c_str(), port, retryMs / 1000);
+      for (int waited = 0; running && waited < retryMs; waited += 100) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+      retryMs = retryMs * 2 > 30000 ? 30000 : retryMs * 2;
+      flushAll(ingest, sync); // Nothing new arrives meanwhile
+      continue;
+    }
+    retryMs = 1000;
+    printf("ingesting from %s:%u into %s/\n", host.c_str(), port, ingest.dir.c_str());
+
+    while (running && client.poll(100)) {
+      Clock::time_point now = Clock::now();
+      if (now >= nextFlush) {
+        flushAll(ingest, sync);
+        nextFlush = now + std::chrono::milliseconds(flushMs);
+      }
+      if (statsS > 0 && now >= nextStats) {
+        printf("%zu devices, %llu messages, %llu samples (+%llu), %llu malformed, %llu frames lost, %llu write errors\n",
+               ingest.devices.size(), (unsigned long long)ingest.messages, (unsigned long long)ingest.samples,
+               (unsigned long long)(ingest.samples - reportedSamples), (unsigned long long)ingest.malformed,
+               (unsigned long long)ingest.lostFrames, (unsigned long long)ingest.writeErrors);
+        fflush(stdout);
+        reportedSamples = ingest.samples;
+        nextStats = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(statsS));
+      }
+    }
+    if (running) fprintf(stderr, "connection to %s:%u lost\n", host.c_str(), port);
+    client.disconnect();
+  }
+
+  closeAll(ingest);
+  running = false;
+  if (brokerThread.joinable()) brokerThread.join();
+  printf("stopped: %llu messages, %llu samples from %zu devices, %llu write errors\n",
+         (unsigned long long)ingest.messages, (unsigned long long)ingest.samples, ingest.devices.size(),
+         (unsigned long long)ingest.writeErrors);
+  return ingest.writeErrors ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+// End-to-end latency of the binary telemetry path, from the sample to the
+// logged CSV row. By default the whole path runs in this process on the real
+// clock:
+//   device: the control tasks and the 10 Hz sample task (main thread), plus a
+//           network thread that publishes SampleHistory frames the way
+//           main.ino's publishHistory() does, through MqttClient to
+//   broker: the MqttBroker stand-in for mosquitto, which notes when each
+//           frame arrives, and on to
+//   logger: a subscriber that decodes the frames and writes the rows
+//           telemetry_logger.py would.
+//
+// Every stamp comes from halTimestampUs() (the system clock here, SNTP time
+// on the device). For each sample it reports the stages
+//   acquire -> publish   sample time to the frame's publish time (batching)
+//   publish -> broker    publish time to arrival at the broker
+//   broker  -> logger    arrival at the broker to receipt by the logger
+//   acquire -> logger    end to end
+// and checks the frame sequence numbers for lost, repeated and reordered
+// frames. --drop P makes the device skip a fraction P of its frames (their
+// sequence numbers are used up), as a lossy link would; the run fails
+// unless the logger finds exactly those gaps.
+//
+// --connect HOST:PORT instead subscribes to a real broker, such as a local
+// mosquitto that a device publishes to. There is no broker stamp, so
+// publish -> logger is reported as one stage, and it includes the offset
+// between the device's clock and this host's.
+//
+// Usage: bioreactor_latency [--seconds S] [--batch N] [--drop P] [--seed N] [--csv FILE]
+//                           [--connect HOST:PORT] [--user TOKEN] [--topic TOPIC]
+
+#include "ControlLoop.hpp"
+#include "HalLinux.hpp"
+#include "MqttBroker.hpp"
+#include "MqttClient.hpp"
+#include "SampleHistory.hpp"
+#include "StirringSubsystem.hpp"
+#include "TelemetryFrame.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* DEFAULT_TOPIC = "bioreactor/telemetry/bin"; // TELEMETRY_BIN_TOPIC
+
+// -------------------------------------------------------------
+// Latency and sequence bookkeeping (logger side)
+// -------------------------------------------------------------
+enum Stage { ACQUIRE_PUBLISH, PUBLISH_BROKER, BROKER_LOGGER, PUBLISH_LOGGER, ACQUIRE_LOGGER, STAGE_COUNT };
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+  "acquire -> publish", "publish -> broker", "broker -> logger", "publish -> logger", "acquire -> logger",
+};
+
+struct SequenceStats {
+  bool started = false;
+  uint32_t next = 0;
+  uint32_t frames = 0;
+  uint32_t lost = 0;       // Sequence numbers skipped over
+  uint32_t repeated = 0;   // Behind the expected number: duplicate or reordered
+  uint32_t restarts = 0;   // Back to 0: the device rebooted
+  std::vector<uint32_t> firstLost; // Start of each gap, for the report
+};
+
+struct Logger {
+  std::mutex mutex;                            // Guards brokerUs (broker thread) against the logger
+  std::map<uint32_t, uint64_t> brokerUs;       // Sequence -> arrival at the broker
+  bool haveBroker = false;
+  std::vector<double> stageMs[STAGE_COUNT];
+  SequenceStats sequence;
+  uint32_t samples = 0;
+  uint32_t malformed = 0;
+  uint32_t unsynced = 0; // Frames with times since boot rather than Unix time
+  FILE* csv = nullptr;
+};
+
+static void checkSequence(SequenceStats& s, uint32_t sequence) {
+  s.frames++;
+  if (s.started && sequence != s.next) {
+    if (sequence == 0) {
+      s.restarts++;
+    } else if (sequence - s.next < 0x80000000u) {
+      s.lost += sequence - s.next;
+      s.firstLost.push_back(s.next);
+    } else {
+      s.repeated++;
+      return; // Keep expecting the same number
+    }
+  }
+  s.started = true;
+  s.next = sequence + 1;
+}
+
+static void onBrokerPublish(const MqttPublish& message, void* ctx) {
+  Logger& logger = *(Logger*)ctx;
+  uint64_t now = halTimestampUs();
+  static TelemetrySample samples[TELEMETRY_MAX_SAMPLES]; // Broker thread only
+  TelemetryFrameInfo info;
+  if (decodeTelemetryFrame(message.payload, message.payloadLength, samples, TELEMETRY_MAX_SAMPLES, &info) <= 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(logger.mutex);
+  logger.brokerUs[info.sequence] = now;
+}
+
+static void onLoggerMessage(const MqttPublish& message, void* ctx) {
+  Logger& logger = *(Logger*)ctx;
+  uint64_t receivedUs = halTimestampUs();
+
+  TelemetrySample samples[TELEMETRY_MAX_SAMPLES];
+  TelemetryFrameInfo info;
+  int count = decodeTelemetryFrame(message.payload, message.payloadLength, samples, TELEMETRY_MAX_SAMPLES, &info);
+  if (count <= 0) {
+    logger.malformed++;
+    return;
+  }
+  checkSequence(logger.sequence, info.sequence);
+  logger.samples += count;
+  if (!halTimestampIsEpoch(info.publishUs)) {
+    logger.unsynced++; // Device and host times are not comparable
+    return;
+  }
+
+  uint64_t brokerUs = 0;
+  if (logger.haveBroker) {
+    std::lock_guard<std::mutex> lock(logger.mutex);
+    auto it = logger.brokerUs.find(info.sequence);
+    if (it != logger.brokerUs.end()) {
+      brokerUs = it->second;
+      logger.brokerUs.erase(it);
+    }
+  }
+
+  auto ms = [](uint64_t from, uint64_t to) { return ((double)to - (double)from) / 1000.0; };
+  if (brokerUs) {
+    logger.stageMs[PUBLISH_BROKER].push_back(ms(info.publishUs, brokerUs));
+    logger.stageMs[BROKER_LOGGER].push_back(ms(brokerUs, receivedUs));
+  }
+  logger.stageMs[PUBLISH_LOGGER].push_back(ms(info.publishUs, receivedUs));
+
+  for (int i = 0; i < count; i++) {
+    const TelemetrySample& s = samples[i];
+    logger.stageMs[ACQUIRE_PUBLISH].push_back(ms(s.timeUs, info.publishUs));
+    logger.stageMs[ACQUIRE_LOGGER].push_back(ms(s.timeUs, receivedUs));
+    if (logger.csv) {
+      // telemetry_logger.py's columns, stamped at acquisition
+      fprintf(logger.csv, "%.3f,%.2f,%.3f,%d,%.1f,%.1f,%d,%d,None\n", s.timeUs / 1e6, s.tempCentiC / 100.0,
+              s.phMilli / 1000.0, s.rpm, 100.0 * s.heaterDuty / 1023, 100.0 * s.motorDuty / 1023,
+              s.flags & TELEMETRY_FLAG_ACID ? 100 : 0, s.flags & TELEMETRY_FLAG_BASE ? 100 : 0);
+    }
+  }
+}
+
+static void loggerLoop(const std::atomic<bool>& running, MqttClient& client) {
+  while (running && client.poll(20)) {
+  }
+}
+
+// -------------------------------------------------------------
+// Device (in-process mode)
+// -------------------------------------------------------------
+static Scheduler scheduler(halMicros);
+static SampleHistory history;
+
+struct Device {
+  MqttClient client;
+  int batchSize = 50;
+  double dropFraction = 0;
+  std::mt19937 rng;
+  uint32_t sequence = 0;
+  uint32_t frames = 0;
+  uint32_t dropped = 0;
+  uint32_t trailingDrops = 0; // Dropped after the last frame sent: no later frame shows the gap
+  uint32_t failed = 0;
+};
+
+static void sampleTelemetry() {
+  TelemetrySample sample;
+  getTelemetrySample(sample);
+  history.push(sample);
+}
+
+// publishHistory() from main.ino, with an optional lossy link
+static void publishHistory(Device& device, TelemetrySample* batch, uint8_t* frame, size_t capacity) {
+  history.age();
+  while (history.archived() > 0 || history.backlog() >= (uint32_t)device.batchSize) {
+    int count = history.read(batch, device.batchSize);
+    TelemetryFrameInfo info;
+    info.flags = history.backlog() > (uint32_t)count ? TELEMETRY_FRAME_BACKFILL : 0;
+    info.sequence = device.sequence;
+    info.publishUs = halTimestampUs();
+    size_t length = encodeTelemetryFrame(batch, count, frame, capacity, info);
+
+    if (std::uniform_real_distribution<double>(0, 1)(device.rng) < device.dropFraction) {
+      device.dropped++; // Lost on the way: the sequence number is used up
+      device.trailingDrops++;
+    } else if (length == 0 || !device.client.publish(DEFAULT_TOPIC, frame, length)) {
+      device.failed++;
+      return;
+    } else {
+      device.trailingDrops = 0;
+    }
+    device.sequence++;
+    device.frames++;
+    history.discard(count);
+  }
+}
+
+static void networkLoop(const std::atomic<bool>& running, Device& device) {
+  std::vector<TelemetrySample> batch(device.batchSize);
+  std::vector<uint8_t> frame(telemetryFrameCapacity(device.batchSize));
+  while (running) {
+    publishHistory(device, batch.data(), frame.data(), frame.size());
+    device.client.poll(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10)); // NETWORK_POLL_MS
+  }
+}
+
+// -------------------------------------------------------------
+// Report
+// -------------------------------------------------------------
+static double percentile(const std::vector<double>& sorted, double p) {
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+static void printStages(Logger& logger) {
+  printf("%-20s %8s %9s %9s %9s %9s %9s\n", "stage (ms)", "n", "min", "p50", "p90", "p99", "max");
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    std::vector<double>& v = logger.stageMs[i];
+    if (v.empty()) continue;
+    std::sort(v.begin(), v.end());
+    printf("%-20s %8zu %9.2f %9.2f %9.2f %9.2f %9.2f\n", STAGE_NAMES[i], v.size(), v.front(), percentile(v, 0.5),
+           percentile(v, 0.9), percentile(v, 0.99), v.back());
+  }
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--seconds S] [--batch N] [--drop P] [--seed N] [--csv FILE]\n"
+          "          [--connect HOST:PORT] [--user TOKEN] [--topic TOPIC]\n",
+          argv0);
+}
+
+int main(int argc, char** argv) {
+  double seconds = 60;
+  int batchSize = 50; // TELEMETRY_BATCH_SAMPLES
+  double dropFraction = 0;
+  uint32_t seed = 1;
+  const char* csvPath = nullptr;
+  const char* connectTo = nullptr;
+  const char* user = nullptr;
+  const char* topic = DEFAULT_TOPIC;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seconds") && hasValue) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--batch") && hasValue) batchSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--drop") && hasValue) dropFraction = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && hasValue) seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--csv") && hasValue) csvPath = argv[++i];
+    else if (!strcmp(argv[i], "--connect") && hasValue) connectTo = argv[++i];
+    else if (!strcmp(argv[i], "--user") && hasValue) user = argv[++i];
+    else if (!strcmp(argv[i], "--topic") && hasValue) topic = argv[++i];
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (seconds <= 0 || batchSize < 1 || batchSize > TELEMETRY_MAX_SAMPLES || dropFraction < 0 || dropFraction >= 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::string host = "127.0.0.1";
+  uint16_t port = 0;
+  if (connectTo) {
+    const char* colon = strrchr(connectTo, ':');
+    if (!colon) {
+      usage(argv[0]);
+      return 2;
+    }
+    host.assign(connectTo, colon - connectTo);
+    port = (uint16_t)atoi(colon + 1);
+  }
+
+  halSimUseRealClock(true);
+  halSimSetLogEnabled(false);
+
+  Logger logger;
+  if (csvPath) {
+    logger.csv = fopen(csvPath, "w");
+    if (!logger.csv) {
+      perror(csvPath);
+      return 1;
+    }
+    fprintf(logger.csv, "timestamp,temp_mean,ph_mean,rpm_mean,heater_pwm,motor_pwm,acid_pwm,base_pwm,faults\n");
+  }
+
+  std::atomic<bool> running(true);
+  MqttBroker broker;
+  std::thread brokerThread;
+  if (!connectTo) {
+    if (!broker.listen("127.0.0.1", 0)) {
+      perror("broker");
+      return 1;
+    }
+    port = broker.port();
+    logger.haveBroker = true;
+    logger.sequence.started = true; // The device starts from 0: a lost first frame counts too
+    broker.setPublishHook(onBrokerPublish, &logger);
+    brokerThread = std::thread([&] { broker.run(running); });
+  }
+
+  MqttClient subscriber;
+  if (!subscriber.connect(host.c_str(), port, "bioreactor_latency_logger", user) ||
+      !subscriber.subscribe(topic, onLoggerMessage, &logger)) {
+    fprintf(stderr, "cannot subscribe to %s on %s:%u\n", topic, host.c_str(), port);
+    running = false;
+    if (brokerThread.joinable()) brokerThread.join();
+    return 1;
+  }
+  std::atomic<bool> logging(true);
+  std::thread loggerThread(loggerLoop, std::cref(logging), std::ref(subscriber));
+
+  Device device;
+  device.batchSize = batchSize;
+  device.dropFraction = dropFraction;
+  device.rng.seed(seed);
+  std::thread networkThread;
+  if (!connectTo) {
+    if (!device.client.connect(host.c_str(), port, "bioreactor_latency_device")) {
+      fprintf(stderr, "device cannot connect to %s:%u\n", host.c_str(), port);
+      return 1;
+    }
+
+    // Constant sensor inputs and a Hall sensor at 1000 rpm, as in bioreactor_host
+    halSimSetAdc(A4, 512);
+    halSimSetAdc(A5, 1394);
+    setupControl();
+    addControlTasks(scheduler);
+    scheduler.addTask("sample", sampleTelemetry, 100000, 50000, 3);
+    setspeed = 1000;
+    scheduler.start();
+    networkThread = std::thread(networkLoop, std::cref(running), std::ref(device));
+
+    const uint64_t pulsePeriodUs = (uint64_t)(60e6 / (1000 * 70));
+    const uint64_t endUs = halSimTimeUs() + (uint64_t)(seconds * 1e6);
+    uint64_t nextPulseUs = halSimTimeUs() + pulsePeriodUs;
+    while (halSimTimeUs() < endUs) {
+      while (scheduler.runOnce()) {
+      }
+      uint64_t now = halSimTimeUs();
+      while (now >= nextPulseUs) {
+        halSimTriggerInterrupt(ENCODER_PIN);
+        nextPulseUs += pulsePeriodUs;
+      }
+      uint64_t idleUs = scheduler.untilNextReleaseUs();
+      if (nextPulseUs - now < idleUs) idleUs = nextPulseUs - now;
+      if (idleUs >= 2000) halDelayMs(idleUs / 1000 - 1);
+    }
+    running = false;
+    networkThread.join();
+    device.client.disconnect();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Let the last frames through
+  } else {
+    printf("listening on %s:%u for %.0f s\n", host.c_str(), port, seconds);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  }
+
+  logging = false;
+  loggerThread.join();
+  running = false;
+  if (brokerThread.joinable()) brokerThread.join();
+  subscriber.disconnect();
+  if (logger.csv) fclose(logger.csv);
+
+  const SequenceStats& seq = logger.sequence;
+  printf("logger: %u frames, %u samples, %u malformed, %u without a synchronised clock\n", seq.frames,
+         logger.samples, logger.malformed, logger.unsynced);
+  printStages(logger);
+  printf("sequence: %u lost in %zu gaps, %u repeated or reordered, %u restarts", seq.lost, seq.firstLost.size(),
+         seq.repeated, seq.restarts);
+  for (size_t i = 0; i < seq.firstLost.size() && i < 8; i++) printf("%s#%u", i ? ", " : " (from ", seq.firstLost[i]);
+  printf("%s\n", seq.firstLost.empty() ? "" : seq.firstLost.size() > 8 ? ", ...)" : ")");
+
+  if (connectTo) return 0;
+
+  MqttBrokerStats bs = broker.stats();
+  printf("device: %u frames, %u dropped on the link, %u publish failures; broker: %u in, %u out\n", device.frames,
+         device.dropped, device.failed, bs.received, bs.forwarded);
+  // Every frame sent must arrive, and every drop but the trailing ones be found
+  bool ok = logger.malformed == 0 && seq.repeated == 0 && seq.restarts == 0 && device.failed == 0 &&
+            seq.frames == device.frames - device.dropped && seq.lost == device.dropped - device.trailingDrops;
+  printf("sequence check: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,925 @@
+// Load generator for brokers and backends, built from the firmware itself:
+// N virtual reactors in one process, each running the real subsystem tasks,
+// loop() and the telemetry, sample and diagnostics tasks of main.ino
+// (VirtualDevice.cpp) against its own PlantModel, and speaking MQTT the way
+// the network task does (CONNECT, the three subscriptions, the shared
+// attribute request, then JSON status, binary frames, RPC responses and
+// client attributes).
+//
+// There is no thread per reactor. The firmware is a shared library
+// (bioreactor_image) and every reactor owns a copy of its globals, about
+// 10 KB (FirmwareImage.hpp). One event loop keeps the reactors in a timer
+// heap: when a reactor is due, or a message has arrived for it, its copy is
+// loaded, its plant is brought up to now, loop() runs once, and the copy is
+// saved again. A reactor is due at its next task release, but at most every
+// --tick-ms: in between, the scheduler drops the releases it missed (as an
+// overloaded ESP32 would, and counts them in the status "sched" block), so
+// the 10 ms control loops run at the tick rate. --tick-ms 10 runs them at
+// their own rate, for fewer reactors.
+//
+// By default the reactors connect to an in-process MqttGateway, which gives
+// each its own v1/devices/me, in front of the MqttBroker stand-in for
+// ThingsBoard. A cloud-side client answers their attribute requests with
+// setpoints, counts what arrives, and sends setPump RPCs (--rpc-hz) and
+// target_rpm updates (--attr-hz) to random reactors, timing the RPC round
+// trips. --connect HOST:PORT sends the reactors to a broker that tells them
+// apart by client ID instead (bioreactor_gateway, or ThingsBoard with client
+// ID credentials); then only the device side is measured.
+//
+// --devices takes a list: the fleet grows to each count in turn and is
+// measured for --seconds at each, one table row per step.
+//
+// Usage: bioreactor_loadgen [--devices N[,N...]] [--seconds S] [--publish-ms MS] [--tick-ms MS] [--binary]
+//                           [--rpc-hz F] [--attr-hz F] [--batch-ms MS] [--connect HOST:PORT] [--user TOKEN]
+
+#include "ControlLoop.hpp"
+#include "FirmwareImage.hpp"
+#include "HalLinux.hpp"
+#include "MqttBroker.hpp"
+#include "MqttClient.hpp"
+#include "MqttGateway.hpp"
+#include "PlantModel.hpp"
+#include "VirtualDevice.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <random>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+static const uint64_t PLANT_STEP_US = 10000;     // As Simulation's default plant step
+static const uint32_t HALL_REPLAY = 16;          // Newest Hall edges replayed before each run (Simulation.cpp)
+static const size_t RX_MAX = 64 * 1024;          // A reactor that gets more than this unread is dropped
+static const uint64_t RECONNECT_US = 1000000;    // As mqtt_reconnect() between attempts
+static const uint16_t KEEPALIVE_S = 15;          // PubSubClient's default
+static const int SERVICES_PER_POLL = 256;        // Reactors run between two looks at the sockets
+
+// -------------------------------------------------------------
+// Heap guard
+// -------------------------------------------------------------
+// Every reactor's copy of the image starts as the same boot bytes, so a heap
+// pointer in the firmware's globals would be shared by all of them, and freed
+// or grown under the others by whichever ran first. The firmware keeps no
+// heap state (only the SampleHistory, which each reactor allocates for
+// itself); this makes that fatal instead of silent. glibc's malloc is
+// interposed, and firmware code run for a reactor, setup() included, aborts
+// the process if it returns with a block still allocated or frees one it did
+// not allocate itself. Scratch memory freed before returning (a heap-backed
+// JsonDocument) is allowed.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static const int CALL_BLOCKS_MAX = 64;
+static thread_local const char* firmwareCall = nullptr; // The firmware entry point running on this thread
+static thread_local void* callBlocks[CALL_BLOCKS_MAX];  // Allocated by it and not yet freed
+static thread_local int callBlockCount = 0;
+
+static void heapFault(const char* what) {
+  // No stdio: it may allocate
+  const char* parts[] = {"bioreactor_loadgen: ", firmwareCall, "() ", what,
+                         ": the firmware's globals must not own heap memory (FirmwareImage.hpp)\n"};
+  for (const char* part : parts) {
+    if (write(STDERR_FILENO, part, strlen(part)) < 0) break;
+  }
+  abort();
+}
+
+static void allocated(void* ptr) {
+  if (!firmwareCall || !ptr) return;
+  if (callBlockCount == CALL_BLOCKS_MAX) heapFault("holds too many heap blocks");
+  callBlocks[callBlockCount++] = ptr;
+}
+
+static void freed(void* ptr) {
+  if (!firmwareCall || !ptr) return;
+  for (int i = callBlockCount - 1; i >= 0; i--) {
+    if (callBlocks[i] == ptr) {
+      callBlocks[i] = callBlocks[--callBlockCount];
+      return;
+    }
+  }
+  heapFault("freed memory allocated before it");
+}
+
+extern "C" void* malloc(size_t size) {
+  void* ptr = __libc_malloc(size);
+  allocated(ptr);
+  return ptr;
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  void* ptr = __libc_calloc(count, size);
+  allocated(ptr);
+  return ptr;
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+  freed(ptr);
+  void* moved = __libc_realloc(ptr, size);
+  allocated(moved ? moved : size ? ptr : nullptr); // On failure the old block stays
+  return moved;
+}
+
+extern "C" void free(void* ptr) {
+  freed(ptr);
+  __libc_free(ptr);
+}
+
+// Marks the firmware code run in its scope for the heap guard
+struct FirmwareCall {
+  explicit FirmwareCall(const char* name) {
+    firmwareCall = name;
+    callBlockCount = 0;
+  }
+  ~FirmwareCall() {
+    if (callBlockCount) heapFault("returned with heap memory allocated");
+    firmwareCall = nullptr;
+  }
+};
+
+static std::atomic<bool> running(true);
+
+static void onSignal(int) {
+  running = false;
+}
+
+static uint64_t monotonicUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t wallUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static double threadCpuS() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double processCpuS() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static double residentMb() {
+  long pages = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f) {
+    long size;
+    if (fscanf(f, "%ld %ld", &size, &pages) != 2) pages = 0;
+    fclose(f);
+  }
+  return pages * (double)sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+static double percentile(std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--devices N[,N...]] [--seconds S] [--publish-ms MS] [--tick-ms MS] [--binary]\n"
+          "          [--rpc-hz F] [--attr-hz F] [--batch-ms MS] [--connect HOST:PORT] [--user TOKEN]\n",
+          argv0);
+}
+
+// -------------------------------------------------------------
+// Virtual reactors
+// -------------------------------------------------------------
+struct Reactor {
+  Reactor(int index, const PlantParams& params) : index(index), plant(params, (uint32_t)index + 1) {
+    snprintf(id, sizeof(id), "vdev-%05d", index);
+  }
+
+  int index;
+  char id[16];
+  int fd = -1;
+  bool online = false;       // CONNACK seen
+  bool writing = false;      // Waiting for EPOLLOUT
+  std::unique_ptr<uint8_t[]> state;
+  PlantModel plant;
+  uint64_t simUs = 0;        // Its clock at the last run
+  uint64_t dueUs = 0;        // Next run (0: not scheduled)
+  uint64_t rxUs = 0;         // Arrival of the oldest message not yet applied
+  uint64_t lastSendUs = 0;
+  uint64_t reconnectUs = 0;
+  std::vector<uint8_t> rx;
+  std::vector<uint8_t> tx;
+};
+
+struct FleetStats {
+  uint64_t runs = 0;
+  uint64_t published = 0;    // PUBLISH packets sent: status, diagnostics, responses, attributes
+  uint64_t frames = 0;       // ... of which binary frames
+  uint64_t received = 0;     // PUBLISH packets applied
+  uint64_t outboxDropped = 0;
+  uint64_t disconnects = 0;
+  std::vector<double> lagMs;     // Run start - due time
+  std::vector<double> appliedMs; // Message arrival - end of the run that applied it
+};
+
+static Reactor* loaded = nullptr; // The reactor whose image is loaded
+
+static int reactorAdc(uint8_t pin) {
+  return loaded ? loaded->plant.adcCode(pin) : 0;
+}
+
+class Fleet {
+public:
+  Fleet(const sockaddr_storage& address, socklen_t addressLength, const char* user, uint32_t publishUs,
+        uint32_t tickUs, bool binary)
+      : address_(address), addressLength_(addressLength), user_(user), tickUs_(tickUs), binary_(binary),
+        outbox_(outboxQueue_), startUs_(monotonicUs()) {
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+
+    // The boot image every reactor starts from: setup() with the HAL reading
+    // the loaded reactor's plant
+    halSimReset();
+    halSimSetLogEnabled(false);
+    halSimSetAdcHook(reactorAdc);
+    halSimSetTimeUs(0);
+    halSimSetEpochUs(wallUs());
+    FirmwareCall call("virtualDeviceSetup");
+    virtualDeviceSetup(publishUs, outbox_);
+  }
+
+  bool attach() {
+    if (!image_.attach((const void*)virtualDeviceSetup)) return false;
+    boot_.reset(new uint8_t[image_.size()]);
+    image_.save(boot_.get());
+    return true;
+  }
+
+  size_t stateBytes() const { return image_.size(); }
+  size_t size() const { return reactors_.size(); }
+  int online() const { return online_; }
+
+  /**
+   * @brief Boots and connects reactors up to count, each with its tasks
+   * started at a random point of the publish period so they do not all
+   * report at once.
+   */
+  bool grow(size_t count, uint32_t publishUs) {
+    PlantParams params;
+    std::mt19937 rng((uint32_t)reactors_.size() + 1);
+    while (reactors_.size() < count) {
+      reactors_.emplace_back(new Reactor((int)reactors_.size(), params));
+      Reactor& r = *reactors_.back();
+      r.state.reset(new uint8_t[image_.size()]);
+
+      uint64_t nowUs = monotonicUs();
+      uint64_t offsetUs = rng() % publishUs;
+      r.simUs = nowUs - startUs_ > offsetUs ? nowUs - startUs_ - offsetUs : 0;
+      loaded = &r;
+      image_.load(boot_.get());
+      halSimSetTimeUs(r.simUs);
+      if (binary_ && !virtualDeviceEnableHistory()) return false; // The one allocation, its own
+      {
+        FirmwareCall call("virtualDeviceStart");
+        virtualDeviceStart();
+      }
+      image_.save(r.state.get());
+      loaded = nullptr;
+
+      if (!connect(r)) return false;
+      schedule(r, nowUs);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Runs the reactors until untilUs.
+   */
+  void run(uint64_t untilUs, FleetStats& stats) {
+    epoll_event events[256];
+    uint64_t now = monotonicUs();
+    while (running && now < untilUs) {
+      int ran = 0;
+      while (!due_.empty() && due_.top().first <= now && ran < SERVICES_PER_POLL) {
+        std::pair<uint64_t, uint32_t> next = due_.top();
+        due_.pop();
+        Reactor& r = *reactors_[next.second];
+        if (r.dueUs != next.first) continue; // Moved earlier since
+        r.dueUs = 0;
+        stats.lagMs.push_back((now - next.first) / 1000.0);
+        service(r, now, stats);
+        ran++;
+        now = monotonicUs();
+      }
+
+      int timeoutMs = 0;
+      if (ran < SERVICES_PER_POLL) {
+        uint64_t wakeUs = due_.empty() ? now + 10000 : std::min(due_.top().first, now + 10000);
+        wakeUs = std::min(wakeUs, untilUs);
+        timeoutMs = wakeUs > now ? (int)((wakeUs - now + 999) / 1000) : 0;
+      }
+      int n = epoll_wait(epollFd_, events, 256, timeoutMs);
+      now = monotonicUs();
+      for (int i = 0; i < n; i++) {
+        Reactor& r = *reactors_[events[i].data.u32];
+        if (r.fd < 0) continue;
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+          drop(r, now, stats);
+          continue;
+        }
+        if (events[i].events & EPOLLOUT) flush(r);
+        if ((events[i].events & EPOLLIN) && !receive(r, now)) drop(r, now, stats);
+      }
+    }
+  }
+
+private:
+  bool connect(Reactor& r) {
+    r.fd = socket(address_.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (r.fd < 0 || ::connect(r.fd, (const sockaddr*)&address_, addressLength_) != 0) {
+      if (r.fd >= 0) close(r.fd);
+      r.fd = -1;
+      return false;
+    }
+    int one = 1;
+    setsockopt(r.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(r.fd, F_SETFL, fcntl(r.fd, F_GETFL) | O_NONBLOCK);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = (uint32_t)r.index;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, r.fd, &event);
+
+    // mqtt_reconnect()
+    r.online = false;
+    r.writing = false;
+    r.rx.clear();
+    r.tx.clear();
+    r.rxUs = 0;
+    mqttEncodeConnect(r.tx, r.id, user_, nullptr, KEEPALIVE_S);
+    mqttEncodeSubscribe(r.tx, 1, "v1/devices/me/rpc/request/+");
+    mqttEncodeSubscribe(r.tx, 2, "v1/devices/me/attributes");
+    mqttEncodeSubscribe(r.tx, 3, "v1/devices/me/attributes/response/+");
+    static const char REQUEST[] = "{\"sharedKeys\":\"target_pH,pH_tolerance,target_temperature,target_rpm\"}";
+    mqttEncodePublish(r.tx, "v1/devices/me/attributes/request/1", 34, (const uint8_t*)REQUEST, sizeof(REQUEST) - 1);
+    flush(r);
+    return r.fd >= 0;
+  }
+
+  void drop(Reactor& r, uint64_t now, FleetStats& stats) {
+    if (r.fd < 0) return;
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, r.fd, nullptr);
+    close(r.fd);
+    r.fd = -1;
+    if (r.online) online_--;
+    r.online = false;
+    r.reconnectUs = now + RECONNECT_US;
+    stats.disconnects++;
+  }
+
+  void schedule(Reactor& r, uint64_t atUs) {
+    if (r.dueUs && r.dueUs <= atUs) return;
+    r.dueUs = atUs;
+    due_.push(std::make_pair(atUs, (uint32_t)r.index));
+  }
+
+  bool receive(Reactor& r, uint64_t now) {
+    uint8_t chunk[4096];
+    for (;;) {
+      ssize_t n = recv(r.fd, chunk, sizeof(chunk), 0);
+      if (n > 0) {
+        r.rx.insert(r.rx.end(), chunk, chunk + n);
+        if (r.rx.size() > RX_MAX) return false;
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      return false;
+    }
+    if (!r.rx.empty()) {
+      if (!r.rxUs) r.rxUs = now;
+      schedule(r, now); // The network task hands it over at once; loop() applies it next
+    }
+    return true;
+  }
+
+  void flush(Reactor& r) {
+    size_t sent = 0;
+    while (sent < r.tx.size()) {
+      ssize_t n = send(r.fd, r.tx.data() + sent, r.tx.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) break;
+      sent += (size_t)n;
+    }
+    r.tx.erase(r.tx.begin(), r.tx.begin() + sent);
+    if (sent) r.lastSendUs = monotonicUs();
+    bool writing = !r.tx.empty();
+    if (writing != r.writing) {
+      epoll_event event = {};
+      event.events = EPOLLIN | (writing ? (uint32_t)EPOLLOUT : 0u);
+      event.data.u32 = (uint32_t)r.index;
+      epoll_ctl(epollFd_, EPOLL_CTL_MOD, r.fd, &event);
+      r.writing = writing;
+    }
+  }
+
+  // Hands the reactor's received packets to its inbox, as mqtt_callback()
+  // does. Leaves room in the outbox for the responses.
+  int takeMessages(Reactor& r) {
+    size_t pos = 0;
+    int taken = 0;
+    for (;;) {
+      MqttPacket packet;
+      long used = mqttParsePacket(r.rx.data() + pos, r.rx.size() - pos, packet);
+      if (used <= 0) break;
+      if (packet.type == MQTT_PUBLISH) {
+        if (taken >= (int)MQTT_QUEUE_DEPTH / 2) break;
+        MqttPublish message;
+        if (mqttParsePublish(packet, message) && message.topicLength < MQTT_TOPIC_MAX) {
+          char topic[MQTT_TOPIC_MAX];
+          memcpy(topic, message.topic, message.topicLength);
+          topic[message.topicLength] = '\0';
+          if (mqttEnqueue(inbox_, topic, message.payload, message.payloadLength)) taken++;
+        }
+      } else if (packet.type == MQTT_CONNACK) {
+        uint8_t code = 1;
+        if (mqttParseConnack(packet, code) && code == 0 && !r.online) {
+          r.online = true;
+          online_++;
+        }
+      }
+      pos += (size_t)used;
+    }
+    r.rx.erase(r.rx.begin(), r.rx.begin() + pos);
+    return taken;
+  }
+
+  void service(Reactor& r, uint64_t now, FleetStats& stats) {
+    if (r.fd < 0) {
+      if (now < r.reconnectUs || !connect(r)) {
+        r.reconnectUs = std::max(r.reconnectUs, now + RECONNECT_US);
+        schedule(r, r.reconnectUs);
+        return;
+      }
+    }
+
+    loaded = &r;
+    image_.load(r.state.get());
+    uint64_t simNow = now - startUs_;
+
+    // The plant, under the duties the firmware has been putting out since its last run
+    double heater = halSimPwmFraction(PLANT_HEATER_PIN);
+    double motor = halSimPwmFraction(PLANT_MOTOR_PIN);
+    double acid = halSimPwmFraction(PLANT_ACID_PIN);
+    double base = halSimPwmFraction(PLANT_BASE_PIN);
+    for (uint64_t t = r.simUs; t < simNow; t += PLANT_STEP_US) {
+      r.plant.step(std::min(PLANT_STEP_US, simNow - t) * 1e-6, heater, motor, acid, base);
+    }
+
+    // The newest Hall edges at the new shaft speed, for the RPM measurement
+    double rate = r.plant.hallPulseRateHz();
+    if (rate > 1.0 && simNow > r.simUs) {
+      uint64_t periodUs = std::max<uint64_t>(1, (uint64_t)(1e6 / rate));
+      uint64_t edges = std::min<uint64_t>(HALL_REPLAY, (simNow - r.simUs) / periodUs);
+      for (uint64_t k = edges; k > 0; k--) {
+        if (!r.plant.deliverHallPulse()) continue;
+        halSimSetTimeUs(simNow - (k - 1) * periodUs);
+        FirmwareCall call("halSimTriggerInterrupt");
+        halSimTriggerInterrupt(PLANT_ENCODER_PIN);
+      }
+    }
+    halSimSetTimeUs(simNow);
+    r.simUs = simNow;
+
+    int taken = takeMessages(r);
+    uint32_t droppedBefore = outbox_.dropped();
+    {
+      FirmwareCall call("virtualDeviceLoop");
+      virtualDeviceLoop(inbox_, outbox_, r.online);
+    }
+    stats.outboxDropped += outbox_.dropped() - droppedBefore;
+
+    // The network task's side: publishOutbox(), then publishHistory()
+    static MqttMessage message;
+    while (outboxQueue_.pop(message)) {
+      mqttEncodePublish(r.tx, message.topic, strlen(message.topic), message.payload, message.length);
+      stats.published++;
+    }
+    if (binary_) {
+      uint8_t frame[TELEMETRY_FRAME_MAX];
+      size_t length;
+      {
+        FirmwareCall call("virtualDeviceFrame");
+        length = virtualDeviceFrame(frame, r.online);
+      }
+      if (length) {
+        mqttEncodePublish(r.tx, TELEMETRY_BIN_TOPIC, sizeof(TELEMETRY_BIN_TOPIC) - 1, frame, length);
+        stats.published++;
+        stats.frames++;
+      }
+    }
+    uint64_t idleUs = virtualDeviceIdleUs();
+    image_.save(r.state.get());
+    loaded = nullptr;
+
+    if (r.online && r.tx.empty() && now - r.lastSendUs >= KEEPALIVE_S * 500000ull) {
+      mqttEncodeEmpty(r.tx, MQTT_PINGREQ);
+    }
+    if (!r.tx.empty() && !r.writing) flush(r);
+    stats.runs++;
+
+    uint64_t end = monotonicUs();
+    if (taken) {
+      stats.received += taken;
+      stats.appliedMs.push_back((end - r.rxUs) / 1000.0);
+      r.rxUs = 0;
+    }
+    if (!r.rx.empty() && taken) {
+      r.rxUs = end;
+      schedule(r, end); // More than fit in the inbox
+    } else {
+      schedule(r, now + std::max<uint64_t>(idleUs, tickUs_));
+    }
+  }
+
+  sockaddr_storage address_;
+  socklen_t addressLength_;
+  const char* user_;
+  uint64_t tickUs_;
+  bool binary_;
+  FirmwareImage image_;
+  std::unique_ptr<uint8_t[]> boot_;
+  std::vector<std::unique_ptr<Reactor>> reactors_;
+  std::priority_queue<std::pair<uint64_t, uint32_t>, std::vector<std::pair<uint64_t, uint32_t>>,
+                      std::greater<std::pair<uint64_t, uint32_t>>> due_;
+  MqttQueue inbox_;       // Shared: one reactor runs at a time, and leaves them empty
+  MqttQueue outboxQueue_;
+  MqttOutbox outbox_;
+  uint64_t startUs_;
+  int epollFd_;
+  int online_ = 0;
+};
+
+// -------------------------------------------------------------
+// The ThingsBoard side (in-process mode)
+// -------------------------------------------------------------
+struct Cloud {
+  std::mutex lock;
+  std::atomic<int> devices{0};      // Reactors that may be sent RPCs
+  std::atomic<uint64_t> entries{0}; // Telemetry messages in v1/gateway/telemetry
+  std::atomic<uint64_t> frames{0};
+  std::atomic<uint64_t> attributeRequests{0};
+  std::unordered_map<uint32_t, uint64_t> pending; // RPC id -> sent time
+  std::vector<double> rpcMs;
+  std::vector<std::string> responses; // Attribute responses to send after the poll
+  uint64_t rpcSent = 0;
+  uint64_t updatesSent = 0;
+};
+
+static bool findNumber(const char* body, const char* end, const char* key, uint64_t& out) {
+  size_t keyLength = strlen(key);
+  const char* p = (const char*)memmem(body, end - body, key, keyLength);
+  if (!p) return false;
+  out = strtoull(p + keyLength, nullptr, 10);
+  return true;
+}
+
+static void onCloudMessage(const MqttPublish& message, void* ctx) {
+  Cloud* cloud = (Cloud*)ctx;
+  std::string topic(message.topic, message.topicLength);
+  const char* body = (const char*)message.payload;
+  const char* end = body + message.payloadLength;
+
+  if (topic == "v1/gateway/telemetry") {
+    static const char KEY[] = "{\"ts\":";
+    uint64_t count = 0;
+    for (const char* p = body; (p = (const char*)memmem(p, end - p, KEY, sizeof(KEY) - 1)); p++) count++;
+    cloud->entries += count;
+  } else if (topic.compare(0, 11, "bioreactor/") == 0) {
+    cloud->frames++;
+  } else if (topic == "v1/gateway/rpc") {
+    uint64_t id;
+    if (memmem(body, end - body, "\"method\"", 8) || !findNumber(body, end, "\"id\":", id)) return;
+    uint64_t now = monotonicUs();
+    std::lock_guard<std::mutex> guard(cloud->lock);
+    auto found = cloud->pending.find((uint32_t)id);
+    if (found == cloud->pending.end()) return;
+    cloud->rpcMs.push_back((now - found->second) / 1000.0);
+    cloud->pending.erase(found);
+  } else if (topic == "v1/gateway/attributes/request") {
+    // {"id":N,"device":"vdev-00001",...}: the setpoints it asked for
+    uint64_t id;
+    const char* device = (const char*)memmem(body, end - body, "\"device\":\"", 10);
+    if (!findNumber(body, end, "\"id\":", id) || !device) return;
+    device += 10;
+    const char* deviceEnd = (const char*)memchr(device, '"', end - device);
+    if (!deviceEnd) return;
+    char response[256];
+    snprintf(response, sizeof(response),
+             "{\"id\":%llu,\"device\":\"%.*s\",\"values\":{\"target_pH\":5.0,\"pH_tolerance\":0.2,"
+             "\"target_temperature\":30,\"target_rpm\":1000}}",
+             (unsigned long long)id, (int)(deviceEnd - device), device);
+    cloud->attributeRequests++;
+    std::lock_guard<std::mutex> guard(cloud->lock);
+    cloud->responses.push_back(response);
+  }
+}
+
+/**
+ * @brief Stands in for ThingsBoard's rule engine and dashboard: answers the
+ * attribute requests, and sends RPCs and attribute updates to random reactors.
+ */
+static void runCloud(MqttClient& client, Cloud& cloud, double rpcHz, double attrHz,
+                     const std::atomic<bool>& active) {
+  std::mt19937 rng(7);
+  uint64_t rpcPeriodUs = rpcHz > 0 ? (uint64_t)(1e6 / rpcHz) : 0;
+  uint64_t attrPeriodUs = attrHz > 0 ? (uint64_t)(1e6 / attrHz) : 0;
+  uint64_t nextRpcUs = monotonicUs(), nextAttrUs = nextRpcUs;
+  uint32_t rpcId = 1;
+  std::vector<std::string> responses;
+
+  while (active && client.connected()) {
+    client.poll(1);
+    {
+      std::lock_guard<std::mutex> guard(cloud.lock);
+      responses.swap(cloud.responses);
+    }
+    for (const std::string& response : responses) {
+      client.publish("v1/gateway/attributes/response", (const uint8_t*)response.data(), response.size());
+    }
+    responses.clear();
+
+    int devices = cloud.devices;
+    if (devices == 0) continue;
+    uint64_t now = monotonicUs();
+    char payload[200];
+    while (rpcPeriodUs && nextRpcUs <= now) {
+      uint32_t id = rpcId++;
+      int length = snprintf(payload, sizeof(payload),
+                            "{\"device\":\"vdev-%05d\",\"data\":{\"id\":%u,\"method\":\"setPump\","
+                            "\"params\":{\"pump\":\"%s\",\"duration\":200}}}",
+                            (int)(rng() % devices), id, id % 2 ? "acid" : "base");
+      {
+        std::lock_guard<std::mutex> guard(cloud.lock);
+        cloud.pending[id] = monotonicUs();
+        cloud.rpcSent++;
+      }
+      client.publish("v1/gateway/rpc", (const uint8_t*)payload, (size_t)length);
+      nextRpcUs += rpcPeriodUs;
+    }
+    while (attrPeriodUs && nextAttrUs <= now) {
+      int length = snprintf(payload, sizeof(payload), "{\"device\":\"vdev-%05d\",\"data\":{\"target_rpm\":%d}}",
+                            (int)(rng() % devices), 800 + (int)(rng() % 401));
+      client.publish("v1/gateway/attributes", (const uint8_t*)payload, (size_t)length);
+      cloud.updatesSent++;
+      nextAttrUs += attrPeriodUs;
+    }
+  }
+}
+
+// -------------------------------------------------------------
+// main
+// -------------------------------------------------------------
+int main(int argc, char** argv) {
+  std::vector<size_t> steps;
+  double seconds = 10;
+  uint32_t publishMs = 5000; // PUBLISH_PERIOD_US with binary telemetry
+  uint32_t tickMs = 100;
+  bool binary = false;
+  double rpcHz = 50;
+  double attrHz = 10;
+  int batchMs = 20;
+  const char* connectTo = nullptr;
+  const char* user = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--devices") && hasValue) {
+      for (char* p = argv[++i]; *p;) {
+        char* next;
+        long n = strtol(p, &next, 10);
+        if (next == p || n <= 0) {
+          usage(argv[0]);
+          return 2;
+        }
+        steps.push_back((size_t)n);
+        p = *next == ',' ? next + 1 : next;
+      }
+    } else if (!strcmp(argv[i], "--seconds") && hasValue) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--publish-ms") && hasValue) publishMs = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--tick-ms") && hasValue) tickMs = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--binary")) binary = true;
+    else if (!strcmp(argv[i], "--rpc-hz") && hasValue) rpcHz = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--attr-hz") && hasValue) attrHz = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--batch-ms") && hasValue) batchMs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--connect") && hasValue) connectTo = argv[++i];
+    else if (!strcmp(argv[i], "--user") && hasValue) user = argv[++i];
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (steps.empty()) steps = {1000};
+  if (seconds <= 0 || publishMs == 0 || tickMs == 0 || batchMs < 1 || !std::is_sorted(steps.begin(), steps.end())) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // A socket per reactor, and the gateway's end of it in-process
+  size_t maxDevices = steps.back();
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  size_t fdsNeeded = (connectTo ? 1 : 2) * maxDevices + 64;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)fdsNeeded) {
+    fprintf(stderr, "open file limit %llu is too low for %zu devices\n", (unsigned long long)limit.rlim_cur,
+            maxDevices);
+    return 1;
+  }
+
+  // --- The other end: a broker, or the gateway in front of the stand-in ---
+  MqttBroker broker;
+  MqttGateway gateway;
+  MqttClient cloudClient;
+  Cloud cloud;
+  std::atomic<bool> brokerRunning(true), cloudRunning(true);
+  std::thread brokerThread, cloudThread;
+  std::string host = "127.0.0.1";
+  uint16_t port = 0;
+
+  if (connectTo) {
+    const char* colon = strrchr(connectTo, ':');
+    if (!colon) {
+      usage(argv[0]);
+      return 2;
+    }
+    host.assign(connectTo, colon - connectTo);
+    port = (uint16_t)atoi(colon + 1);
+  } else {
+    if (!broker.listen("127.0.0.1", 0)) {
+      perror("broker");
+      return 1;
+    }
+    brokerThread = std::thread([&] { broker.run(brokerRunning); });
+
+    MqttGatewayConfig config;
+    config.listenAddress = "127.0.0.1";
+    config.listenPort = 0;
+    config.upstreamPort = broker.port();
+    config.batchMs = batchMs;
+    config.ioThreads = 2;
+    if (!gateway.start(config)) {
+      perror("gateway");
+      return 1;
+    }
+    port = gateway.port();
+
+    const char* filters[] = {"v1/gateway/telemetry", "v1/gateway/rpc", "v1/gateway/attributes/request",
+                             "bioreactor/+/telemetry/bin"};
+    bool subscribed = cloudClient.connect("127.0.0.1", broker.port(), "loadgen-cloud");
+    for (const char* filter : filters) subscribed = subscribed && cloudClient.subscribe(filter, onCloudMessage, &cloud);
+    if (!subscribed) {
+      fprintf(stderr, "cannot connect to the stand-in broker\n");
+      return 1;
+    }
+    cloudThread = std::thread([&] { runCloud(cloudClient, cloud, rpcHz, attrHz, cloudRunning); });
+  }
+
+  addrinfo hints = {}, *resolved = nullptr;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &resolved) != 0 || !resolved) {
+    fprintf(stderr, "cannot resolve %s\n", host.c_str());
+    return 1;
+  }
+  sockaddr_storage address = {};
+  memcpy(&address, resolved->ai_addr, resolved->ai_addrlen);
+  socklen_t addressLength = resolved->ai_addrlen;
+  freeaddrinfo(resolved);
+
+  Fleet fleet(address, addressLength, user, publishMs * 1000, tickMs * 1000, binary);
+  if (!fleet.attach()) {
+    fprintf(stderr, "cannot find the firmware image's data\n");
+    return 1;
+  }
+
+  printf("%zu bytes of firmware state per reactor; status every %u ms, run at most every %u ms%s\n",
+         fleet.stateBytes(), publishMs, tickMs, binary ? ", binary frames every 5 s" : "");
+  if (connectTo) printf("reactors connect to %s\n\n", connectTo);
+  else printf("in-process gateway (%d ms batches) and broker; %g RPC/s and %g attribute updates/s\n\n", batchMs,
+              rpcHz, attrHz);
+  printf("| Devices | Published msg/s | Delivered msg/s | RPC p50 / p99 / p99.9 ms | Applied p99 ms | "
+         "Loop lag p50 / p99 ms | Loop CPU | us/run | RSS MB |\n");
+  printf("| ---: | ---: | ---: | ---: | ---: | ---: | ---: | ---: | ---: |\n");
+  fflush(stdout);
+
+  bool ok = true;
+  for (size_t count : steps) {
+    if (!running) break;
+    if (!fleet.grow(count, publishMs * 1000)) {
+      fprintf(stderr, "cannot start %zu devices (%s)\n", count, strerror(errno));
+      ok = false;
+      break;
+    }
+
+    // Until they are all connected and have booted, then the measured window
+    FleetStats warmup;
+    uint64_t settleUntil = monotonicUs() + 30000000;
+    while (running && fleet.online() < (int)count && monotonicUs() < settleUntil) {
+      fleet.run(monotonicUs() + 100000, warmup);
+    }
+    cloud.devices = (int)count;
+    fleet.run(monotonicUs() + publishMs * 1000ull, warmup);
+
+    FleetStats stats;
+    stats.lagMs.reserve((size_t)(count * seconds * 1000 / tickMs) + 1024);
+    uint64_t entries0 = cloud.entries + cloud.frames;
+    size_t rpc0;
+    {
+      std::lock_guard<std::mutex> guard(cloud.lock);
+      rpc0 = cloud.rpcMs.size();
+    }
+    double cpu0 = threadCpuS();
+    uint64_t t0 = monotonicUs();
+    fleet.run(t0 + (uint64_t)(seconds * 1e6), stats);
+    double elapsedS = (monotonicUs() - t0) * 1e-6;
+    double cpuS = threadCpuS() - cpu0;
+    uint64_t delivered = cloud.entries + cloud.frames - entries0;
+
+    std::vector<double> rpcMs;
+    {
+      std::lock_guard<std::mutex> guard(cloud.lock);
+      rpcMs.assign(cloud.rpcMs.begin() + rpc0, cloud.rpcMs.end());
+    }
+    std::sort(rpcMs.begin(), rpcMs.end());
+    std::sort(stats.lagMs.begin(), stats.lagMs.end());
+    std::sort(stats.appliedMs.begin(), stats.appliedMs.end());
+
+    char deliveredText[32] = "-", rpcText[64] = "-";
+    if (!connectTo) {
+      snprintf(deliveredText, sizeof(deliveredText), "%.0f", delivered / elapsedS);
+      snprintf(rpcText, sizeof(rpcText), "%.1f / %.1f / %.1f", percentile(rpcMs, 0.5), percentile(rpcMs, 0.99),
+               percentile(rpcMs, 0.999));
+    }
+    printf("| %zu | %.0f | %s | %s | %.1f | %.1f / %.1f | %.0f%% | %.1f | %.0f |\n", count,
+           stats.published / elapsedS, deliveredText, rpcText, percentile(stats.appliedMs, 0.99),
+           percentile(stats.lagMs, 0.5), percentile(stats.lagMs, 0.99), 100 * cpuS / elapsedS,
+           stats.runs ? cpuS * 1e6 / stats.runs : 0.0, residentMb());
+    fflush(stdout);
+    if (stats.disconnects || stats.outboxDropped) {
+      printf("|   | %llu disconnects, %llu outbox messages dropped | | | | | | | |\n",
+             (unsigned long long)stats.disconnects, (unsigned long long)stats.outboxDropped);
+      ok = false;
+    }
+    if (fleet.online() < (int)count) {
+      fprintf(stderr, "only %d of %zu devices online\n", fleet.online(), count);
+      ok = false;
+    }
+  }
+
+  if (!connectTo) {
+    cloud.devices = 0;
+    gateway.stop();
+    uint64_t drainUntil = monotonicUs() + 3 * batchMs * 1000 + 500000;
+    while (monotonicUs() < drainUntil) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    cloudRunning = false;
+    cloudThread.join();
+    cloudClient.disconnect();
+    brokerRunning = false;
+    brokerThread.join();
+
+    MqttGatewayStats g = gateway.stats();
+    std::lock_guard<std::mutex> guard(cloud.lock);
+    printf("\n%llu RPCs and %llu attribute updates sent, %zu RPCs unanswered; %llu attribute requests answered; "
+           "gateway %llu dropped, %llu undeliverable; %.1f s CPU in total\n",
+           (unsigned long long)cloud.rpcSent, (unsigned long long)cloud.updatesSent, cloud.pending.size(),
+           (unsigned long long)cloud.attributeRequests.load(), (unsigned long long)g.dropped,
+           (unsigned long long)g.undeliverable, processCpuS());
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+// Offline replay of the anomaly detectors (main/Detectors.hpp) over summary
+// CSVs (bioreactor_sim --csv, data-analysis/logs/*.csv), scored the way
+// anomalydetection/main does live: the baselines are learned from the first
+// rows of a fault-free file, then every row of the test file goes through the
+// zscore/hysteresis/sliding detectors of each signal and is compared with its
+// faults column.
+//
+// Usage: bioreactor_replay --train NOFAULTS.csv --test FAULTS.csv [--train-samples N] [--skip N]
+//
+// --skip drops the first N rows of both files (the start-up transient, which
+// would otherwise dominate the learned baseline).
+
+#include "Detectors.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char* SIGNALS[] = {"temp_mean", "ph_mean", "rpm_mean"};
+static const int SIGNAL_COUNT = 3;
+static const char* DETECTORS[] = {"zscore", "hysteresis", "sliding"};
+static const int DETECTOR_COUNT = 3;
+
+struct Row {
+  float values[SIGNAL_COUNT];
+  bool fault;
+};
+
+// Reads the signal and faults columns; faults is "None" (or empty) when healthy
+static bool readCsv(const char* path, std::vector<Row>& rows) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  char line[1024];
+  int columns[SIGNAL_COUNT] = {-1, -1, -1};
+  int faultsColumn = -1;
+
+  if (fgets(line, sizeof(line), f)) {
+    int column = 0;
+    for (char* field = strtok(line, ",\r\n"); field; field = strtok(nullptr, ",\r\n"), column++) {
+      for (int s = 0; s < SIGNAL_COUNT; s++) {
+        if (!strcmp(field, SIGNALS[s])) columns[s] = column;
+      }
+      if (!strcmp(field, "faults")) faultsColumn = column;
+    }
+  }
+  for (int s = 0; s < SIGNAL_COUNT; s++) {
+    if (columns[s] < 0) {
+      fprintf(stderr, "%s: no %s column\n", path, SIGNALS[s]);
+      fclose(f);
+      return false;
+    }
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    Row row = {{0, 0, 0}, false};
+    int column = 0;
+    // strsep keeps empty fields, so column numbers stay aligned
+    char* cursor = line;
+    for (char* field = strsep(&cursor, ",\r\n"); field; field = strsep(&cursor, ",\r\n"), column++) {
+      for (int s = 0; s < SIGNAL_COUNT; s++) {
+        if (column == columns[s]) row.values[s] = strtof(field, nullptr);
+      }
+      if (column == faultsColumn) row.fault = field[0] != '\0' && strcmp(field, "None") != 0;
+    }
+    rows.push_back(row);
+  }
+
+  fclose(f);
+  return true;
+}
+
+struct SignalDetectors {
+  BaselineZScoreDetector zscore{3.0f};
+  BandHysteresisDetector hysteresis{3.0f, 0.5f};
+  BaselineDriftDetector<64> sliding{30, 2.0f};
+};
+
+static void usage(const char* argv0) {
+  fprintf(stderr, "usage: %s --train NOFAULTS.csv --test FAULTS.csv [--train-samples N] [--skip N]\n", argv0);
+}
+
+int main(int argc, char** argv) {
+  const char* trainPath = nullptr;
+  const char* testPath = nullptr;
+  size_t trainSamples = 500;
+  size_t skip = 0;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--train") && hasValue) trainPath = argv[++i];
+    else if (!strcmp(argv[i], "--test") && hasValue) testPath = argv[++i];
+    else if (!strcmp(argv[i], "--train-samples") && hasValue) trainSamples = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--skip") && hasValue) skip = atol(argv[++i]);
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!trainPath || !testPath) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<Row> train, test;
+  if (!readCsv(trainPath, train) || !readCsv(testPath, test)) return 1;
+  train.erase(train.begin(), train.begin() + std::min(skip, train.size()));
+  test.erase(test.begin(), test.begin() + std::min(skip, test.size()));
+  if (train.size() > trainSamples) train.resize(trainSamples);
+  if (train.empty() || test.empty()) {
+    fprintf(stderr, "not enough rows (train %zu, test %zu)\n", train.size(), test.size());
+    return 1;
+  }
+
+  // --- Training: Welford over the fault-free rows ---
+  SignalDetectors detectors[SIGNAL_COUNT];
+  for (int s = 0; s < SIGNAL_COUNT; s++) {
+    RunningStats baseline;
+    for (const Row& row : train) baseline.add(row.values[s]);
+
+    detectors[s].zscore.train(baseline);
+    detectors[s].hysteresis.train(baseline);
+    detectors[s].sliding.train(baseline);
+    printf("%-10s mean=%.4f std=%.4f range=[%.4f, %.4f] margin=%.4f\n", SIGNALS[s], baseline.mean(),
+           baseline.stddev(), detectors[s].hysteresis.low(), detectors[s].hysteresis.high(),
+           detectors[s].hysteresis.margin());
+  }
+
+  // --- Testing ---
+  ConfusionMatrix matrices[SIGNAL_COUNT][DETECTOR_COUNT];
+  ConfusionMatrix overall;
+  std::vector<uint8_t> flagged(test.size() * SIGNAL_COUNT * DETECTOR_COUNT);
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t r = 0; r < test.size(); r++) {
+    uint8_t* out = &flagged[r * SIGNAL_COUNT * DETECTOR_COUNT];
+    for (int s = 0; s < SIGNAL_COUNT; s++) {
+      float value = test[r].values[s];
+      out[s * DETECTOR_COUNT + 0] = detectors[s].zscore.update(value).anomaly;
+      out[s * DETECTOR_COUNT + 1] = detectors[s].hysteresis.update(value);
+      out[s * DETECTOR_COUNT + 2] = detectors[s].sliding.update(value).anomaly;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  for (size_t r = 0; r < test.size(); r++) {
+    bool any = false;
+    for (int s = 0; s < SIGNAL_COUNT; s++) {
+      for (int d = 0; d < DETECTOR_COUNT; d++) {
+        bool hit = flagged[(r * SIGNAL_COUNT + s) * DETECTOR_COUNT + d];
+        matrices[s][d].update(hit, test[r].fault);
+        any = any || hit;
+      }
+    }
+    overall.update(any, test[r].fault);
+  }
+
+  printf("\n%-22s %6s %6s %6s %6s %9s %9s %9s %9s\n", "detector", "TP", "FP", "FN", "TN", "accuracy", "precision",
+         "recall", "f1");
+  auto report = [](const std::string& name, const ConfusionMatrix& m) {
+    printf("%-22s %6llu %6llu %6llu %6llu %8.1f%% %8.1f%% %8.1f%% %8.1f%%\n", name.c_str(),
+           (unsigned long long)m.tp, (unsigned long long)m.fp, (unsigned long long)m.fn, (unsigned long long)m.tn, 100 * m.accuracy(), 100 * m.precision(), 100 * m.recall(), 100 * m.f1());
+  };
+  for (int s = 0; s < SIGNAL_COUNT; s++) {
+    for (int d = 0; d < DETECTOR_COUNT; d++) {
+      report(std::string(SIGNALS[s]) + "_" + DETECTORS[d], matrices[s][d]);
+    }
+  }
+  report("overall (any)", overall);
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("\n%zu training rows, %zu test rows, %.1f ns per detector update\n", train.size(), test.size(),
+         ns / (test.size() * SIGNAL_COUNT * DETECTOR_COUNT));
+  return 0;
+}
@@ -0,0 +1,294 @@
+// Reads the segment files bioreactor_ingest writes (TelemetryStore.hpp).
+//
+//   info DIR|FILE...          rows, time range, size and bytes per column
+//   csv DIR [--device NAME] [--from S] [--to S] [--out FILE]
+//                             rows in the logs/*.csv layout for anomaly_analysis.py
+//                             (S: Unix seconds), oldest segment first
+//   bench [--rows N] [--batch N]
+//                             segment write/read/range query against
+//                             telemetry_logger.py's CSV append, on synthetic 10 Hz samples
+
+#include "TelemetryStore.hpp"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s info DIR|FILE...\n"
+          "       %s csv DIR [--device NAME] [--from S] [--to S] [--out FILE]\n"
+          "       %s bench [--rows N] [--batch N]\n",
+          argv0, argv0, argv0);
+}
+
+static bool isDirectory(const char* path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void printTime(uint64_t us) {
+  time_t s = (time_t)(us / 1000000);
+  struct tm t;
+  gmtime_r(&s, &t);
+  char text[32];
+  strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &t);
+  printf("%s", text);
+}
+
+// -------------------------------------------------------------
+// info
+// -------------------------------------------------------------
+static int runInfo(int argc, char** argv) {
+  std::vector<std::string> paths;
+  for (int i = 0; i < argc; i++) {
+    if (isDirectory(argv[i])) {
+      std::vector<std::string> found = storeListSegments(argv[i]);
+      paths.insert(paths.end(), found.begin(), found.end());
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+
+  uint64_t totalRows = 0, totalBytes = 0;
+  uint64_t columns[STORE_COLUMN_COUNT] = {};
+  int bad = 0;
+  for (const std::string& path : paths) {
+    SegmentReader reader;
+    if (!reader.open(path)) {
+      fprintf(stderr, "%s: not a segment\n", path.c_str());
+      bad++;
+      continue;
+    }
+    printf("%s: %s, %u rows in %zu blocks, %s, %.2f bytes/row, ", path.c_str(), reader.device(), reader.rows(),
+           reader.blocks().size(), reader.sealed() ? "sealed" : "open", reader.rows() ? (double)reader.bytes() / reader.rows() : 0.0);
+    printTime(reader.minUs());
+    printf(" .. ");
+    printTime(reader.maxUs());
+    printf("\n");
+
+    uint64_t bytes[STORE_COLUMN_COUNT];
+    reader.columnBytes(bytes);
+    for (int c = 0; c < STORE_COLUMN_COUNT; c++) columns[c] += bytes[c];
+    totalRows += reader.rows();
+    totalBytes += reader.bytes();
+  }
+
+  if (totalRows > 0) {
+    printf("total: %llu rows, %llu bytes (%.2f bytes/row)\n", (unsigned long long)totalRows,
+           (unsigned long long)totalBytes, (double)totalBytes / totalRows);
+    printf("bytes/row by column:");
+    for (int c = 0; c < STORE_COLUMN_COUNT; c++) printf(" %s %.2f", STORE_COLUMN_NAMES[c], (double)columns[c] / totalRows);
+    printf("\n");
+  }
+  return bad ? 1 : 0;
+}
+
+// -------------------------------------------------------------
+// csv
+// -------------------------------------------------------------
+static int runCsv(int argc, char** argv) {
+  if (argc < 1) return 2;
+  const char* dir = argv[0];
+  const char* device = nullptr;
+  const char* outPath = nullptr;
+  uint64_t fromUs = 0, toUs = UINT64_MAX;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--device") && hasValue) device = argv[++i];
+    else if (!strcmp(argv[i], "--from") && hasValue) fromUs = (uint64_t)(atof(argv[++i]) * 1e6);
+    else if (!strcmp(argv[i], "--to") && hasValue) toUs = (uint64_t)(atof(argv[++i]) * 1e6);
+    else if (!strcmp(argv[i], "--out") && hasValue) outPath = argv[++i];
+    else return 2;
+  }
+
+  FILE* out = outPath ? fopen(outPath, "w") : stdout;
+  if (!out) {
+    perror(outPath);
+    return 1;
+  }
+  storeWriteCsvHeader(out);
+
+  int bad = 0;
+  std::vector<TelemetrySample> rows;
+  for (const std::string& path : storeListSegments(dir, device)) {
+    SegmentReader reader;
+    rows.clear();
+    if (!reader.open(path) || reader.read(fromUs, toUs, rows) < 0) {
+      fprintf(stderr, "%s: unreadable, skipped\n", path.c_str());
+      bad++;
+      continue;
+    }
+    storeWriteCsvRows(out, rows.data(), rows.size());
+  }
+  if (outPath) fclose(out);
+  return bad ? 1 : 0;
+}
+
+// -------------------------------------------------------------
+// bench
+// -------------------------------------------------------------
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// A reactor holding its setpoints: slow drifts, sensor noise, a few steps
+static std::vector<TelemetrySample> syntheticRun(size_t rows) {
+  std::mt19937 rng(1);
+  std::normal_distribution<double> noise(0, 1);
+  std::vector<TelemetrySample> out(rows);
+  uint64_t t = 1760000000ULL * 1000000ULL;
+  double heater = 400;
+  for (size_t i = 0; i < rows; i++) {
+    TelemetrySample& s = out[i];
+    memset(&s, 0, sizeof(s));
+    s.timeUs = t + (uint64_t)(noise(rng) * 50); // Sample task jitter
+    t += 100000;
+    double phase = i / 36000.0;
+    s.tempCentiC = (int16_t)lround(3500 + 5 * sin(phase) + 2 * noise(rng));
+    s.phMilli = (int16_t)lround(5000 + 20 * sin(3 * phase) + 3 * noise(rng));
+    s.rpm = (int16_t)lround(1000 + 4 * noise(rng));
+    heater += noise(rng);
+    heater = heater < 0 ? 0 : heater > 1023 ? 1023 : heater;
+    s.heaterDuty = (uint16_t)heater;
+    s.motorDuty = (uint16_t)lround(620 + 2 * noise(rng));
+    s.flags = TELEMETRY_FLAG_ACTIVE | (s.heaterDuty ? TELEMETRY_FLAG_HEATER : 0);
+    if (s.phMilli > 5015) s.flags |= TELEMETRY_FLAG_ACID;
+    s.tempSetCentiC = 3500;
+    s.phSetMilli = 5000;
+    s.rpmSet = i % 72000 < 36000 ? 1000 : 800;
+  }
+  return out;
+}
+
+static bool sameSample(const TelemetrySample& a, const TelemetrySample& b) {
+  return a.timeUs == b.timeUs && a.tempCentiC == b.tempCentiC && a.phMilli == b.phMilli && a.rpm == b.rpm &&
+         a.heaterDuty == b.heaterDuty && a.motorDuty == b.motorDuty && a.flags == b.flags &&
+         a.tempSetCentiC == b.tempSetCentiC && a.phSetMilli == b.phSetMilli && a.rpmSet == b.rpmSet;
+}
+
+static size_t fileSize(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static int runBench(int argc, char** argv) {
+  size_t rowCount = 864000; // A day at 10 Hz
+  int batch = 50;           // Samples per binary frame (TELEMETRY_BATCH_SAMPLES)
+  for (int i = 0; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--rows") && hasValue) rowCount = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--batch") && hasValue) batch = atoi(argv[++i]);
+    else return 2;
+  }
+  if (rowCount < 1 || batch < 1) return 2;
+
+  char dirTemplate[] = "/tmp/bioreactor_segments.XXXXXX";
+  if (!mkdtemp(dirTemplate)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string dir = dirTemplate;
+  std::string segPath = dir + "/bench.seg";
+  std::string csvPath = dir + "/bench.csv";
+  std::vector<TelemetrySample> rows = syntheticRun(rowCount);
+
+  // telemetry_logger.py: open, append the frame's rows, close, per message
+  Clock::time_point start = Clock::now();
+  FILE* f = fopen(csvPath.c_str(), "w");
+  storeWriteCsvHeader(f);
+  fclose(f);
+  for (size_t i = 0; i < rowCount; i += batch) {
+    f = fopen(csvPath.c_str(), "a");
+    storeWriteCsvRows(f, &rows[i], std::min((size_t)batch, rowCount - i));
+    fclose(f);
+  }
+  double csvWriteS = secondsSince(start);
+
+  // Segment: append a frame at a time, a write per full block
+  start = Clock::now();
+  SegmentWriter writer;
+  if (!writer.open(segPath, "bench")) {
+    perror(segPath.c_str());
+    return 1;
+  }
+  for (size_t i = 0; i < rowCount; i += batch) writer.append(&rows[i], (int)std::min((size_t)batch, rowCount - i));
+  bool sealed = writer.close();
+  double segWriteS = secondsSince(start);
+
+  // Read everything back: parse the CSV, decode the mapped segment
+  start = Clock::now();
+  f = fopen(csvPath.c_str(), "r");
+  char line[256];
+  size_t csvRows = 0;
+  double checksum = 0;
+  if (fgets(line, sizeof(line), f)) {
+    while (fgets(line, sizeof(line), f)) {
+      char* p = line;
+      for (int field = 0; field < 8; field++) {
+        checksum += strtod(p, &p);
+        if (*p == ',') p++;
+      }
+      csvRows++;
+    }
+  }
+  fclose(f);
+  double csvReadS = secondsSince(start);
+
+  start = Clock::now();
+  SegmentReader reader;
+  std::vector<TelemetrySample> back;
+  back.reserve(rowCount);
+  bool readOk = reader.open(segPath) && reader.read(0, UINT64_MAX, back) == (long)rowCount;
+  double segReadS = secondsSince(start);
+  bool same = readOk && std::equal(back.begin(), back.end(), rows.begin(), sameSample);
+
+  // One hour from the middle of the run
+  uint64_t fromUs = rows[rowCount / 2].timeUs, toUs = fromUs + 3600ULL * 1000000;
+  start = Clock::now();
+  std::vector<TelemetrySample> hour;
+  long hourRows = reader.read(fromUs, toUs, hour);
+  double rangeS = secondsSince(start);
+
+  size_t csvBytes = fileSize(csvPath), segBytes = fileSize(segPath);
+  printf("%zu samples (%.1f h at 10 Hz), %d per message\n", rowCount, rowCount / 36000.0, batch);
+  printf("| Path | Write (Msamples/s) | Read (Msamples/s) | Bytes/sample |\n");
+  printf("| :--- | ---: | ---: | ---: |\n");
+  printf("| CSV, open/append/close per message | %.2f | %.2f | %.1f |\n", rowCount / csvWriteS / 1e6,
+         csvRows / csvReadS / 1e6, (double)csvBytes / rowCount);
+  printf("| Segment, mmap read | %.2f | %.2f | %.2f |\n", rowCount / segWriteS / 1e6, rowCount / segReadS / 1e6,
+         (double)segBytes / rowCount);
+  printf("one-hour range query: %ld rows in %.3f ms (%zu blocks indexed)\n", hourRows, rangeS * 1e3,
+         reader.blocks().size());
+  uint64_t columns[STORE_COLUMN_COUNT];
+  reader.columnBytes(columns);
+  printf("bytes/sample by column:");
+  for (int c = 0; c < STORE_COLUMN_COUNT; c++) printf(" %s %.2f", STORE_COLUMN_NAMES[c], (double)columns[c] / rowCount);
+  printf("\n(csv checksum %.0f)\n", checksum);
+
+  unlink(csvPath.c_str());
+  unlink(segPath.c_str());
+  rmdir(dir.c_str());
+
+  bool ok = sealed && same && hourRows > 0;
+  printf("round trip: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  int result = 2;
+  if (argc >= 3 && !strcmp(argv[1], "info")) result = runInfo(argc - 2, argv + 2);
+  else if (argc >= 3 && !strcmp(argv[1], "csv")) result = runCsv(argc - 2, argv + 2);
+  else if (argc >= 2 && !strcmp(argv[1], "bench")) result = runBench(argc - 2, argv + 2);
+  if (result == 2) usage(argv[0]);
+  return result;
+}
@@ -0,0 +1,185 @@
+// Closed-loop plant simulator: runs the real subsystem tasks against
+// PlantModel on the simulated clock, optionally with injected faults, and
+// writes summary rows in the data-analysis/logs/*.csv layout used by anomaly_analysis.py.
+// --at and --rpc deliver attribute updates and RPC requests during the run;
+// what the firmware publishes in reply is printed at the end.
+//
+// Usage: bioreactor_sim [--hours H | --seconds S] [--scenario nofaults|single_fault|three_faults]
+//                       [--seed N] [--summary S] [--attr JSON] [--csv FILE] [--truth]
+//                       [--at S:JSON]... [--rpc S:JSON]... [--motor-kv RPM/V] [--motor-tau S]
+//                       [--buffer S:PH]... [--probe-slope PH/V] [--probe-offset PH]
+//                       [--profile]
+//
+// --buffer moves the pH probe into a calibration buffer (PH < 0: back into
+// the vessel); --probe-slope/--probe-offset make the probe differ from the
+// firmware's default coefficients. --profile prints the profiler's section
+// timings for the run: execution times are host wall-clock, lateness is on
+// the simulated clock.
+//
+// e.g. --rpc '5:{"method":"autotune","params":{"loop":"stirring"}}' --at '20:{"target_rpm":700}'
+
+#include "Simulation.hpp"
+#include "Profiler.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+struct CsvSink {
+  FILE* file;
+  bool truth;
+};
+
+static void writeRow(const SimSummary& r, void* ctx) {
+  CsvSink* sink = (CsvSink*)ctx;
+  fprintf(sink->file, "%.1f,%.3f,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%s",
+          r.timeS, r.tempMean, r.phMean, r.rpmMean,
+          r.heaterPwm, r.motorPwm, r.acidPwm, r.basePwm, r.faults);
+  if (sink->truth) {
+    fprintf(sink->file, ",%.3f,%.3f,%.1f", r.trueTempMean, r.truePhMean, r.trueRpmMean);
+  }
+  fputc('\n', sink->file);
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--hours H | --seconds S] [--scenario nofaults|single_fault|three_faults]\n"
+          "          [--seed N] [--summary S] [--attr JSON] [--csv FILE] [--truth]\n"
+          "          [--at S:JSON]... [--rpc S:JSON]... [--motor-kv RPM/V] [--motor-tau S]\n"
+          "          [--buffer S:PH]... [--probe-slope PH/V] [--probe-offset PH] [--profile]\n",
+          argv0);
+}
+
+#if PROFILING
+static void printSectionTimes() {
+  printf("%-14s %10s %9s %9s %9s\n", "section", "n", "min us", "mean us", "max us");
+  float usPerCycle = 1.0f / halCyclesPerUs();
+  for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+    const ProfileStats& s = profileStats((ProfileSection)i);
+    if (s.count == 0) continue;
+    printf("%-14s %10lu %9.1f %9.1f %9.1f\n", profileSectionName((ProfileSection)i),
+           (unsigned long)s.count, s.minCycles * usPerCycle,
+           (float)s.totalCycles / s.count * usPerCycle, s.maxCycles * usPerCycle);
+  }
+  printf("isr: hall %lu, capture %lu\n", (unsigned long)profileCounterDelta(PROFILE_ISR_HALL),
+         (unsigned long)profileCounterDelta(PROFILE_ISR_CAPTURE));
+}
+#endif
+
+struct TimedMessage {
+  double atS;
+  const char* json;
+  bool rpc;
+};
+
+// "S:JSON" -> seconds and JSON
+static bool parseTimed(const char* arg, bool rpc, std::vector<TimedMessage>& out) {
+  char* end;
+  double atS = strtod(arg, &end);
+  if (end == arg || *end != ':' || atS < 0) return false;
+  out.push_back(TimedMessage{atS, end + 1, rpc});
+  return true;
+}
+
+int main(int argc, char** argv) {
+  SimConfig config;
+  std::vector<TimedMessage> timed;
+  std::vector<TimedMessage> buffers;
+  const char* attributes = "{\"target_pH\": 5.0, \"target_temperature\": 30.0, \"target_rpm\": 1000}";
+  const char* csvPath = nullptr;
+  bool truth = false;
+  bool profile = false;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--hours") && hasValue) config.durationS = atof(argv[++i]) * 3600.0;
+    else if (!strcmp(argv[i], "--seconds") && hasValue) config.durationS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && hasValue) config.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--summary") && hasValue) config.summaryS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--attr") && hasValue) attributes = argv[++i];
+    else if (!strcmp(argv[i], "--csv") && hasValue) csvPath = argv[++i];
+    else if (!strcmp(argv[i], "--truth")) truth = true;
+    else if (!strcmp(argv[i], "--profile")) profile = true;
+    else if (!strcmp(argv[i], "--motor-kv") && hasValue) config.plant.motorKv = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--motor-tau") && hasValue) config.plant.motorTauS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--probe-slope") && hasValue) config.plant.probeSlope = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--probe-offset") && hasValue) config.plant.probeOffset = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--buffer") && hasValue) {
+      if (!parseTimed(argv[++i], false, buffers)) {
+        usage(argv[0]);
+        return 2;
+      }
+    }
+    else if ((!strcmp(argv[i], "--at") || !strcmp(argv[i], "--rpc")) && hasValue) {
+      bool rpc = !strcmp(argv[i], "--rpc");
+      if (!parseTimed(argv[++i], rpc, timed)) {
+        usage(argv[0]);
+        return 2;
+      }
+    }
+    else if (!strcmp(argv[i], "--scenario") && hasValue) {
+      if (!parseScenario(argv[++i], &config.scenario)) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  Simulation sim(config);
+  if (!sim.setAttributes(attributes)) {
+    fprintf(stderr, "invalid --attr JSON: %s\n", attributes);
+    return 2;
+  }
+  for (const TimedMessage& m : timed) {
+    if (m.rpc) sim.scheduleRpc(m.atS, m.json);
+    else sim.scheduleAttributes(m.atS, m.json);
+  }
+  for (const TimedMessage& b : buffers) sim.scheduleProbeBuffer(b.atS, atof(b.json));
+
+  CsvSink sink = {nullptr, truth};
+  if (csvPath) {
+    sink.file = fopen(csvPath, "w");
+    if (!sink.file) {
+      perror(csvPath);
+      return 1;
+    }
+    fprintf(sink.file, "timestamp,temp_mean,ph_mean,rpm_mean,heater_pwm,motor_pwm,acid_pwm,base_pwm,faults%s\n",
+            truth ? ",true_temp,true_ph,true_rpm" : "");
+  }
+
+#if PROFILING
+  profileReset();
+#endif
+  sim.run(csvPath ? writeRow : nullptr, &sink);
+
+  if (sink.file) fclose(sink.file);
+
+  const SimMetrics& m = sim.metrics();
+  printf("simulated %.1f h in %.2f s (%.0fx real time), %d fault episodes\n",
+         config.durationS / 3600.0, config.durationS / sim.speedup(), sim.speedup(), m.faultEpisodes);
+  for (const FaultEpisode& e : sim.episodes()) {
+    printf("  %-13s %9.0f s .. %9.0f s  magnitude %.2f\n", faultName(e.type), e.startS, e.endS, e.magnitude);
+  }
+  printf("temperature: settle %.0f s, overshoot %.2f C, ripple %.2f C, MAE %.3f C, heater %.1f Wh\n",
+         m.tempSettleS, m.tempOvershootC, m.tempRippleC, m.tempMaeC, m.heaterWh);
+  printf("pH:          in band %.1f%% of the time, MAE %.3f, acid %.1f mL, base %.1f mL\n",
+         100.0 * m.phInBandFrac, m.phMae, m.acidMl, m.baseMl);
+  printf("stirring:    settle %.2f s, overshoot %.0f rpm, RMS error %.1f rpm\n",
+         m.rpmSettleS, m.rpmOvershoot, m.rpmRmsError);
+  for (const SimMessage& p : sim.published()) {
+    printf("%9.2f s  %s  %s\n", p.timeS, p.topic.c_str(), p.payload.c_str());
+  }
+
+  if (profile) {
+#if PROFILING
+    printSectionTimes();
+#else
+    fprintf(stderr, "--profile: built with PROFILING=0\n");
+#endif
+  }
+
+  return 0;
+}
@@ -0,0 +1,153 @@
+// One-Class SVM inference benchmark: decisions per second of OneClassSvm
+// (main/OneClassSvm.hpp) as the support-vector count grows, next to the
+// straightforward version (vector-per-row layout, libm exp, as
+// anomalydetection/svm_test.py computes it). Also checks the two agree.
+//
+// Usage: bioreactor_svm [--queries N] [--seed S]
+//
+// The models are synthetic: support vectors scattered around the scaled
+// origin, positive weights, and the intercept set so that about 2 % of the
+// queries are outliers (nu = 0.02, the svm_train.py default).
+
+#include "OneClassSvm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static const int FEATURES = 3;
+static const uint16_t MAX_SV = 1024;
+
+// Same feature scaling as a model trained on the nofaults stream
+static const float SCALER_MEAN[FEATURES] = {30.0f, 5.0f, 1000.0f};
+static const float SCALER_SCALE[FEATURES] = {0.2f, 0.05f, 5.0f};
+
+struct Model {
+  std::vector<float> sv; // count x FEATURES, svm_model.h layout
+  std::vector<float> coef;
+  float gamma;
+  float intercept;
+};
+
+// svm_test.py SVMDetector.predict(), in double precision
+static double reference(const Model& m, const float* x) {
+  double scaled[FEATURES];
+  for (int f = 0; f < FEATURES; f++) scaled[f] = (x[f] - SCALER_MEAN[f]) / SCALER_SCALE[f];
+
+  double decision = m.intercept;
+  for (size_t i = 0; i < m.coef.size(); i++) {
+    double d2 = 0;
+    for (int f = 0; f < FEATURES; f++) {
+      double d = scaled[f] - m.sv[i * FEATURES + f];
+      d2 += d * d;
+    }
+    decision += m.coef[i] * exp(-m.gamma * d2);
+  }
+  return decision;
+}
+
+// The obvious float port: row per vector, expf per kernel
+static float naive(const Model& m, const float* x) {
+  float scaled[FEATURES];
+  for (int f = 0; f < FEATURES; f++) scaled[f] = (x[f] - SCALER_MEAN[f]) / SCALER_SCALE[f];
+
+  float decision = m.intercept;
+  for (size_t i = 0; i < m.coef.size(); i++) {
+    float d2 = 0;
+    for (int f = 0; f < FEATURES; f++) {
+      float d = scaled[f] - m.sv[i * FEATURES + f];
+      d2 += d * d;
+    }
+    decision += m.coef[i] * expf(-m.gamma * d2);
+  }
+  return decision;
+}
+
+template <typename F>
+static double nsPerDecision(const std::vector<float>& queries, F decide, float& checksum) {
+  size_t n = queries.size() / FEATURES;
+  float sum = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t q = 0; q < n; q++) sum += decide(&queries[q * FEATURES]);
+  auto t1 = std::chrono::steady_clock::now();
+  checksum = sum; // Keeps the loop from being optimized away
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+int main(int argc, char** argv) {
+  long queryCount = 20000;
+  unsigned seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--queries") && hasValue) queryCount = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && hasValue) seed = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--queries N] [--seed S]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (queryCount < 100) queryCount = 100;
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> unit(0, 1);
+
+  // Queries: mostly normal operation, some well outside it
+  std::vector<float> queries(queryCount * FEATURES);
+  for (long q = 0; q < queryCount; q++) {
+    float spread = q % 20 == 0 ? 4.0f : 1.0f;
+    for (int f = 0; f < FEATURES; f++) {
+      queries[q * FEATURES + f] = SCALER_MEAN[f] + spread * SCALER_SCALE[f] * unit(rng);
+    }
+  }
+
+  static OneClassSvm<FEATURES, MAX_SV> svm; // ~16 KB, keep it off the stack
+
+  printf("%ld queries per model, %d features\n", queryCount, FEATURES);
+  printf("%6s %12s %12s %10s %14s %12s %10s\n", "svs", "naive_ns", "soa_ns", "speedup", "decisions/s", "max_err",
+         "flips");
+
+  for (uint16_t count = 8; count <= MAX_SV; count *= 2) {
+    Model m;
+    m.gamma = 0.002f * 500 / count; // Keeps the kernel width comparable as the model grows
+    m.sv.resize(count * FEATURES);
+    m.coef.resize(count);
+    for (float& v : m.sv) v = 1.5f * unit(rng);
+    for (float& c : m.coef) c = 1.0f / count * (0.5f + fabsf(unit(rng)));
+    m.intercept = 0;
+
+    // Intercept at the 2nd percentile of the scores: ~2 % outliers
+    std::vector<double> scores(queryCount);
+    for (long q = 0; q < queryCount; q++) scores[q] = reference(m, &queries[q * FEATURES]);
+    std::vector<double> sorted = scores;
+    std::nth_element(sorted.begin(), sorted.begin() + queryCount / 50, sorted.end());
+    m.intercept = (float)-sorted[queryCount / 50];
+
+    svm.load(m.sv.data(), m.coef.data(), count, SCALER_MEAN, SCALER_SCALE, m.gamma, m.intercept);
+
+    float naiveSum, soaSum;
+    double naiveNs = nsPerDecision(queries, [&](const float* x) { return naive(m, x); }, naiveSum);
+    double soaNs = nsPerDecision(queries, [&](const float* x) { return svm.decision(x); }, soaSum);
+
+    // Accuracy against the double-precision reference (with the final intercept)
+    double maxErr = 0;
+    long flips = 0;
+    for (long q = 0; q < queryCount; q++) {
+      double ref = scores[q] + m.intercept;
+      float got = svm.decision(&queries[q * FEATURES]);
+      maxErr = std::max(maxErr, fabs(got - ref));
+      // A flip within float rounding of the boundary is not a disagreement
+      if ((got < 0) != (ref < 0) && fabs(ref) > 1e-5) flips++;
+    }
+
+    printf("%6u %12.1f %12.1f %9.1fx %14.3g %12.2g %10ld\n", count, naiveNs, soaNs, naiveNs / soaNs, 1e9 / soaNs,
+           maxErr, flips);
+    if (naiveSum != naiveSum || soaSum != soaSum) return 1; // NaN: broken model
+  }
+
+  return 0;
+}
@@ -0,0 +1,222 @@
+// Binary telemetry check: samples the firmware at the telemetry rate while it
+// runs against the plant simulator, buffers and publishes the samples through
+// SampleHistory exactly as main.ino does, decodes every frame again and
+// compares size and encode cost with the JSON status message. --outage cuts the
+// simulated broker connection to exercise ageing and back-fill.
+//
+// Usage: bioreactor_telemetry [--seconds S] [--rate HZ] [--batch N]
+//                             [--outage START:LENGTH] [--out FILE]
+//
+// --out writes uint16 length-prefixed frames for data-analysis/telemetry_codec.py.
+
+#include "ControlLoop.hpp"
+#include "PHSubsystem.hpp"
+#include "SampleHistory.hpp"
+#include "Simulation.hpp"
+#include "StirringSubsystem.hpp"
+#include "TelemetryFrame.hpp"
+#include "heatingSubsystem.hpp"
+#include <ArduinoJson.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Frames per sample while catching up: main.ino's network task sends
+// TELEMETRY_BACKFILL_FRAMES (1) per 10 ms poll, ten per 100 ms sample
+const int BACKFILL_FRAMES = 10;
+
+struct Collector {
+  int batchSize = 0;
+  SampleHistory* history = nullptr;
+  std::vector<TelemetrySample> batch;
+  std::vector<uint8_t> frame;
+  FILE* out = nullptr;
+  double outageStartS = -1;
+  double outageEndS = -1;
+
+  long samples = 0;
+  long published = 0;
+  long frames = 0;
+  long backfillFrames = 0;
+  long mismatches = 0;
+  long outOfOrder = 0;
+  uint32_t sequence = 0;
+  uint64_t lastTimeUs = 0;
+  uint64_t maxGapUs = 0;
+  uint32_t maxBacklog = 0;
+  size_t binaryBytes = 0;
+  size_t jsonBytes = 0;
+  double encodeNs = 0;
+  double jsonNs = 0;
+};
+
+static bool sameSample(const TelemetrySample& a, const TelemetrySample& b) {
+  return a.timeUs == b.timeUs && a.tempCentiC == b.tempCentiC && a.phMilli == b.phMilli &&
+         a.rpm == b.rpm && a.heaterDuty == b.heaterDuty && a.motorDuty == b.motorDuty &&
+         a.flags == b.flags && a.tempSetCentiC == b.tempSetCentiC && a.phSetMilli == b.phSetMilli &&
+         a.rpmSet == b.rpmSet;
+}
+
+// Encodes, "publishes" and checks one frame of what read() returned
+static void publishFrame(Collector& c, int count, uint8_t flags) {
+  TelemetryFrameInfo info;
+  info.flags = flags;
+  info.sequence = c.sequence++;
+  info.publishUs = halTimestampUs();
+  auto t0 = std::chrono::steady_clock::now();
+  size_t length = encodeTelemetryFrame(c.batch.data(), count, c.frame.data(), c.frame.size(), info);
+  auto t1 = std::chrono::steady_clock::now();
+  c.encodeNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+  std::vector<TelemetrySample> decoded(count);
+  TelemetryFrameInfo decodedInfo;
+  int n = decodeTelemetryFrame(c.frame.data(), length, decoded.data(), count, &decodedInfo);
+  if (n != count || telemetryFrameFlags(c.frame.data(), length) != flags || decodedInfo.flags != info.flags ||
+      decodedInfo.sequence != info.sequence || decodedInfo.publishUs != info.publishUs) {
+    c.mismatches += count;
+  } else {
+    for (int i = 0; i < n; i++) {
+      if (!sameSample(decoded[i], c.batch[i])) c.mismatches++;
+
+      // Across all frames the timeline must move forwards
+      if (c.published > 0) {
+        int64_t gap = (int64_t)(decoded[i].timeUs - c.lastTimeUs);
+        if (gap <= 0) c.outOfOrder++;
+        else if ((uint64_t)gap > c.maxGapUs) c.maxGapUs = gap;
+      }
+      c.lastTimeUs = decoded[i].timeUs;
+      c.published++;
+    }
+  }
+
+  if (c.out) {
+    uint8_t prefix[2] = {(uint8_t)length, (uint8_t)(length >> 8)};
+    fwrite(prefix, 1, 2, c.out);
+    fwrite(c.frame.data(), 1, length, c.out);
+  }
+
+  c.binaryBytes += length;
+  c.frames++;
+  if (flags & TELEMETRY_FRAME_BACKFILL) c.backfillFrames++;
+}
+
+// Same policy as publishHistory() in main.ino (run here at sample time)
+static void publishHistory(Collector& c, bool connected, bool flush) {
+  SampleHistory& history = *c.history;
+  history.age();
+  if (history.backlog() > c.maxBacklog) c.maxBacklog = history.backlog();
+  if (!connected) return;
+
+  for (int frame = 0; frame < BACKFILL_FRAMES || flush; frame++) {
+    if (history.backlog() == 0) return;
+    if (!flush && history.archived() == 0 && history.backlog() < (uint32_t)c.batchSize) return;
+
+    int count = history.read(c.batch.data(), c.batchSize);
+    uint8_t flags = history.backlog() > (uint32_t)count ? TELEMETRY_FRAME_BACKFILL : 0;
+    publishFrame(c, count, flags);
+    history.discard(count);
+  }
+}
+
+static void takeSample(const SimSummary& row, void* ctx) {
+  Collector& c = *(Collector*)ctx;
+
+  TelemetrySample sample;
+  getTelemetrySample(sample);
+  c.history->push(sample);
+  c.samples++;
+
+  // The same readings as one JSON status message (without scheduler stats)
+  char buffer[512];
+  auto t0 = std::chrono::steady_clock::now();
+  StaticJsonDocument<512> doc;
+  JsonObject root = doc.to<JsonObject>();
+  getPHStatus(root);
+  getStirringStatus(root);
+  getHeatingStatus(root);
+  root["operational_mode"] = is_system_active;
+  size_t jsonLength = serializeJson(doc, buffer, sizeof(buffer));
+  auto t1 = std::chrono::steady_clock::now();
+  c.jsonNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+  c.jsonBytes += jsonLength;
+
+  bool connected = row.timeS < c.outageStartS || row.timeS >= c.outageEndS;
+  publishHistory(c, connected, false);
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr, "usage: %s [--seconds S] [--rate HZ] [--batch N] [--outage START:LENGTH] [--out FILE]\n", argv0);
+}
+
+int main(int argc, char** argv) {
+  SimConfig config;
+  config.durationS = 600;
+  double rateHz = 10;
+  int batchSize = 50;
+  const char* outPath = nullptr;
+  double outageStartS = -1, outageS = 0;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seconds") && hasValue) config.durationS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--rate") && hasValue) rateHz = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--batch") && hasValue) batchSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--out") && hasValue) outPath = argv[++i];
+    else if (!strcmp(argv[i], "--outage") && hasValue) {
+      if (sscanf(argv[++i], "%lf:%lf", &outageStartS, &outageS) != 2) {
+        usage(argv[0]);
+        return 2;
+      }
+    }
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (rateHz <= 0 || batchSize < 1 || batchSize > TELEMETRY_MAX_SAMPLES) {
+    usage(argv[0]);
+    return 2;
+  }
+  config.summaryS = 1.0 / rateHz;
+
+  Collector c;
+  c.batchSize = batchSize;
+  c.history = new SampleHistory();
+  c.batch.resize(batchSize);
+  c.frame.resize(telemetryFrameCapacity(batchSize));
+  c.outageStartS = outageStartS;
+  c.outageEndS = outageStartS + outageS;
+  if (outPath) {
+    c.out = fopen(outPath, "wb");
+    if (!c.out) {
+      perror(outPath);
+      return 1;
+    }
+  }
+
+  Simulation sim(config);
+  sim.setAttributes("{\"target_pH\": 5.0, \"target_temperature\": 30.0, \"target_rpm\": 1000}");
+  sim.run(takeSample, &c);
+  publishHistory(c, true, true);
+  if (c.out) fclose(c.out);
+
+  double seconds = config.durationS;
+  HistoryStats hs = c.history->stats();
+  printf("%ld samples at %.0f Hz, %ld published in %ld frames of up to %d samples (%ld back-fill)\n",
+         c.samples, rateHz, c.published, c.frames, batchSize, c.backfillFrames);
+  printf("history: max backlog %u, %u decimated, %u dropped, %u overruns, largest gap %.1f s\n",
+         c.maxBacklog, hs.decimated, hs.dropped, hs.overruns, c.maxGapUs / 1e6);
+  printf("binary: %6.2f bytes/sample, %7.1f B/s, encode %6.1f ns/sample\n",
+         (double)c.binaryBytes / c.published, c.binaryBytes / seconds, c.encodeNs / c.published);
+  printf("json:   %6.2f bytes/sample, %7.1f B/s, encode %6.1f ns/sample (same rate, one message per sample)\n",
+         (double)c.jsonBytes / c.samples, c.jsonBytes / seconds, c.jsonNs / c.samples);
+  printf("json at the previous 5 s period: %.1f B/s\n", (double)c.jsonBytes / c.samples / 5.0);
+  bool ok = c.mismatches == 0 && c.outOfOrder == 0 &&
+            c.published + (long)(hs.decimated + hs.dropped + hs.overruns) == c.samples;
+  printf("round trip: %s (%ld mismatched, %ld out of order)\n", ok ? "ok" : "FAILED", c.mismatches, c.outOfOrder);
+
+  delete c.history;
+  return ok ? 0 : 1;
+}
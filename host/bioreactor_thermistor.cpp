@@ -0,0 +1,155 @@
+// Thermistor conversion check: compares HEATING_THERMISTOR (the compile-time
+// table of main/Thermistor.hpp used by the heating subsystem) against the
+// Beta curve evaluated with libm at every ADC code and in between, checks the
+// out-of-range codes, shows how far the old linear fit is from the curve, and
+// times both conversions.
+//
+// Usage: bioreactor_thermistor [--tolerance C]   (default 0.05 degC)
+
+#include "heatingSubsystem.hpp"
+#include "Thermistor.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+typedef ThermistorTable<10000, 12> Table;
+
+// Same parameters as HEATING_NTC, evaluated independently of Thermistor.hpp
+const double SERIES_OHM = 10000.0;
+const double NTC_OHM_AT_35C = 5162.0;
+const double NTC_BETA = 3950.0;
+
+static double curveCelsius(double code) {
+  double ohm = SERIES_OHM * code / (Table::ADC_FULL_SCALE - code);
+  return 1.0 / (1.0 / 308.15 + std::log(ohm / NTC_OHM_AT_35C) / NTC_BETA) - 273.15;
+}
+
+static double curveCode(double celsius) {
+  double ohm = NTC_OHM_AT_35C * std::exp(NTC_BETA * (1.0 / (celsius + 273.15) - 1.0 / 308.15));
+  return ohm / (SERIES_OHM + ohm) * Table::ADC_FULL_SCALE;
+}
+
+// The conversion executeHeating() used before the table (heating.cpp fit)
+static float linearFitCelsius(float code) {
+  const float Vcc = 3.3;
+  const float R = 10000;
+  const float Kadc = 3.3 / 4095;
+  float Vadc = Kadc * code;
+  if (std::fabs(Vcc - Vadc) > 0.01) {
+    float Rth = R * Vadc / (Vcc - Vadc);
+    return -0.00295 * Rth + 50.23;
+  }
+  return 999.0;
+}
+
+template <typename F>
+static double nsPerConversion(const std::vector<float>& codes, F&& convert) {
+  volatile float sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  const int rounds = 200;
+  for (int r = 0; r < rounds; r++) {
+    float sum = 0;
+    for (float code : codes) sum += convert(code);
+    sink = sink + sum;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / (rounds * codes.size());
+}
+
+int main(int argc, char** argv) {
+  double tolerance = 0.05;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [--tolerance C]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const Table& table = HEATING_THERMISTOR;
+  bool ok = true;
+
+  // --- Table against the curve, at every quarter code in range ---
+  double maxError = 0;
+  double worstCode = 0;
+  for (double code = table.minCode(); code <= table.maxCode(); code += 0.25) {
+    float celsius = 0;
+    if (table.convert((float)code, celsius) != THERMISTOR_OK) {
+      printf("FAIL: code %.2f reported out of range\n", code);
+      ok = false;
+      continue;
+    }
+    double error = std::fabs(celsius - curveCelsius(code));
+    if (error > maxError) {
+      maxError = error;
+      worstCode = code;
+    }
+  }
+  printf("table: %zu entries (%zu bytes), codes %u-%u convert (%.2f to %.2f degC)\n",
+         Table::ENTRIES, Table::ENTRIES * sizeof(float), (unsigned)table.minCode(),
+         (unsigned)table.maxCode(), curveCelsius(table.maxCode()), curveCelsius(table.minCode()));
+  printf("max |table - curve| = %.4f degC at code %.2f\n", maxError, worstCode);
+  if (maxError > tolerance) {
+    printf("FAIL: above the %.3f degC tolerance\n", tolerance);
+    ok = false;
+  }
+
+  // --- Range limits ---
+  struct Edge {
+    float code;
+    ThermistorStatus expected;
+  };
+  const Edge edges[] = {
+    {0, THERMISTOR_ABOVE_RANGE},
+    {(float)table.minCode() - 1, THERMISTOR_ABOVE_RANGE},
+    {(float)table.maxCode() + 1, THERMISTOR_BELOW_RANGE},
+    {(float)Table::ADC_FULL_SCALE, THERMISTOR_BELOW_RANGE},
+  };
+  for (const Edge& edge : edges) {
+    float celsius = -1;
+    ThermistorStatus status = table.convert(edge.code, celsius);
+    if (status != edge.expected || celsius != -1) {
+      printf("FAIL: code %.0f gave status %d (expected %d)\n", edge.code, status, edge.expected);
+      ok = false;
+    }
+  }
+  if (curveCelsius(table.minCode()) > 100.0 || curveCelsius(table.minCode() - 1) <= 100.0 ||
+      curveCelsius(table.maxCode()) < 0.0 || curveCelsius(table.maxCode() + 1) >= 0.0) {
+    printf("FAIL: range codes do not bracket 0-100 degC\n");
+    ok = false;
+  }
+
+  // --- The old linear fit ---
+  printf("\n%8s %8s %12s %10s\n", "degC", "code", "table", "linear fit");
+  for (int celsius = 0; celsius <= 100; celsius += 10) {
+    float code = (float)curveCode(celsius);
+    float fromTable = 0;
+    char converted[16] = "out of range";
+    if (table.convert(code, fromTable) == THERMISTOR_OK) {
+      snprintf(converted, sizeof(converted), "%.3f", fromTable);
+    }
+    printf("%8d %8.1f %12s %10.3f\n", celsius, code, converted, linearFitCelsius(code));
+  }
+
+  // --- Cost ---
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniform((float)table.minCode(), (float)table.maxCode());
+  std::vector<float> codes(4096);
+  for (float& code : codes) code = uniform(rng);
+
+  double linearNs = nsPerConversion(codes, linearFitCelsius);
+  double tableNs = nsPerConversion(codes, [&](float code) {
+    float celsius = 0;
+    table.convert(code, celsius);
+    return celsius;
+  });
+  printf("\nns per conversion: linear fit %.2f, table %.2f\n", linearNs, tableNs);
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,1024 @@
+// Parameter search for the controller gains and anomaly thresholds that are
+// shared attributes (heating_kp/_ki, stirring_kp/_ki, pH_tolerance,
+// anomaly_z, *_drift_band). Every configuration runs the real firmware
+// against the plant simulator: one fault-free run for the control metrics and
+// --seeds runs with injected faults for the detection metrics, all from the
+// same seeds so configurations meet the same faults. --recorded CSVs (with a
+// faults column) are replayed through the on-device detectors as well.
+//
+// The firmware keeps its state in globals, so a simulation cannot share a
+// process with another one. Each run is a forked child of this process, which
+// never runs the firmware itself; a work-stealing pool (WorkStealingPool.hpp)
+// keeps one child per core busy and reads its result back over a pipe.
+//
+// --grid KEY=V1,V2,... (repeatable) evaluates every combination. --cmaes
+// KEY,KEY,... (or "control", "detection") runs CMA-ES over those keys within
+// their search ranges, one generation per pool batch. Configurations are
+// ranked by a weighted sum of eight objectives, each relative to the firmware
+// defaults (which always run too): temperature and RPM settling time and
+// overshoot, pH mean absolute error, reagent used, the false-positive rate of
+// the anomaly flags, and detection latency (a missed fault counts its whole
+// length). --weight OBJECTIVE=W changes a weight, 0 drops the objective.
+// --out writes the winner as a shared-attributes JSON object for ThingsBoard.
+//
+// Usage: bioreactor_tune (--grid KEY=V1,V2,...)... | --cmaes KEY[,KEY...] [--generations N] [--population N]
+//                        [--hours H] [--seeds N] [--scenario single_fault|three_faults] [--warmup S]
+//                        [--attr JSON] [--recorded CSV]... [--weight OBJECTIVE=W]... [--threads N]
+//                        [--top N] [--out FILE] [--csv FILE]
+
+#include "AnomalyMonitor.hpp"
+#include "PHSubsystem.hpp"
+#include "Simulation.hpp"
+#include "StirringSubsystem.hpp"
+#include "WorkStealingPool.hpp"
+#include "heatingSubsystem.hpp"
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// --- Parameters (shared attributes) ---
+
+enum Group { GROUP_CONTROL, GROUP_DETECTION };
+
+struct Parameter {
+  const char* key;
+  Group group;
+  bool logScale;        // Searched in log space, range relative to the default
+  double low;           // Search range: multiples of the default if logScale
+  double high;
+  double defaultValue;  // Read from the firmware at start-up
+};
+
+// Index into PARAMETERS
+enum ParameterIndex {
+  P_HEATING_KP,
+  P_HEATING_KI,
+  P_STIRRING_KP,
+  P_STIRRING_KI,
+  P_PH_TOLERANCE,
+  P_ANOMALY_Z,
+  P_TEMP_DRIFT_BAND,
+  P_PH_DRIFT_BAND,
+  P_RPM_DRIFT_BAND
+};
+
+static Parameter PARAMETERS[] = {
+  {"heating_kp", GROUP_CONTROL, true, 0.25, 4, 0},
+  {"heating_ki", GROUP_CONTROL, true, 0.25, 4, 0},
+  {"stirring_kp", GROUP_CONTROL, true, 0.25, 4, 0},
+  {"stirring_ki", GROUP_CONTROL, true, 0.25, 4, 0},
+  {"pH_tolerance", GROUP_CONTROL, false, 0.05, 1.0, 0},
+  {"anomaly_z", GROUP_DETECTION, false, 2.0, 6.0, 0},
+  {"temperature_drift_band", GROUP_DETECTION, true, 0.25, 4, 0},
+  {"pH_drift_band", GROUP_DETECTION, true, 0.25, 4, 0},
+  {"rpm_drift_band", GROUP_DETECTION, true, 0.25, 4, 0},
+};
+static const int PARAMETER_COUNT = sizeof(PARAMETERS) / sizeof(PARAMETERS[0]);
+static_assert(PARAMETER_COUNT == P_RPM_DRIFT_BAND + 1, "PARAMETERS and ParameterIndex differ");
+
+static void readDefaults() {
+  float kp, ki;
+  getHeatingGains(kp, ki);
+  PARAMETERS[P_HEATING_KP].defaultValue = kp;
+  PARAMETERS[P_HEATING_KI].defaultValue = ki;
+  getStirringGains(kp, ki);
+  PARAMETERS[P_STIRRING_KP].defaultValue = kp;
+  PARAMETERS[P_STIRRING_KI].defaultValue = ki;
+  PARAMETERS[P_PH_TOLERANCE].defaultValue = PH_TOLERANCE_DEFAULT;
+  PARAMETERS[P_ANOMALY_Z].defaultValue = ANOMALY_Z_THRESHOLD;
+  PARAMETERS[P_TEMP_DRIFT_BAND].defaultValue = TEMP_DRIFT_BAND;
+  PARAMETERS[P_PH_DRIFT_BAND].defaultValue = PH_DRIFT_BAND;
+  PARAMETERS[P_RPM_DRIFT_BAND].defaultValue = RPM_DRIFT_BAND;
+}
+
+static int findParameter(const char* key, size_t length) {
+  for (int p = 0; p < PARAMETER_COUNT; p++) {
+    if (strlen(PARAMETERS[p].key) == length && !strncmp(PARAMETERS[p].key, key, length)) return p;
+  }
+  return -1;
+}
+
+// Search coordinate in [0, 1] <-> value
+static double parameterValue(int p, double u) {
+  const Parameter& parameter = PARAMETERS[p];
+  if (parameter.logScale) return parameter.defaultValue * parameter.low * pow(parameter.high / parameter.low, u);
+  return parameter.low + (parameter.high - parameter.low) * u;
+}
+
+static double parameterCoordinate(int p, double value) {
+  const Parameter& parameter = PARAMETERS[p];
+  double u = parameter.logScale ? log(value / (parameter.defaultValue * parameter.low)) / log(parameter.high / parameter.low)
+                                : (value - parameter.low) / (parameter.high - parameter.low);
+  return std::min(1.0, std::max(0.0, u));
+}
+
+// --- Objectives ---
+
+enum Objective {
+  OBJ_TEMP_SETTLE,
+  OBJ_TEMP_OVERSHOOT,
+  OBJ_RPM_SETTLE,
+  OBJ_RPM_OVERSHOOT,
+  OBJ_PH_MAE,
+  OBJ_REAGENT,
+  OBJ_FALSE_POSITIVES,
+  OBJ_LATENCY,
+  OBJECTIVE_COUNT
+};
+
+struct ObjectiveInfo {
+  const char* key;
+  const char* column;
+  const char* format;
+  double floor; // Scale used when the defaults score less (e.g. no overshoot at all)
+};
+
+static const ObjectiveInfo OBJECTIVES[OBJECTIVE_COUNT] = {
+  {"temp_settle", "Temp settle s", "%.0f", 1.0},
+  {"temp_overshoot", "Temp overshoot C", "%.2f", 0.01},
+  {"rpm_settle", "RPM settle s", "%.2f", 0.01},
+  {"rpm_overshoot", "RPM overshoot", "%.0f", 1.0},
+  {"ph_mae", "pH MAE", "%.3f", 0.005},
+  {"reagent", "Reagent mL", "%.1f", 0.1},
+  {"false_positives", "False positives %", "%.2f", 0.1},
+  {"latency", "Latency s", "%.0f", 1.0},
+};
+
+// --- Study ---
+
+enum RunKind { RUN_CONTROL, RUN_FAULTS, RUN_RECORDED };
+
+struct RecordedRow {
+  double timeS;
+  float values[3]; // temp_mean, ph_mean, rpm_mean
+  bool faulty;
+};
+
+struct Recording {
+  std::string path;
+  std::vector<RecordedRow> rows;
+};
+
+struct Study {
+  double hours = 2;
+  uint32_t seeds = 3;
+  Scenario scenario = SCENARIO_SINGLE_FAULT;
+  double warmupS = 1800;
+  std::string attributes = "{\"target_pH\":5.0,\"target_temperature\":30,\"target_rpm\":1000}";
+  float setpoints[3] = {0, 0, 0}; // From attributes, for the recorded runs
+  std::vector<Recording> recordings;
+  bool varied[PARAMETER_COUNT] = {};
+  bool controlVaried = false;
+  double weights[OBJECTIVE_COUNT] = {1, 1, 1, 1, 1, 1, 1, 1};
+};
+
+static Study study;
+
+// After a fault ends the plant needs a while to recover; flags then are not false positives
+static const double RECOVERY_S = 300;
+
+// Everything one run reports; crosses the pipe from the child as raw bytes
+struct RunResult {
+  bool ok;
+  SimMetrics metrics;  // RUN_CONTROL only
+  uint32_t scoredRows; // Fault-free rows
+  uint32_t flaggedRows;
+  uint32_t episodes;
+  uint32_t detected;
+  double latencySumS;  // Missed episodes count their length
+};
+
+struct DetectionRow {
+  double timeS;
+  bool flagged;
+};
+
+struct Episode {
+  double startS;
+  double endS;
+};
+
+struct Candidate {
+  bool baseline;                   // Firmware defaults: no attributes sent
+  double values[PARAMETER_COUNT];  // Only the varied ones are sent
+  bool ok;
+  double objectives[OBJECTIVE_COUNT];
+  double score;
+  bool front;                      // Not dominated on the weighted objectives
+};
+
+static std::string candidateAttributes(const Candidate& c) {
+  std::string json = "{";
+  if (!c.baseline) {
+    char entry[64];
+    for (int p = 0; p < PARAMETER_COUNT; p++) {
+      if (!study.varied[p]) continue;
+      snprintf(entry, sizeof(entry), "%s\"%s\":%.6g", json.size() > 1 ? "," : "", PARAMETERS[p].key, c.values[p]);
+      json += entry;
+    }
+  }
+  return json + "}";
+}
+
+static std::string candidateName(const Candidate& c) {
+  if (c.baseline) return "defaults";
+  std::string name;
+  char entry[64];
+  for (int p = 0; p < PARAMETER_COUNT; p++) {
+    if (!study.varied[p]) continue;
+    snprintf(entry, sizeof(entry), "%s%s=%.4g", name.empty() ? "" : " ", PARAMETERS[p].key, c.values[p]);
+    name += entry;
+  }
+  return name;
+}
+
+static void scoreDetection(const std::vector<DetectionRow>& rows, const std::vector<Episode>& episodes,
+                           double fromS, RunResult& result) {
+  for (const DetectionRow& row : rows) {
+    if (row.timeS < fromS) continue;
+    bool quiet = true;
+    for (const Episode& e : episodes) {
+      if (row.timeS >= e.startS && row.timeS < e.endS + RECOVERY_S) quiet = false;
+    }
+    if (!quiet) continue;
+    result.scoredRows++;
+    if (row.flagged) result.flaggedRows++;
+  }
+
+  for (const Episode& e : episodes) {
+    if (e.startS < fromS) continue;
+    result.episodes++;
+    double latencyS = e.endS - e.startS;
+    for (const DetectionRow& row : rows) {
+      if (row.timeS >= e.startS && row.timeS < e.endS && row.flagged) {
+        latencyS = row.timeS - e.startS;
+        result.detected++;
+        break;
+      }
+    }
+    result.latencySumS += latencyS;
+  }
+}
+
+// --- Simulated runs (in a child process) ---
+
+static void logFlags(const SimSummary& row, void* ctx) {
+  std::vector<DetectionRow>* rows = (std::vector<DetectionRow>*)ctx;
+  rows->push_back(DetectionRow{row.timeS, (getTemperatureAnomaly() | getPHAnomaly() | getRPMAnomaly()) != 0});
+}
+
+static RunResult simulate(const std::string& attributes, RunKind kind, uint32_t seed) {
+  RunResult result;
+  memset(&result, 0, sizeof(result));
+
+  SimConfig config;
+  config.durationS = study.hours * 3600;
+  config.seed = seed;
+  config.scenario = kind == RUN_CONTROL ? SCENARIO_NOFAULTS : study.scenario;
+  Simulation sim(config);
+  if (!sim.setAttributes(study.attributes.c_str()) || !sim.setAttributes(attributes.c_str())) return result;
+
+  std::vector<DetectionRow> rows;
+  rows.reserve((size_t)(config.durationS / config.summaryS) + 1);
+  sim.run(logFlags, &rows);
+
+  result.metrics = sim.metrics();
+  if (kind == RUN_FAULTS) {
+    std::vector<Episode> episodes;
+    for (const FaultEpisode& e : sim.episodes()) episodes.push_back(Episode{e.startS, e.endS});
+    scoreDetection(rows, episodes, study.warmupS, result);
+  }
+  result.ok = true;
+  return result;
+}
+
+static bool readAll(int fd, void* data, size_t length) {
+  uint8_t* p = (uint8_t*)data;
+  while (length > 0) {
+    ssize_t n = read(fd, p, length);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const void* data, size_t length) {
+  const uint8_t* p = (const uint8_t*)data;
+  while (length > 0) {
+    ssize_t n = write(fd, p, length);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+// Forked from a pool thread: the child only simulates, writes its result and exits
+static RunResult simulateInChild(const std::string& attributes, RunKind kind, uint32_t seed) {
+  RunResult result;
+  memset(&result, 0, sizeof(result));
+
+  int fds[2];
+  if (pipe(fds) != 0) return result;
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    RunResult child = simulate(attributes, kind, seed);
+    _exit(writeAll(fds[1], &child, sizeof(child)) ? 0 : 1);
+  }
+  close(fds[1]);
+  if (pid > 0) {
+    if (!readAll(fds[0], &result, sizeof(result))) result.ok = false;
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+  }
+  close(fds[0]);
+  return result;
+}
+
+// --- Recorded runs (in-process: the monitors are local) ---
+
+static bool readRecording(const char* path, Recording& recording) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  static const char* SIGNALS[] = {"temp_mean", "ph_mean", "rpm_mean"};
+  char line[1024];
+  int columns[3] = {-1, -1, -1};
+  int timeColumn = -1, faultsColumn = -1;
+  if (fgets(line, sizeof(line), f)) {
+    int column = 0;
+    for (char* field = strtok(line, ",\r\n"); field; field = strtok(nullptr, ",\r\n"), column++) {
+      for (int s = 0; s < 3; s++) {
+        if (!strcmp(field, SIGNALS[s])) columns[s] = column;
+      }
+      if (!strcmp(field, "timestamp")) timeColumn = column;
+      if (!strcmp(field, "faults")) faultsColumn = column;
+    }
+  }
+  if (columns[0] < 0 || columns[1] < 0 || columns[2] < 0 || faultsColumn < 0) {
+    fprintf(stderr, "%s: needs temp_mean, ph_mean, rpm_mean and faults columns\n", path);
+    fclose(f);
+    return false;
+  }
+
+  recording.path = path;
+  size_t index = 0;
+  while (fgets(line, sizeof(line), f)) {
+    RecordedRow row = {(double)index++, {0, 0, 0}, false};
+    int column = 0;
+    char* cursor = line;
+    for (char* field = strsep(&cursor, ",\r\n"); field; field = strsep(&cursor, ",\r\n"), column++) {
+      for (int s = 0; s < 3; s++) {
+        if (column == columns[s]) row.values[s] = strtof(field, nullptr);
+      }
+      if (column == timeColumn) row.timeS = strtod(field, nullptr);
+      if (column == faultsColumn) row.faulty = field[0] && strcmp(field, "None") != 0;
+    }
+    recording.rows.push_back(row);
+  }
+  fclose(f);
+  return true;
+}
+
+static RunResult replay(const Candidate& c, const Recording& recording) {
+  RunResult result;
+  memset(&result, 0, sizeof(result));
+
+  double value[PARAMETER_COUNT];
+  for (int p = 0; p < PARAMETER_COUNT; p++) {
+    value[p] = !c.baseline && study.varied[p] ? c.values[p] : PARAMETERS[p].defaultValue;
+  }
+  SignalMonitor monitors[3] = {SignalMonitor(value[P_TEMP_DRIFT_BAND]), SignalMonitor(value[P_PH_DRIFT_BAND]),
+                               SignalMonitor(value[P_RPM_DRIFT_BAND])};
+  for (SignalMonitor& m : monitors) m.zscore.setThreshold(value[P_ANOMALY_Z]);
+
+  std::vector<DetectionRow> rows;
+  std::vector<Episode> episodes;
+  bool inFault = false;
+  rows.reserve(recording.rows.size());
+  for (const RecordedRow& r : recording.rows) {
+    bool flagged = false;
+    for (int s = 0; s < 3; s++) {
+      monitors[s].update(r.values[s], study.setpoints[s]);
+      if (monitors[s].current) flagged = true;
+    }
+    rows.push_back(DetectionRow{r.timeS, flagged});
+
+    // An episode is a run of faulty rows
+    if (r.faulty && !inFault) episodes.push_back(Episode{r.timeS, r.timeS});
+    if (!r.faulty && inFault) episodes.back().endS = r.timeS;
+    inFault = r.faulty;
+  }
+  if (inFault) episodes.back().endS = recording.rows.back().timeS;
+
+  scoreDetection(rows, episodes, recording.rows.empty() ? 0 : recording.rows.front().timeS, result);
+  result.ok = true;
+  return result;
+}
+
+// --- Evaluation ---
+
+struct Task {
+  size_t candidate;
+  RunKind kind;
+  uint32_t index; // Seed, or recording
+};
+
+/**
+ * @brief Runs candidates[first..] on the pool, then fills in their objectives.
+ * candidates[0] must be the baseline and already evaluated unless first == 0.
+ */
+static void evaluate(WorkStealingPool& pool, std::vector<Candidate>& candidates, size_t first) {
+  // Simulations first: the recorded replays are small and even out the end of the batch
+  std::vector<Task> tasks;
+  for (size_t c = first; c < candidates.size(); c++) {
+    if (candidates[c].baseline || study.controlVaried) tasks.push_back(Task{c, RUN_CONTROL, 1});
+    for (uint32_t s = 1; s <= study.seeds; s++) tasks.push_back(Task{c, RUN_FAULTS, s});
+  }
+  for (size_t c = first; c < candidates.size(); c++) {
+    for (size_t r = 0; r < study.recordings.size(); r++) tasks.push_back(Task{c, RUN_RECORDED, (uint32_t)r});
+  }
+
+  std::vector<std::string> attributes(candidates.size());
+  for (size_t c = first; c < candidates.size(); c++) attributes[c] = candidateAttributes(candidates[c]);
+
+  std::vector<RunResult> results(tasks.size());
+  pool.run(tasks.size(), [&](size_t i, unsigned) {
+    const Task& task = tasks[i];
+    results[i] = task.kind == RUN_RECORDED ? replay(candidates[task.candidate], study.recordings[task.index])
+                                           : simulateInChild(attributes[task.candidate], task.kind, task.index);
+  });
+
+  std::vector<RunResult> totals(candidates.size());
+  std::vector<bool> haveControl(candidates.size(), false);
+  for (size_t c = first; c < candidates.size(); c++) {
+    memset(&totals[c], 0, sizeof(RunResult));
+    candidates[c].ok = true;
+  }
+  for (size_t i = 0; i < tasks.size(); i++) {
+    const RunResult& r = results[i];
+    size_t c = tasks[i].candidate;
+    if (!r.ok) candidates[c].ok = false;
+    if (tasks[i].kind == RUN_CONTROL) {
+      totals[c].metrics = r.metrics;
+      haveControl[c] = true;
+    }
+    totals[c].scoredRows += r.scoredRows;
+    totals[c].flaggedRows += r.flaggedRows;
+    totals[c].episodes += r.episodes;
+    totals[c].detected += r.detected;
+    totals[c].latencySumS += r.latencySumS;
+  }
+
+  for (size_t c = first; c < candidates.size(); c++) {
+    Candidate& candidate = candidates[c];
+    double* o = candidate.objectives;
+    if (haveControl[c]) {
+      const SimMetrics& m = totals[c].metrics;
+      o[OBJ_TEMP_SETTLE] = m.tempSettleS;
+      o[OBJ_TEMP_OVERSHOOT] = m.tempOvershootC;
+      o[OBJ_RPM_SETTLE] = m.rpmSettleS;
+      o[OBJ_RPM_OVERSHOOT] = m.rpmOvershoot;
+      o[OBJ_PH_MAE] = m.phMae;
+      o[OBJ_REAGENT] = m.acidMl + m.baseMl;
+    } else {
+      // Only detection parameters vary: the control run is the baseline's
+      for (int k = OBJ_TEMP_SETTLE; k <= OBJ_REAGENT; k++) o[k] = candidates[0].objectives[k];
+    }
+    const RunResult& t = totals[c];
+    o[OBJ_FALSE_POSITIVES] = t.scoredRows ? 100.0 * t.flaggedRows / t.scoredRows : 0;
+    o[OBJ_LATENCY] = t.episodes ? t.latencySumS / t.episodes : 0;
+  }
+
+  // Scores are relative to the defaults
+  for (size_t c = first; c < candidates.size(); c++) {
+    Candidate& candidate = candidates[c];
+    candidate.score = 0;
+    for (int k = 0; k < OBJECTIVE_COUNT; k++) {
+      double scale = std::max(candidates[0].objectives[k], OBJECTIVES[k].floor);
+      candidate.score += study.weights[k] * candidate.objectives[k] / scale;
+    }
+    if (!candidate.ok) candidate.score = INFINITY;
+  }
+}
+
+static void markFront(std::vector<Candidate>& candidates) {
+  for (Candidate& a : candidates) {
+    a.front = a.ok;
+    for (const Candidate& b : candidates) {
+      if (&a == &b || !b.ok || !a.front) continue;
+      bool noWorse = true, better = false;
+      for (int k = 0; k < OBJECTIVE_COUNT; k++) {
+        if (study.weights[k] == 0) continue;
+        if (b.objectives[k] > a.objectives[k]) noWorse = false;
+        if (b.objectives[k] < a.objectives[k]) better = true;
+      }
+      if (noWorse && better) a.front = false;
+    }
+  }
+}
+
+// --- CMA-ES ---
+
+// Eigen-decomposition of a symmetric matrix (cyclic Jacobi): a = v diag(d) v^T
+static void symmetricEigen(std::vector<double> a, int n, std::vector<double>& d, std::vector<double>& v) {
+  v.assign(n * n, 0);
+  for (int i = 0; i < n; i++) v[i * n + i] = 1;
+  for (int sweep = 0; sweep < 50; sweep++) {
+    double off = 0;
+    for (int i = 0; i < n; i++) {
+      for (int j = i + 1; j < n; j++) off += a[i * n + j] * a[i * n + j];
+    }
+    if (off < 1e-30) break;
+    for (int p = 0; p < n; p++) {
+      for (int q = p + 1; q < n; q++) {
+        if (fabs(a[p * n + q]) < 1e-300) continue;
+        double theta = (a[q * n + q] - a[p * n + p]) / (2 * a[p * n + q]);
+        double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1));
+        double c = 1 / sqrt(t * t + 1), s = t * c;
+        for (int k = 0; k < n; k++) {
+          double akp = a[k * n + p], akq = a[k * n + q];
+          a[k * n + p] = c * akp - s * akq;
+          a[k * n + q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < n; k++) {
+          double apk = a[p * n + k], aqk = a[q * n + k];
+          a[p * n + k] = c * apk - s * aqk;
+          a[q * n + k] = s * apk + c * aqk;
+        }
+        for (int k = 0; k < n; k++) {
+          double vkp = v[k * n + p], vkq = v[k * n + q];
+          v[k * n + p] = c * vkp - s * vkq;
+          v[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  d.resize(n);
+  for (int i = 0; i < n; i++) d[i] = a[i * n + i];
+}
+
+/**
+ * @brief (mu/mu_w, lambda)-CMA-ES with rank-one and rank-mu covariance
+ * updates and cumulative step-size adaptation (Hansen's tutorial defaults).
+ */
+class CmaEs {
+public:
+  CmaEs(const std::vector<double>& mean, double sigma, int lambda)
+      : n_((int)mean.size()), lambda_(lambda), mean_(mean), sigma_(sigma), generation_(0), rng_(1) {
+    mu_ = lambda_ / 2;
+    double sum = 0, sumSq = 0;
+    for (int i = 0; i < mu_; i++) {
+      weights_.push_back(log(mu_ + 0.5) - log(i + 1.0));
+      sum += weights_.back();
+    }
+    for (double& w : weights_) {
+      w /= sum;
+      sumSq += w * w;
+    }
+    muEff_ = 1 / sumSq;
+
+    double n = n_;
+    cc_ = (4 + muEff_ / n) / (n + 4 + 2 * muEff_ / n);
+    cs_ = (muEff_ + 2) / (n + muEff_ + 5);
+    c1_ = 2 / ((n + 1.3) * (n + 1.3) + muEff_);
+    cmu_ = std::min(1 - c1_, 2 * (muEff_ - 2 + 1 / muEff_) / ((n + 2) * (n + 2) + muEff_));
+    damps_ = 1 + 2 * std::max(0.0, sqrt((muEff_ - 1) / (n + 1)) - 1) + cs_;
+    chiN_ = sqrt(n) * (1 - 1 / (4 * n) + 1 / (21 * n * n));
+
+    pc_.assign(n_, 0);
+    ps_.assign(n_, 0);
+    c_.assign(n_ * n_, 0);
+    for (int i = 0; i < n_; i++) c_[i * n_ + i] = 1;
+    b_ = c_;
+    d_.assign(n_, 1);
+  }
+
+  std::vector<std::vector<double>> ask() {
+    std::normal_distribution<double> normal;
+    std::vector<std::vector<double>> points(lambda_, std::vector<double>(n_));
+    std::vector<double> z(n_);
+    for (std::vector<double>& x : points) {
+      for (double& zi : z) zi = normal(rng_);
+      for (int i = 0; i < n_; i++) {
+        double y = 0;
+        for (int j = 0; j < n_; j++) y += b_[i * n_ + j] * d_[j] * z[j];
+        x[i] = mean_[i] + sigma_ * y;
+      }
+    }
+    return points;
+  }
+
+  void tell(const std::vector<std::vector<double>>& points, const std::vector<double>& fitness) {
+    std::vector<int> order(lambda_);
+    for (int k = 0; k < lambda_; k++) order[k] = k;
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return fitness[a] < fitness[b]; });
+
+    std::vector<double> old = mean_, yw(n_, 0);
+    for (int i = 0; i < n_; i++) {
+      mean_[i] = 0;
+      for (int k = 0; k < mu_; k++) mean_[i] += weights_[k] * points[order[k]][i];
+      yw[i] = (mean_[i] - old[i]) / sigma_;
+    }
+
+    // C^-1/2 yw = B D^-1 B^T yw
+    std::vector<double> t(n_, 0), invSqrt(n_, 0);
+    for (int j = 0; j < n_; j++) {
+      for (int i = 0; i < n_; i++) t[j] += b_[i * n_ + j] * yw[i];
+      t[j] /= d_[j];
+    }
+    for (int i = 0; i < n_; i++) {
+      for (int j = 0; j < n_; j++) invSqrt[i] += b_[i * n_ + j] * t[j];
+    }
+
+    double psNorm = 0;
+    for (int i = 0; i < n_; i++) {
+      ps_[i] = (1 - cs_) * ps_[i] + sqrt(cs_ * (2 - cs_) * muEff_) * invSqrt[i];
+      psNorm += ps_[i] * ps_[i];
+    }
+    psNorm = sqrt(psNorm);
+    generation_++;
+    bool hsig = psNorm / sqrt(1 - pow(1 - cs_, 2.0 * generation_)) / chiN_ < 1.4 + 2.0 / (n_ + 1);
+    for (int i = 0; i < n_; i++) {
+      pc_[i] = (1 - cc_) * pc_[i] + (hsig ? sqrt(cc_ * (2 - cc_) * muEff_) : 0) * yw[i];
+    }
+
+    double keep = 1 - c1_ - cmu_ + (hsig ? 0 : c1_ * cc_ * (2 - cc_));
+    for (int i = 0; i < n_; i++) {
+      for (int j = 0; j <= i; j++) {
+        double rankMu = 0;
+        for (int k = 0; k < mu_; k++) {
+          const std::vector<double>& x = points[order[k]];
+          rankMu += weights_[k] * (x[i] - old[i]) * (x[j] - old[j]) / (sigma_ * sigma_);
+        }
+        double cij = keep * c_[i * n_ + j] + c1_ * pc_[i] * pc_[j] + cmu_ * rankMu;
+        c_[i * n_ + j] = c_[j * n_ + i] = cij;
+      }
+    }
+    sigma_ *= exp((cs_ / damps_) * (psNorm / chiN_ - 1));
+
+    std::vector<double> eigen;
+    symmetricEigen(c_, n_, eigen, b_);
+    for (int i = 0; i < n_; i++) d_[i] = sqrt(std::max(eigen[i], 1e-20));
+  }
+
+  double sigma() const { return sigma_; }
+
+private:
+  int n_, lambda_, mu_;
+  std::vector<double> weights_;
+  double muEff_, cc_, cs_, c1_, cmu_, damps_, chiN_;
+  std::vector<double> mean_, pc_, ps_, c_, b_, d_;
+  double sigma_;
+  int generation_;
+  std::mt19937 rng_;
+};
+
+// --- Output ---
+
+static void printTable(const std::vector<Candidate>& candidates, size_t top) {
+  std::vector<size_t> order(candidates.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return candidates[a].score < candidates[b].score; });
+
+  printf("\n| Rank | Configuration |");
+  for (int k = 0; k < OBJECTIVE_COUNT; k++) printf(" %s |", OBJECTIVES[k].column);
+  printf(" Score | Pareto |\n| ---: | :--- |");
+  for (int k = 0; k < OBJECTIVE_COUNT; k++) printf(" ---: |");
+  printf(" ---: | :---: |\n");
+
+  for (size_t rank = 0; rank < order.size(); rank++) {
+    const Candidate& c = candidates[order[rank]];
+    if (rank >= top && !c.baseline) continue;
+    if (!c.ok) {
+      printf("| %zu | %s | failed |\n", rank + 1, candidateName(c).c_str());
+      continue;
+    }
+    printf("| %zu | %s |", rank + 1, candidateName(c).c_str());
+    for (int k = 0; k < OBJECTIVE_COUNT; k++) {
+      printf(" ");
+      printf(OBJECTIVES[k].format, c.objectives[k]);
+      printf(" |");
+    }
+    printf(" %.3f | %s |\n", c.score, c.front ? "*" : "");
+  }
+}
+
+static bool writeCsv(const char* path, const std::vector<Candidate>& candidates) {
+  FILE* out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  fprintf(out, "baseline");
+  for (int p = 0; p < PARAMETER_COUNT; p++) {
+    if (study.varied[p]) fprintf(out, ",%s", PARAMETERS[p].key);
+  }
+  for (int k = 0; k < OBJECTIVE_COUNT; k++) fprintf(out, ",%s", OBJECTIVES[k].key);
+  fprintf(out, ",score,pareto\n");
+  for (const Candidate& c : candidates) {
+    fprintf(out, "%d", c.baseline ? 1 : 0);
+    for (int p = 0; p < PARAMETER_COUNT; p++) {
+      if (study.varied[p]) fprintf(out, ",%.6g", c.baseline ? PARAMETERS[p].defaultValue : c.values[p]);
+    }
+    for (int k = 0; k < OBJECTIVE_COUNT; k++) fprintf(out, ",%.6g", c.ok ? c.objectives[k] : NAN);
+    fprintf(out, ",%.6g,%d\n", c.score, c.front ? 1 : 0);
+  }
+  fclose(out);
+  return true;
+}
+
+static double processCpuS() {
+  rusage self, children;
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  return self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec + children.ru_stime.tv_sec +
+         (self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec + children.ru_stime.tv_usec) * 1e-6;
+}
+
+// --- Command line ---
+
+struct GridAxis {
+  int parameter;
+  std::vector<double> values;
+};
+
+// "KEY=V1,V2,..."
+static bool parseGrid(const char* arg, std::vector<GridAxis>& axes) {
+  const char* equals = strchr(arg, '=');
+  if (!equals) return false;
+  GridAxis axis;
+  axis.parameter = findParameter(arg, equals - arg);
+  if (axis.parameter < 0) {
+    fprintf(stderr, "unknown parameter in %s\n", arg);
+    return false;
+  }
+  const char* cursor = equals + 1;
+  while (*cursor) {
+    char* end;
+    double value = strtod(cursor, &end);
+    if (end == cursor || value <= 0 || (*end && *end != ',')) return false;
+    axis.values.push_back(value);
+    cursor = *end ? end + 1 : end;
+  }
+  if (axis.values.empty()) return false;
+  axes.push_back(axis);
+  return true;
+}
+
+// "KEY,KEY,..." or a group name
+static bool parseSearchKeys(const char* arg, std::vector<int>& keys) {
+  if (!strcmp(arg, "control") || !strcmp(arg, "detection")) {
+    Group group = arg[0] == 'c' ? GROUP_CONTROL : GROUP_DETECTION;
+    for (int p = 0; p < PARAMETER_COUNT; p++) {
+      if (PARAMETERS[p].group == group) keys.push_back(p);
+    }
+    return true;
+  }
+  const char* cursor = arg;
+  while (*cursor) {
+    const char* end = strchr(cursor, ',');
+    size_t length = end ? (size_t)(end - cursor) : strlen(cursor);
+    int p = findParameter(cursor, length);
+    if (p < 0) {
+      fprintf(stderr, "unknown parameter in %s\n", arg);
+      return false;
+    }
+    keys.push_back(p);
+    cursor += length + (end ? 1 : 0);
+  }
+  return !keys.empty();
+}
+
+// "OBJECTIVE=W"
+static bool parseWeight(const char* arg) {
+  const char* equals = strchr(arg, '=');
+  if (!equals) return false;
+  for (int k = 0; k < OBJECTIVE_COUNT; k++) {
+    if (strlen(OBJECTIVES[k].key) == (size_t)(equals - arg) && !strncmp(OBJECTIVES[k].key, arg, equals - arg)) {
+      study.weights[k] = atof(equals + 1);
+      return study.weights[k] >= 0;
+    }
+  }
+  fprintf(stderr, "unknown objective in %s\n", arg);
+  return false;
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s (--grid KEY=V1,V2,...)... | --cmaes KEY[,KEY...] [--generations N] [--population N]\n"
+          "          [--hours H] [--seeds N] [--scenario single_fault|three_faults] [--warmup S]\n"
+          "          [--attr JSON] [--recorded CSV]... [--weight OBJECTIVE=W]... [--threads N]\n"
+          "          [--top N] [--out FILE] [--csv FILE]\n"
+          "parameters:",
+          argv0);
+  for (int p = 0; p < PARAMETER_COUNT; p++) fprintf(stderr, " %s", PARAMETERS[p].key);
+  fprintf(stderr, "\nobjectives:");
+  for (int k = 0; k < OBJECTIVE_COUNT; k++) fprintf(stderr, " %s", OBJECTIVES[k].key);
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv) {
+  readDefaults();
+
+  std::vector<GridAxis> grid;
+  std::vector<int> searchKeys;
+  std::vector<const char*> recordedPaths;
+  int generations = 12;
+  int population = 0;
+  unsigned threads = 0;
+  size_t top = 10;
+  const char* outPath = nullptr;
+  const char* csvPath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--grid") && hasValue) {
+      if (!parseGrid(argv[++i], grid)) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--cmaes") && hasValue) {
+      if (!parseSearchKeys(argv[++i], searchKeys)) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--generations") && hasValue) generations = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--population") && hasValue) population = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--hours") && hasValue) study.hours = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seeds") && hasValue) study.seeds = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--scenario") && hasValue) {
+      if (!parseScenario(argv[++i], &study.scenario) || study.scenario == SCENARIO_NOFAULTS) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--warmup") && hasValue) study.warmupS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--attr") && hasValue) study.attributes = argv[++i];
+    else if (!strcmp(argv[i], "--recorded") && hasValue) recordedPaths.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--weight") && hasValue) {
+      if (!parseWeight(argv[++i])) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (!strcmp(argv[i], "--threads") && hasValue) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--top") && hasValue) top = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--out") && hasValue) outPath = argv[++i];
+    else if (!strcmp(argv[i], "--csv") && hasValue) csvPath = argv[++i];
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (grid.empty() == searchKeys.empty() || study.hours <= 0 || generations < 1 || population < 0 ||
+      (study.seeds == 0 && recordedPaths.empty() && study.weights[OBJ_FALSE_POSITIVES] + study.weights[OBJ_LATENCY] > 0)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  StaticJsonDocument<512> attributes;
+  if (deserializeJson(attributes, study.attributes.c_str(), study.attributes.size())) {
+    fprintf(stderr, "--attr is not valid JSON\n");
+    return 2;
+  }
+  study.setpoints[0] = attributes["target_temperature"] | 0.0f;
+  study.setpoints[1] = attributes["target_pH"] | 0.0f;
+  study.setpoints[2] = attributes["target_rpm"] | 0.0f;
+
+  for (const char* path : recordedPaths) {
+    study.recordings.emplace_back();
+    if (!readRecording(path, study.recordings.back())) return 1;
+  }
+
+  for (const GridAxis& axis : grid) study.varied[axis.parameter] = true;
+  for (int p : searchKeys) study.varied[p] = true;
+  for (int p = 0; p < PARAMETER_COUNT; p++) {
+    if (study.varied[p] && PARAMETERS[p].group == GROUP_CONTROL) study.controlVaried = true;
+  }
+
+  WorkStealingPool pool(threads);
+  auto wallStart = std::chrono::steady_clock::now();
+
+  std::vector<Candidate> candidates(1);
+  candidates[0].baseline = true;
+  for (int p = 0; p < PARAMETER_COUNT; p++) candidates[0].values[p] = PARAMETERS[p].defaultValue;
+
+  if (!grid.empty()) {
+    // Every combination, the last axis varying fastest
+    size_t count = 1;
+    for (const GridAxis& axis : grid) count *= axis.values.size();
+    for (size_t index = 0; index < count; index++) {
+      Candidate c = candidates[0];
+      c.baseline = false;
+      size_t rest = index;
+      for (size_t a = grid.size(); a-- > 0;) {
+        c.values[grid[a].parameter] = grid[a].values[rest % grid[a].values.size()];
+        rest /= grid[a].values.size();
+      }
+      candidates.push_back(c);
+    }
+    printf("grid of %zu configurations plus the defaults on %u workers\n", count, pool.threads());
+    evaluate(pool, candidates, 0);
+  } else {
+    int n = (int)searchKeys.size();
+    if (population == 0) population = std::max(4 + (int)(3 * log((double)n)), (int)pool.threads());
+    if (population < 4) population = 4;
+    printf("CMA-ES over %d parameters: %d generations of %d on %u workers\n", n, generations, population,
+           pool.threads());
+    fflush(stdout); // Before the progress lines on stderr
+    evaluate(pool, candidates, 0);
+
+    std::vector<double> mean(n);
+    for (int i = 0; i < n; i++) mean[i] = parameterCoordinate(searchKeys[i], PARAMETERS[searchKeys[i]].defaultValue);
+    CmaEs search(mean, 0.2, population);
+
+    for (int g = 0; g < generations; g++) {
+      std::vector<std::vector<double>> points = search.ask();
+      size_t first = candidates.size();
+      for (const std::vector<double>& x : points) {
+        Candidate c = candidates[0];
+        c.baseline = false;
+        for (int i = 0; i < n; i++) {
+          c.values[searchKeys[i]] = parameterValue(searchKeys[i], std::min(1.0, std::max(0.0, x[i])));
+        }
+        candidates.push_back(c);
+      }
+      evaluate(pool, candidates, first);
+
+      // Points outside the ranges are evaluated at the nearest edge and pay for the distance
+      std::vector<double> fitness(points.size());
+      double best = INFINITY;
+      for (size_t k = 0; k < points.size(); k++) {
+        double outside = 0;
+        for (int i = 0; i < n; i++) {
+          double clipped = std::min(1.0, std::max(0.0, points[k][i]));
+          outside += (points[k][i] - clipped) * (points[k][i] - clipped);
+        }
+        fitness[k] = std::min(candidates[first + k].score, 1e9) + 10 * outside;
+        best = std::min(best, candidates[first + k].score);
+      }
+      search.tell(points, fitness);
+      fprintf(stderr, "generation %d: best score %.3f, sigma %.3f\n", g + 1, best, search.sigma());
+    }
+  }
+
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  markFront(candidates);
+
+  size_t runs = (study.controlVaried ? 1 : 0) + study.seeds + study.recordings.size();
+  printf("%zu configurations, %zu runs each (%s%u x %.1f h with faults, %zu recorded): %.1f s, %.1f s CPU\n",
+         candidates.size(), runs, study.controlVaried ? "1 fault-free, " : "", study.seeds, study.hours,
+         study.recordings.size(), wallS, processCpuS());
+  printTable(candidates, top);
+
+  const Candidate* best = &candidates[0];
+  for (const Candidate& c : candidates) {
+    if (c.score < best->score) best = &c;
+  }
+  if (!best->ok) {
+    fprintf(stderr, "every configuration failed\n");
+    return 1;
+  }
+
+  // The winner's values of every searched key, the defaults included
+  std::string json = "{";
+  char entry[64];
+  for (int p = 0; p < PARAMETER_COUNT; p++) {
+    if (!study.varied[p]) continue;
+    snprintf(entry, sizeof(entry), "%s\"%s\":%.6g", json.size() > 1 ? "," : "", PARAMETERS[p].key, best->values[p]);
+    json += entry;
+  }
+  json += "}";
+  printf("\nbest: %s (score %.3f against %.3f for the defaults)\n", json.c_str(), best->score, candidates[0].score);
+
+  if (outPath) {
+    FILE* out = fopen(outPath, "w");
+    if (!out) {
+      perror(outPath);
+      return 1;
+    }
+    fprintf(out, "%s\n", json.c_str());
+    fclose(out);
+  }
+  if (csvPath && !writeCsv(csvPath, candidates)) return 1;
+  return 0;
+}
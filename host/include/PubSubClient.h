@@ -0,0 +1,42 @@
+#ifndef PUBSUBCLIENT_HOST_H
+#define PUBSUBCLIENT_HOST_H
+
+// Host build stand-in for the Arduino PubSubClient library.
+// Only the publish side used by the subsystem RPC handlers is provided;
+// messages are handed to an optional hook instead of a broker.
+
+#include <stdint.h>
+#include <string.h>
+
+class PubSubClient {
+public:
+  typedef void (*PublishHook)(const char* topic, const uint8_t* payload, unsigned int length, void* ctx);
+
+  PubSubClient() : hook_(nullptr), ctx_(nullptr), published_(0) {}
+
+  void setPublishHook(PublishHook hook, void* ctx) {
+    hook_ = hook;
+    ctx_ = ctx;
+  }
+
+  bool publish(const char* topic, const char* payload) {
+    return publish(topic, (const uint8_t*)payload, (unsigned int)strlen(payload));
+  }
+
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) {
+    published_++;
+    if (hook_) hook_(topic, payload, length, ctx_);
+    return true;
+  }
+
+  bool connected() const { return true; }
+  bool loop() { return true; }
+  uint32_t publishedCount() const { return published_; }
+
+private:
+  PublishHook hook_;
+  void* ctx_;
+  uint32_t published_;
+};
+
+#endif // PUBSUBCLIENT_HOST_H
@@ -0,0 +1,120 @@
+// Python bindings for main/Detectors.hpp, drop-in replacements for the classes
+// of both detectors.py scripts:
+//
+//   bioreactor_detectors.windowed  <- data-analysis/detectors.py
+//   bioreactor_detectors.baseline  <- anomalydetection/detectors.py
+//
+// Same constructor keywords, same update() results, O(1) per sample.
+// Built by CMake when pybind11 is found (pip install pybind11).
+
+#include "Detectors.hpp"
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <stdio.h>
+#include <vector>
+
+namespace py = pybind11;
+
+// Large enough for any window the scripts use; checked at construction
+const uint16_t MAX_WINDOW = 1024;
+
+static uint16_t checkWindow(int windowSize) {
+  if (windowSize < 1 || windowSize > MAX_WINDOW) {
+    throw py::value_error("window_size must be between 1 and 1024");
+  }
+  return (uint16_t)windowSize;
+}
+
+static RunningStats baselineOf(const std::vector<double>& data) {
+  RunningStats stats;
+  for (double x : data) stats.add(x);
+  return stats;
+}
+
+static py::tuple detection(const Detection& d) {
+  return py::make_tuple(d.anomaly, d.score);
+}
+
+// train() prints the learned values like the Python versions do
+static void printLine(const char* fmt, double a, double b, double c = 0) {
+  char line[160];
+  snprintf(line, sizeof(line), fmt, a, b, c);
+  py::print(line);
+}
+
+PYBIND11_MODULE(bioreactor_detectors, m) {
+  m.doc() = "O(1) streaming anomaly detectors (main/Detectors.hpp)";
+
+  // --- data-analysis/detectors.py ---
+  py::module_ windowed = m.def_submodule("windowed", "Detectors of data-analysis/detectors.py");
+
+  py::class_<ZScoreDetector<MAX_WINDOW>>(windowed, "ZScoreDetector")
+      .def(py::init([](int windowSize, float threshold) {
+             return new ZScoreDetector<MAX_WINDOW>(checkWindow(windowSize), threshold);
+           }),
+           py::arg("window_size") = 100, py::arg("threshold") = 3.0f)
+      .def("update", [](ZScoreDetector<MAX_WINDOW>& d, float value) { return detection(d.update(value)); })
+      .def("reset", &ZScoreDetector<MAX_WINDOW>::reset);
+
+  py::class_<HysteresisDetector>(windowed, "HysteresisDetector")
+      .def(py::init<float, float, bool>(), py::arg("low_threshold"), py::arg("high_threshold"),
+           py::arg("initial_state") = false)
+      .def("update", &HysteresisDetector::update)
+      .def_property_readonly("state", &HysteresisDetector::state);
+
+  py::class_<SlidingWindowDetector<MAX_WINDOW>>(windowed, "SlidingWindowDetector")
+      .def(py::init([](int windowSize, float threshold, float ideal) {
+             return new SlidingWindowDetector<MAX_WINDOW>(checkWindow(windowSize), threshold, ideal);
+           }),
+           py::arg("window_size") = 50, py::arg("threshold") = 0.0f, py::arg("ideal_value") = 0.0f)
+      .def("update", [](SlidingWindowDetector<MAX_WINDOW>& d, float value) { return detection(d.update(value)); })
+      .def("reset", &SlidingWindowDetector<MAX_WINDOW>::reset);
+
+  // --- anomalydetection/detectors.py ---
+  py::module_ baseline = m.def_submodule("baseline", "Detectors of anomalydetection/detectors.py");
+
+  py::class_<BaselineZScoreDetector>(baseline, "ZScoreDetector")
+      .def(py::init<float>(), py::arg("threshold") = 3.0f)
+      .def("train",
+           [](BaselineZScoreDetector& d, const std::vector<double>& data) {
+             d.train(baselineOf(data));
+             printLine("      mean=%.4f, std=%.4f, threshold=±%gσ", d.mean(), d.stddev(), d.threshold());
+           },
+           py::arg("training_data"))
+      .def("update", [](const BaselineZScoreDetector& d, float value) { return detection(d.update(value)); })
+      .def_property_readonly("is_trained", &BaselineZScoreDetector::trained)
+      .def_property_readonly("baseline_mean", &BaselineZScoreDetector::mean)
+      .def_property_readonly("baseline_std", &BaselineZScoreDetector::stddev);
+
+  py::class_<BandHysteresisDetector>(baseline, "HysteresisDetector")
+      .def(py::init<float, float>(), py::arg("k") = 3.0f, py::arg("hysteresis_factor") = 0.5f)
+      .def("train",
+           [](BandHysteresisDetector& d, const std::vector<double>& data) {
+             d.train(baselineOf(data));
+             printLine("      range=[%.4f, %.4f], margin=%.4f", d.low(), d.high(), d.margin());
+           },
+           py::arg("training_data"))
+      .def("update", &BandHysteresisDetector::update)
+      .def("reset", &BandHysteresisDetector::reset)
+      .def_property_readonly("is_trained", &BandHysteresisDetector::trained)
+      .def_property_readonly("low", &BandHysteresisDetector::low)
+      .def_property_readonly("high", &BandHysteresisDetector::high)
+      .def_property_readonly("margin", &BandHysteresisDetector::margin);
+
+  py::class_<BaselineDriftDetector<MAX_WINDOW>>(baseline, "SlidingWindowDetector")
+      .def(py::init([](int windowSize, float k) {
+             return new BaselineDriftDetector<MAX_WINDOW>(checkWindow(windowSize), k);
+           }),
+           py::arg("window_size") = 30, py::arg("k") = 2.0f)
+      .def("train",
+           [](BaselineDriftDetector<MAX_WINDOW>& d, const std::vector<double>& data) {
+             d.train(baselineOf(data));
+             printLine("      baseline=%.4f, threshold=±%.4f", d.baseline(), d.threshold());
+           },
+           py::arg("training_data"))
+      .def("update", [](BaselineDriftDetector<MAX_WINDOW>& d, float value) { return detection(d.update(value)); })
+      .def("reset", &BaselineDriftDetector<MAX_WINDOW>::reset)
+      .def_property_readonly("is_trained", &BaselineDriftDetector<MAX_WINDOW>::trained)
+      .def_property_readonly("baseline_mean", &BaselineDriftDetector<MAX_WINDOW>::baseline)
+      .def_property_readonly("threshold", &BaselineDriftDetector<MAX_WINDOW>::threshold);
+}
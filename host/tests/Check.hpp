@@ -0,0 +1,49 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <math.h>
+#include <stdio.h>
+
+// Assertions for the host tests run by ctest. A failed CHECK prints the
+// expression and its line and the test carries on; main() returns
+// checkResult(), which is non-zero if anything failed.
+
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                        \
+  do {                                                                          \
+    if (!(condition)) {                                                         \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      checkFailures++;                                                          \
+    }                                                                           \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                              \
+  do {                                                                          \
+    long long a_ = (long long)(actual), e_ = (long long)(expected);             \
+    if (a_ != e_) {                                                             \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+      checkFailures++;                                                          \
+    }                                                                           \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                 \
+  do {                                                                          \
+    double a_ = (double)(actual), e_ = (double)(expected);                      \
+    if (!(fabs(a_ - e_) <= (tolerance))) {                                      \
+      fprintf(stderr, "%s:%d: %s is %g, expected %g +- %g\n", __FILE__, __LINE__, #actual, a_, e_, \
+              (double)(tolerance));                                             \
+      checkFailures++;                                                          \
+    }                                                                           \
+  } while (0)
+
+static inline int checkResult(const char* name) {
+  if (checkFailures) {
+    fprintf(stderr, "%s: %d check(s) failed\n", name, checkFailures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif // CHECK_HPP
@@ -0,0 +1,132 @@
+// Feeds known Hall pulse trains into the Linux HAL's pulse capture mock and
+// checks the RPM that captureRpm() (the stirring subsystem's capture backend)
+// derives from them: steady speeds, a speed step, glitch edges, the stopped
+// motor timeout and the 32-bit clock wrap.
+
+#include "Check.hpp"
+#include "HalLinux.hpp"
+#include "PulseRate.hpp"
+
+const uint8_t PIN = 2;
+const uint16_t EDGES = 7;         // RPM_EDGES_PER_CAPTURE
+const float PULSES_PER_REV = 70;  // Npulses
+const uint32_t TIMEOUT_US = 100000;
+
+static float rpmForPeriod(double periodUs) {
+  return 60e6 / (PULSES_PER_REV * periodUs);
+}
+
+static float readRpm() {
+  HalPulseCapture capture;
+  CHECK(halPulseCaptureRead(PIN, capture));
+  return captureRpm(capture, halMicros(), EDGES, PULSES_PER_REV, TIMEOUT_US);
+}
+
+static void pulses(int n, uint32_t periodUs) {
+  for (int i = 0; i < n; i++) {
+    halSimAdvanceUs(periodUs);
+    CHECK(halSimTriggerInterrupt(PIN));
+  }
+}
+
+static void startCapture(uint64_t timeUs) {
+  halSimReset();
+  halSimSetLogEnabled(false);
+  halSimSetTimeUs(timeUs);
+  CHECK(halPulseCaptureStart(PIN, EDGES));
+}
+
+static void testSteadyAndStep() {
+  startCapture(0);
+  CHECK_NEAR(readRpm(), 0, 0);
+
+  // One capture has no span yet
+  pulses(EDGES, 1000);
+  HalPulseCapture capture;
+  halPulseCaptureRead(PIN, capture);
+  CHECK_EQ(capture.captures, 1);
+  CHECK_EQ(capture.spanNs, 0);
+  CHECK_NEAR(readRpm(), 0, 0);
+
+  pulses(EDGES, 1000);
+  halPulseCaptureRead(PIN, capture);
+  CHECK_EQ(capture.captures, 2);
+  CHECK_EQ(capture.spanNs, EDGES * 1000 * 1000);
+  CHECK_NEAR(readRpm(), rpmForPeriod(1000), 0.01); // 857 rpm
+
+  // Edges between captures do not change the reading
+  pulses(EDGES - 1, 500);
+  CHECK_NEAR(readRpm(), rpmForPeriod(1000), 0.01);
+  pulses(1, 500);
+  CHECK_NEAR(readRpm(), rpmForPeriod(500), 0.01); // 1714 rpm from the next capture on
+  pulses(EDGES, 500);
+  CHECK_NEAR(readRpm(), rpmForPeriod(500), 0.01);
+}
+
+static void testGlitch() {
+  startCapture(0);
+  pulses(2 * EDGES, 800);
+  CHECK_NEAR(readRpm(), rpmForPeriod(800), 0.01);
+
+  // A bounce 3 us after a real edge counts as an edge: the capture it falls
+  // into spans one period less, so one reading is 7/6 high...
+  pulses(3, 800);
+  halSimAdvanceUs(3);
+  halSimTriggerInterrupt(PIN);
+  halSimAdvanceUs(800 - 3);
+  halSimTriggerInterrupt(PIN);
+  pulses(EDGES - 5, 800);
+  CHECK_NEAR(readRpm(), rpmForPeriod(800) * 7 / 6, 0.01);
+
+  // ...and the next one is exact again, one edge out of phase
+  pulses(EDGES, 800);
+  CHECK_NEAR(readRpm(), rpmForPeriod(800), 0.01);
+}
+
+static void testTimeout() {
+  startCapture(0);
+  pulses(2 * EDGES, 1000);
+  float rpm = rpmForPeriod(1000);
+
+  // Still valid exactly at the timeout, 0 (stopped) one microsecond later
+  halSimAdvanceUs(TIMEOUT_US);
+  CHECK_NEAR(readRpm(), rpm, 0.01);
+  halSimAdvanceUs(1);
+  CHECK_NEAR(readRpm(), 0, 0);
+
+  // Restarting: the first span includes the stop and reads low, the second is exact
+  pulses(EDGES, 1000);
+  CHECK(readRpm() < rpm / 10);
+  pulses(EDGES, 1000);
+  CHECK_NEAR(readRpm(), rpm, 0.01);
+}
+
+static void testClockWrap() {
+  // Captures either side of the 32-bit halMicros() wrap
+  startCapture(0xFFFFFFFFull - 5000);
+  pulses(2 * EDGES, 1000);
+  CHECK(halSimTimeUs() > 0xFFFFFFFFull);
+  CHECK_NEAR(readRpm(), rpmForPeriod(1000), 0.01);
+  halSimAdvanceUs(TIMEOUT_US + 1);
+  CHECK_NEAR(readRpm(), 0, 0);
+}
+
+static void testSetup() {
+  halSimReset();
+  HalPulseCapture capture;
+  CHECK(!halPulseCaptureRead(PIN, capture));
+  CHECK(!halSimTriggerInterrupt(PIN)); // Neither an ISR nor a capture
+  CHECK(!halPulseCaptureStart(PIN, 0));
+  CHECK(!halPulseCaptureStart(PIN, 257));
+  CHECK(!halPulseCaptureStart(HAL_SIM_PIN_COUNT, EDGES));
+  CHECK(halPulseCaptureStart(PIN, 256));
+}
+
+int main() {
+  testSteadyAndStep();
+  testGlitch();
+  testTimeout();
+  testClockWrap();
+  testSetup();
+  return checkResult("test_pulse_capture");
+}
@@ -0,0 +1,151 @@
+// Checks the manual pulse rules of PumpTimeline: start, merge and queue,
+// acid and base never on together, the MAX_PULSE_MS limit with the merge
+// overflow as a follow-on pulse, the full queue, cancel, and the wrap of the
+// 32-bit millisecond clock.
+
+#include "Check.hpp"
+#include "PumpTimeline.hpp"
+
+static void testStartMergeQueue() {
+  PumpTimeline t;
+  CHECK(!t.busy());
+  CHECK_EQ(t.request(PUMP_ACID, 1000, 0), PULSE_STARTED);
+  CHECK(t.isOn(PUMP_ACID));
+  CHECK(!t.isOn(PUMP_BASE));
+
+  // Same pump running: the durations add up
+  CHECK_EQ(t.request(PUMP_ACID, 500, 200), PULSE_MERGED);
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 200), 1300);
+
+  // Opposite pump waits, then the same pump after it merges into that pulse
+  CHECK_EQ(t.request(PUMP_BASE, 400, 300), PULSE_QUEUED);
+  CHECK_EQ(t.request(PUMP_BASE, 100, 300), PULSE_MERGED);
+  CHECK_EQ(t.request(PUMP_ACID, 250, 300), PULSE_QUEUED);
+  CHECK_EQ(t.pendingMs(PUMP_BASE, 300), 500);
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 300), 1200 + 250);
+
+  // Never both on: base starts when acid ends at 1500
+  t.step(1499);
+  CHECK(t.isOn(PUMP_ACID));
+  CHECK(!t.isOn(PUMP_BASE));
+  t.step(1500);
+  CHECK(!t.isOn(PUMP_ACID));
+  CHECK(t.isOn(PUMP_BASE));
+  t.step(2000);
+  CHECK(t.isOn(PUMP_ACID));
+  t.step(2250);
+  CHECK(!t.busy());
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 2250), 0);
+}
+
+static void testLimits() {
+  PumpTimeline t;
+  CHECK_EQ(t.request(PUMP_ACID, 0, 0), PULSE_REJECTED);
+  CHECK_EQ(t.request(PUMP_ACID, MAX_PULSE_MS + 1, 0), PULSE_REJECTED);
+  CHECK_EQ(t.request(PUMP_ALL, 100, 0), PULSE_REJECTED);
+  CHECK(!t.busy());
+  CHECK_EQ(t.request(PUMP_ACID, MAX_PULSE_MS, 0), PULSE_STARTED);
+
+  // A merge past MAX_PULSE_MS keeps the whole dose: the running pulse is
+  // extended to MAX_PULSE_MS from now, and the rest follows as its own pulse
+  CHECK_EQ(t.request(PUMP_ACID, 3000, 1000), PULSE_MERGED);
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 1000), 9000 + 3000);
+  t.step(10999);
+  CHECK(t.isOn(PUMP_ACID));
+  t.step(11000);
+  CHECK(t.isOn(PUMP_ACID));
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 11000), 2000);
+  t.step(13000);
+  CHECK(!t.busy());
+
+  // Same for a queued pulse
+  CHECK_EQ(t.request(PUMP_BASE, 100, 20000), PULSE_STARTED);
+  CHECK_EQ(t.request(PUMP_ACID, 8000, 20000), PULSE_QUEUED);
+  CHECK_EQ(t.request(PUMP_ACID, 5000, 20000), PULSE_MERGED);
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 20000), 13000);
+  t.step(20100);
+  t.step(30100);
+  CHECK(t.isOn(PUMP_ACID));
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 30100), 3000);
+}
+
+static void testQueueFull() {
+  PumpTimeline t;
+  CHECK_EQ(t.request(PUMP_ACID, 100, 0), PULSE_STARTED);
+  for (int i = 0; i < PULSE_QUEUE_LENGTH; i++) {
+    CHECK_EQ(t.request(i % 2 ? PUMP_ACID : PUMP_BASE, 100, 0), PULSE_QUEUED);
+  }
+  CHECK_EQ(t.request(PUMP_BASE, 100, 0), PULSE_REJECTED);
+  // Merging into the last pulse needs no slot, unless it goes past MAX_PULSE_MS
+  CHECK_EQ(t.request(PUMP_ACID, 100, 0), PULSE_MERGED);
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 0), 400);
+
+  PumpTimeline u;
+  u.request(PUMP_ACID, 100, 0);
+  for (int i = 0; i < PULSE_QUEUE_LENGTH; i++) u.request(i % 2 ? PUMP_ACID : PUMP_BASE, 9000, 0);
+  CHECK_EQ(u.request(PUMP_ACID, 500, 0), PULSE_MERGED);
+  CHECK_EQ(u.request(PUMP_ACID, 1000, 0), PULSE_REJECTED); // 10500 would need a follow-on
+  CHECK_EQ(u.pendingMs(PUMP_ACID, 0), 100 + 9000 + 9500);
+}
+
+static void testCancel() {
+  PumpTimeline t;
+  t.request(PUMP_ACID, 1000, 0);
+  t.request(PUMP_BASE, 200, 0);
+  t.request(PUMP_ACID, 300, 0);
+  t.request(PUMP_BASE, 400, 0);
+
+  // Dropping acid removes the running pulse and one queued; the two base pulses merge
+  CHECK_EQ(t.cancel(PUMP_ACID, 100), 2);
+  CHECK(t.isOn(PUMP_BASE));
+  CHECK_EQ(t.pendingMs(PUMP_BASE, 100), 600);
+  CHECK_EQ(t.pendingMs(PUMP_ACID, 100), 0);
+  t.step(699);
+  CHECK(t.isOn(PUMP_BASE));
+  t.step(700);
+  CHECK(!t.busy());
+
+  // Neighbours that would exceed MAX_PULSE_MS stay apart
+  t.request(PUMP_ACID, 100, 1000);
+  t.request(PUMP_BASE, 6000, 1000);
+  t.request(PUMP_ACID, 100, 1000);
+  t.request(PUMP_BASE, 6000, 1000);
+  CHECK_EQ(t.cancel(PUMP_ACID, 1000), 2);
+  CHECK_EQ(t.pendingMs(PUMP_BASE, 1000), 12000);
+  t.step(7000);
+  CHECK(t.isOn(PUMP_BASE));
+  t.step(13000);
+  CHECK(!t.busy());
+
+  t.request(PUMP_ACID, 100, 20000);
+  t.request(PUMP_BASE, 100, 20000);
+  CHECK_EQ(t.cancel(PUMP_ALL, 20000), 2);
+  CHECK(!t.busy());
+  CHECK_EQ(t.cancel(PUMP_ALL, 20000), 0);
+}
+
+static void testClockWrap() {
+  PumpTimeline t;
+  uint32_t start = 0xFFFFFFFFu - 300;
+  CHECK_EQ(t.request(PUMP_ACID, 1000, start), PULSE_STARTED);
+  CHECK_EQ(t.request(PUMP_BASE, 500, start), PULSE_QUEUED);
+  t.step(start + 500); // Past the wrap, before the end
+  CHECK(t.isOn(PUMP_ACID));
+  CHECK_EQ(t.pendingMs(PUMP_ACID, start + 500), 500);
+  CHECK_EQ(t.request(PUMP_BASE, 100, start + 500), PULSE_MERGED);
+  t.step(start + 1000);
+  CHECK(t.isOn(PUMP_BASE));
+  t.step(start + 1599);
+  CHECK(t.isOn(PUMP_BASE));
+  t.step(start + 1600);
+  CHECK(!t.busy());
+}
+
+int main() {
+  testStartMergeQueue();
+  testLimits();
+  testQueueFull();
+  testCancel();
+  testClockWrap();
+  return checkResult("test_pump_timeline");
+}
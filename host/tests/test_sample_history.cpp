@@ -0,0 +1,149 @@
+// Checks SpscRing (full, empty, wrap, reserve/commit, at/discard) and the
+// SampleHistory built on it: ageing into the decimated tiers, overrun,
+// decimation and drop accounting, and the back-fill order of read()/discard()
+// (oldest archive first, then live). Samples are told apart by timeUs, which
+// is their push index.
+
+#include "Check.hpp"
+#include "SampleHistory.hpp"
+
+static void testRing() {
+  SpscRing<int, 4> ring;
+  int item = -1;
+  CHECK(ring.empty());
+  CHECK(!ring.pop(item));
+
+  for (int i = 0; i < 4; i++) CHECK(ring.push(i));
+  CHECK_EQ(ring.size(), 4);
+  CHECK(!ring.push(4)); // Full: refused, nothing overwritten
+  CHECK(ring.reserve() == nullptr);
+  CHECK_EQ(ring.at(0), 0);
+  CHECK_EQ(ring.at(3), 3);
+
+  // Keep it half full across many laps of the slots, oldest out first
+  int next = 4, expected = 0;
+  for (int lap = 0; lap < 10; lap++) {
+    for (int i = 0; i < 2; i++) {
+      CHECK(ring.pop(item));
+      CHECK_EQ(item, expected++);
+    }
+    CHECK(ring.push(next++));
+    int* slot = ring.reserve();
+    CHECK(slot != nullptr);
+    if (slot) *slot = next++;
+    ring.commit();
+    CHECK_EQ(ring.size(), 4);
+  }
+  CHECK_EQ(ring.at(0), expected);
+  CHECK_EQ(ring.at(3), expected + 3);
+
+  ring.discard(3);
+  CHECK_EQ(ring.size(), 1);
+  CHECK(ring.pop(item));
+  CHECK_EQ(item, expected + 3);
+  CHECK(ring.empty());
+  CHECK(!ring.pop(item));
+}
+
+static TelemetrySample sampleAt(uint64_t index) {
+  TelemetrySample sample = {};
+  sample.timeUs = index;
+  return sample;
+}
+
+// 130 KB each: kept off the stack
+static SampleHistory history;
+static TelemetrySample out[HISTORY_LIVE_SAMPLES + HISTORY_TIER1_SAMPLES + HISTORY_TIER2_SAMPLES];
+
+static void testAgeing() {
+  // Fill the live ring while offline and not ageing: the next push is an overrun
+  for (uint32_t i = 0; i < HISTORY_LIVE_SAMPLES; i++) CHECK(history.push(sampleAt(i)));
+  CHECK(!history.push(sampleAt(HISTORY_LIVE_SAMPLES)));
+  CHECK_EQ(history.stats().overruns, 1);
+  CHECK_EQ(history.archived(), 0);
+
+  // Ageing brings the live ring down to the high-water mark; of the aged
+  // samples tier 1 keeps the first of every HISTORY_TIER1_DECIMATION
+  history.age();
+  const uint32_t aged = HISTORY_LIVE_SAMPLES - HISTORY_LIVE_HIGH_WATER;
+  const uint32_t kept = (aged + HISTORY_TIER1_DECIMATION - 1) / HISTORY_TIER1_DECIMATION;
+  CHECK_EQ(history.archived(), kept);
+  CHECK_EQ(history.backlog(), kept + HISTORY_LIVE_HIGH_WATER);
+  CHECK_EQ(history.stats().decimated, aged - kept);
+  CHECK_EQ(history.stats().dropped, 0);
+
+  // Back-fill order: the archive, then live, oldest first
+  int n = history.read(out, (int)history.backlog());
+  CHECK_EQ(n, kept + HISTORY_LIVE_HIGH_WATER);
+  CHECK_EQ(out[0].timeUs, 0);
+  CHECK_EQ(out[1].timeUs, HISTORY_TIER1_DECIMATION);
+  CHECK_EQ(out[kept - 1].timeUs, (kept - 1) * HISTORY_TIER1_DECIMATION);
+  CHECK_EQ(out[kept].timeUs, aged);
+  CHECK_EQ(out[n - 1].timeUs, HISTORY_LIVE_SAMPLES - 1);
+
+  // read() leaves the samples in place; discard() takes them in the same order
+  CHECK_EQ(history.read(out, 3), 3);
+  CHECK_EQ(out[0].timeUs, 0);
+  history.discard(kept + 2); // All of the archive and two live samples
+  CHECK_EQ(history.archived(), 0);
+  CHECK_EQ(history.read(out, 1), 1);
+  CHECK_EQ(out[0].timeUs, aged + 2);
+
+  // More than the backlog empties it
+  history.discard((int)history.backlog() + 10);
+  CHECK_EQ(history.backlog(), 0);
+  CHECK_EQ(history.read(out, 1), 0);
+}
+
+static void testLongOutage() {
+  // A long outage with the publisher ageing after every sample, long enough
+  // for tier 1 to spill into tier 2 and tier 2 to drop its oldest
+  SampleHistory* h = new SampleHistory();
+  const uint64_t total = 7000000;
+  for (uint64_t i = 0; i < total; i++) {
+    h->push(sampleAt(i));
+    h->age();
+  }
+
+  HistoryStats stats = h->stats();
+  CHECK_EQ(stats.overruns, 0);
+  CHECK_EQ(h->backlog(), HISTORY_LIVE_HIGH_WATER + HISTORY_TIER1_SAMPLES + HISTORY_TIER2_SAMPLES);
+
+  // Every sample is either waiting, decimated or dropped
+  CHECK_EQ(h->backlog() + stats.decimated + stats.dropped, total);
+  const uint64_t tier1Kept =
+      (total - HISTORY_LIVE_HIGH_WATER + HISTORY_TIER1_DECIMATION - 1) / HISTORY_TIER1_DECIMATION;
+  const uint64_t tier2Kept =
+      (tier1Kept - HISTORY_TIER1_SAMPLES + HISTORY_TIER2_DECIMATION - 1) / HISTORY_TIER2_DECIMATION;
+  CHECK_EQ(stats.dropped, tier2Kept - HISTORY_TIER2_SAMPLES);
+
+  // Oldest first across the tiers, spaced by each tier's decimation
+  int n = h->read(out, (int)h->backlog());
+  CHECK_EQ(n, h->backlog());
+  bool ascending = true;
+  for (int i = 1; i < n; i++) ascending = ascending && out[i].timeUs > out[i - 1].timeUs;
+  CHECK(ascending);
+  const uint64_t tier2Step = (uint64_t)HISTORY_TIER1_DECIMATION * HISTORY_TIER2_DECIMATION;
+  CHECK_EQ(out[1].timeUs - out[0].timeUs, tier2Step);
+  CHECK_EQ(out[HISTORY_TIER2_SAMPLES + 1].timeUs - out[HISTORY_TIER2_SAMPLES].timeUs, HISTORY_TIER1_DECIMATION);
+  CHECK_EQ(out[n - 1].timeUs - out[n - 2].timeUs, 1);
+  CHECK_EQ(out[n - 1].timeUs, total - 1);
+  CHECK_EQ(out[n - HISTORY_LIVE_HIGH_WATER].timeUs, total - HISTORY_LIVE_HIGH_WATER);
+
+  // Back-fill a frame at a time: the tier 2 samples go first
+  const int batch = 50;
+  CHECK_EQ(h->read(out, batch), batch);
+  uint64_t first = out[0].timeUs;
+  h->discard(batch);
+  CHECK_EQ(h->read(out, 1), 1);
+  CHECK_EQ(out[0].timeUs, first + batch * tier2Step);
+  CHECK_EQ(h->archived(), HISTORY_TIER1_SAMPLES + HISTORY_TIER2_SAMPLES - batch);
+  delete h;
+}
+
+int main() {
+  testRing();
+  testAgeing();
+  testLongOutage();
+  return checkResult("test_sample_history");
+}
@@ -0,0 +1,180 @@
+// Drives the Scheduler against a fake microsecond clock: each task advances the
+// clock by its execution time, so deadline misses, skipped releases and jitter
+// are exact and can be asserted on.
+
+#include "Check.hpp"
+#include "Scheduler.hpp"
+
+static uint32_t fakeNow = 0;
+static uint32_t fakeClock() { return fakeNow; }
+
+static uint32_t execA = 0, execB = 0;
+static int order[16], orderCount = 0;
+
+static void taskA() {
+  if (orderCount < 16) order[orderCount++] = 0;
+  fakeNow += execA;
+}
+
+static void taskB() {
+  if (orderCount < 16) order[orderCount++] = 1;
+  fakeNow += execB;
+}
+
+static void reset(uint32_t start) {
+  fakeNow = start;
+  execA = execB = 0;
+  orderCount = 0;
+}
+
+// Sleeps until the next release and runs one task, like the firmware's loop()
+static void step(Scheduler& s) {
+  fakeNow += s.untilNextReleaseUs();
+  CHECK(s.runOnce());
+}
+
+static void testOnTime() {
+  reset(1000);
+  Scheduler s(fakeClock);
+  CHECK_EQ(s.addTask("a", taskA, 1000, 500, 1), 0);
+  s.start();
+  execA = 100;
+
+  for (int i = 0; i < 10; i++) step(s);
+
+  const TaskStats& st = s.task(0).stats;
+  CHECK_EQ(st.runs, 10);
+  CHECK_EQ(st.missedDeadlines, 0);
+  CHECK_EQ(st.skippedReleases, 0);
+  CHECK_EQ(st.maxJitterUs, 0);
+  CHECK_EQ(st.maxExecUs, 100);
+  CHECK_EQ(st.lastExecUs, 100);
+  CHECK_EQ(s.task(0).nextRelease, 1000 + 10 * 1000);
+  CHECK_EQ(s.untilNextReleaseUs(), 900); // The last run took 100 us of the period
+  CHECK(!s.runOnce());
+}
+
+static void testDeadlineMiss() {
+  reset(0);
+  Scheduler s(fakeClock);
+  s.addTask("a", taskA, 1000, 500, 1);
+  s.start();
+
+  execA = 500; // Finishing exactly on the deadline is not a miss
+  step(s);
+  CHECK_EQ(s.task(0).stats.missedDeadlines, 0);
+
+  execA = 501;
+  step(s);
+  step(s);
+  CHECK_EQ(s.task(0).stats.missedDeadlines, 2);
+  CHECK_EQ(s.task(0).stats.skippedReleases, 0);
+}
+
+static void testJitterAndPriority() {
+  reset(0);
+  Scheduler s(fakeClock);
+  s.addTask("low", taskB, 1000, 1000, 2);
+  s.addTask("high", taskA, 1000, 1000, 1);
+  s.start();
+  execA = 300;
+  execB = 50;
+
+  // Both release together: the higher priority task runs first and the other
+  // starts late by its execution time
+  step(s);
+  step(s);
+  CHECK_EQ(orderCount, 2);
+  CHECK_EQ(order[0], 0);
+  CHECK_EQ(order[1], 1);
+  CHECK_EQ(s.task(1).stats.maxJitterUs, 0);
+  CHECK_EQ(s.task(0).stats.maxJitterUs, 300);
+
+  // Equal priorities: the earliest release runs first
+  reset(0);
+  Scheduler e(fakeClock);
+  e.addTask("b", taskB, 1000, 1000, 1);
+  e.addTask("a", taskA, 400, 1000, 1);
+  e.start();
+  step(e);
+  step(e);
+  CHECK_EQ(order[0], 1); // Same release at 0: table order
+  CHECK_EQ(order[1], 0);
+  fakeNow = 1000; // a is due since 400, b since 1000
+  CHECK(e.runOnce());
+  CHECK_EQ(order[2], 0);
+  CHECK_EQ(e.task(1).stats.maxJitterUs, 600);
+}
+
+static void testSkippedReleases() {
+  reset(0);
+  Scheduler s(fakeClock);
+  s.addTask("a", taskA, 1000, 1000, 1);
+  s.start();
+
+  // A 3.5-period overrun drops the releases at 1000 and 2000 and resumes on
+  // the grid at 3000 instead of running back to back to catch up
+  execA = 3500;
+  step(s);
+  const TaskStats& st = s.task(0).stats;
+  CHECK_EQ(st.missedDeadlines, 1);
+  CHECK_EQ(st.skippedReleases, 2);
+  CHECK_EQ(s.task(0).nextRelease, 3000);
+
+  execA = 100;
+  step(s);
+  CHECK_EQ(st.maxJitterUs, 500); // Started at 3500 for the 3000 release
+  CHECK_EQ(st.skippedReleases, 2);
+  CHECK_EQ(s.task(0).nextRelease, 4000);
+
+  // Less than one whole period behind: nothing is skipped
+  execA = 1900;
+  step(s);
+  CHECK_EQ(st.skippedReleases, 2);
+  CHECK_EQ(s.task(0).nextRelease, 5000);
+}
+
+static void testClockWrap() {
+  reset(0xFFFFF000u);
+  Scheduler s(fakeClock);
+  s.addTask("a", taskA, 1000, 500, 1);
+  s.start();
+  execA = 100;
+
+  for (int i = 0; i < 10; i++) step(s);
+
+  const TaskStats& st = s.task(0).stats;
+  CHECK_EQ(st.runs, 10);
+  CHECK_EQ(st.missedDeadlines, 0);
+  CHECK_EQ(st.skippedReleases, 0);
+  CHECK_EQ(st.maxJitterUs, 0);
+  CHECK_EQ(s.task(0).nextRelease, (uint32_t)(0xFFFFF000u + 10 * 1000));
+}
+
+static void testTableLimits() {
+  reset(0);
+  Scheduler s(fakeClock);
+  CHECK_EQ(s.untilNextReleaseUs(), 0);
+  CHECK(!s.runOnce());
+  CHECK_EQ(s.addTask("bad", nullptr, 1000, 1000, 1), -1);
+  CHECK_EQ(s.addTask("bad", taskA, 0, 1000, 1), -1);
+  for (int i = 0; i < MAX_TASKS; i++) CHECK_EQ(s.addTask("a", taskA, 1000, 1000, 1), i);
+  CHECK_EQ(s.addTask("a", taskA, 1000, 1000, 1), -1);
+  CHECK_EQ(s.taskCount(), MAX_TASKS);
+
+  execA = 2000;
+  step(s);
+  s.resetStats();
+  CHECK_EQ(s.task(0).stats.runs, 0);
+  CHECK_EQ(s.task(0).stats.maxExecUs, 0);
+}
+
+int main() {
+  testOnTime();
+  testDeadlineMiss();
+  testJitterAndPriority();
+  testSkippedReleases();
+  testClockWrap();
+  testTableLimits();
+  return checkResult("test_scheduler");
+}
@@ -0,0 +1,74 @@
+// Records every motor PWM command (halSimRecordPwm()) while the closed-loop
+// simulator spins the stirrer up from standstill, and checks the soft start:
+// steps of at most 50 counts per 10 ms task period, each smoothed by a 2 ms
+// hardware fade that ends before the next command, writes only for small
+// corrections, ~0.2 s from 0 to full scale, and no integrator windup.
+
+#include "Check.hpp"
+#include "Actuators.hpp"
+#include "HalLinux.hpp"
+#include "Simulation.hpp"
+#include <stdlib.h>
+
+const uint32_t STEP_COUNTS = 50;       // Per 10 ms step (StirringSubsystem.cpp)
+const uint32_t FADE_US = 2000;         // SOFT_START_FADE_MS
+const double MAX_OVERSHOOT_RPM = 40;   // 23 rpm measured; windup gave 80-110
+
+int main() {
+  SimConfig config;
+  config.durationS = 3;
+  Simulation sim(config);
+  CHECK(sim.setAttributes("{\"target_rpm\": 1000}"));
+  std::vector<HalSimPwmCommand> log;
+  halSimRecordPwm(&log);
+  sim.run(nullptr, nullptr);
+  halSimRecordPwm(nullptr);
+
+  std::vector<HalSimPwmCommand> motor;
+  for (const HalSimPwmCommand& c : log) {
+    if (c.pin == MOTOR_PIN) motor.push_back(c);
+  }
+  CHECK(motor.size() > 20);
+
+  int fades = 0, lateFades = 0;
+  uint64_t firstOnUs = 0, fullScaleUs = 0;
+  for (size_t i = 0; i < motor.size(); i++) {
+    const HalSimPwmCommand& c = motor[i];
+    uint32_t step = (uint32_t)abs((int)c.toDuty - (int)c.fromDuty);
+    CHECK(step <= STEP_COUNTS + 1); // +1: the volts -> counts rounding
+
+    if (c.fadeUs > 0) {
+      fades++;
+      CHECK_EQ(c.fadeUs, FADE_US);
+      CHECK(step > ACTUATOR_RAMP_MIN_STEP);
+      if (c.timeUs > 1000000) lateFades++;
+    } else if (i > 0) {
+      CHECK(step <= ACTUATOR_RAMP_MIN_STEP);
+    }
+
+    // A piecewise-linear waveform: each command starts where the last one
+    // ended, after its fade has finished
+    if (i > 0) {
+      const HalSimPwmCommand& prev = motor[i - 1];
+      CHECK(c.timeUs >= prev.timeUs + prev.fadeUs);
+      CHECK_EQ(c.fromDuty, prev.toDuty);
+    }
+
+    if (!firstOnUs && c.toDuty > 0) firstOnUs = c.timeUs;
+    if (!fullScaleUs && c.toDuty == ACTUATOR_DUTY_MAX) fullScaleUs = c.timeUs + c.fadeUs;
+  }
+  CHECK(fades >= 15);
+  CHECK_EQ(lateFades, 0); // Settled: corrections are below ACTUATOR_RAMP_MIN_STEP
+
+  // Full scale is 1023 / 50 = 20.5 steps after the motor starts
+  CHECK(firstOnUs > 0 && fullScaleUs > firstOnUs);
+  CHECK_NEAR((double)(fullScaleUs - firstOnUs), 202000, 10000);
+
+  const SimMetrics& m = sim.metrics();
+  CHECK(m.rpmOvershoot < MAX_OVERSHOOT_RPM);
+  CHECK(m.rpmSettleS < 0.6);
+  printf("motor: %zu commands, %d fades, 0 to full scale in %.0f ms, overshoot %.0f rpm, settle %.2f s\n",
+         motor.size(), fades, (fullScaleUs - firstOnUs) / 1000.0, m.rpmOvershoot, m.rpmSettleS);
+
+  return checkResult("test_soft_start");
+}
@@ -0,0 +1,52 @@
+#include "Actuators.hpp"
+
+const ActuatorChannel ACTUATOR_CHANNELS[ACTUATOR_COUNT] = {
+  {HEATER_PIN, 1000, "heater"},
+  {MOTOR_PIN, 20000, "motor"},
+  {ACID_PUMP_PIN, 1000, "acid pump"},
+  {BASE_PUMP_PIN, 1000, "base pump"},
+};
+
+static uint32_t targets[ACTUATOR_COUNT];
+
+bool setupActuators() {
+  bool ok = true;
+  for (int i = 0; i < ACTUATOR_COUNT; i++) {
+    const ActuatorChannel& channel = ACTUATOR_CHANNELS[i];
+    if (!halPwmAttach(channel.pin, channel.freqHz, ACTUATOR_RESOLUTION_BITS)) {
+      halLog("actuators: cannot attach the %s PWM on pin %u\n", channel.name, channel.pin);
+      ok = false;
+    }
+    halPwmWrite(channel.pin, 0);
+    targets[i] = 0;
+  }
+  return ok;
+}
+
+void actuatorWrite(Actuator actuator, uint32_t duty) {
+  if (duty > ACTUATOR_DUTY_MAX) duty = ACTUATOR_DUTY_MAX;
+  targets[actuator] = duty;
+  halPwmWrite(ACTUATOR_CHANNELS[actuator].pin, duty);
+}
+
+void actuatorRamp(Actuator actuator, uint32_t duty, uint32_t rampMs) {
+  if (duty > ACTUATOR_DUTY_MAX) duty = ACTUATOR_DUTY_MAX;
+  if (duty == targets[actuator]) return; // Already there or on its way: the fade runs on
+  uint8_t pin = ACTUATOR_CHANNELS[actuator].pin;
+  uint32_t now = halPwmDuty(pin);
+  uint32_t step = duty > now ? duty - now : now - duty;
+  if (rampMs == 0 || step <= ACTUATOR_RAMP_MIN_STEP) {
+    actuatorWrite(actuator, duty);
+    return;
+  }
+  targets[actuator] = duty;
+  if (!halPwmFade(pin, duty, rampMs)) halPwmWrite(pin, duty);
+}
+
+uint32_t actuatorTarget(Actuator actuator) {
+  return targets[actuator];
+}
+
+uint32_t actuatorDuty(Actuator actuator) {
+  return halPwmDuty(ACTUATOR_CHANNELS[actuator].pin);
+}
@@ -0,0 +1,77 @@
+#ifndef ACTUATORS_HPP
+#define ACTUATORS_HPP
+
+#include "Hal.hpp"
+#include <stdint.h>
+
+// One driver for every PWM output of the reactor. Each actuator is an LEDC
+// channel at its own frequency, and all share one duty resolution, so
+// callers work in the same 0 .. ACTUATOR_DUTY_MAX counts whatever they drive.
+// Ramps are hardware fades (halPwmFade()): the LEDC peripheral steps the
+// duty, and the CPU only starts the fade.
+//
+//   heater  1 kHz    the same frequency analogWrite() used
+//   motor   20 kHz   above hearing, as before
+//   pumps   1 kHz    the pump drivers' MOSFETs switch slowly; only ever off or full on
+
+enum Actuator : uint8_t {
+  ACTUATOR_HEATER,
+  ACTUATOR_MOTOR,
+  ACTUATOR_ACID_PUMP,
+  ACTUATOR_BASE_PUMP,
+  ACTUATOR_COUNT
+};
+
+// --- Pins ---
+const uint8_t HEATER_PIN = 6;     // D6 -> heater MOSFET
+const uint8_t MOTOR_PIN = 10;     // D10 -> motor MOSFET gate
+const uint8_t ACID_PUMP_PIN = 8;  // D8 -> acid pump MOSFET
+const uint8_t BASE_PUMP_PIN = 9;  // D9 -> base pump MOSFET
+
+const uint8_t ACTUATOR_RESOLUTION_BITS = 10; // 20 kHz x 2^10 is well within the 80 MHz LEDC clock
+const uint32_t ACTUATOR_DUTY_MAX = (1u << ACTUATOR_RESOLUTION_BITS) - 1;
+
+// Changes up to this many counts are written at once by actuatorRamp(): a
+// fade would cost more to start than it smooths
+const uint32_t ACTUATOR_RAMP_MIN_STEP = 8;
+
+struct ActuatorChannel {
+  uint8_t pin;
+  uint32_t freqHz;
+  const char* name;
+};
+
+extern const ActuatorChannel ACTUATOR_CHANNELS[ACTUATOR_COUNT];
+
+/**
+ * @brief Attaches every actuator's channel with its output off. Call before
+ * the subsystems' setup.
+ * @return false if a channel could not be attached (it is logged).
+ */
+bool setupActuators();
+
+/**
+ * @brief Sets an actuator's duty now, replacing any ramp in progress.
+ * @param duty 0 .. ACTUATOR_DUTY_MAX (larger values are clamped).
+ */
+void actuatorWrite(Actuator actuator, uint32_t duty);
+
+/**
+ * @brief Ramps an actuator linearly from its present duty to duty over
+ * rampMs, in hardware. Repeating the target of a ramp in progress leaves it
+ * running. Small changes (ACTUATOR_RAMP_MIN_STEP) and rampMs 0 are written
+ * at once, as is everything if the channel cannot fade.
+ */
+void actuatorRamp(Actuator actuator, uint32_t duty, uint32_t rampMs);
+
+/**
+ * @brief The last duty commanded (the end of a ramp in progress).
+ */
+uint32_t actuatorTarget(Actuator actuator);
+
+/**
+ * @brief The duty the channel is putting out now, part-way through a ramp.
+ */
+uint32_t actuatorDuty(Actuator actuator);
+
+#endif // ACTUATORS_HPP
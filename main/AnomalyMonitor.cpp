@@ -0,0 +1,123 @@
+#include "AnomalyMonitor.hpp"
+#include "ControlLoop.hpp"
+#include "Detectors.hpp"
+#include "OneClassSvm.hpp"
+#include "Profiler.hpp"
+
+#if __has_include("svm_model.h")
+#include "svm_model.h"
+#define HAVE_SVM_MODEL 1
+static OneClassSvm<N_FEATURES, N_SUPPORT_VECTORS> svm;
+static float svmScore = 0;
+#else
+#define HAVE_SVM_MODEL 0
+#endif
+
+static SignalMonitor temperatureMonitor(TEMP_DRIFT_BAND);
+static SignalMonitor pHMonitor(PH_DRIFT_BAND);
+static SignalMonitor rpmMonitor(RPM_DRIFT_BAND);
+
+static bool svmCurrent = false;
+static bool svmLatched = false;
+
+void setupAnomaly() {
+#if HAVE_SVM_MODEL
+  // svm_train.py features: temp_mean, ph_mean, rpm_mean
+  static_assert(N_FEATURES == 3, "svm_model.h must use the three telemetry features");
+  svm.load(SUPPORT_VECTORS, DUAL_COEF, N_SUPPORT_VECTORS, SCALER_MEAN, SCALER_SCALE, SVM_GAMMA, SVM_INTERCEPT);
+  halLog("anomaly: SVM model with %d support vectors\n", N_SUPPORT_VECTORS);
+#endif
+}
+
+void executeAnomaly() {
+  PROFILE_SCOPE(PROFILE_ANOMALY);
+  // Inactive: outputs are forced off, so the readings are not the controlled process
+  if (!is_system_active) {
+    temperatureMonitor.reset();
+    pHMonitor.reset();
+    rpmMonitor.reset();
+    svmCurrent = false;
+    return;
+  }
+
+  TelemetrySample sample;
+  getTelemetrySample(sample);
+  temperatureMonitor.update(sample.tempCentiC / 100.0f, sample.tempSetCentiC / 100.0f);
+  pHMonitor.update(sample.phMilli / 1000.0f, sample.phSetMilli / 1000.0f);
+  rpmMonitor.update(sample.rpm, sample.rpmSet);
+
+#if HAVE_SVM_MODEL
+  float features[N_FEATURES] = {sample.tempCentiC / 100.0f, sample.phMilli / 1000.0f, (float)sample.rpm};
+  svmScore = svm.decision(features);
+  svmCurrent = svmScore < 0;
+  svmLatched |= svmCurrent;
+#endif
+}
+
+uint8_t getTemperatureAnomaly() {
+  return temperatureMonitor.current;
+}
+
+uint8_t getPHAnomaly() {
+  return pHMonitor.current;
+}
+
+uint8_t getRPMAnomaly() {
+  return rpmMonitor.current;
+}
+
+bool getSvmAnomaly() {
+  return svmCurrent;
+}
+
+void getAnomalyStatus(JsonObject& doc) {
+  JsonObject anomaly = doc.createNestedObject("anomaly");
+  anomaly["temperature"] = temperatureMonitor.latched;
+  anomaly["pH"] = pHMonitor.latched;
+  anomaly["rpm"] = rpmMonitor.latched;
+#if HAVE_SVM_MODEL
+  anomaly["svm"] = svmLatched;
+  anomaly["svm_score"] = svmScore;
+#endif
+
+  // Each report covers one publish interval
+  temperatureMonitor.latched = 0;
+  pHMonitor.latched = 0;
+  rpmMonitor.latched = 0;
+  svmLatched = false;
+}
+
+// Returns false (and logs) unless the attribute is a number > 0
+static bool positiveAttribute(JsonVariant value, const char* key) {
+  if (!value.is<float>() || (float)value <= 0) {
+    halLog("Attribute Error: %s must be a number > 0.\n", key);
+    return false;
+  }
+  return true;
+}
+
+void onAnomalyZ(JsonVariant value) {
+  if (!positiveAttribute(value, "anomaly_z")) return;
+  temperatureMonitor.zscore.setThreshold(value);
+  pHMonitor.zscore.setThreshold(value);
+  rpmMonitor.zscore.setThreshold(value);
+  halLog("Updated anomaly z threshold: %.2f\n", (float)value);
+}
+
+void onTemperatureDriftBand(JsonVariant value) {
+  if (!positiveAttribute(value, "temperature_drift_band")) return;
+  temperatureMonitor.drift.setThreshold(value);
+  halLog("Updated temperature drift band: %.2f\n", (float)value);
+}
+
+void onPHDriftBand(JsonVariant value) {
+  if (!positiveAttribute(value, "pH_drift_band")) return;
+  pHMonitor.drift.setThreshold(value);
+  halLog("Updated pH drift band: %.2f\n", (float)value);
+}
+
+void onRpmDriftBand(JsonVariant value) {
+  if (!positiveAttribute(value, "rpm_drift_band")) return;
+  rpmMonitor.drift.setThreshold(value);
+  halLog("Updated RPM drift band: %.1f\n", (float)value);
+}
@@ -0,0 +1,112 @@
+#ifndef ANOMALYMONITOR_HPP
+#define ANOMALYMONITOR_HPP
+
+#include "Detectors.hpp"
+#include "Dispatch.hpp"
+#include "Hal.hpp"
+#include <ArduinoJson.h>
+
+// On-device anomaly flags: the streaming detectors of Detectors.hpp run once a
+// second next to the subsystems, on the same readings as the telemetry.
+// Per signal (temperature, pH, RPM):
+//   ANOMALY_ZSCORE  |z| > 3 (anomaly_z) against the last minute of readings
+//   ANOMALY_DRIFT   30 s average further from the setpoint than the band
+//                   (temperature_drift_band, pH_drift_band, rpm_drift_band)
+//
+// If main/svm_model.h exists (exported by anomalydetection/svm_train.py), the
+// One-Class SVM also scores the (temperature, pH, RPM) triple every second;
+// without it the SVM flag stays clear.
+
+const uint32_t ANOMALY_PERIOD_US = 1000000;
+
+const uint8_t ANOMALY_ZSCORE = 0x01;
+const uint8_t ANOMALY_DRIFT = 0x02;
+
+// Window lengths in updates (seconds)
+const uint16_t ANOMALY_ZSCORE_WINDOW = 60;
+const uint16_t ANOMALY_DRIFT_WINDOW = 30;
+
+// Defaults of the anomaly_z and *_drift_band attributes
+const float ANOMALY_Z_THRESHOLD = 3.0;
+const float TEMP_DRIFT_BAND = 0.5;  // C
+const float PH_DRIFT_BAND = 0.3;
+const float RPM_DRIFT_BAND = 50;
+
+/**
+ * @brief The z-score and drift detectors of one signal. bioreactor_tune
+ * replays recorded runs through it.
+ */
+struct SignalMonitor {
+  ZScoreDetector<ANOMALY_ZSCORE_WINDOW> zscore;
+  SlidingWindowDetector<ANOMALY_DRIFT_WINDOW> drift;
+  uint8_t current;
+  uint8_t latched; // Raised since the last status report
+
+  explicit SignalMonitor(float band)
+      : zscore(ANOMALY_ZSCORE_WINDOW, ANOMALY_Z_THRESHOLD), drift(ANOMALY_DRIFT_WINDOW, band), current(0), latched(0) {}
+
+  void update(float value, float setpoint) {
+    current = 0;
+    if (zscore.update(value).anomaly) current |= ANOMALY_ZSCORE;
+
+    // No setpoint (e.g. pH target 0 before it is set): nothing to drift from
+    if (setpoint != 0) {
+      drift.setIdeal(setpoint);
+      if (drift.update(value).anomaly) current |= ANOMALY_DRIFT;
+    }
+    latched |= current;
+  }
+
+  void reset() {
+    zscore.reset();
+    drift.reset();
+    current = 0;
+  }
+};
+
+extern bool is_system_active;
+
+/**
+ * @brief Loads the One-Class SVM model, if one was compiled in.
+ */
+void setupAnomaly();
+
+/**
+ * @brief Feeds the current readings to the detectors ("anomaly" scheduler task).
+ */
+void executeAnomaly();
+
+/**
+ * @brief Current ANOMALY_* bits of each signal.
+ */
+uint8_t getTemperatureAnomaly();
+uint8_t getPHAnomaly();
+uint8_t getRPMAnomaly();
+
+/**
+ * @brief True while the One-Class SVM scores the current readings as an outlier.
+ */
+bool getSvmAnomaly();
+
+/**
+ * @brief Adds the bits raised per signal since the last report, then clears them.
+ * @param doc The JsonObject to populate.
+ */
+void getAnomalyStatus(JsonObject& doc);
+
+// --- Shared attributes (dispatched by ControlLoop.cpp) ---
+// anomaly_z: |z| threshold of every signal; *_drift_band: how far the 30 s
+// average may be from the setpoint. All > 0.
+void onAnomalyZ(JsonVariant value);
+void onTemperatureDriftBand(JsonVariant value);
+void onPHDriftBand(JsonVariant value);
+void onRpmDriftBand(JsonVariant value);
+
+constexpr AttributeEntry ANOMALY_ATTRIBUTES[] = {
+  {"anomaly_z", onAnomalyZ},
+  {"temperature_drift_band", onTemperatureDriftBand},
+  {"pH_drift_band", onPHDriftBand},
+  {"rpm_drift_band", onRpmDriftBand},
+};
+
+#endif // ANOMALYMONITOR_HPP
@@ -0,0 +1,320 @@
+#include "ControlLoop.hpp"
+#include "Actuators.hpp"
+#include "AnomalyMonitor.hpp"
+#include "Hal.hpp"
+#include "PHSubsystem.hpp"
+#include "Profiler.hpp"
+#include "SampleHistory.hpp"
+#include "StirringSubsystem.hpp"
+#include "heatingSubsystem.hpp"
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+
+void setupControl() {
+  setupActuators(); // Every PWM output off before the subsystems start
+
+  setupPH();
+  halLog("ph done\n");
+
+  setupStirring();
+  halLog("stirring done\n");
+
+  setupHeating();
+  halLog("heating done\n");
+
+  setupAnomaly();
+}
+
+#if PROFILING
+static int stirringTask = -1;
+static int heatingTask = -1;
+
+static void recordLateness(int index, uint32_t jitterUs, uint32_t) {
+  if (index == stirringTask) PROFILE_US(PROFILE_STIRRING_LATE, jitterUs);
+  else if (index == heatingTask) PROFILE_US(PROFILE_HEATING_LATE, jitterUs);
+}
+#endif
+
+void addControlTasks(Scheduler& scheduler) {
+  // Lower priority number runs first
+  int stirring = scheduler.addTask("stirring", executeStirring, STIRRING_PERIOD_US,  2000,  0);
+  int heating  = scheduler.addTask("heating",  executeHeating,  HEATING_PERIOD_US,   20000, 1);
+  scheduler.addTask("ph",       executePH,       PH_SAMPLE_PERIOD_US, 10000, 2);
+  scheduler.addTask("anomaly",  executeAnomaly,  ANOMALY_PERIOD_US,   100000, 3);
+
+#if PROFILING
+  stirringTask = stirring;
+  heatingTask = heating;
+  scheduler.setObserver(recordLateness);
+#else
+  (void)stirring;
+  (void)heating;
+#endif
+}
+
+void getTelemetrySample(TelemetrySample& sample) {
+  memset(&sample, 0, sizeof(sample));
+  sample.timeUs = halTimestampUs();
+  getPHSample(sample);
+  getStirringSample(sample);
+  getHeatingSample(sample);
+  if (is_system_active) sample.flags |= TELEMETRY_FLAG_ACTIVE;
+  if (getSvmAnomaly()) sample.flags |= TELEMETRY_FLAG_SVM;
+}
+
+// --- Commands from the network task ---
+
+static void onOperationalMode(JsonVariant value) {
+  is_system_active = value;
+  halLog("Updated operational_mode: %s\n", is_system_active ? "ACTIVE" : "INACTIVE");
+}
+
+constexpr AttributeEntry GLOBAL_ATTRIBUTES[] = {
+  {"operational_mode", onOperationalMode},
+};
+
+static constexpr auto ATTRIBUTES =
+    makeDispatchTable(GLOBAL_ATTRIBUTES, PH_ATTRIBUTES, STIRRING_ATTRIBUTES, HEATING_ATTRIBUTES,
+                      ANOMALY_ATTRIBUTES);
+static_assert(dispatchTableValid(ATTRIBUTES), "attribute key declared twice");
+
+// {"method": "autotune", "params": {"loop": "stirring"}} or "heating"
+static void rpcAutotune(RpcContext& rpc, JsonVariant params) {
+  const char* loop = params["loop"];
+  const char* refused;
+  if (loop && strcmp(loop, "stirring") == 0) {
+    refused = startStirringAutotune();
+  } else if (loop && strcmp(loop, "heating") == 0) {
+    refused = startHeatingAutotune();
+  } else {
+    rpc.error("Invalid parameters");
+    return;
+  }
+
+  if (refused) {
+    rpc.error(refused);
+  } else {
+    rpc.replyf("{\"status\": \"started\", \"loop\": \"%s\"}", loop);
+  }
+}
+
+constexpr RpcEntry GLOBAL_RPCS[] = {
+  {"autotune", rpcAutotune},
+};
+
+// setRPM is handled via attributes (target_rpm)
+static constexpr auto RPCS = makeDispatchTable(GLOBAL_RPCS, PH_RPCS, HEATING_RPCS);
+static_assert(dispatchTableValid(RPCS), "RPC method declared twice");
+
+void dispatchAttributes(JsonObject shared) {
+  for (JsonPair attribute : shared) {
+    const AttributeEntry* entry = findDispatchEntry(ATTRIBUTES, attribute.key().c_str());
+    if (entry) {
+      entry->handler(attribute.value());
+    }
+  }
+}
+
+void handleAttributes(const uint8_t* payload, size_t length) {
+  StaticJsonDocument<500> doc;
+  DeserializationError error = deserializeJson(doc, payload, length);
+
+  if (error) {
+    halLog("deserializeJson() failed: %s\n", error.c_str());
+    return;
+  }
+
+  // Attribute responses wrap the values in "shared"; updates do not
+  JsonObject shared = doc["shared"];
+  if (shared.isNull()) {
+    shared = doc.as<JsonObject>();
+  }
+  dispatchAttributes(shared);
+}
+
+void dispatchRpc(RpcContext& rpc, JsonObject request) {
+  const char* method = request["method"];
+  const RpcEntry* entry = method ? findDispatchEntry(RPCS, method) : nullptr;
+  if (!entry) {
+    halLog("RPC Error: unknown method %s\n", method ? method : "(none)");
+    rpc.error("Unknown method");
+    return;
+  }
+  entry->handler(rpc, request["params"]);
+}
+
+void handleRpc(MqttOutbox& outbox, const char* topic, const uint8_t* payload, size_t length) {
+  RpcContext rpc(outbox, topic + sizeof(RPC_REQUEST_PREFIX) - 1);
+  if (!rpc.valid()) {
+    halLog("RPC Error: bad request topic %s\n", topic);
+    return;
+  }
+
+  StaticJsonDocument<200> doc;
+  DeserializationError error = deserializeJson(doc, payload, length);
+  if (error) {
+    halLog("deserializeJson() failed: %s\n", error.c_str());
+    rpc.error("Invalid JSON");
+    return;
+  }
+  dispatchRpc(rpc, doc.as<JsonObject>());
+}
+
+void processInbox(MqttQueue& inbox, MqttOutbox& outbox) {
+  PROFILE_SCOPE(PROFILE_INBOX);
+  static MqttMessage message; // Control side only; too big for the stack
+
+  while (inbox.pop(message)) {
+    if (strncmp(message.topic, "v1/devices/me/attributes", 24) == 0) {
+      handleAttributes(message.payload, message.length);
+    } else if (strncmp(message.topic, RPC_REQUEST_PREFIX, sizeof(RPC_REQUEST_PREFIX) - 1) == 0) {
+      handleRpc(outbox, message.topic, message.payload, message.length);
+    }
+  }
+  publishClientAttributes(outbox);
+}
+
+// {"<loop>_autotune": "done", "<loop>_ku": .., "<loop>_pu_s": .., "<loop>_kp": .., "<loop>_ki": ..}
+// or {"<loop>_autotune": "failed", "<loop>_autotune_error": ".."}
+static void publishAutotune(MqttOutbox& outbox, const char* loop, const AutotuneResult& result) {
+  char payload[192];
+  if (result.state == AUTOTUNE_DONE) {
+    snprintf(payload, sizeof(payload),
+             "{\"%s_autotune\": \"done\", \"%s_ku\": %.6g, \"%s_pu_s\": %.4g, "
+             "\"%s_kp\": %.6g, \"%s_ki\": %.6g}",
+             loop, loop, result.ultimateGain, loop, result.ultimatePeriodS, loop, result.kp, loop,
+             result.ki);
+    halLog("%s autotune: Ku %.4g, Pu %.3g s -> Kp %.4g, Ki %.4g\n", loop, result.ultimateGain,
+           result.ultimatePeriodS, result.kp, result.ki);
+  } else {
+    snprintf(payload, sizeof(payload), "{\"%s_autotune\": \"failed\", \"%s_autotune_error\": \"%s\"}",
+             loop, loop, result.error);
+    halLog("%s autotune failed: %s\n", loop, result.error);
+  }
+  outbox.publish("v1/devices/me/attributes", payload);
+}
+
+void publishClientAttributes(MqttOutbox& outbox) {
+  AutotuneResult result;
+  if (takeStirringAutotune(result)) publishAutotune(outbox, "stirring", result);
+  if (takeHeatingAutotune(result)) publishAutotune(outbox, "heating", result);
+
+  char payload[160];
+  if (takePHCalibrationReport(payload, sizeof(payload))) {
+    outbox.publish("v1/devices/me/attributes", payload);
+  }
+}
+
+// --- Telemetry tasks ---
+static Scheduler* telemetryScheduler = nullptr;
+static MqttOutbox* telemetryOutbox = nullptr;
+static const std::atomic<bool>* telemetryOnline = nullptr;
+static SampleHistory* sampleHistory = nullptr;
+static uint32_t statusSequence = 0; // +1 per JSON status, so a receiver can tell a lost message from a quiet device
+
+// Adds per-task missed deadlines and worst-case jitter since the last report
+static void getSchedulerStatus(JsonObject& doc) {
+  JsonObject sched = doc.createNestedObject("sched");
+
+  for (int i = 0; i < telemetryScheduler->taskCount(); i++) {
+    const Task& t = telemetryScheduler->task(i);
+    JsonObject entry = sched.createNestedObject(t.name);
+    entry["missed"] = t.stats.missedDeadlines;
+    entry["skipped"] = t.stats.skippedReleases;
+    entry["jitter_us"] = t.stats.maxJitterUs;
+    entry["exec_us"] = t.stats.maxExecUs;
+  }
+
+  // Each report covers one publish interval
+  telemetryScheduler->resetStats();
+}
+
+// The "telemetry" task: the combined status of all subsystems
+static void publishTelemetry() {
+  if (!*telemetryOnline) {
+    return;
+  }
+
+  StaticJsonDocument<1024> doc; // Combined JSON doc, sized for the scheduler and history stats
+  JsonObject root = doc.to<JsonObject>();
+
+  getPHStatus(root);
+  getStirringStatus(root);
+  getHeatingStatus(root);
+  getSchedulerStatus(root);
+  getAnomalyStatus(root);
+
+  // Global status
+  root["operational_mode"] = is_system_active;
+  root["seq"] = statusSequence++;
+
+  if (sampleHistory) {
+    HistoryStats stats = sampleHistory->stats();
+    JsonObject hist = root.createNestedObject("history");
+    hist["backlog"] = sampleHistory->backlog();
+    hist["overruns"] = stats.overruns;
+    hist["decimated"] = stats.decimated;
+    hist["dropped"] = stats.dropped;
+  }
+
+  char buffer[1024];
+  {
+    PROFILE_SCOPE(PROFILE_SERIALIZE);
+    serializeJson(doc, buffer);
+  }
+  telemetryOutbox->publish("v1/devices/me/telemetry", buffer);
+}
+
+#if PROFILING
+// The "diag" task: the profiler's report for the last DIAG_PERIOD_US, which
+// starts the next window
+static void publishDiagnostics() {
+  char buffer[MQTT_PAYLOAD_MAX];
+  size_t length = profileReport(buffer, sizeof(buffer), DIAG_PERIOD_US / 1000);
+  if (length > 0 && *telemetryOnline) {
+    telemetryOutbox->publish("v1/devices/me/telemetry", buffer);
+  }
+}
+#endif
+
+// The "sample" task: one sample into the history (the network side publishes it)
+static void sampleTelemetry() {
+  TelemetrySample sample;
+  getTelemetrySample(sample);
+  sampleHistory->push(sample);
+}
+
+void addTelemetryTasks(Scheduler& scheduler, MqttOutbox& outbox, const std::atomic<bool>& online,
+                       uint32_t publishPeriodUs) {
+  telemetryScheduler = &scheduler;
+  telemetryOutbox = &outbox;
+  telemetryOnline = &online;
+  scheduler.addTask("telemetry", publishTelemetry, publishPeriodUs, 1000000, 3);
+#if PROFILING
+  scheduler.addTask("diag", publishDiagnostics, DIAG_PERIOD_US, 1000000, 3);
+#endif
+}
+
+bool addSampleTask(Scheduler& scheduler, SampleHistory& history) {
+  if (scheduler.addTask("sample", sampleTelemetry, TELEMETRY_SAMPLE_PERIOD_US, 50000, 3) < 0) {
+    return false;
+  }
+  sampleHistory = &history;
+  return true;
+}
+
+size_t nextTelemetryFrame(SampleHistory& history, TelemetrySample* batch, uint8_t* frame, uint32_t sequence,
+                          int& count) {
+  count = 0;
+  if (history.archived() == 0 && history.backlog() < (uint32_t)TELEMETRY_BATCH_SAMPLES) {
+    return 0;
+  }
+
+  count = history.read(batch, TELEMETRY_BATCH_SAMPLES);
+  TelemetryFrameInfo info;
+  info.flags = history.backlog() > (uint32_t)count ? TELEMETRY_FRAME_BACKFILL : 0;
+  info.sequence = sequence;
+  info.publishUs = halTimestampUs();
+  return encodeTelemetryFrame(batch, count, frame, TELEMETRY_FRAME_MAX, info);
+}
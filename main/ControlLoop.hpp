@@ -0,0 +1,123 @@
+#ifndef CONTROLLOOP_HPP
+#define CONTROLLOOP_HPP
+
+#include "Dispatch.hpp"
+#include "MqttQueue.hpp"
+#include "Scheduler.hpp"
+#include "TelemetryFrame.hpp"
+#include <atomic>
+
+class SampleHistory;
+
+// Shared by main.ino and the host build so both run the same task table.
+
+// --- Task Timing (microseconds) ---
+const uint32_t STIRRING_PERIOD_US  = 10000;   // 10 ms PI loop
+const uint32_t HEATING_PERIOD_US   = 100000;  // 100 ms PI loop (heater PWM)
+const uint32_t PH_SAMPLE_PERIOD_US = 10000;   // 10 ms pH step (filtered burst; pump decision every 100 ms)
+
+/**
+ * @brief Sets up the hardware of all subsystems.
+ */
+void setupControl();
+
+/**
+ * @brief Registers the stirring, heating and pH tasks (priorities 0-2) and the
+ * anomaly monitor (priority 3). With PROFILING, also the scheduler observer
+ * that records the stirring and heating lateness.
+ */
+void addControlTasks(Scheduler& scheduler);
+
+/**
+ * @brief Applies the attribute updates and RPC requests queued by the network
+ * task, then publishes client attributes. Runs on the control side, so
+ * handlers never race the control tasks.
+ * @param inbox Messages received from the broker.
+ * @param outbox Where RPC responses and client attributes are queued.
+ */
+void processInbox(MqttQueue& inbox, MqttOutbox& outbox);
+
+/**
+ * @brief Publishes, as client attributes, what finished in the background
+ * since the last call: autotunes (stirring_* / heating_*: ku, pu_s, kp, ki)
+ * and pH calibration points (ph_cal_*).
+ */
+void publishClientAttributes(MqttOutbox& outbox);
+
+/**
+ * @brief Parses a shared-attribute message (an attribute response with a
+ * "shared" member, or an update) and dispatches it with dispatchAttributes().
+ */
+void handleAttributes(const uint8_t* payload, size_t length);
+
+/**
+ * @brief Calls the handler of every key that a subsystem declared in its
+ * attribute table; unknown keys are ignored.
+ */
+void dispatchAttributes(JsonObject shared);
+
+/**
+ * @brief Parses an RPC request and dispatches it with dispatchRpc().
+ * Requests with a malformed request ID in the topic are dropped unanswered.
+ * @param topic "v1/devices/me/rpc/request/<id>".
+ */
+void handleRpc(MqttOutbox& outbox, const char* topic, const uint8_t* payload, size_t length);
+
+/**
+ * @brief Calls the handler declared for request["method"], or replies
+ * {"error": "Unknown method"}.
+ */
+void dispatchRpc(RpcContext& rpc, JsonObject request);
+
+/**
+ * @brief Takes a telemetry sample of all subsystems. timeUs is
+ * halTimestampUs(): epoch microseconds once SNTP has synchronised the clock,
+ * microseconds since boot before that.
+ */
+void getTelemetrySample(TelemetrySample& sample);
+
+// --- Telemetry tasks ---
+// The JSON status, the 10 Hz samples and the diagnostics, as main.ino and the
+// virtual devices (host/VirtualDevice.cpp) run them. The network side, which
+// sends the outbox and the binary frames, is the caller's.
+#ifndef TELEMETRY_BIN_TOPIC
+#define TELEMETRY_BIN_TOPIC "bioreactor/telemetry/bin"
+#endif
+const uint32_t TELEMETRY_SAMPLE_PERIOD_US = 100000; // 10 Hz
+const int TELEMETRY_BATCH_SAMPLES = 50;              // One frame every 5 s
+const size_t TELEMETRY_FRAME_MAX = telemetryFrameCapacity(TELEMETRY_BATCH_SAMPLES);
+const uint32_t DIAG_PERIOD_US = 60000000;           // 60 s
+
+/**
+ * @brief Registers the "telemetry" task, which queues the combined status of
+ * all subsystems and the scheduler for v1/devices/me/telemetry every
+ * publishPeriodUs while online is set, and with PROFILING the "diag" task,
+ * which does the same with the profiler's report every DIAG_PERIOD_US.
+ * @param outbox Where both are queued.
+ * @param online The network side's connection state.
+ */
+void addTelemetryTasks(Scheduler& scheduler, MqttOutbox& outbox, const std::atomic<bool>& online,
+                       uint32_t publishPeriodUs);
+
+/**
+ * @brief Registers the 10 Hz "sample" task, which takes getTelemetrySample()
+ * into history, and adds the history's stats to the JSON status.
+ * @return false if the task table is full.
+ */
+bool addSampleTask(Scheduler& scheduler, SampleHistory& history);
+
+/**
+ * @brief Encodes the next binary frame for TELEMETRY_BIN_TOPIC: the oldest
+ * TELEMETRY_BATCH_SAMPLES samples, once a full batch is live or back-fill
+ * is waiting. The samples stay in the history; after publishing the frame,
+ * the caller takes them with history.discard(count).
+ * @param batch Scratch for TELEMETRY_BATCH_SAMPLES samples.
+ * @param frame At least TELEMETRY_FRAME_MAX bytes.
+ * @param sequence The frame's sequence number.
+ * @param count Set to the number of samples in the frame.
+ * @return Frame length, 0 if there is nothing to send.
+ */
+size_t nextTelemetryFrame(SampleHistory& history, TelemetrySample* batch, uint8_t* frame, uint32_t sequence,
+                          int& count);
+
+#endif // CONTROLLOOP_HPP
@@ -0,0 +1,159 @@
+#ifndef CONTROLLER_HPP
+#define CONTROLLER_HPP
+
+#include <stdint.h>
+
+// Discrete PID controller with its structure and limits fixed at compile time.
+//
+// A policy supplies the value type and the constants:
+//
+//   struct HeaterPolicy {
+//     typedef float Value;                   // float or Fixed<N>
+//     static constexpr Value KP = 300;       // output units per error unit
+//     static constexpr Value KI = 1;         // per second; 0 for P/PD
+//     static constexpr Value KD = 0;         // seconds; 0 for P/PI
+//     static constexpr Value OUT_MIN = 0;
+//     static constexpr Value OUT_MAX = 255;
+//     static constexpr Value SLEW = 0;       // max output change per second; 0 = none
+//     static constexpr Value TRACKING = 0.1; // back-calculation gain (1/Tt) per second
+//   };
+//
+// Terms with a zero gain compile away. The others start at the policy's
+// gains and can be retuned at run time with setGains(). The derivative acts on the
+// measurement, so setpoint steps do not kick the output. Anti-windup is
+// both back-calculation (the integrator is pulled towards the output that
+// was actually applied, after clamping and slew limiting) and clamping (the
+// integrator never leaves [OUT_MIN, OUT_MAX]).
+
+/**
+ * @brief Signed Q(31-FracBits).FracBits fixed-point number for policies on
+ * targets without an FPU. Products and quotients go through 64 bits.
+ */
+template <int FracBits>
+class Fixed {
+  static_assert(FracBits > 0 && FracBits < 31, "FracBits must be 1-30");
+
+public:
+  constexpr Fixed() : raw_(0) {}
+  constexpr Fixed(double value)
+      : raw_((int32_t)(value * (1 << FracBits) + (value < 0 ? -0.5 : 0.5))) {}
+
+  static constexpr Fixed fromRaw(int32_t raw) {
+    Fixed f;
+    f.raw_ = raw;
+    return f;
+  }
+
+  constexpr int32_t raw() const { return raw_; }
+  constexpr float toFloat() const { return (float)raw_ / (1 << FracBits); }
+  explicit constexpr operator float() const { return toFloat(); }
+
+  constexpr Fixed operator+(Fixed o) const { return fromRaw(raw_ + o.raw_); }
+  constexpr Fixed operator-(Fixed o) const { return fromRaw(raw_ - o.raw_); }
+  constexpr Fixed operator-() const { return fromRaw(-raw_); }
+  constexpr Fixed operator*(Fixed o) const {
+    return fromRaw((int32_t)(((int64_t)raw_ * o.raw_) >> FracBits));
+  }
+  constexpr Fixed operator/(Fixed o) const {
+    return fromRaw((int32_t)(((int64_t)raw_ << FracBits) / o.raw_));
+  }
+
+  constexpr bool operator<(Fixed o) const { return raw_ < o.raw_; }
+  constexpr bool operator>(Fixed o) const { return raw_ > o.raw_; }
+  constexpr bool operator==(Fixed o) const { return raw_ == o.raw_; }
+  constexpr bool operator!=(Fixed o) const { return raw_ != o.raw_; }
+
+private:
+  int32_t raw_;
+};
+
+template <typename Value>
+constexpr Value controllerClamp(Value x, Value low, Value high) {
+  return x < low ? low : (x > high ? high : x);
+}
+
+template <typename Policy>
+class Controller {
+public:
+  typedef typename Policy::Value Value;
+
+  static_assert(Policy::OUT_MIN < Policy::OUT_MAX, "empty output range");
+
+  Controller() : kp_(Policy::KP), ki_(Policy::KI), kd_(Policy::KD) { reset(); }
+
+  /**
+   * @brief Replaces the gains. Gains of terms the policy leaves out (zero
+   * there) are ignored. The integrator is kept, so a change is bumpless only
+   * if the new KP acts on a small error; reset() to the current output otherwise.
+   */
+  void setGains(Value kp, Value ki, Value kd) {
+    kp_ = kp;
+    ki_ = ki;
+    kd_ = kd;
+  }
+
+  Value kp() const { return kp_; }
+  Value ki() const { return ki_; }
+  Value kd() const { return kd_; }
+
+  /**
+   * @brief Restarts from output (clamped to the output range), e.g. the
+   * actuator's current value for a bumpless start.
+   */
+  void reset(Value output = Value(0)) {
+    output_ = controllerClamp(output, Policy::OUT_MIN, Policy::OUT_MAX);
+    integral_ = Policy::KI != Value(0) ? output_ : Value(0);
+    lastMeasurement_ = Value(0);
+    primed_ = false;
+  }
+
+  /**
+   * @brief One control step.
+   * @param dt Time since the previous step, in the units the gains use (seconds).
+   * @return The new output, within [OUT_MIN, OUT_MAX].
+   */
+  Value update(Value setpoint, Value measurement, Value dt) {
+    Value error = setpoint - measurement;
+
+    if (Policy::KI != Value(0)) {
+      integral_ = integral_ + ki_ * error * dt;
+    }
+    Value unsaturated = kp_ * error + integral_;
+
+    if (Policy::KD != Value(0)) {
+      if (primed_ && dt > Value(0)) {
+        unsaturated = unsaturated - kd_ * (measurement - lastMeasurement_) / dt;
+      }
+      lastMeasurement_ = measurement;
+      primed_ = true;
+    }
+
+    Value out = controllerClamp(unsaturated, Policy::OUT_MIN, Policy::OUT_MAX);
+    if (Policy::SLEW != Value(0)) {
+      Value step = Policy::SLEW * dt;
+      out = controllerClamp(out, output_ - step, output_ + step);
+    }
+
+    if (Policy::KI != Value(0)) {
+      integral_ = integral_ + Policy::TRACKING * (out - unsaturated) * dt;
+      integral_ = controllerClamp(integral_, Policy::OUT_MIN, Policy::OUT_MAX);
+    }
+
+    output_ = out;
+    return out;
+  }
+
+  Value output() const { return output_; }
+  Value integral() const { return integral_; }
+
+private:
+  Value kp_;
+  Value ki_;
+  Value kd_;
+  Value output_;
+  Value integral_;
+  Value lastMeasurement_;
+  bool primed_;
+};
+
+#endif // CONTROLLER_HPP
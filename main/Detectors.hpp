@@ -0,0 +1,367 @@
+#ifndef DETECTORS_HPP
+#define DETECTORS_HPP
+
+#include <math.h>
+#include <stdint.h>
+
+// Streaming anomaly detectors, O(1) per sample and allocation-free.
+// C++ counterparts of the Python detectors, with the same update rules:
+//
+//   data-analysis/detectors.py (thresholds given, statistics over a window)
+//     ZScoreDetector, HysteresisDetector, SlidingWindowDetector
+//   anomalydetection/detectors.py (thresholds learned from fault-free data)
+//     BaselineZScoreDetector, BandHysteresisDetector, BaselineDriftDetector,
+//     ConfusionMatrix
+//
+// The window length is a runtime argument up to the compile-time capacity
+// MaxN, so one instantiation covers the window sizes the scripts use. Means
+// and variances are population statistics (numpy's default, ddof=0).
+
+/**
+ * @brief Result of a detector update, the (is_anomaly, score) tuple in Python.
+ */
+struct Detection {
+  bool anomaly;
+  float score;
+};
+
+/**
+ * @brief Welford mean/variance over an unbounded stream (training data).
+ */
+class RunningStats {
+public:
+  RunningStats() { reset(); }
+
+  void reset() {
+    n_ = 0;
+    mean_ = 0;
+    m2_ = 0;
+  }
+
+  void add(double x) {
+    n_++;
+    double delta = x - mean_;
+    mean_ += delta / n_;
+    m2_ += delta * (x - mean_);
+  }
+
+  uint32_t count() const { return n_; }
+  double mean() const { return mean_; }
+  double variance() const { return n_ ? m2_ / n_ : 0; }
+  double stddev() const { return sqrt(variance()); }
+
+private:
+  uint32_t n_;
+  double mean_;
+  double m2_;
+};
+
+/**
+ * @brief Mean/variance of the last `size` values (size <= MaxN).
+ * Welford's update extended to replace the value leaving the window, so
+ * there is no per-sample pass over the window and no sum-of-squares
+ * cancellation. Every 256 trips round the window the statistics are
+ * recomputed exactly, so rounding cannot build up on a long stream.
+ */
+template <uint16_t MaxN>
+class WindowStats {
+  static_assert(MaxN >= 2, "WindowStats needs at least two slots");
+
+public:
+  explicit WindowStats(uint16_t size) : size_(size < 2 ? 2 : (size > MaxN ? MaxN : size)) { reset(); }
+
+  void reset() {
+    count_ = 0;
+    next_ = 0;
+    wraps_ = 0;
+    mean_ = 0;
+    m2_ = 0;
+  }
+
+  void add(double value) {
+    float x = (float)value; // Exactly what the window stores
+    if (count_ < size_) {
+      count_++;
+      double delta = x - mean_;
+      mean_ += delta / count_;
+      m2_ += delta * (x - mean_);
+    } else {
+      double old = window_[next_];
+      double oldMean = mean_;
+      mean_ += (x - old) / size_;
+      m2_ += (x - old) * (x - mean_ + old - oldMean);
+      if (m2_ < 0) m2_ = 0; // Rounding can leave a tiny negative on a flat signal
+    }
+    window_[next_] = x;
+    next_ = next_ + 1 == size_ ? 0 : next_ + 1;
+
+    if (next_ == 0 && ++wraps_ == 0) {
+      recompute();
+    }
+  }
+
+  uint16_t count() const { return count_; }
+  uint16_t size() const { return size_; }
+  double mean() const { return mean_; }
+  double variance() const { return count_ ? m2_ / count_ : 0; }
+  double stddev() const { return sqrt(variance()); }
+
+private:
+  void recompute() {
+    double sum = 0;
+    for (uint16_t i = 0; i < count_; i++) sum += window_[i];
+    mean_ = sum / count_;
+    m2_ = 0;
+    for (uint16_t i = 0; i < count_; i++) m2_ += (window_[i] - mean_) * (window_[i] - mean_);
+  }
+
+  float window_[MaxN];
+  uint16_t size_;
+  uint16_t count_;
+  uint16_t next_;
+  uint8_t wraps_;
+  double mean_;
+  double m2_;
+};
+
+// --- data-analysis/detectors.py ---
+
+/**
+ * @brief |z| of each value against the mean/std of the last window_size values
+ * (including itself). Silent until 10 values have been seen.
+ */
+template <uint16_t MaxN = 256>
+class ZScoreDetector {
+public:
+  explicit ZScoreDetector(uint16_t windowSize = 100, float threshold = 3.0f)
+      : stats_(windowSize), threshold_(threshold) {}
+
+  Detection update(float value) {
+    stats_.add(value);
+    if (stats_.count() < 10) return {false, 0};
+
+    double std = stats_.stddev();
+    if (std == 0) return {false, 0};
+
+    float z = (float)fabs((value - stats_.mean()) / std);
+    return {z > threshold_, z};
+  }
+
+  void setThreshold(float threshold) { threshold_ = threshold; }
+  void reset() { stats_.reset(); }
+
+private:
+  WindowStats<MaxN> stats_;
+  float threshold_;
+};
+
+/**
+ * @brief Latches on above `high`, releases below `low`.
+ */
+class HysteresisDetector {
+public:
+  HysteresisDetector(float low, float high, bool initialState = false)
+      : low_(low), high_(high), state_(initialState) {}
+
+  bool update(float value) {
+    if (!state_ && value > high_) state_ = true;
+    else if (state_ && value < low_) state_ = false;
+    return state_;
+  }
+
+  void setThresholds(float low, float high) {
+    low_ = low;
+    high_ = high;
+  }
+
+  bool state() const { return state_; }
+
+private:
+  float low_;
+  float high_;
+  bool state_;
+};
+
+/**
+ * @brief Flags a window average more than `threshold` from `ideal`.
+ * The score is the average while flagged, 0 otherwise (as in Python).
+ */
+template <uint16_t MaxN = 256>
+class SlidingWindowDetector {
+public:
+  SlidingWindowDetector(uint16_t windowSize = 50, float threshold = 0.0f, float ideal = 0.0f)
+      : stats_(windowSize), threshold_(threshold), ideal_(ideal) {}
+
+  Detection update(float value) {
+    stats_.add(value);
+    float avg = (float)stats_.mean();
+    if (avg > ideal_ + threshold_ || avg < ideal_ - threshold_) return {true, avg};
+    return {false, 0};
+  }
+
+  /**
+   * @brief Moves the reference, e.g. when the setpoint changes.
+   */
+  void setIdeal(float ideal) { ideal_ = ideal; }
+  void setThreshold(float threshold) { threshold_ = threshold; }
+  void reset() { stats_.reset(); }
+
+private:
+  WindowStats<MaxN> stats_;
+  float threshold_;
+  float ideal_;
+};
+
+// --- anomalydetection/detectors.py ---
+
+/**
+ * @brief |z| against a baseline learned by train(). Silent until trained.
+ */
+class BaselineZScoreDetector {
+public:
+  explicit BaselineZScoreDetector(float threshold = 3.0f) : threshold_(threshold), trained_(false) {}
+
+  void train(const RunningStats& baseline) {
+    mean_ = baseline.mean();
+    std_ = baseline.stddev();
+    trained_ = true;
+  }
+
+  Detection update(float value) const {
+    if (!trained_ || std_ == 0) return {false, 0};
+    float z = (float)fabs((value - mean_) / std_);
+    return {z > threshold_, z};
+  }
+
+  bool trained() const { return trained_; }
+  float threshold() const { return threshold_; }
+  double mean() const { return mean_; }
+  double stddev() const { return std_; }
+
+private:
+  float threshold_;
+  bool trained_;
+  double mean_ = 0;
+  double std_ = 0;
+};
+
+/**
+ * @brief Normal band mean ± k·std from training. Trips outside the band
+ * widened by hysteresisFactor·std, and clears only strictly inside the band.
+ */
+class BandHysteresisDetector {
+public:
+  BandHysteresisDetector(float k = 3.0f, float hysteresisFactor = 0.5f)
+      : k_(k), factor_(hysteresisFactor), state_(false), trained_(false) {}
+
+  void train(const RunningStats& baseline) {
+    double std = baseline.stddev();
+    low_ = baseline.mean() - k_ * std;
+    high_ = baseline.mean() + k_ * std;
+    margin_ = factor_ * std;
+    trained_ = true;
+  }
+
+  bool update(float value) {
+    if (!trained_) return false;
+    if (!state_) {
+      if (value < low_ - margin_ || value > high_ + margin_) state_ = true;
+    } else if (low_ < value && value < high_) {
+      state_ = false;
+    }
+    return state_;
+  }
+
+  void reset() { state_ = false; }
+  bool trained() const { return trained_; }
+  double low() const { return low_; }
+  double high() const { return high_; }
+  double margin() const { return margin_; }
+
+private:
+  float k_;
+  float factor_;
+  bool state_;
+  bool trained_;
+  double low_ = 0;
+  double high_ = 0;
+  double margin_ = 0;
+};
+
+/**
+ * @brief Flags a rolling average more than k·std from the training mean.
+ * Needs half a window before deciding; the score is the signed deviation.
+ */
+template <uint16_t MaxN = 256>
+class BaselineDriftDetector {
+public:
+  BaselineDriftDetector(uint16_t windowSize = 30, float k = 2.0f)
+      : stats_(windowSize), k_(k), trained_(false) {}
+
+  void train(const RunningStats& baseline) {
+    mean_ = baseline.mean();
+    threshold_ = k_ * baseline.stddev();
+    trained_ = true;
+  }
+
+  Detection update(float value) {
+    if (!trained_) return {false, 0};
+    stats_.add(value);
+    if (stats_.count() < stats_.size() / 2) return {false, 0};
+
+    float deviation = (float)(stats_.mean() - mean_);
+    return {fabs(deviation) > threshold_, deviation};
+  }
+
+  void reset() { stats_.reset(); }
+  bool trained() const { return trained_; }
+  double baseline() const { return mean_; }
+  double threshold() const { return threshold_; }
+
+private:
+  WindowStats<MaxN> stats_;
+  float k_;
+  bool trained_;
+  double mean_ = 0;
+  double threshold_ = 0;
+};
+
+/**
+ * @brief TP/TN/FP/FN counts and the derived scores.
+ */
+struct ConfusionMatrix {
+  uint64_t tp = 0;
+  uint64_t tn = 0;
+  uint64_t fp = 0;
+  uint64_t fn = 0;
+
+  void update(bool predicted, bool actual) {
+    if (actual && predicted) tp++;
+    else if (!actual && !predicted) tn++;
+    else if (predicted) fp++;
+    else fn++;
+  }
+
+  /**
+   * @brief Adds the counts of another matrix (e.g. one per shard).
+   */
+  ConfusionMatrix& operator+=(const ConfusionMatrix& other) {
+    tp += other.tp;
+    tn += other.tn;
+    fp += other.fp;
+    fn += other.fn;
+    return *this;
+  }
+
+  uint64_t total() const { return tp + tn + fp + fn; }
+  double precision() const { return tp + fp ? (double)tp / (tp + fp) : 0; }
+  double recall() const { return tp + fn ? (double)tp / (tp + fn) : 0; }
+  double f1() const {
+    double p = precision(), r = recall();
+    return p + r > 0 ? 2 * p * r / (p + r) : 0;
+  }
+  double accuracy() const { return total() ? (double)(tp + tn) / total() : 0; }
+  double falsePositiveRate() const { return fp + tn ? (double)fp / (fp + tn) : 0; }
+};
+
+#endif // DETECTORS_HPP
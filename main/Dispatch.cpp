@@ -0,0 +1,46 @@
+#include "Dispatch.hpp"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool validRequestId(const char* id) {
+  size_t length = 0;
+  for (; id[length]; length++) {
+    char c = id[length];
+    bool ok = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '-';
+    if (!ok || length >= RPC_REQUEST_ID_MAX) return false;
+  }
+  return length > 0;
+}
+
+RpcContext::RpcContext(MqttOutbox& outbox, const char* requestId)
+    : outbox_(outbox), replied_(false) {
+  static_assert(sizeof(RPC_RESPONSE_PREFIX) - 1 + RPC_REQUEST_ID_MAX < RPC_TOPIC_MAX, "RPC topic buffer too small");
+  static_assert(RPC_TOPIC_MAX <= MQTT_TOPIC_MAX, "RPC topic must fit an outbox message");
+
+  topic_[0] = '\0';
+  if (validRequestId(requestId)) {
+    size_t prefix = sizeof(RPC_RESPONSE_PREFIX) - 1;
+    memcpy(topic_, RPC_RESPONSE_PREFIX, prefix);
+    strcpy(topic_ + prefix, requestId);
+  }
+}
+
+void RpcContext::reply(const char* payload) {
+  if (!valid()) return;
+  outbox_.publish(topic_, payload);
+  replied_ = true;
+}
+
+void RpcContext::replyf(const char* fmt, ...) {
+  char payload[RPC_PAYLOAD_MAX];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(payload, sizeof(payload), fmt, args);
+  va_end(args);
+  reply(payload);
+}
+
+void RpcContext::error(const char* message) {
+  replyf("{\"error\": \"%s\"}", message);
+}
@@ -0,0 +1,137 @@
+#ifndef DISPATCH_HPP
+#define DISPATCH_HPP
+
+#include "MqttQueue.hpp"
+#include <ArduinoJson.h>
+#include <array>
+#include <stddef.h>
+
+// Routing of shared attributes and RPC requests.
+// Each subsystem declares its attribute keys and RPC methods as constexpr
+// tables in its header; ControlLoop.cpp merges them with makeDispatchTable()
+// into one sorted array per kind at compile time, so dispatching a key is a
+// binary search with no heap use. Duplicate keys fail the build.
+
+const size_t RPC_REQUEST_ID_MAX = 24; // ThingsBoard sends a decimal counter
+const size_t RPC_TOPIC_MAX = 64;      // "v1/devices/me/rpc/response/" + request ID
+const size_t RPC_PAYLOAD_MAX = 128;
+
+const char RPC_REQUEST_PREFIX[] = "v1/devices/me/rpc/request/";
+const char RPC_RESPONSE_PREFIX[] = "v1/devices/me/rpc/response/";
+
+/**
+ * @brief Response side of one RPC request. The response topic and payload are
+ * formatted into fixed buffers and copied into the outbox.
+ */
+class RpcContext {
+public:
+  /**
+   * @param requestId Request ID from the request topic; see valid().
+   */
+  RpcContext(MqttOutbox& outbox, const char* requestId);
+
+  /**
+   * @brief false if the request ID is empty, too long or not [0-9A-Za-z_-].
+   * Such requests cannot be answered and are dropped.
+   */
+  bool valid() const { return topic_[0] != '\0'; }
+  bool replied() const { return replied_; }
+
+  void reply(const char* payload);
+  void replyf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  /**
+   * @brief Replies {"error": message}. message must not need JSON escaping.
+   */
+  void error(const char* message);
+
+private:
+  MqttOutbox& outbox_;
+  char topic_[RPC_TOPIC_MAX];
+  bool replied_;
+};
+
+typedef void (*AttributeHandler)(JsonVariant value);
+typedef void (*RpcHandler)(RpcContext& rpc, JsonVariant params);
+
+struct AttributeEntry {
+  const char* key;
+  AttributeHandler handler;
+};
+
+struct RpcEntry {
+  const char* method;
+  RpcHandler handler;
+};
+
+constexpr const char* dispatchKey(const AttributeEntry& entry) { return entry.key; }
+constexpr const char* dispatchKey(const RpcEntry& entry) { return entry.method; }
+
+/**
+ * @brief strcmp() usable in constant expressions.
+ */
+constexpr int dispatchCompare(const char* a, const char* b) {
+  while (*a && *a == *b) {
+    a++;
+    b++;
+  }
+  return (unsigned char)*a - (unsigned char)*b;
+}
+
+/**
+ * @brief Concatenates per-subsystem tables and sorts the result by key.
+ */
+template <typename Entry, size_t... N>
+constexpr std::array<Entry, (N + ...)> makeDispatchTable(const Entry (&... tables)[N]) {
+  std::array<Entry, (N + ...)> table{};
+  size_t n = 0;
+  auto append = [&](const auto& entries) {
+    for (const Entry& entry : entries) table[n++] = entry;
+  };
+  (append(tables), ...);
+
+  // Insertion sort: a handful of entries, and std::sort is not constexpr in C++17
+  for (size_t i = 1; i < table.size(); i++) {
+    Entry entry = table[i];
+    size_t j = i;
+    for (; j > 0 && dispatchCompare(dispatchKey(table[j - 1]), dispatchKey(entry)) > 0; j--) {
+      table[j] = table[j - 1];
+    }
+    table[j] = entry;
+  }
+  return table;
+}
+
+/**
+ * @brief true if the keys are strictly increasing: sorted, no duplicates.
+ */
+template <typename Entry, size_t N>
+constexpr bool dispatchTableValid(const std::array<Entry, N>& table) {
+  for (size_t i = 1; i < N; i++) {
+    if (dispatchCompare(dispatchKey(table[i - 1]), dispatchKey(table[i])) >= 0) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Binary search of a table built by makeDispatchTable().
+ * @return nullptr if the key is not in the table.
+ */
+template <typename Entry, size_t N>
+const Entry* findDispatchEntry(const std::array<Entry, N>& table, const char* key) {
+  size_t low = 0;
+  size_t high = N;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    int order = dispatchCompare(dispatchKey(table[mid]), key);
+    if (order == 0) return &table[mid];
+    if (order < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return nullptr;
+}
+
+#endif // DISPATCH_HPP
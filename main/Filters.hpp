@@ -0,0 +1,190 @@
+#ifndef FILTERS_HPP
+#define FILTERS_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+// Allocation-free sensor filters with the window size fixed at compile time.
+//
+//  - trimmedMean(): one-shot robust mean of a burst of ADC samples
+//  - RunningMedian<T, N>: median of the last N values
+//  - RunningTrimmedMean<T, N, Trim>: mean of the last N values without the
+//    Trim lowest and Trim highest
+//  - Ema: first-order low-pass
+//
+// The running filters keep their window both in arrival order (to know which
+// value leaves) and sorted (so the median/trimmed mean is a lookup), so an
+// update costs O(N) moves and no sorting.
+
+/**
+ * @brief Mean of samples[trim .. n-trim) once sorted: drops the trim lowest
+ * and trim highest, so isolated spikes in a burst do not move the result.
+ * Sorts samples in place (insertion sort; bursts are small).
+ * @return The mean, or 0 if n <= 2 * trim.
+ */
+template <typename T>
+float trimmedMean(T* samples, int n, int trim) {
+  if (n <= 2 * trim) {
+    return 0;
+  }
+
+  for (int i = 1; i < n; i++) {
+    T x = samples[i];
+    int j = i - 1;
+    while (j >= 0 && samples[j] > x) {
+      samples[j + 1] = samples[j];
+      j--;
+    }
+    samples[j + 1] = x;
+  }
+
+  float sum = 0;
+  for (int i = trim; i < n - trim; i++) {
+    sum += samples[i];
+  }
+  return sum / (n - 2 * trim);
+}
+
+/**
+ * @brief Sliding window of the last N values, also kept in sorted order.
+ */
+template <typename T, uint8_t N>
+class SortedWindow {
+  static_assert(N >= 1, "SortedWindow needs at least one slot");
+
+public:
+  SortedWindow() { reset(); }
+
+  void reset() {
+    count_ = 0;
+    next_ = 0;
+  }
+
+  /**
+   * @brief Adds a value, replacing the oldest once the window is full.
+   */
+  void push(T x) {
+    if (count_ == N) {
+      removeSorted(window_[next_]);
+    }
+    window_[next_] = x;
+    next_ = next_ + 1 == N ? 0 : next_ + 1;
+    insertSorted(x);
+  }
+
+  uint8_t size() const { return count_; }
+  bool full() const { return count_ == N; }
+
+  /**
+   * @brief The i-th smallest value in the window; i must be below size().
+   */
+  T sorted(uint8_t i) const { return sorted_[i]; }
+
+protected:
+  // Number of sorted values below x (binary search)
+  uint8_t lowerBound(T x) const {
+    uint8_t lo = 0;
+    uint8_t hi = count_;
+    while (lo < hi) {
+      uint8_t mid = (lo + hi) / 2;
+      if (sorted_[mid] < x) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  void insertSorted(T x) {
+    uint8_t i = lowerBound(x);
+    memmove(&sorted_[i + 1], &sorted_[i], (count_ - i) * sizeof(T));
+    sorted_[i] = x;
+    count_++;
+  }
+
+  void removeSorted(T x) {
+    uint8_t i = lowerBound(x); // x is in the window, so sorted_[i] == x
+    memmove(&sorted_[i], &sorted_[i + 1], (count_ - i - 1) * sizeof(T));
+    count_--;
+  }
+
+  T window_[N];
+  T sorted_[N];
+  uint8_t count_; // Values in the window (and in sorted_)
+  uint8_t next_;  // Slot of the oldest value once full
+};
+
+/**
+ * @brief Median of the last N values. Rejects up to (N-1)/2 outliers in a row.
+ */
+template <typename T, uint8_t N>
+class RunningMedian : public SortedWindow<T, N> {
+public:
+  /**
+   * @brief Adds a value and returns the median of the window.
+   */
+  float update(T x) {
+    this->push(x);
+    return value();
+  }
+
+  float value() const {
+    uint8_t n = this->size();
+    if (n == 0) return 0;
+    if (n & 1) return this->sorted(n / 2);
+    return ((float)this->sorted(n / 2 - 1) + (float)this->sorted(n / 2)) / 2;
+  }
+};
+
+/**
+ * @brief Mean of the last N values without the Trim lowest and Trim highest.
+ * Until the window fills, trims proportionally less.
+ */
+template <typename T, uint8_t N, uint8_t Trim>
+class RunningTrimmedMean : public SortedWindow<T, N> {
+  static_assert(2 * Trim < N, "Trim leaves no values to average");
+
+public:
+  float update(T x) {
+    this->push(x);
+    return value();
+  }
+
+  float value() const {
+    uint8_t n = this->size();
+    if (n == 0) return 0;
+    uint8_t trim = (uint8_t)((uint16_t)Trim * n / N);
+    float sum = 0;
+    for (uint8_t i = trim; i < n - trim; i++) {
+      sum += this->sorted(i);
+    }
+    return sum / (n - 2 * trim);
+  }
+};
+
+/**
+ * @brief Exponential moving average, y += alpha * (x - y). The first value
+ * seeds the output so there is no start-up ramp from zero.
+ */
+class Ema {
+public:
+  explicit Ema(float alpha) : alpha_(alpha), value_(0), seeded_(false) {}
+
+  float update(float x) {
+    if (!seeded_) {
+      value_ = x;
+      seeded_ = true;
+    } else {
+      value_ += alpha_ * (x - value_);
+    }
+    return value_;
+  }
+
+  float value() const { return value_; }
+  void reset() { seeded_ = false; }
+
+private:
+  float alpha_;
+  float value_;
+  bool seeded_;
+};
+
+#endif // FILTERS_HPP
@@ -0,0 +1,205 @@
+#ifndef HAL_HPP
+#define HAL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Thin hardware abstraction layer used by the subsystems.
+// Backends:
+//  - HalEsp32.cpp: Arduino-ESP32 (compiled with the sketch)
+//  - host/HalLinux.cpp: Linux, simulated or real-time clock (CMake host build)
+// The functions are deliberately thin wrappers so the ESP32 build costs no
+// more than calling the Arduino API directly.
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define HAL_ISR_ATTR IRAM_ATTR
+#else
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#define HAL_ISR_ATTR
+
+typedef uint8_t byte;
+
+// Board pin aliases used by the subsystems (Arduino Nano ESP32 on target)
+const uint8_t A4 = 14;
+const uint8_t A5 = 15;
+const uint8_t LED_RED = 46;
+#define LED_BUILTIN 48
+
+using std::abs;
+using std::min;
+using std::max;
+
+template <typename T, typename L, typename H>
+inline T constrain(T x, L low, H high) {
+  return x < low ? (T)low : (x > high ? (T)high : x);
+}
+#endif
+
+// --- Types ---
+enum HalPinMode : uint8_t { HAL_INPUT, HAL_OUTPUT, HAL_INPUT_PULLUP };
+enum HalEdge : uint8_t { HAL_RISING, HAL_FALLING, HAL_CHANGE };
+typedef void (*HalIsr)();
+
+// --- Clock ---
+uint32_t halMicros();
+uint32_t halMillis();
+void halDelayMs(uint32_t ms); // Blocks the caller; yields the core to other tasks/threads
+
+// --- Wall clock ---
+// Timestamps below this (2020-01-01) are time since boot, not Unix time
+const uint64_t HAL_EPOCH_VALID_US = 1577836800ULL * 1000000ULL;
+
+/**
+ * @brief Starts keeping the wall clock in step with an (S)NTP server, in the
+ * background. The ESP32 slews the clock towards each new sync instead of
+ * stepping it, so timestamps stay monotonic. Call once the network is up.
+ */
+void halClockSyncStart(const char* server);
+
+/**
+ * @brief Microseconds since the Unix epoch once the clock has been
+ * synchronised; before that, microseconds since boot (below
+ * HAL_EPOCH_VALID_US). Does not wrap.
+ */
+uint64_t halTimestampUs();
+
+inline bool halTimestampIsEpoch(uint64_t us) {
+  return us >= HAL_EPOCH_VALID_US;
+}
+
+// --- GPIO ---
+void halPinMode(uint8_t pin, HalPinMode mode);
+void halDigitalWrite(uint8_t pin, bool level);
+bool halDigitalRead(uint8_t pin);
+
+// --- ADC ---
+/**
+ * @brief Raw ADC reading (12-bit on the ESP32).
+ */
+int halAdcRead(uint8_t pin);
+
+// Per-pin conversion rate once a pin is sampled continuously
+const uint32_t HAL_ADC_CONTINUOUS_HZ = 2000;
+
+/**
+ * @brief Adds a pin to background sampling by the ADC's DMA engine (ESP32
+ * continuous mode, HAL_ADC_CONTINUOUS_HZ per pin). Afterwards halAdcRead() and
+ * halAdcReadBurst() on the pin return buffered conversions instead of
+ * starting one. Setup-time only; reads must all come from one task.
+ * @return false if the pin cannot be sampled continuously (single reads are used).
+ */
+bool halAdcStartContinuous(uint8_t pin);
+
+/**
+ * @brief The newest raw readings of a pin, oldest first: buffered DMA
+ * conversions for continuously sampled pins, back-to-back single reads otherwise.
+ * @return Number of readings written; fewer than count only while the DMA
+ * buffer is still filling after start-up.
+ */
+int halAdcReadBurst(uint8_t pin, uint16_t* out, int count);
+
+// --- PWM ---
+/**
+ * @brief Attaches a PWM channel to a pin.
+ * @param freqHz PWM frequency.
+ * @param resolutionBits Duty resolution (duty range is 0 .. 2^bits - 1).
+ */
+bool halPwmAttach(uint8_t pin, uint32_t freqHz, uint8_t resolutionBits);
+
+/**
+ * @brief Sets the duty now, stopping a fade in progress.
+ */
+void halPwmWrite(uint8_t pin, uint32_t duty);
+
+/**
+ * @brief Moves the duty linearly from its present value to targetDuty over
+ * fadeMs, in hardware (ESP32 LEDC fade); the CPU only starts it. A later
+ * halPwmWrite() or halPwmFade() replaces a fade in progress.
+ * @return false if the channel cannot fade (nothing is written).
+ */
+bool halPwmFade(uint8_t pin, uint32_t targetDuty, uint32_t fadeMs);
+
+/**
+ * @brief The duty being put out now, part-way through a fade.
+ */
+uint32_t halPwmDuty(uint8_t pin);
+
+// --- Interrupts ---
+void halAttachInterrupt(uint8_t pin, HalIsr isr, HalEdge edge);
+
+/**
+ * @brief Masks interrupts around reads of ISR-shared state.
+ */
+void halEnterCritical();
+void halExitCritical();
+
+// --- Pulse capture ---
+/**
+ * @brief Consistent snapshot of a captured pulse train.
+ */
+struct HalPulseCapture {
+  uint32_t captures; // Captures so far, one per edgesPerCapture rising edges
+  uint32_t spanNs;   // Time between the last two captures (0 until there are two)
+  uint32_t lastUs;   // halMicros() of the last capture
+};
+
+/**
+ * @brief Timestamps every edgesPerCapture-th rising edge of a pin in hardware
+ * (ESP32 MCPWM capture, 80 MHz timer), so there is one interrupt per
+ * edgesPerCapture edges instead of one per edge. Setup-time only; one pin.
+ * @param edgesPerCapture 1-256.
+ * @return false if the pin cannot be captured (use halAttachInterrupt()).
+ */
+bool halPulseCaptureStart(uint8_t pin, uint16_t edgesPerCapture);
+
+/**
+ * @brief Reads the capture state without masking interrupts (the capture
+ * interrupt may update it concurrently; the read retries until it is consistent).
+ * @return false if the pin is not being captured.
+ */
+bool halPulseCaptureRead(uint8_t pin, HalPulseCapture& out);
+
+// --- Console ---
+/**
+ * @brief printf-style log line to the serial console.
+ */
+void halLog(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Reads one line of console input if one is available. Non-blocking.
+ * @param buf Destination, always NUL-terminated. Trailing whitespace is trimmed.
+ * @return true if a non-empty line was read.
+ */
+bool halConsoleReadLine(char* buf, size_t len);
+
+// --- Memory ---
+/**
+ * @brief Allocates a large, long-lived buffer, from PSRAM when the board has it.
+ * @return nullptr if no memory is available.
+ */
+void* halAllocLarge(size_t bytes);
+
+/**
+ * @brief Free heap now, and the lowest it has been since boot (0 on Linux).
+ */
+uint32_t halFreeHeap();
+uint32_t halMinFreeHeap();
+
+// --- Profiling ---
+/**
+ * @brief Free-running counter for timing short sections: CPU cycles of the
+ * calling core on the ESP32, nanoseconds of the real (never the simulated)
+ * clock on Linux. Wraps; only differences are meaningful.
+ */
+uint32_t halCycles();
+
+/**
+ * @brief halCycles() ticks per microsecond.
+ */
+uint32_t halCyclesPerUs();
+
+#endif // HAL_HPP
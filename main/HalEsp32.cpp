@@ -0,0 +1,387 @@
+// ESP32 (Arduino core) backend of the hardware abstraction layer.
+#ifdef ARDUINO
+
+#include "Hal.hpp"
+#include "Profiler.hpp"
+#include "driver/ledc.h"
+#include "driver/mcpwm_cap.h"
+#include "esp32-hal-periman.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+namespace {
+
+// --- Continuous ADC ---
+// The DMA engine converts the registered pins round-robin into the driver's
+// pool; drainAdc() demultiplexes whatever has arrived into a small ring of
+// the newest conversions per pin, so a read never waits for a conversion.
+const int ADC_MAX_PINS = 4;
+const uint32_t ADC_RECENT = 64; // Newest conversions kept per pin (power of two)
+const uint32_t ADC_FRAME_BYTES = 256;
+
+struct AdcStream {
+  uint8_t pin;
+  uint8_t channel;
+  uint32_t written;
+  uint16_t recent[ADC_RECENT];
+};
+
+adc_continuous_handle_t adcHandle = nullptr;
+AdcStream adcStreams[ADC_MAX_PINS];
+int adcStreamCount = 0;
+
+AdcStream* findAdcStream(uint8_t pin) {
+  for (int i = 0; i < adcStreamCount; i++) {
+    if (adcStreams[i].pin == pin) return &adcStreams[i];
+  }
+  return nullptr;
+}
+
+void drainAdc() {
+  uint8_t frame[ADC_FRAME_BYTES];
+  uint32_t length = 0;
+
+  while (adc_continuous_read(adcHandle, frame, sizeof(frame), &length, 0) == ESP_OK) {
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+      const adc_digi_output_data_t* result = (const adc_digi_output_data_t*)&frame[i];
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+      uint8_t channel = result->type1.channel;
+      uint16_t data = result->type1.data;
+#else
+      uint8_t channel = result->type2.channel;
+      uint16_t data = result->type2.data;
+#endif
+      for (int s = 0; s < adcStreamCount; s++) {
+        if (adcStreams[s].channel == channel) {
+          adcStreams[s].recent[adcStreams[s].written++ & (ADC_RECENT - 1)] = data;
+        }
+      }
+    }
+  }
+}
+
+// (Re)starts the DMA with every registered pin in the pattern
+bool configureAdc() {
+  if (adcHandle) {
+    adc_continuous_stop(adcHandle);
+    adc_continuous_deinit(adcHandle);
+    adcHandle = nullptr;
+  }
+
+  adc_continuous_handle_cfg_t handleConfig = {};
+  handleConfig.max_store_buf_size = 4 * ADC_FRAME_BYTES;
+  handleConfig.conv_frame_size = ADC_FRAME_BYTES;
+  if (adc_continuous_new_handle(&handleConfig, &adcHandle) != ESP_OK) {
+    adcHandle = nullptr;
+    return false;
+  }
+
+  adc_digi_pattern_config_t pattern[ADC_MAX_PINS] = {};
+  for (int i = 0; i < adcStreamCount; i++) {
+    pattern[i].atten = ADC_ATTEN_DB_11; // analogRead()'s default range (0-3.1 V)
+    pattern[i].channel = adcStreams[i].channel;
+    pattern[i].unit = ADC_UNIT_1;
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+
+  adc_continuous_config_t config = {};
+  config.pattern_num = adcStreamCount;
+  config.adc_pattern = pattern;
+  config.sample_freq_hz = HAL_ADC_CONTINUOUS_HZ * adcStreamCount;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+#else
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+#endif
+
+  if (adc_continuous_config(adcHandle, &config) != ESP_OK || adc_continuous_start(adcHandle) != ESP_OK) {
+    adc_continuous_deinit(adcHandle);
+    adcHandle = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// --- Pulse capture ---
+// The MCPWM capture channel latches its 80 MHz timer on every Nth rising edge
+// (the channel prescaler) and interrupts once per capture. The callback
+// publishes under a sequence lock: odd while it writes, so readers on either
+// core retry instead of masking interrupts.
+struct PulseCaptureState {
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> captures;
+  std::atomic<uint32_t> lastTicks;
+  std::atomic<uint32_t> spanTicks;
+  std::atomic<uint32_t> lastUs;
+};
+
+int capturePin = -1;
+uint32_t captureTicksPerUs = 80;
+mcpwm_cap_timer_handle_t captureTimer = nullptr;
+mcpwm_cap_channel_handle_t captureChannel = nullptr;
+PulseCaptureState captureState;
+
+bool IRAM_ATTR onPulseCapture(mcpwm_cap_channel_handle_t, const mcpwm_capture_event_data_t* event, void*) {
+  PulseCaptureState& s = captureState;
+  uint32_t sequence = s.sequence.load(std::memory_order_relaxed);
+  s.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  uint32_t captures = s.captures.load(std::memory_order_relaxed);
+  if (captures > 0) {
+    s.spanTicks.store(event->cap_value - s.lastTicks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+  s.lastTicks.store(event->cap_value, std::memory_order_relaxed);
+  s.lastUs.store((uint32_t)esp_timer_get_time(), std::memory_order_relaxed);
+  s.captures.store(captures + 1, std::memory_order_relaxed);
+
+  s.sequence.store(sequence + 2, std::memory_order_release);
+  PROFILE_COUNT(PROFILE_ISR_CAPTURE);
+  return false; // No task woken
+}
+
+// --- PWM fades ---
+// Pins with a fade started since their last write. A fade has to be stopped
+// before the duty is written or a new fade starts on the channel.
+uint64_t fadingPins = 0;
+
+void stopFade(uint8_t pin) {
+  if (pin >= 64 || !(fadingPins & (1ULL << pin))) return;
+  fadingPins &= ~(1ULL << pin);
+  ledc_channel_handle_t* bus =
+      (ledc_channel_handle_t*)perimanGetPinBus(digitalPinToGPIONumber(pin), ESP32_BUS_TYPE_LEDC);
+  if (bus) {
+    ledc_fade_stop((ledc_mode_t)(bus->channel / SOC_LEDC_CHANNEL_NUM),
+                   (ledc_channel_t)(bus->channel % SOC_LEDC_CHANNEL_NUM));
+  }
+}
+
+} // namespace
+
+uint32_t halMicros() {
+  return micros();
+}
+
+uint32_t halMillis() {
+  return millis();
+}
+
+void halDelayMs(uint32_t ms) {
+  delay(ms);
+}
+
+void halClockSyncStart(const char* server) {
+  if (esp_sntp_enabled()) return;
+  // Smooth mode adjusts with adjtime(), so a sync never steps the clock back
+  sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+  configTime(0, 0, server);
+}
+
+// Before the first sync the system clock counts from boot
+uint64_t halTimestampUs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (uint64_t)tv.tv_sec * 1000000ULL + (uint64_t)tv.tv_usec;
+}
+
+void halPinMode(uint8_t pin, HalPinMode mode) {
+  switch (mode) {
+    case HAL_OUTPUT:       pinMode(pin, OUTPUT); break;
+    case HAL_INPUT_PULLUP: pinMode(pin, INPUT_PULLUP); break;
+    default:               pinMode(pin, INPUT); break;
+  }
+}
+
+void halDigitalWrite(uint8_t pin, bool level) {
+  digitalWrite(pin, level ? HIGH : LOW);
+}
+
+bool halDigitalRead(uint8_t pin) {
+  return digitalRead(pin) == HIGH;
+}
+
+int halAdcRead(uint8_t pin) {
+  AdcStream* stream = adcHandle ? findAdcStream(pin) : nullptr;
+  if (!stream) return analogRead(pin);
+
+  drainAdc();
+  return stream->written ? stream->recent[(stream->written - 1) & (ADC_RECENT - 1)] : 0;
+}
+
+bool halAdcStartContinuous(uint8_t pin) {
+  if (findAdcStream(pin)) return true;
+  if (adcStreamCount == ADC_MAX_PINS) return false;
+
+  adc_unit_t unit;
+  adc_channel_t channel;
+  if (adc_continuous_io_to_channel(digitalPinToGPIONumber(pin), &unit, &channel) != ESP_OK || unit != ADC_UNIT_1) {
+    return false; // Only ADC1 is sampled by the DMA here
+  }
+
+  AdcStream& stream = adcStreams[adcStreamCount++];
+  stream.pin = pin;
+  stream.channel = (uint8_t)channel;
+  stream.written = 0;
+
+  if (!configureAdc()) {
+    adcStreamCount--;
+    if (adcStreamCount > 0) configureAdc(); // Keep the pins that worked before
+    return false;
+  }
+  return true;
+}
+
+int halAdcReadBurst(uint8_t pin, uint16_t* out, int count) {
+  AdcStream* stream = adcHandle ? findAdcStream(pin) : nullptr;
+  if (!stream) {
+    for (int i = 0; i < count; i++) {
+      out[i] = (uint16_t)analogRead(pin);
+    }
+    return count;
+  }
+
+  drainAdc();
+  uint32_t available = stream->written < ADC_RECENT ? stream->written : ADC_RECENT;
+  uint32_t n = (uint32_t)count < available ? (uint32_t)count : available;
+  uint32_t first = stream->written - n;
+  for (uint32_t i = 0; i < n; i++) {
+    out[i] = stream->recent[(first + i) & (ADC_RECENT - 1)];
+  }
+  return (int)n;
+}
+
+bool halPwmAttach(uint8_t pin, uint32_t freqHz, uint8_t resolutionBits) {
+  return ledcAttach(pin, freqHz, resolutionBits);
+}
+
+void halPwmWrite(uint8_t pin, uint32_t duty) {
+  stopFade(pin);
+  ledcWrite(pin, duty);
+}
+
+bool halPwmFade(uint8_t pin, uint32_t targetDuty, uint32_t fadeMs) {
+  if (pin >= 64) return false;
+  stopFade(pin); // Else starting a fade blocks until the running one ends
+  if (!ledcFade(pin, ledcRead(pin), targetDuty, (int)fadeMs)) return false;
+  fadingPins |= 1ULL << pin; // Until the next write or fade; a finished fade stops at once
+  return true;
+}
+
+uint32_t halPwmDuty(uint8_t pin) {
+  return ledcRead(pin); // The duty register, which the fade unit updates as it steps
+}
+
+void halAttachInterrupt(uint8_t pin, HalIsr isr, HalEdge edge) {
+  int mode = edge == HAL_RISING ? RISING : (edge == HAL_FALLING ? FALLING : CHANGE);
+  attachInterrupt(digitalPinToInterrupt(pin), isr, mode);
+}
+
+bool halPulseCaptureStart(uint8_t pin, uint16_t edgesPerCapture) {
+  if (capturePin >= 0 || edgesPerCapture < 1 || edgesPerCapture > 256) return false;
+
+  mcpwm_capture_timer_config_t timerConfig = {};
+  timerConfig.group_id = 0;
+  timerConfig.clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT;
+  if (mcpwm_new_capture_timer(&timerConfig, &captureTimer) != ESP_OK) return false;
+
+  mcpwm_capture_channel_config_t channelConfig = {};
+  channelConfig.gpio_num = digitalPinToGPIONumber(pin);
+  channelConfig.prescale = edgesPerCapture;
+  channelConfig.flags.pos_edge = true;
+  channelConfig.flags.neg_edge = false;
+  channelConfig.flags.pull_up = true;
+
+  mcpwm_capture_event_callbacks_t callbacks = {};
+  callbacks.on_cap = onPulseCapture;
+
+  uint32_t resolutionHz = 0;
+  if (mcpwm_new_capture_channel(captureTimer, &channelConfig, &captureChannel) != ESP_OK ||
+      mcpwm_capture_channel_register_event_callbacks(captureChannel, &callbacks, nullptr) != ESP_OK ||
+      mcpwm_capture_channel_enable(captureChannel) != ESP_OK ||
+      mcpwm_capture_timer_get_resolution(captureTimer, &resolutionHz) != ESP_OK ||
+      mcpwm_capture_timer_enable(captureTimer) != ESP_OK || mcpwm_capture_timer_start(captureTimer) != ESP_OK) {
+    if (captureChannel) mcpwm_del_capture_channel(captureChannel);
+    mcpwm_del_capture_timer(captureTimer);
+    captureChannel = nullptr;
+    captureTimer = nullptr;
+    return false;
+  }
+
+  captureTicksPerUs = resolutionHz / 1000000;
+  capturePin = pin;
+  return true;
+}
+
+bool halPulseCaptureRead(uint8_t pin, HalPulseCapture& out) {
+  if (pin != capturePin) return false;
+
+  PulseCaptureState& s = captureState;
+  uint32_t before, after, spanTicks;
+  do {
+    before = s.sequence.load(std::memory_order_acquire);
+    out.captures = s.captures.load(std::memory_order_relaxed);
+    spanTicks = s.spanTicks.load(std::memory_order_relaxed);
+    out.lastUs = s.lastUs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = s.sequence.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+
+  out.spanNs = (uint32_t)((uint64_t)spanTicks * 1000 / captureTicksPerUs);
+  return true;
+}
+
+void halEnterCritical() {
+  noInterrupts();
+}
+
+void halExitCritical() {
+  interrupts();
+}
+
+void halLog(const char* fmt, ...) {
+  char line[160];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  Serial.print(line);
+}
+
+bool halConsoleReadLine(char* buf, size_t len) {
+  if (len == 0 || !Serial.available()) return false;
+
+  size_t n = Serial.readBytesUntil('\n', buf, len - 1);
+  while (n > 0 && (buf[n - 1] == '\r' || buf[n - 1] == ' ' || buf[n - 1] == '\t')) n--;
+  buf[n] = '\0';
+
+  return n > 0;
+}
+
+void* halAllocLarge(size_t bytes) {
+  void* p = psramFound() ? ps_malloc(bytes) : nullptr;
+  return p ? p : malloc(bytes);
+}
+
+uint32_t halFreeHeap() {
+  return ESP.getFreeHeap();
+}
+
+uint32_t halMinFreeHeap() {
+  return ESP.getMinFreeHeap();
+}
+
+uint32_t halCycles() {
+  return ESP.getCycleCount();
+}
+
+uint32_t halCyclesPerUs() {
+  return getCpuFrequencyMhz();
+}
+
+#endif // ARDUINO
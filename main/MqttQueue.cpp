@@ -0,0 +1,34 @@
+#include "MqttQueue.hpp"
+#include <string.h>
+
+bool mqttEnqueue(MqttQueue& queue, const char* topic, const uint8_t* payload, size_t length) {
+  size_t topicLength = strlen(topic);
+  if (topicLength >= MQTT_TOPIC_MAX || length > MQTT_PAYLOAD_MAX) {
+    return false;
+  }
+
+  // Filled in place: a message is ~1 KB, too big to build on the stack first
+  MqttMessage* message = queue.reserve();
+  if (!message) {
+    return false;
+  }
+
+  memcpy(message->topic, topic, topicLength + 1);
+  memcpy(message->payload, payload, length);
+  message->payload[length] = '\0';
+  message->length = (uint16_t)length;
+  queue.commit();
+  return true;
+}
+
+bool MqttOutbox::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload, (unsigned int)strlen(payload));
+}
+
+bool MqttOutbox::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  if (!mqttEnqueue(queue_, topic, payload, length)) {
+    dropped_++;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,53 @@
+#ifndef MQTTQUEUE_HPP
+#define MQTTQUEUE_HPP
+
+#include "RingBuffer.hpp"
+#include <stddef.h>
+#include <stdint.h>
+
+// Message queues between the network task (which owns the PubSubClient) and
+// the control loop. Each direction is an SpscRing, so neither side ever waits
+// for the other:
+//   inbox:  network -> control  (attribute updates, RPC requests)
+//   outbox: control -> network  (JSON status, RPC responses)
+
+const size_t MQTT_TOPIC_MAX = 96;
+const size_t MQTT_PAYLOAD_MAX = 1024;
+const uint32_t MQTT_QUEUE_DEPTH = 8;
+
+struct MqttMessage {
+  char topic[MQTT_TOPIC_MAX];
+  uint16_t length;
+  uint8_t payload[MQTT_PAYLOAD_MAX + 1]; // NUL-terminated for convenience
+};
+
+typedef SpscRing<MqttMessage, MQTT_QUEUE_DEPTH> MqttQueue;
+
+/**
+ * @brief Copies a message into the queue (producer side).
+ * @return false if the queue is full or the topic/payload is too long.
+ */
+bool mqttEnqueue(MqttQueue& queue, const char* topic, const uint8_t* payload, size_t length);
+
+/**
+ * @brief Publishing end of the outbox, used by the control side in place of
+ * the PubSubClient. Messages are sent by the network task when it is connected.
+ */
+class MqttOutbox {
+public:
+  explicit MqttOutbox(MqttQueue& queue) : queue_(queue), dropped_(0) {}
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+
+  /**
+   * @brief Messages that did not fit in the queue.
+   */
+  uint32_t dropped() const { return dropped_; }
+
+private:
+  MqttQueue& queue_;
+  uint32_t dropped_;
+};
+
+#endif // MQTTQUEUE_HPP
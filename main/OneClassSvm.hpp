@@ -0,0 +1,145 @@
+#ifndef ONECLASSSVM_HPP
+#define ONECLASSSVM_HPP
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// One-Class SVM inference (RBF kernel) for the model that
+// anomalydetection/svm_train.py exports as svm_model.h:
+//
+//   decision(x) = sum_i DUAL_COEF[i] * exp(-SVM_GAMMA * |s(x) - SV_i|^2) + SVM_INTERCEPT
+//   s(x)        = (x - SCALER_MEAN) / SCALER_SCALE
+//
+// decision < 0 is an outlier, as sklearn's predict() == -1.
+//
+// load() transposes the generated row-per-vector array into one array per
+// feature (structure of arrays), padded with zero-weight vectors to a whole
+// number of blocks. The kernel loop then runs over fixed-size blocks of
+// contiguous floats with no branches, which the compiler can vectorize, and
+// exp() is a polynomial instead of a libm call.
+
+/**
+ * @brief e^x for -87 <= x <= 0, branch-free: 2^k from the exponent bits times
+ * a degree-6 polynomial for 2^f, |f| <= 0.5 (relative error below 2e-7).
+ */
+inline float svmExp(float x) {
+  float t = x * 1.44269504f; // log2(e)
+  int32_t k = (int32_t)(t - 0.5f); // Round to nearest (t <= 0)
+  float f = t - (float)k;
+  float p = 1.535336188e-4f;
+  p = p * f + 1.339887440e-3f;
+  p = p * f + 9.618437357e-3f;
+  p = p * f + 5.550332471e-2f;
+  p = p * f + 2.402264791e-1f;
+  p = p * f + 6.931472028e-1f;
+  p = p * f + 1.0f;
+  int32_t bits = (k + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+/**
+ * @brief min(x, limit) for x, limit >= 0 (NaN and inf give limit).
+ * Compares the bit patterns as integers, which order the same as the values
+ * for non-negative floats: a float compare in the kernel loop keeps GCC from
+ * vectorizing it unless -fno-trapping-math is set.
+ */
+inline float svmClamp(float x, float limit) {
+  int32_t xBits, limitBits;
+  memcpy(&xBits, &x, sizeof(x));
+  memcpy(&limitBits, &limit, sizeof(limit));
+  xBits = xBits < limitBits ? xBits : limitBits;
+  memcpy(&x, &xBits, sizeof(x));
+  return x;
+}
+
+/**
+ * @brief One-Class SVM with up to MaxSV support vectors of Features values each.
+ */
+template <uint8_t Features, uint16_t MaxSV>
+class OneClassSvm {
+public:
+  // Vectors per kernel block; the padded capacity is a multiple of it
+  static const uint16_t BLOCK = 16;
+  static const uint16_t CAPACITY = (MaxSV + BLOCK - 1) / BLOCK * BLOCK;
+
+  OneClassSvm() : count_(0), padded_(0), gamma_(0), maxDistance_(0), intercept_(0) {}
+
+  /**
+   * @brief Copies a model in the svm_model.h layout.
+   * @param supportVectors count x Features values, one vector per row
+   * @return false if count is above MaxSV (the model is then empty)
+   */
+  bool load(const float* supportVectors, const float* dualCoef, uint16_t count, const float* scalerMean,
+            const float* scalerScale, float gamma, float intercept) {
+    if (count > MaxSV) {
+      count_ = padded_ = 0;
+      return false;
+    }
+    count_ = count;
+    padded_ = (count + BLOCK - 1) / BLOCK * BLOCK;
+    for (uint16_t i = 0; i < padded_; i++) {
+      bool real = i < count;
+      for (uint8_t f = 0; f < Features; f++) {
+        sv_[f][i] = real ? supportVectors[i * Features + f] : 0;
+      }
+      coef_[i] = real ? dualCoef[i] : 0;
+    }
+    for (uint8_t f = 0; f < Features; f++) {
+      mean_[f] = scalerMean[f];
+      invScale_[f] = scalerScale[f] != 0 ? 1.0f / scalerScale[f] : 1.0f;
+    }
+    gamma_ = gamma;
+    maxDistance_ = gamma > 0 ? 87.0f / gamma : 0; // Keeps svmExp() in range
+    intercept_ = intercept;
+    return true;
+  }
+
+  /**
+   * @brief Signed distance to the boundary; negative outside (anomaly).
+   * @param x Features raw (unscaled) values
+   */
+  float decision(const float* x) const {
+    float q[Features];
+    for (uint8_t f = 0; f < Features; f++) {
+      q[f] = (x[f] - mean_[f]) * invScale_[f];
+    }
+
+    float sum = 0;
+    for (uint16_t base = 0; base < padded_; base += BLOCK) {
+      float k[BLOCK];
+      for (uint16_t i = 0; i < BLOCK; i++) k[i] = 0;
+      for (uint8_t f = 0; f < Features; f++) {
+        const float* column = &sv_[f][base];
+        for (uint16_t i = 0; i < BLOCK; i++) {
+          float d = q[f] - column[i];
+          k[i] += d * d;
+        }
+      }
+      for (uint16_t i = 0; i < BLOCK; i++) {
+        k[i] = coef_[base + i] * svmExp(-gamma_ * svmClamp(k[i], maxDistance_));
+      }
+      for (uint16_t i = 0; i < BLOCK; i++) sum += k[i];
+    }
+    return sum + intercept_;
+  }
+
+  bool isAnomaly(const float* x) const { return decision(x) < 0; }
+
+  uint16_t count() const { return count_; }
+
+private:
+  float sv_[Features][CAPACITY]; // Scaled support vectors, one row per feature
+  float coef_[CAPACITY];
+  float mean_[Features];
+  float invScale_[Features];
+  uint16_t count_;
+  uint16_t padded_; // count_ rounded up to BLOCK
+  float gamma_;
+  float maxDistance_; // Squared distance where the kernel reaches e^-87
+  float intercept_;
+};
+
+#endif // ONECLASSSVM_HPP
@@ -1,164 +1,80 @@
 #include "PHSubsystem.hpp"
-#include <Arduino.h>
-#include <ArduinoJson.h> 
+#include "Actuators.hpp"
+#include "Filters.hpp"
+#include "PhCalibration.hpp"
+#include "Profiler.hpp"
+#include "PumpTimeline.hpp"
+#include "Hal.hpp"
+#include <ArduinoJson.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 
 // --- Pin Definitions (from PHCHANGES.md) ---
+// The pumps are ACTUATOR_ACID_PUMP (D8) and ACTUATOR_BASE_PUMP (D9)
 #define SENSOR_PIN A4
-#define ACID_PIN 8
-#define ALKALI_PIN 9
 
 // --- State Variables (from PHCHANGES2.md) ---
 float targetPH = 0.0; // Start with no target (pumps off until set)
-float tolerance = 0.4; // Not const, to allow updates via attributes
-
-const int ARRAY_LENGTH = 10;
-float pHArray[ARRAY_LENGTH];
-int pHArrayIndex = 0; // NOTE: newPH.cpp uses -1 but that causes undefined behavior
+float tolerance = PH_TOLERANCE_DEFAULT; // Not const, to allow updates via attributes
+
+// --- Filtering ---
+// Every step averages a burst of raw readings without the outer quartiles
+// (spikes), then a running median over the last steps rejects transients
+// such as a bubble on the probe. currentPH updates every step (10 ms).
+const int PH_BURST = 16;
+const int PH_DECISION_STEPS = 10; // Pump decision every 10 steps (100 ms)
+RunningMedian<float, 5> voltageMedian;
+float probeVoltage = 0;
+int pHStep = 0;
 
 long timeMS, t1;
 long timeAfterCalibration; // Added from newPH.cpp
 
 float linearCoefficients[2] = {1.38, 0.76}; // slope, offset - pre-calibrated defaults
 
-int doneCalibrating = 0;
+// --- Calibration (calibratePH RPC) ---
+// A point is captured once the probe drifts less than 0.1 pH/min with less
+// than 0.02 pH of scatter over the last 10 s; limits in volts follow from the
+// current slope. Pumps stay off while a session is open (the probe is out of
+// the vessel); heating and stirring carry on.
+const float PH_CAL_MAX_DRIFT_PH_PER_MIN = 0.1;
+const float PH_CAL_MAX_NOISE_PH = 0.02;
+const uint32_t PH_CAL_TIMEOUT_MS = 5 * 60 * 1000UL;
+PhCalibration phCalibration;
+static char calReport[160]; // Client attributes for the last point, until published
+static bool calReportPending = false;
 
 // Telemetry State
 float currentPH = 0.0; 
 bool acid_on = false;
 bool alkali_on = false;
 
-// --- Helper Functions (from PHCHANGES.md) ---
-
-// code from: https://jwbrooks.blogspot.com/2014/02/arduino-linear-regression-function.html?m=1
-// code from: https://jwbrooks.blogspot.com/2014/02/arduino-linear-regression-function.html?m=1
-// Updated formula from newPH.cpp for consistency with new pH calculation
-void simpLinReg(float* x, float* y, float* lrCoef, int n){
-  // pass x and y arrays (pointers), lrCoef pointer, and n.  The lrCoef array is comprised of the slope=lrCoef[0] and intercept=lrCoef[1].  n is length of the x and y arrays.
-  // http://en.wikipedia.org/wiki/Simple_linear_regression
-
-  // initialize variables
-  float xbar=0;
-  float ybar=0;
-  float xybar=0;
-  float xsqbar=0;
-  
-  // calculations required for linear regression
-  for (int i=0; i<n; i++){
-    xbar=xbar+x[i];
-    ybar=ybar+y[i];
-    xybar=xybar+x[i]*y[i];
-    xsqbar=xsqbar+x[i]*x[i];
-  }
-  // Note: Using summed values directly (not normalized) per newPH.cpp formula
-  
-  // simple linear regression algorithm (updated from newPH.cpp)
-  lrCoef[0]=(n*xybar-xbar*ybar)/(n*xsqbar-xbar*xbar);
-  lrCoef[1]=(ybar/n)-(lrCoef[0]*(xbar/n));
-}
+// Autonomous (bang-bang) pump demand; manual pulses take precedence
+bool auto_acid = false;
+bool auto_alkali = false;
 
-// altered code from: https://wiki.dfrobot.com/PH_meter_SKU__SEN0161_
-float get_average(float* arr, int length) {
-  int i;
-  float max, min;
-  float avg;
-  float amount = 0.0; // Fixed: was 'long', causing precision loss with float accumulation
-  if (length <= 0) {
-    Serial.println("Error length for the array to averaging!/n");
-    return 0;
-  }
-  if (length < 5) {
-    for (i = 0; i < length; i++) {
-      amount += arr[i];
-    }
-    avg = amount / length;
-    return avg;
-  } else {
-    if (arr[0] < arr[1]) {
-      min = arr[0];
-      max = arr[1];
-    } else {
-      min = arr[1];
-      max = arr[0];
-    }
-    for (i = 2; i < length; i++) {
-      if (arr[i] < min) {
-        amount += min;
-        min = arr[i];
-      } else {
-        if (arr[i] > max) {
-          amount += max;
-          max = arr[i];
-        } else {
-          amount += arr[i];
-        }
-      }
-    }
-    avg = (double)amount / (length - 2);
-  }
-  return avg;
-}
+// Manual pulses requested over RPC
+PumpTimeline pumpTimeline;
 
-// Calibration routine updated from newPH.cpp
-// Note: xArray/yArray swapped to match new formula (pH = slope*voltage + offset)
-void calibrate(float* lrCoef) {
-  float yArray[3] = {4, 7, 10}; // Known pH values
-  float xArray[3]; // Measured voltages
-  
-  int numOfReadings = 50;
-  for (int i = 0; i < 3; i++) {
-    int doneRinsing = 0;
-    Serial.println("Rinse the probe and then enter y");
-    
-    while (doneRinsing == 0) {
-      if (Serial.available()) {
-        String userInput = Serial.readStringUntil('\n');
-        userInput.trim();
-
-        if (userInput == "y") {
-          Serial.println("Wait 1 minute for values to stabilise");
-          delay(60000);
-          Serial.println("Taking average now");
-          doneRinsing = 1;
-        }
-        else {
-          Serial.println("Ignored... please type y, after rinsing.");
-        }
-      }
-    }
-
-    float voltageSum = 0;
-    for (int j = 0; j < numOfReadings; j++) { // Fixed: was numOfReadings+1, causing off-by-one
-      voltageSum = voltageSum + analogRead(SENSOR_PIN) * 3.3 / 1024.0;
-      delay(100);
-    }
-
-    float averageVoltage = voltageSum / numOfReadings;
+/**
+ * @brief Drives the pump PWMs (off or full flow) from the manual pulse
+ * timeline and the autonomous demand. While a manual pulse runs, the
+ * autonomous demand is suppressed so acid and base are never on together.
+ */
+void applyPumpOutputs() {
+  pumpTimeline.step(halMillis());
 
-    xArray[i] = averageVoltage; // Store voltage in xArray (swapped from original)
-    Serial.println("Done, rinse now.");
+  if (pumpTimeline.busy()) {
+    acid_on = pumpTimeline.isOn(PUMP_ACID);
+    alkali_on = pumpTimeline.isOn(PUMP_BASE);
+  } else {
+    acid_on = auto_acid;
+    alkali_on = auto_alkali;
   }
-  simpLinReg(xArray, yArray, linearCoefficients, 3);
-  
-  // Output calibration results (from newPH.cpp)
-  Serial.print("Slope: ");
-  Serial.print(linearCoefficients[0]);
-  Serial.print(" Y-intercept: ");
-  Serial.print(linearCoefficients[1]);
-  Serial.println();
-}
 
-/**
- * @brief Manually pulses a pump for a given duration.
- * This is a blocking function.
- */
-void pulsePump(int pin, int duration) {
-  if (pin == ACID_PIN) Serial.print("Manual Pulse: ACID");
-  if (pin == ALKALI_PIN) Serial.print("Manual Pulse: ALKALI");
-  Serial.printf(" for %d ms\n", duration);
-
-  digitalWrite(pin, HIGH);
-  delay(duration); 
-  digitalWrite(pin, LOW);
+  actuatorWrite(ACTUATOR_ACID_PUMP, acid_on ? ACTUATOR_DUTY_MAX : 0);
+  actuatorWrite(ACTUATOR_BASE_PUMP, alkali_on ? ACTUATOR_DUTY_MAX : 0);
 }
 
 // --- Interface Functions ---
@@ -166,102 +82,107 @@ void pulsePump(int pin, int duration) {
 void setupPH() {
   // Serial.begin(200000); // Handled by main.ino
 
-  pinMode(ACID_PIN, OUTPUT);
-  pinMode(ALKALI_PIN, OUTPUT);
-  pinMode(SENSOR_PIN, INPUT);
+  // The pump PWMs are attached off by setupActuators()
+  halPinMode(SENSOR_PIN, HAL_INPUT);
+
+  if (!halAdcStartContinuous(SENSOR_PIN)) {
+    halLog("pH: continuous ADC unavailable, using single reads\n");
+  }
 
-  digitalWrite(ACID_PIN, LOW);
-  digitalWrite(ALKALI_PIN, LOW);
+  // Pre-calibrated defaults until a calibratePH session replaces them
+  timeAfterCalibration = halMillis(); // Track time from startup
+}
 
-  // Calibration is now optional - using pre-calibrated defaults
-  // Uncomment the line below to enable calibration on startup
-  // calibrate(linearCoefficients);
-  doneCalibrating = 1;
-  timeAfterCalibration = millis(); // Track time from startup
+/**
+ * @brief Feeds the calibration with the filtered voltage (every 100 ms) and
+ * prepares the report of a captured or timed-out point.
+ */
+static void stepCalibration() {
+  PhCalEvent event = phCalibration.update(probeVoltage, halMillis());
+  int n = phCalibration.pointCount();
+
+  if (event == PH_CAL_CAPTURED) {
+    const PhCalPoint& point = phCalibration.point(n - 1);
+    snprintf(calReport, sizeof(calReport),
+             "{\"ph_cal_point\": %d, \"ph_cal_buffer\": %.2f, \"ph_cal_voltage\": %.4f, "
+             "\"ph_cal_settle_s\": %.1f}",
+             n, point.bufferPH, point.voltage, point.settleMs * 1e-3f);
+    calReportPending = true;
+    halLog("pH calibration: point %d (pH %.2f) = %.4f V after %.1f s\n", n, point.bufferPH,
+           point.voltage, point.settleMs * 1e-3f);
+  } else if (event == PH_CAL_TIMEOUT) {
+    snprintf(calReport, sizeof(calReport),
+             "{\"ph_cal_point\": %d, \"ph_cal_error\": \"probe did not stabilise\"}", n + 1);
+    calReportPending = true;
+    halLog("pH calibration: point %d did not stabilise (drift %.2g V/s, noise %.2g V)\n", n + 1,
+           phCalibration.driftVPerS(), phCalibration.noiseV());
+  }
 }
 
 void executePH() {
+  PROFILE_SCOPE(PROFILE_PH);
+  // Read the probe every step, also while inactive so it can be calibrated
+  // before a run (updated formula from newPH.cpp)
+  uint16_t burst[PH_BURST];
+  int n = halAdcReadBurst(SENSOR_PIN, burst, PH_BURST);
+  if (n > 0) {
+    probeVoltage = voltageMedian.update(trimmedMean(burst, n, n / 4) * 3.3 / 1024.0);
+    currentPH = (linearCoefficients[0] * probeVoltage) + linearCoefficients[1];
+  }
+
+  // pump decision and calibration at the old 100 ms cadence
+  bool decide = false;
+  if (voltageMedian.size() > 0 && ++pHStep >= PH_DECISION_STEPS) {
+    pHStep = 0;
+    decide = true;
+    if (phCalibration.state() == PH_CAL_STABILISING) stepCalibration();
+  }
+
   // Safety Check: If system is not active, force pumps off and exit
   if (!is_system_active) {
-    digitalWrite(ACID_PIN, LOW);
-    digitalWrite(ALKALI_PIN, LOW);
-    acid_on = false;
-    alkali_on = false;
+    pumpTimeline.cancel(PUMP_ALL, halMillis());
+    auto_acid = false;
+    auto_alkali = false;
+    applyPumpOutputs();
     return;
   }
 
-  if (doneCalibrating == 1) {
-    // Check for serial input to change target pH (from newPH.cpp)
-    if (Serial.available()) {
-      String userInput = Serial.readStringUntil('\n');
-      userInput.trim();
+  // End expired manual pulses and start queued ones (every call, 10 ms resolution)
+  applyPumpOutputs();
 
-      if (userInput.length() > 0) {
-        targetPH = userInput.toFloat();
-        Serial.println("Input received, changing pH");
-      }
-    }
-    
-    // read voltage and convert to pH (updated formula from newPH.cpp)
-    float voltage = analogRead(SENSOR_PIN) * 3.3 / 1024.0;
-    float pHValue = (linearCoefficients[0] * voltage) + linearCoefficients[1];
-    pHArray[pHArrayIndex++] = pHValue;
-
-    // once buffer full, calculate average
-    if (pHArrayIndex >= ARRAY_LENGTH) {
-      currentPH = get_average(pHArray, ARRAY_LENGTH);
-      pHArrayIndex = 0;
-
-      // bang-bang control
-      acid_on = false;
-      alkali_on = false;
-
-      // Safety check: only activate pumps if targetPH is set (from newPH.cpp)
-      if (targetPH != 0.0) {
-        if (currentPH > (targetPH + tolerance)) {
-          // pH too high, add acid
-          digitalWrite(ACID_PIN, HIGH);
-          digitalWrite(ALKALI_PIN, LOW);
-          acid_on = true;
-        } else if (currentPH < (targetPH - tolerance)) {
-          // pH too low, add alkali
-          digitalWrite(ACID_PIN, LOW);
-          digitalWrite(ALKALI_PIN, HIGH);
-          alkali_on = true;
-        } else {
-          // pH within tolerance, turn off both pumps
-          digitalWrite(ACID_PIN, LOW);
-          digitalWrite(ALKALI_PIN, LOW);
-        }
-      } else {
-        // No target set, ensure both pumps are off
-        digitalWrite(ACID_PIN, LOW);
-        digitalWrite(ALKALI_PIN, LOW);
-      }
+  // Check for serial input to change target pH (from newPH.cpp)
+  char userInput[16];
+  if (halConsoleReadLine(userInput, sizeof(userInput))) {
+    targetPH = atof(userInput);
+    halLog("Input received, changing pH\n");
+  }
 
-      // Time tracking relative to calibration (from newPH.cpp)
-      timeMS = millis() - timeAfterCalibration;
-      if (timeMS - t1 > 0) {
-        t1 = t1 + 1000;
-        Serial.print("time: ");
-        Serial.print(t1 / 1000);
-        Serial.print(" | ");
-        Serial.print("current pH: ");
-        Serial.print(currentPH);
-        Serial.print(" | ");
-        Serial.print("set pH: ");
-        Serial.print(targetPH);
-        Serial.print(" | ");
-        Serial.print("alkali: ");
-        Serial.print(alkali_on);
-        Serial.print(" | ");
-        Serial.print("acid: ");
-        Serial.print(acid_on);
-        Serial.println();
+  if (decide) {
+    // bang-bang control
+    auto_acid = false;
+    auto_alkali = false;
+
+    // Safety check: only activate pumps if targetPH is set (from newPH.cpp),
+    // and not while the probe is out for calibration
+    if (targetPH != 0.0 && !phCalibration.active()) {
+      if (currentPH > (targetPH + tolerance)) {
+        // pH too high, add acid
+        auto_acid = true;
+      } else if (currentPH < (targetPH - tolerance)) {
+        // pH too low, add alkali
+        auto_alkali = true;
       }
+      // Otherwise pH within tolerance, both pumps stay off
+    }
+    applyPumpOutputs();
+
+    // Time tracking relative to calibration (from newPH.cpp)
+    timeMS = halMillis() - timeAfterCalibration;
+    if (timeMS - t1 > 0) {
+      t1 = t1 + 1000;
+      halLog("time: %ld | current pH: %.2f | set pH: %.2f | alkali: %d | acid: %d\n",
+             t1 / 1000, currentPH, targetPH, alkali_on, acid_on);
     }
-
-    delay(1);  // Reduced delay from newPH.cpp (was 100ms)
   }
 }
 
@@ -270,51 +191,163 @@ void getPHStatus(JsonObject& doc) {
   doc["target_pH"] = targetPH;
   doc["acid_pump"] = acid_on;
   doc["base_pump"] = alkali_on;
+  static const char* CAL_STATE_NAMES[] = {"idle", "ready", "stabilising"};
+  doc["ph_calibration"] = CAL_STATE_NAMES[phCalibration.state()];
 }
 
-void handlePHCommand(PubSubClient& client, char* topic, byte* payload, unsigned int length) {
-  StaticJsonDocument<200> doc;
-  deserializeJson(doc, payload, length);
-
-  // Expected RPC: {"method": "setPump", "params": {"pump": "acid", "duration": 500}}
-  
-  JsonObject params = doc["params"];
-  const char* pump = params["pump"];     
-  int duration = params["duration"] | 750; 
-
-  // Get request ID from topic
-  String topicStr = String(topic);
-  String requestId = topicStr.substring(topicStr.lastIndexOf('/') + 1);
-
-  if (pump) { 
-    if (strcmp(pump, "acid") == 0) {
-      pulsePump(ACID_PIN, duration);
-    } else if (strcmp(pump, "base") == 0) {
-      pulsePump(ALKALI_PIN, duration);
-    }
-    
-    char responseTopic[100];
-    sprintf(responseTopic, "v1/devices/me/rpc/response/%s", requestId.c_str());
-    String responsePayload = "{\"status\": \"ok\", \"pump\": \"" + String(pump) + "\"}";
-    client.publish(responseTopic, responsePayload.c_str());
-    
+void getPHSample(TelemetrySample& sample) {
+  sample.phMilli = telemetryFixed(currentPH, 1000);
+  sample.phSetMilli = telemetryFixed(targetPH, 1000);
+  if (acid_on) sample.flags |= TELEMETRY_FLAG_ACID;
+  if (alkali_on) sample.flags |= TELEMETRY_FLAG_BASE;
+}
+
+// --- RPC methods ---
+// Responses are sent as soon as the request is accepted; the pulse itself
+// runs in the background (see applyPumpOutputs()).
+
+static bool parsePump(const char* pump, bool allowAll, Pump& which) {
+  if (!pump) return false;
+  if (strcmp(pump, "acid") == 0) {
+    which = PUMP_ACID;
+  } else if (strcmp(pump, "base") == 0) {
+    which = PUMP_BASE;
+  } else if (allowAll && strcmp(pump, "all") == 0) {
+    which = PUMP_ALL;
   } else {
-    Serial.println("RPC Error: 'pump' parameter missing.");
-    char responseTopic[100];
-    sprintf(responseTopic, "v1/devices/me/rpc/response/%s", requestId.c_str());
-    client.publish(responseTopic, "{\"error\": \"Invalid parameters\"}");
+    return false;
   }
+  return true;
 }
 
-void handlePHAttributes(JsonObject& doc) {
-  if (doc.containsKey("target_pH")) {
-    targetPH = doc["target_pH"];
-    Serial.print("Updated targetPH: ");
-    Serial.println(targetPH);
+// {"method": "setPump", "params": {"pump": "acid" | "base", "duration": 500}}
+void rpcSetPump(RpcContext& rpc, JsonVariant params) {
+  const char* pump = params["pump"];
+  int duration = params["duration"] | 750;
+
+  Pump which;
+  if (!parsePump(pump, false, which)) {
+    halLog("RPC Error: 'pump' parameter missing.\n");
+    rpc.error("Invalid parameters");
+    return;
   }
-  if (doc.containsKey("pH_tolerance")) {
-    tolerance = doc["pH_tolerance"];
-    Serial.print("Updated pH tolerance: ");
-    Serial.println(tolerance);
+  if (duration <= 0 || duration > (int)MAX_PULSE_MS || !is_system_active) {
+    rpc.error("Invalid parameters");
+    return;
+  }
+  if (phCalibration.active()) {
+    rpc.error("Calibration in progress"); // The probe is out of the vessel
+    return;
   }
-}
\ No newline at end of file
+
+  PulseResult result = pumpTimeline.request(which, (uint32_t)duration, halMillis());
+  applyPumpOutputs();
+
+  static const char* RESULT_NAMES[] = {"started", "merged", "queued", "rejected"};
+  halLog("Manual Pulse: %s for %d ms (%s)\n", pump, duration, RESULT_NAMES[result]);
+
+  if (result == PULSE_REJECTED) {
+    rpc.replyf("{\"error\": \"Pump queue full\", \"pump\": \"%s\"}", pump);
+  } else {
+    rpc.replyf("{\"status\": \"ok\", \"pump\": \"%s\", \"pulse\": \"%s\", \"pending_ms\": %lu}",
+               pump, RESULT_NAMES[result], (unsigned long)pumpTimeline.pendingMs(which, halMillis()));
+  }
+}
+
+// {"method": "cancelPump", "params": {"pump": "acid" | "base" | "all"}}
+void rpcCancelPump(RpcContext& rpc, JsonVariant params) {
+  const char* pump = params["pump"];
+
+  Pump which;
+  if (!parsePump(pump, true, which)) {
+    halLog("RPC Error: 'pump' parameter missing.\n");
+    rpc.error("Invalid parameters");
+    return;
+  }
+
+  int removed = pumpTimeline.cancel(which, halMillis());
+  applyPumpOutputs();
+  halLog("Manual Pulse: cancel %s (%d removed)\n", pump, removed);
+  rpc.replyf("{\"status\": \"ok\", \"pump\": \"%s\", \"cancelled\": %d}", pump, removed);
+}
+
+// {"method": "calibratePH", "params": {"action": "start" | "point" | "finish" | "cancel", "pH": 4.0}}
+// "point" (with the buffer's pH) after the probe is in the buffer; the point
+// is reported as client attributes once captured.
+void rpcCalibratePH(RpcContext& rpc, JsonVariant params) {
+  const char* action = params["action"];
+  if (!action) {
+    rpc.error("Invalid parameters");
+    return;
+  }
+
+  if (strcmp(action, "start") == 0) {
+    float slope = fabsf(linearCoefficients[0]);
+    PhCalConfig config;
+    config.sampleMs = PH_DECISION_STEPS * 10; // 10 ms steps
+    config.maxDriftVPerS = PH_CAL_MAX_DRIFT_PH_PER_MIN / 60 / slope;
+    config.maxNoiseV = PH_CAL_MAX_NOISE_PH / slope;
+    config.timeoutMs = PH_CAL_TIMEOUT_MS;
+    phCalibration.start(config);
+    pumpTimeline.cancel(PUMP_ALL, halMillis());
+    auto_acid = false;
+    auto_alkali = false;
+    applyPumpOutputs();
+    calReportPending = false;
+    halLog("pH calibration: started, pumps off\n");
+    rpc.reply("{\"status\": \"ok\", \"state\": \"ready\"}");
+  } else if (strcmp(action, "point") == 0) {
+    float bufferPH = params["pH"] | -1.0f;
+    if (bufferPH < 0 || bufferPH > 14) {
+      rpc.error("Invalid parameters");
+      return;
+    }
+    if (!phCalibration.beginPoint(bufferPH, halMillis())) {
+      rpc.error(phCalibration.state() == PH_CAL_IDLE ? "No calibration session"
+                : phCalibration.state() == PH_CAL_STABILISING ? "Point in progress"
+                : "Too many points");
+      return;
+    }
+    halLog("pH calibration: point %d, buffer pH %.2f\n", phCalibration.pointCount() + 1, bufferPH);
+    rpc.replyf("{\"status\": \"ok\", \"state\": \"stabilising\", \"point\": %d}",
+               phCalibration.pointCount() + 1);
+  } else if (strcmp(action, "finish") == 0) {
+    PhCalFit fit;
+    if (!phCalibration.finish(fit)) {
+      rpc.error(phCalibration.state() == PH_CAL_IDLE ? "No calibration session"
+                : phCalibration.state() == PH_CAL_STABILISING ? "Point in progress"
+                : "Need two distinct points");
+      return;
+    }
+    linearCoefficients[0] = fit.slope;
+    linearCoefficients[1] = fit.offset;
+    halLog("pH calibration: slope %.4f offset %.4f (RMS %.3f pH)\n", fit.slope, fit.offset, fit.rmsPH);
+    rpc.replyf("{\"status\": \"ok\", \"slope\": %.5f, \"offset\": %.5f, \"rms_pH\": %.4f}",
+               fit.slope, fit.offset, fit.rmsPH);
+  } else if (strcmp(action, "cancel") == 0) {
+    phCalibration.cancel();
+    halLog("pH calibration: cancelled\n");
+    rpc.reply("{\"status\": \"ok\", \"state\": \"idle\"}");
+  } else {
+    rpc.error("Invalid parameters");
+  }
+}
+
+bool takePHCalibrationReport(char* payload, size_t size) {
+  if (!calReportPending) return false;
+  calReportPending = false;
+  snprintf(payload, size, "%s", calReport);
+  return true;
+}
+
+// --- Shared attributes ---
+
+void onTargetPH(JsonVariant value) {
+  targetPH = value;
+  halLog("Updated targetPH: %.2f\n", targetPH);
+}
+
+void onPHTolerance(JsonVariant value) {
+  tolerance = value;
+  halLog("Updated pH tolerance: %.2f\n", tolerance);
+}
@@ -1,13 +1,16 @@
 #ifndef PHSUBSYSTEM_HPP
 #define PHSUBSYSTEM_HPP
 
-// We need PubSubClient to be able to publish
-#include <PubSubClient.h>
+#include "Hal.hpp"
+#include "TelemetryFrame.hpp"
+#include "Dispatch.hpp"
 #include <ArduinoJson.h>
 
 // --- Global State ---
 extern bool is_system_active;
 
+const float PH_TOLERANCE_DEFAULT = 0.4; // Until pH_tolerance is set
+
 // --- Function Declarations ---
 
 /**
@@ -22,24 +25,56 @@ void setupPH();
 void executePH();
 
 /**
- * @brief Populates the passed JSON object with the current pH status.
+ * @brief Populates the passed JSON object with the current pH status and the
+ * calibration state (ph_calibration: "idle", "ready" or "stabilising").
  * @param doc The JsonObject to populate.
  */
 void getPHStatus(JsonObject& doc);
 
 /**
- * @brief Handles incoming MQTT messages (RPC commands).
- * @param client The PubSubClient instance.
- * @param topic The message topic.
- * @param payload The raw message payload.
- * @param length The length of the payload.
+ * @brief Fills the pH reading, target and pump flags of a telemetry sample.
+ * @param sample The sample to populate.
  */
-void handlePHCommand(PubSubClient& client, char* topic, byte* payload, unsigned int length);
+void getPHSample(TelemetrySample& sample);
+
+// --- Shared attributes and RPC methods (dispatched by ControlLoop.cpp) ---
+void onTargetPH(JsonVariant value);
+void onPHTolerance(JsonVariant value);
 
 /**
- * @brief Handles incoming Shared Attribute updates.
- * @param doc The JsonObject containing the attributes.
+ * @brief Queues a manual pulse behind any running one and replies with the
+ * outcome (started, merged, queued or rejected) and the pending time.
  */
-void handlePHAttributes(JsonObject& doc);
+void rpcSetPump(RpcContext& rpc, JsonVariant params);
+
+/**
+ * @brief Stops the running pulse and drops the queued ones of a pump ("all": both).
+ */
+void rpcCancelPump(RpcContext& rpc, JsonVariant params);
+
+/**
+ * @brief Runs a calibration session: "start", then "point" with the pH of
+ * each buffer the probe is put in, then "finish" to fit and apply the
+ * coefficients (or "cancel"). Never blocks; points are captured in executePH().
+ */
+void rpcCalibratePH(RpcContext& rpc, JsonVariant params);
+
+/**
+ * @brief The client attributes reporting the last captured (or timed-out)
+ * calibration point, once.
+ * @return false if there is nothing new to report.
+ */
+bool takePHCalibrationReport(char* payload, size_t size);
+
+constexpr AttributeEntry PH_ATTRIBUTES[] = {
+  {"target_pH", onTargetPH},
+  {"pH_tolerance", onPHTolerance},
+};
+
+constexpr RpcEntry PH_RPCS[] = {
+  {"setPump", rpcSetPump},
+  {"cancelPump", rpcCancelPump},
+  {"calibratePH", rpcCalibratePH},
+};
 
-#endif // PHSUBSYSTEM_HPP
\ No newline at end of file
+#endif // PHSUBSYSTEM_HPP
@@ -0,0 +1,154 @@
+#include "PhCalibration.hpp"
+#include <math.h>
+
+// Floor on a point's standard error, so one very quiet point cannot take
+// all the weight (about a tenth of an ADC step after burst averaging)
+static const float MIN_STD_ERR_V = 0.0003f;
+
+PhCalibration::PhCalibration()
+    : config_(), state_(PH_CAL_IDLE), count_(0), pendingPH_(0), pointStartMs_(0), head_(0),
+      filled_(0), drift_(0), noise_(0) {
+}
+
+void PhCalibration::start(const PhCalConfig& config) {
+  config_ = config;
+  state_ = PH_CAL_READY;
+  count_ = 0;
+}
+
+bool PhCalibration::beginPoint(float bufferPH, uint32_t nowMs) {
+  if (state_ != PH_CAL_READY || count_ >= PH_CAL_MAX_POINTS) {
+    return false;
+  }
+  state_ = PH_CAL_STABILISING;
+  pendingPH_ = bufferPH;
+  pointStartMs_ = nowMs;
+  head_ = 0;
+  filled_ = 0;
+  drift_ = 0;
+  noise_ = 0;
+  return true;
+}
+
+PhCalEvent PhCalibration::update(float voltage, uint32_t nowMs) {
+  if (state_ != PH_CAL_STABILISING) {
+    return PH_CAL_NO_EVENT;
+  }
+
+  window_[head_] = voltage;
+  head_ = (head_ + 1) % PH_CAL_WINDOW;
+  if (filled_ < PH_CAL_WINDOW) filled_++;
+
+  PhCalPoint point;
+  if (filled_ == PH_CAL_WINDOW && judgeWindow(point)) {
+    point.bufferPH = pendingPH_;
+    point.settleMs = nowMs - pointStartMs_;
+    points_[count_++] = point;
+    state_ = PH_CAL_READY;
+    return PH_CAL_CAPTURED;
+  }
+
+  if (nowMs - pointStartMs_ > config_.timeoutMs) {
+    state_ = PH_CAL_READY;
+    return PH_CAL_TIMEOUT;
+  }
+  return PH_CAL_NO_EVENT;
+}
+
+// Fits v = a + b t over the window (t in seconds, oldest sample first) and
+// accepts it if both the slope and the scatter are small. The captured
+// voltage is the fit at the newest sample, which lags a settling probe less
+// than the window mean.
+bool PhCalibration::judgeWindow(PhCalPoint& point) {
+  const int n = PH_CAL_WINDOW;
+  const float dt = config_.sampleMs * 1e-3f;
+
+  // Sums relative to the first sample keep float precision
+  float v0 = window_[head_];
+  float sumV = 0, sumTV = 0;
+  for (int i = 0; i < n; i++) {
+    float v = window_[(head_ + i) % n] - v0;
+    float t = i * dt;
+    sumV += v;
+    sumTV += t * v;
+  }
+  float tMean = (n - 1) * dt / 2;
+  float sxx = dt * dt * (float)n * ((float)n * n - 1) / 12; // sum (t - tMean)^2
+  float vMean = sumV / n;
+  float slope = (sumTV - n * tMean * vMean) / sxx;
+
+  float sse = 0;
+  for (int i = 0; i < n; i++) {
+    float residual = window_[(head_ + i) % n] - v0 - (vMean + slope * (i * dt - tMean));
+    sse += residual * residual;
+  }
+  drift_ = slope;
+  noise_ = sqrtf(sse / (n - 2));
+
+  if (fabsf(drift_) > config_.maxDriftVPerS || noise_ > config_.maxNoiseV) {
+    return false;
+  }
+
+  float tEnd = (n - 1) * dt;
+  point.voltage = v0 + vMean + slope * (tEnd - tMean);
+  point.stdErrV = noise_ * sqrtf(1.0f / n + (tEnd - tMean) * (tEnd - tMean) / sxx);
+  return true;
+}
+
+bool PhCalibration::finish(PhCalFit& fit) {
+  if (state_ != PH_CAL_READY || count_ < 2) {
+    return false;
+  }
+
+  float x[PH_CAL_MAX_POINTS], y[PH_CAL_MAX_POINTS], w[PH_CAL_MAX_POINTS];
+  for (int i = 0; i < count_; i++) {
+    float err = points_[i].stdErrV > MIN_STD_ERR_V ? points_[i].stdErrV : MIN_STD_ERR_V;
+    x[i] = points_[i].voltage;
+    y[i] = points_[i].bufferPH;
+    w[i] = 1.0f / (err * err);
+  }
+  if (!weightedLinReg(x, y, w, count_, fit.slope, fit.offset)) {
+    return false;
+  }
+
+  float sumW = 0, sumWR2 = 0;
+  for (int i = 0; i < count_; i++) {
+    float residual = y[i] - (fit.slope * x[i] + fit.offset);
+    sumW += w[i];
+    sumWR2 += w[i] * residual * residual;
+  }
+  fit.rmsPH = sqrtf(sumWR2 / sumW);
+  state_ = PH_CAL_IDLE;
+  return true;
+}
+
+void PhCalibration::cancel() {
+  state_ = PH_CAL_IDLE;
+  count_ = 0;
+}
+
+bool weightedLinReg(const float* x, const float* y, const float* w, int n, float& slope, float& offset) {
+  float sumW = 0, sumWX = 0, sumWY = 0;
+  for (int i = 0; i < n; i++) {
+    sumW += w[i];
+    sumWX += w[i] * x[i];
+    sumWY += w[i] * y[i];
+  }
+  if (sumW <= 0) return false;
+  float xMean = sumWX / sumW;
+  float yMean = sumWY / sumW;
+
+  // Centred sums: no cancellation between large terms
+  float sxx = 0, sxy = 0;
+  for (int i = 0; i < n; i++) {
+    float dx = x[i] - xMean;
+    sxx += w[i] * dx * dx;
+    sxy += w[i] * dx * (y[i] - yMean);
+  }
+  // Reject points closer together than ~1 mV (weighted RMS spread)
+  if (sxx <= sumW * 1e-6f) return false;
+
+  slope = sxy / sxx;
+  offset = yMean - slope * xMean;
+  return true;
+}
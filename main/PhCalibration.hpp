@@ -0,0 +1,117 @@
+#ifndef PHCALIBRATION_HPP
+#define PHCALIBRATION_HPP
+
+#include <stdint.h>
+
+// Non-blocking N-point calibration of the pH probe.
+// The operator puts the probe in a buffer and names its pH (beginPoint()).
+// update() is fed the filtered probe voltage from the control loop, and the
+// point is captured as soon as the signal has stabilised: over the last
+// PH_CAL_WINDOW samples, the fitted drift and the scatter around that fit are
+// both under the configured limits. There is no fixed wait, and nothing
+// blocks. finish() fits pH = slope * voltage + offset through the captured
+// points by weighted least squares. Each point is weighted by the inverse
+// variance of its voltage estimate. Plain C++ (time is passed in), host-buildable.
+
+const int PH_CAL_MAX_POINTS = 5;
+const int PH_CAL_WINDOW = 100; // Samples judged for stability (10 s at 100 ms)
+
+enum PhCalState : uint8_t {
+  PH_CAL_IDLE,        // No session
+  PH_CAL_READY,       // Session open, waiting for the next buffer
+  PH_CAL_STABILISING, // Probe in a buffer, waiting for a stable signal
+};
+
+enum PhCalEvent : uint8_t {
+  PH_CAL_NO_EVENT,
+  PH_CAL_CAPTURED, // A point was captured; back to READY
+  PH_CAL_TIMEOUT,  // The signal did not settle in time; the point is dropped
+};
+
+struct PhCalConfig {
+  uint32_t sampleMs;   // Interval between update() calls
+  float maxDriftVPerS; // Fitted slope over the window
+  float maxNoiseV;     // RMS residual around the fitted line
+  uint32_t timeoutMs;  // Per point
+};
+
+struct PhCalPoint {
+  float bufferPH;
+  float voltage;  // At the end of the stable window
+  float stdErrV;  // Standard error of voltage
+  uint32_t settleMs; // From beginPoint() to capture
+};
+
+struct PhCalFit {
+  float slope;  // pH per volt
+  float offset; // pH
+  float rmsPH;  // Weighted RMS residual of the points
+};
+
+class PhCalibration {
+public:
+  PhCalibration();
+
+  /**
+   * @brief Opens a session, dropping any captured points.
+   */
+  void start(const PhCalConfig& config);
+
+  /**
+   * @brief Starts stabilising on a buffer.
+   * @return false unless READY with room for another point.
+   */
+  bool beginPoint(float bufferPH, uint32_t nowMs);
+
+  /**
+   * @brief Feeds one filtered voltage while STABILISING; ignored otherwise.
+   */
+  PhCalEvent update(float voltage, uint32_t nowMs);
+
+  /**
+   * @brief Fits the captured points and closes the session.
+   * @return false (and the session stays open) with fewer than two points,
+   * while stabilising, or if the points do not span a range of voltages.
+   */
+  bool finish(PhCalFit& fit);
+
+  /**
+   * @brief Closes the session without a fit.
+   */
+  void cancel();
+
+  PhCalState state() const { return state_; }
+  bool active() const { return state_ != PH_CAL_IDLE; }
+  int pointCount() const { return count_; }
+  const PhCalPoint& point(int i) const { return points_[i]; }
+
+  /**
+   * @brief Drift and noise over the current window (valid once it is full).
+   */
+  float driftVPerS() const { return drift_; }
+  float noiseV() const { return noise_; }
+
+private:
+  bool judgeWindow(PhCalPoint& point);
+
+  PhCalConfig config_;
+  PhCalState state_;
+  PhCalPoint points_[PH_CAL_MAX_POINTS];
+  int count_;
+
+  float pendingPH_;
+  uint32_t pointStartMs_;
+  float window_[PH_CAL_WINDOW];
+  int head_;
+  int filled_;
+  float drift_;
+  float noise_;
+};
+
+/**
+ * @brief Weighted least-squares line y = slope * x + offset.
+ * @return false if the weighted x values have no spread.
+ */
+bool weightedLinReg(const float* x, const float* y, const float* w, int n, float& slope, float& offset);
+
+#endif // PHCALIBRATION_HPP
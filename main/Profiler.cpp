@@ -0,0 +1,117 @@
+#include "Profiler.hpp"
+
+#if PROFILING
+
+#include <stdio.h>
+#include <string.h>
+
+volatile uint32_t profileCounters[PROFILE_COUNTER_COUNT];
+
+static const char* const SECTION_NAMES[PROFILE_SECTION_COUNT] = {
+  "ph",
+  "stirring",
+  "heating",
+  "anomaly",
+  "inbox",
+  "mqtt_loop",
+  "serialize",
+  "stirring_late",
+  "heating_late",
+};
+
+static ProfileStats sections[PROFILE_SECTION_COUNT];
+static uint32_t counterBase[PROFILE_COUNTER_COUNT];
+static uint32_t cyclesPerUs = 0; // Cached halCyclesPerUs()
+
+static inline uint32_t ticksPerUs() {
+  if (cyclesPerUs == 0) cyclesPerUs = halCyclesPerUs();
+  return cyclesPerUs;
+}
+
+static inline int bucketOf(uint32_t cycles) {
+  uint32_t us = cycles / ticksPerUs();
+  if (us == 0) return 0;
+  int bucket = 32 - __builtin_clz(us);
+  return bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1;
+}
+
+void profileRecordCycles(ProfileSection section, uint32_t cycles) {
+  ProfileStats& s = sections[section];
+  if (s.count == 0 || cycles < s.minCycles) s.minCycles = cycles;
+  if (cycles > s.maxCycles) s.maxCycles = cycles;
+  s.count++;
+  s.totalCycles += cycles;
+  s.histogram[bucketOf(cycles)]++;
+}
+
+void profileRecordUs(ProfileSection section, uint32_t us) {
+  uint64_t cycles = (uint64_t)us * ticksPerUs();
+  profileRecordCycles(section, cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles);
+}
+
+const ProfileStats& profileStats(ProfileSection section) {
+  return sections[section];
+}
+
+const char* profileSectionName(ProfileSection section) {
+  return section < PROFILE_SECTION_COUNT ? SECTION_NAMES[section] : "unknown";
+}
+
+uint32_t profileCounterDelta(ProfileCounter counter) {
+  return profileCounters[counter] - counterBase[counter];
+}
+
+void profileReset() {
+  memset(sections, 0, sizeof(sections));
+  for (int i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+    counterBase[i] = profileCounters[i];
+  }
+}
+
+size_t profileReport(char* out, size_t size, uint32_t periodMs) {
+  int n = snprintf(out, size,
+                   "{\"diag\": {\"period_s\": %lu, \"heap_free\": %lu, \"heap_min\": %lu, "
+                   "\"isr\": {\"hall\": %lu, \"capture\": %lu}",
+                   (unsigned long)(periodMs / 1000), (unsigned long)halFreeHeap(),
+                   (unsigned long)halMinFreeHeap(),
+                   (unsigned long)profileCounterDelta(PROFILE_ISR_HALL),
+                   (unsigned long)profileCounterDelta(PROFILE_ISR_CAPTURE));
+  if (n < 0 || (size_t)n + 3 > size) {
+    profileReset();
+    return 0;
+  }
+  size_t length = (size_t)n;
+  const float usPerCycle = 1.0f / ticksPerUs();
+
+  for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+    const ProfileStats& s = sections[i];
+    if (s.count == 0) continue;
+
+    int last = PROFILE_BUCKETS - 1;
+    while (last > 0 && s.histogram[last] == 0) last--;
+
+    char entry[256];
+    int e = snprintf(entry, sizeof(entry),
+                     ", \"%s\": {\"n\": %lu, \"min_us\": %.1f, \"mean_us\": %.1f, \"max_us\": %.1f, \"hist\": [",
+                     SECTION_NAMES[i], (unsigned long)s.count, s.minCycles * usPerCycle,
+                     (float)s.totalCycles / s.count * usPerCycle, s.maxCycles * usPerCycle);
+    for (int b = 0; b <= last && e > 0 && (size_t)e < sizeof(entry); b++) {
+      e += snprintf(entry + e, sizeof(entry) - e, b ? ", %lu" : "%lu", (unsigned long)s.histogram[b]);
+    }
+    if (e > 0 && (size_t)e < sizeof(entry)) {
+      e += snprintf(entry + e, sizeof(entry) - e, "]}");
+    }
+
+    // Keep room for the closing braces
+    if (e <= 0 || (size_t)e >= sizeof(entry) || length + e + 3 > size) continue;
+    memcpy(out + length, entry, e);
+    length += e;
+  }
+
+  memcpy(out + length, "}}", 3);
+  length += 2;
+  profileReset();
+  return length;
+}
+
+#endif // PROFILING
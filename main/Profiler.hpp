@@ -0,0 +1,116 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "Hal.hpp"
+#include <stddef.h>
+#include <stdint.h>
+
+// Hot-path instrumentation in fixed memory.
+// PROFILE_SCOPE(section) times the rest of the enclosing block with
+// halCycles() (the CPU cycle counter on the ESP32, the steady clock on
+// Linux) and adds it to the section's count, min, max, total and log2
+// histogram. PROFILE_US() records a duration measured elsewhere, such as
+// task lateness from the scheduler. PROFILE_COUNT() counts an event, and is
+// safe in an ISR. Sections and counters are fixed enums, so recording is an
+// array update with no lookup and no allocation.
+//
+// Each section must be recorded from one core. profileReport() reads and
+// resets from the control side, so a section recorded on the network core
+// may lose the sample in flight at the reset.
+//
+// With PROFILING 0 the macros expand to nothing and the profiler is not compiled.
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+enum ProfileSection : uint8_t {
+  PROFILE_PH,            // executePH()
+  PROFILE_STIRRING,      // executeStirring()
+  PROFILE_HEATING,       // executeHeating()
+  PROFILE_ANOMALY,       // executeAnomaly()
+  PROFILE_INBOX,         // processInbox()
+  PROFILE_MQTT_LOOP,     // client.loop() (network core)
+  PROFILE_SERIALIZE,     // serializeJson() of the status message
+  PROFILE_STIRRING_LATE, // Start of the 10 ms stirring task after its release
+  PROFILE_HEATING_LATE,  // Start of the 100 ms heating task after its release
+  PROFILE_SECTION_COUNT
+};
+
+enum ProfileCounter : uint8_t {
+  PROFILE_ISR_HALL,    // Tsense() calls
+  PROFILE_ISR_CAPTURE, // Pulse capture interrupts
+  PROFILE_COUNTER_COUNT
+};
+
+// Bucket 0: under 1 us; bucket k: [2^(k-1), 2^k) us; the last is open-ended
+const int PROFILE_BUCKETS = 16;
+
+struct ProfileStats {
+  uint32_t count;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+  uint32_t histogram[PROFILE_BUCKETS];
+};
+
+#if PROFILING
+
+extern volatile uint32_t profileCounters[PROFILE_COUNTER_COUNT];
+
+void profileRecordCycles(ProfileSection section, uint32_t cycles);
+void profileRecordUs(ProfileSection section, uint32_t us);
+
+const ProfileStats& profileStats(ProfileSection section);
+const char* profileSectionName(ProfileSection section);
+
+/**
+ * @brief Counts of every counter since the last report (or reset).
+ */
+uint32_t profileCounterDelta(ProfileCounter counter);
+
+/**
+ * @brief Writes the diagnostics telemetry message and starts a new window:
+ * {"diag": {"period_s": .., "heap_free": .., "heap_min": .., "isr": {..},
+ *  "<section>": {"n": .., "min_us": .., "mean_us": .., "max_us": .., "hist": [..]}, ..}}
+ * Sections with no samples are left out, and so are sections that would
+ * not fit in size.
+ * @return Length written (excluding the NUL), 0 if size is too small.
+ */
+size_t profileReport(char* out, size_t size, uint32_t periodMs);
+
+/**
+ * @brief Clears all sections and rebases the counters.
+ */
+void profileReset();
+
+/**
+ * @brief Times its own lifetime into a section.
+ */
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfileSection section) : section_(section), start_(halCycles()) {}
+  ~ProfileScope() { profileRecordCycles(section_, halCycles() - start_); }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  ProfileSection section_;
+  uint32_t start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(section) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(section)
+#define PROFILE_US(section, us) profileRecordUs(section, us)
+#define PROFILE_COUNT(counter) (profileCounters[counter] = profileCounters[counter] + 1)
+
+#else
+
+#define PROFILE_SCOPE(section) do {} while (0)
+#define PROFILE_US(section, us) do {} while (0)
+#define PROFILE_COUNT(counter) do {} while (0)
+
+#endif // PROFILING
+
+#endif // PROFILER_HPP
@@ -0,0 +1,23 @@
+#ifndef PULSERATE_HPP
+#define PULSERATE_HPP
+
+#include "Hal.hpp"
+#include <stdint.h>
+
+/**
+ * @brief Speed from a pulse capture snapshot (halPulseCaptureRead()): the
+ * span between the last two captures covers edgesPerCapture pulse periods.
+ * @param capture Snapshot of the captured pin.
+ * @param nowUs halMicros() now.
+ * @param edgesPerCapture The value passed to halPulseCaptureStart().
+ * @param pulsesPerRev Pulses per revolution of the shaft.
+ * @param timeoutUs Reads 0 if the last capture is older than this (stopped).
+ * @return Revolutions per minute, or 0 before the second capture or after the timeout.
+ */
+inline float captureRpm(const HalPulseCapture& capture, uint32_t nowUs, uint16_t edgesPerCapture,
+                        float pulsesPerRev, uint32_t timeoutUs) {
+  if (capture.spanNs == 0 || (int32_t)(nowUs - capture.lastUs) > (int32_t)timeoutUs) return 0;
+  return edgesPerCapture * (60.0 / pulsesPerRev) * 1e9 / (float)capture.spanNs;
+}
+
+#endif // PULSERATE_HPP
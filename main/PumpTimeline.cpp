@@ -0,0 +1,123 @@
+#include "PumpTimeline.hpp"
+
+// Signed difference of two wrapping millisecond timestamps (a - b)
+static inline int32_t elapsed(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b);
+}
+
+PumpTimeline::PumpTimeline() : running_(false), active_(PUMP_ACID), activeEnd_(0), size_(0) {
+}
+
+PulseResult PumpTimeline::request(Pump pump, uint32_t durationMs, uint32_t nowMs) {
+  if ((pump != PUMP_ACID && pump != PUMP_BASE) || durationMs == 0 || durationMs > MAX_PULSE_MS) {
+    return PULSE_REJECTED;
+  }
+
+  step(nowMs);
+
+  // Idle: start straight away
+  if (!running_) {
+    running_ = true;
+    active_ = pump;
+    activeEnd_ = nowMs + durationMs;
+    return PULSE_STARTED;
+  }
+
+  // Same pump is last in line: merge into that pulse. What does not fit
+  // under MAX_PULSE_MS follows it as a pulse of its own.
+  if (size_ > 0 ? queue_[size_ - 1].pump == pump : active_ == pump) {
+    int last = size_ - 1; // -1: the running pulse
+    uint32_t lastMs = last >= 0 ? queue_[last].durationMs : (uint32_t)elapsed(activeEnd_, nowMs);
+    uint32_t overflowMs = lastMs + durationMs > MAX_PULSE_MS ? lastMs + durationMs - MAX_PULSE_MS : 0;
+    if (overflowMs > 0) {
+      if (size_ >= PULSE_QUEUE_LENGTH) {
+        return PULSE_REJECTED;
+      }
+      queue_[size_].pump = pump;
+      queue_[size_].durationMs = overflowMs;
+      size_++;
+    }
+    if (last >= 0) {
+      queue_[last].durationMs += durationMs - overflowMs;
+    } else {
+      activeEnd_ += durationMs - overflowMs;
+    }
+    return PULSE_MERGED;
+  }
+
+  // Opposite pump is running or queued: wait for it
+  if (size_ >= PULSE_QUEUE_LENGTH) {
+    return PULSE_REJECTED;
+  }
+  queue_[size_].pump = pump;
+  queue_[size_].durationMs = durationMs;
+  size_++;
+  return PULSE_QUEUED;
+}
+
+int PumpTimeline::cancel(Pump pump, uint32_t nowMs) {
+  int removed = 0;
+
+  // Drop matching queued pulses, keeping the order of the rest
+  int kept = 0;
+  for (int i = 0; i < size_; i++) {
+    if (pump == PUMP_ALL || queue_[i].pump == pump) {
+      removed++;
+    } else {
+      queue_[kept++] = queue_[i];
+    }
+  }
+  size_ = kept;
+
+  // Neighbouring pulses of the same pump are now adjacent: merge them where
+  // the sum stays within MAX_PULSE_MS
+  kept = 0;
+  for (int i = 0; i < size_; i++) {
+    if (kept > 0 && queue_[kept - 1].pump == queue_[i].pump &&
+        queue_[kept - 1].durationMs + queue_[i].durationMs <= MAX_PULSE_MS) {
+      queue_[kept - 1].durationMs += queue_[i].durationMs;
+    } else {
+      queue_[kept++] = queue_[i];
+    }
+  }
+  size_ = kept;
+
+  if (running_ && (pump == PUMP_ALL || active_ == pump)) {
+    running_ = false;
+    removed++;
+    startNext(nowMs);
+  }
+
+  return removed;
+}
+
+void PumpTimeline::step(uint32_t nowMs) {
+  if (running_ && elapsed(nowMs, activeEnd_) >= 0) {
+    running_ = false;
+    startNext(nowMs);
+  }
+}
+
+uint32_t PumpTimeline::pendingMs(Pump pump, uint32_t nowMs) const {
+  uint32_t total = 0;
+  if (running_ && active_ == pump && elapsed(activeEnd_, nowMs) > 0) {
+    total += (uint32_t)elapsed(activeEnd_, nowMs);
+  }
+  for (int i = 0; i < size_; i++) {
+    if (queue_[i].pump == pump) total += queue_[i].durationMs;
+  }
+  return total;
+}
+
+void PumpTimeline::startNext(uint32_t nowMs) {
+  if (size_ == 0) return;
+
+  running_ = true;
+  active_ = queue_[0].pump;
+  activeEnd_ = nowMs + queue_[0].durationMs;
+
+  for (int i = 1; i < size_; i++) {
+    queue_[i - 1] = queue_[i];
+  }
+  size_--;
+}
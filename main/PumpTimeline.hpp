@@ -0,0 +1,82 @@
+#ifndef PUMPTIMELINE_HPP
+#define PUMPTIMELINE_HPP
+
+#include <stdint.h>
+
+// Non-blocking timeline of manual acid/base pump pulses.
+// Requests are accepted immediately and stepped from the control loop, so a
+// pulse never blocks the caller. Plain C++ (time is passed in), host-buildable.
+//
+// Rules:
+//  - Acid and base are never on together: a pulse for the opposite pump is
+//    queued and starts when the running pulse ends.
+//  - A pulse for the pump that is already last in line is merged into that
+//    pulse (durations add up, so the requested dose is preserved). Beyond
+//    MAX_PULSE_MS, the rest is queued as a follow-on pulse of the same pump.
+//  - No pulse is longer than MAX_PULSE_MS; longer requests are rejected.
+
+enum Pump : uint8_t {
+  PUMP_ACID = 0,
+  PUMP_BASE = 1,
+  PUMP_ALL  = 0xFF // Only valid for cancel()
+};
+
+enum PulseResult : uint8_t {
+  PULSE_STARTED,  // Pump switched on now
+  PULSE_MERGED,   // Added to a running or queued pulse of the same pump (and a follow-on pulse)
+  PULSE_QUEUED,   // Waiting for the opposite pump to finish
+  PULSE_REJECTED  // Queue full, or duration outside 1..MAX_PULSE_MS
+};
+
+const int PULSE_QUEUE_LENGTH = 4;
+const uint32_t MAX_PULSE_MS = 10000;
+
+class PumpTimeline {
+public:
+  PumpTimeline();
+
+  /**
+   * @brief Requests a timed pulse. Never blocks.
+   * @param pump PUMP_ACID or PUMP_BASE.
+   * @param durationMs Pulse length in milliseconds (1..MAX_PULSE_MS).
+   * @param nowMs Current time in milliseconds.
+   */
+  PulseResult request(Pump pump, uint32_t durationMs, uint32_t nowMs);
+
+  /**
+   * @brief Stops the running pulse and drops queued pulses for a pump.
+   * @param pump PUMP_ACID, PUMP_BASE or PUMP_ALL.
+   * @return Number of running or queued pulses removed.
+   */
+  int cancel(Pump pump, uint32_t nowMs);
+
+  /**
+   * @brief Ends expired pulses and starts the next queued one.
+   * Call at least once per control period.
+   */
+  void step(uint32_t nowMs);
+
+  bool isOn(Pump pump) const { return running_ && active_ == pump; }
+  bool busy() const { return running_; }
+
+  /**
+   * @brief Milliseconds of dosing left for a pump, running and queued.
+   */
+  uint32_t pendingMs(Pump pump, uint32_t nowMs) const;
+
+private:
+  struct Pulse {
+    Pump pump;
+    uint32_t durationMs;
+  };
+
+  void startNext(uint32_t nowMs);
+
+  bool running_;
+  Pump active_;
+  uint32_t activeEnd_;
+  Pulse queue_[PULSE_QUEUE_LENGTH];
+  int size_;
+};
+
+#endif // PUMPTIMELINE_HPP
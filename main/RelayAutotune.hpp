@@ -0,0 +1,167 @@
+#ifndef RELAYAUTOTUNE_HPP
+#define RELAYAUTOTUNE_HPP
+
+#include <math.h>
+#include <stdint.h>
+
+// Relay-feedback autotuning (Astrom-Hagglund). While running, the tuner
+// replaces the loop's controller: it drives the actuator to `high` below the
+// setpoint and to `low` above it, with a hysteresis band against noise. The
+// loop settles into a limit cycle whose period is the ultimate period Pu, and
+// whose amplitude a gives the ultimate gain Ku = 4 d / (pi sqrt(a^2 - eps^2))
+// for a relay of amplitude d and hysteresis eps. PI gains follow from Ku and
+// Pu by a tuning rule.
+
+enum AutotuneState : uint8_t {
+  AUTOTUNE_IDLE,
+  AUTOTUNE_RUNNING,
+  AUTOTUNE_DONE,
+  AUTOTUNE_FAILED,
+};
+
+/**
+ * @brief "idle", "running", "done" or "failed", for status reports.
+ */
+inline const char* autotuneStateName(AutotuneState state) {
+  static const char* const NAMES[] = {"idle", "running", "done", "failed"};
+  return NAMES[state];
+}
+
+enum AutotuneRule : uint8_t {
+  AUTOTUNE_ZIEGLER_NICHOLS, // Kp = 0.45 Ku, Ti = Pu / 1.2: fast, some overshoot
+  AUTOTUNE_TYREUS_LUYBEN,   // Kp = Ku / 3.2, Ti = 2.2 Pu: slower, little overshoot
+};
+
+struct AutotuneConfig {
+  float setpoint;
+  float low;        // Relay outputs, within the actuator range
+  float high;
+  float hysteresis; // eps, in measurement units; above the measurement noise
+  uint8_t cycles;   // Limit cycles averaged, after one discarded to settle
+  uint32_t timeoutMs;
+  AutotuneRule rule;
+};
+
+struct AutotuneResult {
+  AutotuneState state;
+  const char* error;     // Why it failed, else nullptr
+  float ultimateGain;    // Ku, output units per measurement unit
+  float ultimatePeriodS; // Pu
+  float kp;
+  float ki;              // Per second
+};
+
+class RelayAutotune {
+public:
+  RelayAutotune() : state_(AUTOTUNE_IDLE), reported_(true) {}
+
+  void start(const AutotuneConfig& config, float measurement, uint32_t nowMs) {
+    config_ = config;
+    state_ = AUTOTUNE_RUNNING;
+    reported_ = false;
+    startMs_ = nowMs;
+    relayHigh_ = measurement < config.setpoint;
+    lastRiseMs_ = 0;
+    rises_ = 0;
+    max_ = min_ = measurement;
+    periodSumMs_ = 0;
+    amplitudeSum_ = 0;
+  }
+
+  /**
+   * @brief One step while running.
+   * @return The relay output to apply.
+   */
+  float update(float measurement, uint32_t nowMs) {
+    if (state_ != AUTOTUNE_RUNNING) return config_.low;
+
+    if (nowMs - startMs_ > config_.timeoutMs) {
+      abort("timeout");
+      return config_.low;
+    }
+
+    if (measurement > max_) max_ = measurement;
+    if (measurement < min_) min_ = measurement;
+
+    if (relayHigh_ && measurement > config_.setpoint + config_.hysteresis) {
+      relayHigh_ = false;
+    } else if (!relayHigh_ && measurement < config_.setpoint - config_.hysteresis) {
+      // Each switch back to high closes one period of the limit cycle
+      relayHigh_ = true;
+      if (rises_ >= 2) { // The first complete cycle is still settling
+        periodSumMs_ += nowMs - lastRiseMs_;
+        amplitudeSum_ += (max_ - min_) / 2;
+      }
+      rises_++;
+      lastRiseMs_ = nowMs;
+      max_ = min_ = measurement;
+      if (rises_ >= config_.cycles + 2) finish();
+    }
+    return state_ == AUTOTUNE_RUNNING && relayHigh_ ? config_.high : config_.low;
+  }
+
+  void abort(const char* reason) {
+    if (state_ != AUTOTUNE_RUNNING) return;
+    state_ = AUTOTUNE_FAILED;
+    result_ = AutotuneResult{AUTOTUNE_FAILED, reason, 0, 0, 0, 0};
+  }
+
+  AutotuneState state() const { return state_; }
+  bool running() const { return state_ == AUTOTUNE_RUNNING; }
+  const AutotuneConfig& config() const { return config_; }
+
+  /**
+   * @brief The result of the last finished run (valid when DONE or FAILED).
+   */
+  const AutotuneResult& result() const { return result_; }
+
+  /**
+   * @brief The result of a finished run, returned once (for reporting).
+   * @return false while running or if already taken.
+   */
+  bool takeResult(AutotuneResult& out) {
+    if (reported_ || state_ == AUTOTUNE_RUNNING || state_ == AUTOTUNE_IDLE) return false;
+    reported_ = true;
+    out = result_;
+    return true;
+  }
+
+private:
+  void finish() {
+    float period = periodSumMs_ * 1e-3f / config_.cycles;
+    float amplitude = amplitudeSum_ / config_.cycles;
+    float eps = config_.hysteresis;
+    if (amplitude <= eps * 1.05f || period <= 0) {
+      abort("no limit cycle");
+      return;
+    }
+
+    float d = (config_.high - config_.low) / 2;
+    float ku = 4 * d / (3.14159265f * sqrtf(amplitude * amplitude - eps * eps));
+    float kp, ti;
+    if (config_.rule == AUTOTUNE_ZIEGLER_NICHOLS) {
+      kp = 0.45f * ku;
+      ti = period / 1.2f;
+    } else {
+      kp = ku / 3.2f;
+      ti = 2.2f * period;
+    }
+    state_ = AUTOTUNE_DONE;
+    result_ = AutotuneResult{AUTOTUNE_DONE, nullptr, ku, period, kp, kp / ti};
+  }
+
+  AutotuneConfig config_;
+  AutotuneState state_;
+  bool reported_;
+  AutotuneResult result_;
+  uint32_t startMs_;
+  bool relayHigh_;
+  uint32_t lastRiseMs_;
+  int rises_;
+  float max_;
+  float min_;
+  uint32_t periodSumMs_;
+  float amplitudeSum_;
+};
+
+#endif // RELAYAUTOTUNE_HPP
@@ -0,0 +1,97 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <atomic>
+#include <stdint.h>
+
+// Single-producer/single-consumer lock-free ring buffer.
+// One context may push (an ISR, a task, or the other core) while another pops;
+// neither side ever blocks or masks interrupts. The indices are free-running
+// 32-bit counters published with release/acquire ordering, so the element is
+// fully written before the consumer can see it (and vice versa for slot reuse).
+// N must be a power of two.
+
+template <typename T, uint32_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() : head_(0), tail_(0) {}
+
+  // --- Producer side ---
+
+  /**
+   * @brief Appends an item.
+   * @return false if the ring is full (the item is not stored).
+   */
+  bool push(const T& item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= N) {
+      return false;
+    }
+    items_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief In-place alternative to push() for large items: returns the next
+   * free slot (nullptr if full), to be filled and then published with commit().
+   */
+  T* reserve() {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= N) {
+      return nullptr;
+    }
+    return &items_[head & (N - 1)];
+  }
+
+  void commit() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // --- Consumer side ---
+
+  /**
+   * @brief Removes the oldest item.
+   * @return false if the ring is empty.
+   */
+  bool pop(T& item) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    item = items_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief The i-th oldest item; i must be below size(). Consumer only.
+   */
+  const T& at(uint32_t i) const {
+    return items_[(tail_.load(std::memory_order_relaxed) + i) & (N - 1)];
+  }
+
+  /**
+   * @brief Drops the n oldest items (n <= size()). Consumer only.
+   */
+  void discard(uint32_t n) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+  }
+
+  // --- Either side (a snapshot; may be stale by the time it is used) ---
+
+  uint32_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  static constexpr uint32_t capacity() { return N; }
+
+private:
+  T items_[N];
+  std::atomic<uint32_t> head_; // Written only by the producer
+  std::atomic<uint32_t> tail_; // Written only by the consumer
+};
+
+#endif // RINGBUFFER_HPP
@@ -0,0 +1,89 @@
+#include "SampleHistory.hpp"
+
+SampleHistory::SampleHistory()
+    : tier1Phase_(0), tier2Phase_(0), overruns_(0), decimated_(0), dropped_(0) {}
+
+bool SampleHistory::push(const TelemetrySample& sample) {
+  if (!live_.push(sample)) {
+    overruns_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void SampleHistory::age() {
+  TelemetrySample sample;
+  while (live_.size() > HISTORY_LIVE_HIGH_WATER && live_.pop(sample)) {
+    // Keep the first sample of every decimation window
+    bool keep = tier1Phase_ == 0;
+    tier1Phase_ = (tier1Phase_ + 1) % HISTORY_TIER1_DECIMATION;
+    if (!keep) {
+      decimated_++;
+      continue;
+    }
+
+    if (tier1_.size() == tier1_.capacity()) {
+      ageTier1();
+    }
+    tier1_.push(sample);
+  }
+}
+
+// Makes room for one sample in tier 1 by moving its oldest into tier 2
+void SampleHistory::ageTier1() {
+  TelemetrySample sample;
+  if (!tier1_.pop(sample)) return;
+
+  bool keep = tier2Phase_ == 0;
+  tier2Phase_ = (tier2Phase_ + 1) % HISTORY_TIER2_DECIMATION;
+  if (!keep) {
+    decimated_++;
+    return;
+  }
+
+  if (tier2_.size() == tier2_.capacity()) {
+    TelemetrySample oldest;
+    tier2_.pop(oldest);
+    dropped_++;
+  }
+  tier2_.push(sample);
+}
+
+int SampleHistory::read(TelemetrySample* out, int max) const {
+  int n = 0;
+
+  // Oldest data lives in the most decimated tier
+  for (uint32_t i = 0, size = tier2_.size(); i < size && n < max; i++) out[n++] = tier2_.at(i);
+  for (uint32_t i = 0, size = tier1_.size(); i < size && n < max; i++) out[n++] = tier1_.at(i);
+  for (uint32_t i = 0, size = live_.size(); i < size && n < max; i++) out[n++] = live_.at(i);
+
+  return n;
+}
+
+void SampleHistory::discard(int n) {
+  uint32_t remaining = n > 0 ? (uint32_t)n : 0;
+  uint32_t k;
+
+  k = remaining < tier2_.size() ? remaining : tier2_.size();
+  tier2_.discard(k);
+  remaining -= k;
+
+  k = remaining < tier1_.size() ? remaining : tier1_.size();
+  tier1_.discard(k);
+  remaining -= k;
+
+  k = remaining < live_.size() ? remaining : live_.size();
+  live_.discard(k);
+}
+
+uint32_t SampleHistory::backlog() const {
+  return live_.size() + tier1_.size() + tier2_.size();
+}
+
+HistoryStats SampleHistory::stats() const {
+  HistoryStats stats;
+  stats.overruns = overruns_.load(std::memory_order_relaxed);
+  stats.decimated = decimated_;
+  stats.dropped = dropped_;
+  return stats;
+}
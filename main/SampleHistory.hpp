@@ -0,0 +1,87 @@
+#ifndef SAMPLEHISTORY_HPP
+#define SAMPLEHISTORY_HPP
+
+#include "RingBuffer.hpp"
+#include "TelemetryFrame.hpp"
+
+// Bounded history of telemetry samples that survives broker outages.
+//
+// The sampling task pushes into the live ring (lock-free, it may run on the
+// other core). The publisher side owns everything else: while samples pile up
+// it ages the oldest ones into two decimated archive tiers, so recent data
+// stays at full rate and older data thins out instead of being lost.
+// Once the connection is back, read()/discard() hand the samples out oldest
+// first to back-fill the gap.
+//
+// With the defaults at 10 Hz: ~77 s at full rate, ~34 min at 1 Hz and ~17 h
+// at one sample per minute, in ~130 KB (allocate it in PSRAM on the ESP32).
+
+const uint32_t HISTORY_LIVE_SAMPLES = 1024;
+const uint32_t HISTORY_TIER1_SAMPLES = 2048;
+const uint32_t HISTORY_TIER2_SAMPLES = 1024;
+const uint32_t HISTORY_TIER1_DECIMATION = 10;  // Keep 1 of every 10 aged live samples
+const uint32_t HISTORY_TIER2_DECIMATION = 60;  // Keep 1 of every 60 aged tier 1 samples
+
+// Start ageing once the live ring is this full, leaving headroom for the producer
+const uint32_t HISTORY_LIVE_HIGH_WATER = HISTORY_LIVE_SAMPLES * 3 / 4;
+
+struct HistoryStats {
+  uint32_t overruns;   // Samples refused because the live ring was full
+  uint32_t decimated;  // Samples thinned out while ageing
+  uint32_t dropped;    // Oldest archive samples discarded when tier 2 was full
+};
+
+class SampleHistory {
+public:
+  SampleHistory();
+
+  // --- Producer (sampling task) ---
+
+  /**
+   * @brief Stores a sample in the live ring.
+   * @return false if the live ring was full (counted as an overrun).
+   */
+  bool push(const TelemetrySample& sample);
+
+  // --- Consumer (publisher) ---
+
+  /**
+   * @brief Ages the oldest live samples into the archive tiers once the live
+   * ring passes its high-water mark. Call regularly, connected or not.
+   */
+  void age();
+
+  /**
+   * @brief Copies up to max of the oldest samples (archive first) without removing them.
+   * @return Number of samples copied.
+   */
+  int read(TelemetrySample* out, int max) const;
+
+  /**
+   * @brief Removes the n oldest samples, e.g. after read() data was published.
+   */
+  void discard(int n);
+
+  /**
+   * @brief Samples waiting in total, and those waiting in the archive tiers
+   * (non-zero means a back-fill is pending).
+   */
+  uint32_t backlog() const;
+  uint32_t archived() const { return tier1_.size() + tier2_.size(); }
+
+  HistoryStats stats() const;
+
+private:
+  void ageTier1();
+
+  SpscRing<TelemetrySample, HISTORY_LIVE_SAMPLES> live_;
+  SpscRing<TelemetrySample, HISTORY_TIER1_SAMPLES> tier1_;
+  SpscRing<TelemetrySample, HISTORY_TIER2_SAMPLES> tier2_;
+  uint32_t tier1Phase_; // Position within the current decimation window
+  uint32_t tier2Phase_;
+  std::atomic<uint32_t> overruns_; // Producer side
+  uint32_t decimated_;
+  uint32_t dropped_;
+};
+
+#endif // SAMPLEHISTORY_HPP
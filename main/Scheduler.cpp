@@ -0,0 +1,102 @@
+#include "Scheduler.hpp"
+#include <string.h>
+
+// Signed difference of two wrapping 32-bit timestamps (a - b)
+static inline int32_t elapsed(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b);
+}
+
+Scheduler::Scheduler(ClockFunction clock) : clock_(clock), observer_(nullptr), count_(0) {
+  memset(tasks_, 0, sizeof(tasks_));
+}
+
+int Scheduler::addTask(const char* name, TaskFunction fn, uint32_t periodUs, uint32_t deadlineUs, uint8_t priority) {
+  if (count_ >= MAX_TASKS || fn == nullptr || periodUs == 0) {
+    return -1;
+  }
+
+  Task& t = tasks_[count_];
+  t.name = name;
+  t.fn = fn;
+  t.periodUs = periodUs;
+  t.deadlineUs = deadlineUs;
+  t.priority = priority;
+  t.nextRelease = (uint32_t)clock_();
+  memset(&t.stats, 0, sizeof(t.stats));
+
+  return count_++;
+}
+
+void Scheduler::start() {
+  uint32_t now = (uint32_t)clock_();
+  for (int i = 0; i < count_; i++) {
+    tasks_[i].nextRelease = now;
+  }
+}
+
+bool Scheduler::runOnce() {
+  uint32_t now = (uint32_t)clock_();
+
+  // Pick the ready task with the highest priority, earliest release first
+  int best = -1;
+  for (int i = 0; i < count_; i++) {
+    if (elapsed(now, tasks_[i].nextRelease) < 0) continue;
+
+    if (best < 0 ||
+        tasks_[i].priority < tasks_[best].priority ||
+        (tasks_[i].priority == tasks_[best].priority &&
+         elapsed(tasks_[i].nextRelease, tasks_[best].nextRelease) < 0)) {
+      best = i;
+    }
+  }
+
+  if (best < 0) {
+    return false;
+  }
+
+  Task& t = tasks_[best];
+  uint32_t release = t.nextRelease;
+  uint32_t jitter = now - release;
+
+  t.fn();
+
+  uint32_t end = (uint32_t)clock_();
+  uint32_t exec = end - now;
+
+  t.stats.runs++;
+  t.stats.lastExecUs = exec;
+  if (exec > t.stats.maxExecUs) t.stats.maxExecUs = exec;
+  if (jitter > t.stats.maxJitterUs) t.stats.maxJitterUs = jitter;
+  if (end - release > t.deadlineUs) t.stats.missedDeadlines++;
+  if (observer_) observer_(best, jitter, exec);
+
+  // Keep the release grid fixed; if whole periods have already passed,
+  // drop them instead of running the task back to back to catch up.
+  t.nextRelease = release + t.periodUs;
+  int32_t behind = elapsed(end, t.nextRelease);
+  if (behind >= (int32_t)t.periodUs) {
+    uint32_t skipped = (uint32_t)behind / t.periodUs;
+    t.nextRelease += skipped * t.periodUs;
+    t.stats.skippedReleases += skipped;
+  }
+
+  return true;
+}
+
+uint32_t Scheduler::untilNextReleaseUs() const {
+  if (count_ == 0) return 0;
+
+  uint32_t now = (uint32_t)clock_();
+  int32_t soonest = elapsed(tasks_[0].nextRelease, now);
+  for (int i = 1; i < count_; i++) {
+    int32_t d = elapsed(tasks_[i].nextRelease, now);
+    if (d < soonest) soonest = d;
+  }
+  return soonest > 0 ? (uint32_t)soonest : 0;
+}
+
+void Scheduler::resetStats() {
+  for (int i = 0; i < count_; i++) {
+    memset(&tasks_[i].stats, 0, sizeof(tasks_[i].stats));
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <stdint.h>
+
+// Cooperative, non-preemptive deadline scheduler.
+// Plain C++ with no Arduino dependency: the clock is injected so the same code
+// runs against halMicros() on the ESP32 and against a fake clock on Linux.
+
+typedef void (*TaskFunction)();
+typedef uint32_t (*ClockFunction)(); // Wrapping microsecond clock, e.g. halMicros
+typedef void (*TaskObserver)(int index, uint32_t jitterUs, uint32_t execUs); // After each run
+
+const int MAX_TASKS = 8;
+
+struct TaskStats {
+  uint32_t runs;            // Number of completed executions
+  uint32_t missedDeadlines; // Executions that finished after release + deadline
+  uint32_t skippedReleases; // Whole periods dropped because the task fell behind
+  uint32_t maxJitterUs;     // Worst-case start lateness relative to the release time
+  uint32_t maxExecUs;       // Worst-case execution time
+  uint32_t lastExecUs;      // Execution time of the most recent run
+};
+
+struct Task {
+  const char* name;
+  TaskFunction fn;
+  uint32_t periodUs;
+  uint32_t deadlineUs;  // Relative to the release time
+  uint8_t priority;     // Lower number = higher priority
+  uint32_t nextRelease; // Absolute release time (wraps with the clock)
+  TaskStats stats;
+};
+
+class Scheduler {
+public:
+  explicit Scheduler(ClockFunction clock);
+
+  /**
+   * @brief Registers a periodic task.
+   * @param name Short label used in reports (not copied, must be static).
+   * @param fn Function to call once per period.
+   * @param periodUs Release period in microseconds.
+   * @param deadlineUs Completion deadline after each release, in microseconds.
+   * @param priority Lower number runs first when several tasks are ready.
+   * @return The task index, or -1 if the table is full.
+   */
+  int addTask(const char* name, TaskFunction fn, uint32_t periodUs, uint32_t deadlineUs, uint8_t priority);
+
+  /**
+   * @brief Aligns the first release of every task to the current time.
+   */
+  void start();
+
+  /**
+   * @brief Runs the highest priority task whose release time has passed.
+   * Ties are broken by the earliest release (earliest deadline first).
+   * @return true if a task was run, false if nothing was ready.
+   */
+  bool runOnce();
+
+  /**
+   * @brief Microseconds until the next task becomes ready (0 if one is ready now).
+   */
+  uint32_t untilNextReleaseUs() const;
+
+  int taskCount() const { return count_; }
+  const Task& task(int index) const { return tasks_[index]; }
+
+  /**
+   * @brief Clears the statistics of every task (e.g. after reporting them).
+   */
+  void resetStats();
+
+  /**
+   * @brief Called after every task run with its start lateness and execution
+   * time, e.g. to keep distributions that TaskStats does not (nullptr: none).
+   */
+  void setObserver(TaskObserver observer) { observer_ = observer; }
+
+private:
+  ClockFunction clock_;
+  TaskObserver observer_;
+  Task tasks_[MAX_TASKS];
+  int count_;
+};
+
+#endif // SCHEDULER_HPP
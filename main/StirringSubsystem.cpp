@@ -1,5 +1,11 @@
 #include "StirringSubsystem.hpp"
-#include <Arduino.h>
+#include "Actuators.hpp"
+#include "ControlLoop.hpp"
+#include "Controller.hpp"
+#include "Hal.hpp"
+#include "Profiler.hpp"
+#include "PulseRate.hpp"
+#include "RelayAutotune.hpp"
 #include <ArduinoJson.h>
 
 // -------------------------------------------------------------
@@ -7,52 +13,86 @@
 // -------------------------------------------------------------
 
 // --- Motor and Control Parameters (Constants) ---
-float MotorSupplyVoltage = 5.0; // IMPORTANT: Define supply voltage here
-const float Kv = 250;           // Motor Velocity Constant
-const float T = 0.15;           // Time Constant
+constexpr float MOTOR_SUPPLY_V = 5.0;
+float MotorSupplyVoltage = MOTOR_SUPPLY_V; // IMPORTANT: Define supply voltage here
+constexpr float Kv = 250;       // Motor Velocity Constant
+constexpr float T = 0.15;       // Time Constant
 const float Npulses = 70;       // Pulses per motor revolution
 int RPM_MAX = 1500;             // Max allowed RPM
-const int CONTROL_INTERVAL_US = 10000; // 10 ms control loop
-
-// --- Calculated Control Gains ---
-const float wn = 1.0 / T;
-const float zeta = 1.0;
-const float wo = 1.0 / T;
-const float Kp = (2.0 * zeta * wn / wo - 1.0) / Kv;
-const float KI = (wn * wn) / (Kv * wo);
 
 // --- Conversion Factors and PWM Setup ---
 const float freqtoRPM = 60.0 / Npulses;
-float pwmScale = 1023.0 / MotorSupplyVoltage;
+float pwmScale = ACTUATOR_DUTY_MAX / MotorSupplyVoltage;
+
+// Soft start: at most 50 PWM counts per 10 ms step (full scale in ~0.2 s) to
+// avoid supply spikes. The limit is the controller's slew, so its anti-windup
+// sees the duty actually put out. A hardware fade takes the edge off each
+// step; it ends well before the next step, so fades never overlap, and it is
+// short enough not to delay the loop (a full-period fade added ~2 rpm overshoot).
+constexpr float SOFT_START_COUNTS_PER_STEP = 50;
+constexpr uint32_t SOFT_START_FADE_MS = 2;
+
+// --- PI Speed Controller (motor volts from RPM error) ---
+// Pole placement on the first-order motor model (Kv, T): closed-loop
+// wn = 1/T, zeta = 1, observer pole wo = 1/T.
+struct StirringPolicy {
+  typedef float Value;
+  static constexpr float WN = 1.0 / T;
+  static constexpr float ZETA = 1.0;
+  static constexpr float WO = 1.0 / T;
+  static constexpr float KP = (2.0 * ZETA * WN / WO - 1.0) / Kv;
+  static constexpr float KI = (WN * WN) / (Kv * WO);
+  static constexpr float KD = 0;
+  static constexpr float OUT_MIN = 0;
+  static constexpr float OUT_MAX = MOTOR_SUPPLY_V;
+  static constexpr float SLEW = SOFT_START_COUNTS_PER_STEP * MOTOR_SUPPLY_V / ACTUATOR_DUTY_MAX / (STIRRING_PERIOD_US * 1e-6);
+  static constexpr float TRACKING = 1.0 / T;
+};
+static Controller<StirringPolicy> speedController;
+
+// --- Relay autotune (rpcAutotune, "loop": "stirring") ---
+// The relay steps stay within a few soft-start slew steps of the bias.
+constexpr float AUTOTUNE_RELAY_V = 0.15;   // Relay amplitude d around the bias
+constexpr float AUTOTUNE_EPS_RPM = 5;      // Hysteresis, above the RPM jitter
+static RelayAutotune rpmTuner;
+static float tunedSetspeed = 0;            // Setpoint the tuner was started at
 
 // --- System Variables (Shared with .hpp) ---
 float setspeed = 0;             // RPM setpoint
 float meanmeasspeed = 0;        // Filtered measured RPM
 
 // --- Internal Variables ---
-volatile long pulseT[8];        
-volatile long pulseTime = 0;    
+volatile uint32_t pulseT[8];    // Wrapping micros() timestamps
+volatile uint32_t pulseTime = 0;
 volatile int count = 0;         
 volatile bool blinkk = false;   
+volatile uint32_t hallInterrupts = 0; // Tsense() calls
+
+// Pulse capture backend
+static bool rpmCapture = false;
+static uint32_t blinkCaptures = 0;
+
+// Hall interrupt rate reported by getStirringStatus()
+static uint32_t statusInterrupts = 0;
+static uint32_t statusTime = 0;
 
-static long currtime, prevtime, T1;
+static uint32_t currtime, prevtime;
 static float measspeed = 0;
-static float error = 0;
-static float KIinterror = 0;
 static float deltaT = 0;
-static int Vmotor = 0;
-static int currentPWM = 0;  // Track current PWM for soft-start ramping
+static int currentPWM = 0;
 
 
 // -------------------------------------------------------------
 // 1. INTERRUPT SERVICE ROUTINE (ISR)
 // -------------------------------------------------------------
-void IRAM_ATTR Tsense() {
+void HAL_ISR_ATTR Tsense() {
   const int Tmin = 60000000 / RPM_MAX / Npulses; 
 
-  pulseTime = micros();
+  pulseTime = halMicros();
+  hallInterrupts++;
+  PROFILE_COUNT(PROFILE_ISR_HALL);
 
-  if (abs(pulseTime - pulseT[0]) > Tmin) {
+  if (abs((int32_t)(pulseTime - pulseT[0])) > Tmin) {
     for (int i = 7; i > 0; i--) {
       pulseT[i] = pulseT[i - 1];
     }
@@ -62,7 +102,7 @@ void IRAM_ATTR Tsense() {
     count += 2;
     if (count > int(Npulses)) {
       count -= int(Npulses);
-      digitalWrite(LED_RED_PIN, blinkk);
+      halDigitalWrite(LED_RED_PIN, blinkk);
       blinkk = !blinkk;
     }
   }
@@ -72,109 +112,125 @@ void IRAM_ATTR Tsense() {
 // 2. SETUP FUNCTION
 // -------------------------------------------------------------
 void setupStirring() {
-  pinMode(ENCODER_PIN, INPUT_PULLUP);
-  pinMode(LED_RED_PIN, OUTPUT);
+  halPinMode(ENCODER_PIN, HAL_INPUT_PULLUP);
+  halPinMode(LED_RED_PIN, HAL_OUTPUT);
 
-  // PWM setup on MOTOR_PIN (D10)
-  ledcAttach(MOTOR_PIN, 20000, 10);
-  ledcWrite(MOTOR_PIN, 0); 
+  // The motor PWM (ACTUATOR_MOTOR, 20 kHz) is attached off by setupActuators()
 
-  // Hall sensor interrupt
-  attachInterrupt(digitalPinToInterrupt(ENCODER_PIN), Tsense, RISING);
+  // Hall sensor: hardware capture if enabled and available, else an interrupt per edge
+  rpmCapture = STIRRING_RPM_CAPTURE && halPulseCaptureStart(ENCODER_PIN, RPM_EDGES_PER_CAPTURE);
+  if (!rpmCapture) {
+    halAttachInterrupt(ENCODER_PIN, Tsense, HAL_RISING);
+  }
+  halLog("stirring: RPM from %s\n", rpmCapture ? "pulse capture" : "Hall interrupt");
 
   // Initialize pulse buffer timestamps
-  long t = micros();
+  uint32_t t = halMicros();
   for (int i = 0; i < 8; i++) {
     pulseT[i] = t;
   }
   prevtime = t;
-  T1 = t;
+  statusTime = t;
+}
+
+// -------------------------------------------------------------
+// RPM MEASUREMENT BACKENDS
+// -------------------------------------------------------------
+// Both return the speed over the last 7 Hall periods, or 0 if the last edge
+// is more than 100 ms old.
+
+static float measureRpmInterrupt(uint32_t now) {
+  // Disable interrupts while reading ISR-shared variables to prevent race conditions
+  halEnterCritical();
+  int32_t Tsens = (int32_t)(pulseT[0] - pulseT[7]);
+  uint32_t localPulseTime = pulseTime;
+  halExitCritical();
+
+  if (Tsens <= 0) Tsens = 1;
+  if ((int32_t)(now - localPulseTime) > 100000) return 0;
+  return 7.0 * freqtoRPM * 1e6 / (float)Tsens;
+}
+
+static float measureRpmCapture(uint32_t now) {
+  HalPulseCapture capture;
+  halPulseCaptureRead(ENCODER_PIN, capture); // Consistent without masking interrupts
+
+  // The LED toggles every half revolution, as in Tsense()
+  const uint32_t capturesPerBlink = (uint32_t)Npulses / 2 / RPM_EDGES_PER_CAPTURE;
+  if (capture.captures - blinkCaptures >= capturesPerBlink) {
+    blinkCaptures = capture.captures;
+    halDigitalWrite(LED_RED_PIN, blinkk);
+    blinkk = !blinkk;
+  }
+
+  return captureRpm(capture, now, RPM_EDGES_PER_CAPTURE, Npulses, 100000);
 }
 
 // -------------------------------------------------------------
 // 3. EXECUTION FUNCTION
 // -------------------------------------------------------------
 void executeStirring() {
+  PROFILE_SCOPE(PROFILE_STIRRING);
   // 1. Safety Check: If system is not active, force off and exit
   if (!is_system_active) {
-    ledcWrite(MOTOR_PIN, 0); // Force PWM duty cycle to 0
+    actuatorWrite(ACTUATOR_MOTOR, 0); // Force PWM duty cycle to 0, ending any ramp
+    currentPWM = 0;
+    speedController.reset(); // Soft-start again from 0 V
+    rpmTuner.abort("system inactive");
     return; 
   }
 
   // --- A. Serial Command Input (Local Test Override) ---
-  if (Serial.available()) {
-    String cmd = Serial.readStringUntil('\n');
-    cmd.trim();
-
-    if (cmd.length() > 0) {
-      int val = cmd.toInt();
-      if ((val >= 500 && val <= RPM_MAX) || val == 0) {
-        setspeed = val;
-        Serial.print("Set speed updated to: ");
-        Serial.println(setspeed);
-      } else {
-        Serial.println("Ignored: setpoint must be 0 or 500-1500 RPM");
-      }
+  char cmd[16];
+  if (halConsoleReadLine(cmd, sizeof(cmd))) {
+    int val = atoi(cmd);
+    if ((val >= 500 && val <= RPM_MAX) || val == 0) {
+      setspeed = val;
+      halLog("Set speed updated to: %.2f\n", setspeed);
+    } else {
+      halLog("Ignored: setpoint must be 0 or 500-1500 RPM\n");
     }
   }
 
-  // --- B. PI Control Loop (Runs every 10 ms) ---
-  currtime = micros();
-  
-  if (currtime - T1 >= 0) {
-
-    deltaT = (currtime - prevtime) * 1e-6; 
-    prevtime = currtime;
-    T1 += CONTROL_INTERVAL_US; 
+  // --- B. PI Control Loop (released every 10 ms by the scheduler) ---
+  currtime = halMicros();
 
-    // Disable interrupts while reading ISR-shared variables to prevent race conditions
-    noInterrupts();
-    long Tsens = pulseT[0] - pulseT[7];
-    long localPulseTime = pulseTime;
-    interrupts();
-    
-    if (Tsens <= 0) Tsens = 1;
+  deltaT = (uint32_t)(currtime - prevtime) * 1e-6; 
+  prevtime = currtime;
 
-    measspeed = 7.0 * freqtoRPM * 1e6 / (float)Tsens;
+  measspeed = rpmCapture ? measureRpmCapture(currtime) : measureRpmInterrupt(currtime);
 
-    if (currtime - localPulseTime > 100000) {
-      measspeed = 0;
-    }
-
-    error = setspeed - measspeed;
-
-    // PI controller implementation
-    KIinterror += KI * error * deltaT;
-    KIinterror = constrain(KIinterror, 0, MotorSupplyVoltage); 
-
-    Vmotor = round(pwmScale * (Kp * error + KIinterror));
-
-    Vmotor = constrain(Vmotor, 0, 1023); 
-    
-    // Soft-start: Ramp PWM gradually to prevent power spikes
-    // Max change of 50 units per control cycle (~10ms) = ~500ms for full ramp
-    if (Vmotor > currentPWM) {
-      currentPWM = min(currentPWM + 50, Vmotor);
-    } else if (Vmotor < currentPWM) {
-      currentPWM = max(currentPWM - 50, Vmotor);
+  float volts;
+  if (rpmTuner.running() && setspeed != tunedSetspeed) {
+    rpmTuner.abort("setpoint changed");
+  }
+  if (rpmTuner.running()) {
+    volts = rpmTuner.update(measspeed, halMillis());
+    if (!rpmTuner.running()) {
+      // Finished: continue with the new gains from the current voltage
+      if (rpmTuner.state() == AUTOTUNE_DONE) {
+        speedController.setGains(rpmTuner.result().kp, rpmTuner.result().ki, 0);
+      }
+      speedController.reset(actuatorDuty(ACTUATOR_MOTOR) / pwmScale);
+      volts = speedController.output();
     }
-    
-    ledcWrite(MOTOR_PIN, currentPWM);
-
-    // Filtered RPM for display
-    meanmeasspeed = 0.1 * measspeed + 0.9 * meanmeasspeed;
-
-    // Serial Plotter logging
-    unsigned long ms = currtime / 1000ul;
-
-    // Serial.print("time:");
-    // Serial.print(ms);
-    // Serial.print("  set:");
-    // Serial.print(setspeed);
-    // Serial.print("  rpm:");
-    // Serial.println(meanmeasspeed);
-    
+  } else {
+    // PI with anti-windup; the slew limit is the soft start
+    volts = speedController.update(setspeed, measspeed, deltaT);
   }
+  currentPWM = (int)round(pwmScale * volts);
+  actuatorRamp(ACTUATOR_MOTOR, currentPWM, SOFT_START_FADE_MS); // Small corrections are written at once
+
+  // Filtered RPM for display
+  meanmeasspeed = 0.1 * measspeed + 0.9 * meanmeasspeed;
+
+  // Serial Plotter logging
+  // Serial.print("time:");
+  // Serial.print(currtime / 1000ul);
+  // Serial.print("  set:");
+  // Serial.print(setspeed);
+  // Serial.print("  rpm:");
+  // Serial.println(meanmeasspeed);
 }
 
 // -------------------------------------------------------------
@@ -183,24 +239,91 @@ void executeStirring() {
 void getStirringStatus(JsonObject& doc) {
   doc["rpm_set"] = (int)setspeed; // Include the current setpoint
   doc["rpm_measured"] = (int)meanmeasspeed; 
+
+  // Hall interrupts per second: every edge with Tsense(), one per capture otherwise
+  uint32_t interrupts = hallInterrupts;
+  if (rpmCapture) {
+    HalPulseCapture capture;
+    halPulseCaptureRead(ENCODER_PIN, capture);
+    interrupts = capture.captures;
+  }
+  uint32_t now = halMicros();
+  uint32_t elapsed = now - statusTime;
+  doc["rpm_sensor"] = rpmCapture ? "capture" : "interrupt";
+  doc["rpm_autotune"] = autotuneStateName(rpmTuner.state());
+  doc["hall_irq_per_s"] = elapsed ? (int)((uint64_t)(interrupts - statusInterrupts) * 1000000 / elapsed) : 0;
+  statusInterrupts = interrupts;
+  statusTime = now;
+}
+
+void getStirringGains(float& kp, float& ki) {
+  kp = speedController.kp();
+  ki = speedController.ki();
+}
+
+void getStirringSample(TelemetrySample& sample) {
+  sample.rpm = telemetryFixed(meanmeasspeed, 1);
+  sample.rpmSet = telemetryFixed(setspeed, 1);
+  // The duty put out now (part-way through a soft start); executeStirring() forces 0 when inactive
+  sample.motorDuty = is_system_active ? (uint16_t)actuatorDuty(ACTUATOR_MOTOR) : 0;
 }
 
 
 // -------------------------------------------------------------
-// 5. MQTT COMMAND HANDLER (RPC)
+// 5. SHARED ATTRIBUTES
 // -------------------------------------------------------------
-/**
- * @brief Handles the 'setRPM' RPC call.
- */
-void handleStirringAttributes(JsonObject& doc) {
-  if (doc.containsKey("target_rpm")) {
-    int new_rpm = doc["target_rpm"];
-    if ((new_rpm >= 500 && new_rpm <= RPM_MAX) || new_rpm == 0) {
-      setspeed = (float)new_rpm;
-      Serial.print("Updated setspeed (RPM): ");
-      Serial.println(setspeed);
-    } else {
-      Serial.println("Attribute Error: target_rpm outside valid range (0 or 500-1500).");
-    }
+void onTargetRpm(JsonVariant value) {
+  int new_rpm = value;
+  if ((new_rpm >= 500 && new_rpm <= RPM_MAX) || new_rpm == 0) {
+    setspeed = (float)new_rpm;
+    halLog("Updated setspeed (RPM): %.2f\n", setspeed);
+  } else {
+    halLog("Attribute Error: target_rpm outside valid range (0 or 500-1500).\n");
+  }
+}
+
+void onStirringKp(JsonVariant value) {
+  if (!value.is<float>() || (float)value < 0) {
+    halLog("Attribute Error: stirring_kp must be a number >= 0.\n");
+    return;
+  }
+  speedController.setGains(value, speedController.ki(), 0);
+  halLog("Updated stirring Kp: %.5f\n", speedController.kp());
+}
+
+void onStirringKi(JsonVariant value) {
+  if (!value.is<float>() || (float)value < 0) {
+    halLog("Attribute Error: stirring_ki must be a number >= 0.\n");
+    return;
   }
-}
\ No newline at end of file
+  speedController.setGains(speedController.kp(), value, 0);
+  halLog("Updated stirring Ki: %.5f\n", speedController.ki());
+}
+
+// -------------------------------------------------------------
+// 6. AUTOTUNE
+// -------------------------------------------------------------
+const char* startStirringAutotune() {
+  if (!is_system_active) return "System inactive";
+  if (setspeed < 500) return "Stirring is off";
+  if (rpmTuner.running()) return "Autotune already running";
+
+  // Relay around the voltage that currently holds the setpoint
+  float bias = speedController.output();
+  AutotuneConfig config;
+  config.setpoint = setspeed;
+  config.low = fmaxf(bias - AUTOTUNE_RELAY_V, 0);
+  config.high = fminf(bias + AUTOTUNE_RELAY_V, MOTOR_SUPPLY_V);
+  config.hysteresis = AUTOTUNE_EPS_RPM;
+  config.cycles = 4;
+  config.timeoutMs = 10000;
+  config.rule = AUTOTUNE_ZIEGLER_NICHOLS;
+  rpmTuner.start(config, measspeed, halMillis());
+  tunedSetspeed = setspeed;
+  halLog("stirring: autotune at %.0f RPM, relay %.2f-%.2f V\n", setspeed, config.low, config.high);
+  return nullptr;
+}
+
+bool takeStirringAutotune(AutotuneResult& result) {
+  return rpmTuner.takeResult(result);
+}
@@ -1,15 +1,28 @@
 #ifndef STIRRINGSUBSYSTEM_HPP
 #define STIRRINGSUBSYSTEM_HPP
 
-#include <Arduino.h>
+#include "Actuators.hpp"
+#include "Hal.hpp"
+#include "TelemetryFrame.hpp"
 #include <PubSubClient.h> // Keep this as we'll need it for future MQTT publishing
+#include "Dispatch.hpp"
+#include "RelayAutotune.hpp"
 #include <ArduinoJson.h>
 
-// --- Pin Definitions ---
+// --- Pin Definitions (the motor is ACTUATOR_MOTOR, Actuators.hpp) ---
 const byte ENCODER_PIN = 2;   // D2 -> Hall sensor
-const byte MOTOR_PIN   = 10;  // D10 -> MOSFET gate (PWM)
 const byte LED_RED_PIN = LED_RED; // Use the built-in red LED for visual pulse confirmation
 
+// --- RPM Measurement ---
+// 1: the Hall edges are timestamped by the pulse capture hardware
+//    (halPulseCaptureStart(), one interrupt per RPM_EDGES_PER_CAPTURE edges)
+// 0: Tsense() runs on every edge (~1750 interrupts/s at 1500 RPM)
+// Capture falls back to Tsense() if the pin cannot be captured.
+#ifndef STIRRING_RPM_CAPTURE
+#define STIRRING_RPM_CAPTURE 0
+#endif
+const uint16_t RPM_EDGES_PER_CAPTURE = 7; // Same span as Tsense()'s 8 timestamps
+
 // --- Motor & Control Parameters ---
 extern float MotorSupplyVoltage; // Defined in .cpp, declared here for external access
 extern int RPM_MAX;
@@ -22,7 +35,7 @@ extern bool is_system_active;
 /**
  * @brief Handles the Hall sensor interrupt. Measures pulse timing for RPM calculation.
  */
-void IRAM_ATTR Tsense();
+void HAL_ISR_ATTR Tsense();
 
 /**
  * @brief Initializes pins, PWM, and the Hall sensor interrupt.
@@ -36,15 +49,54 @@ void setupStirring();
 void executeStirring();
 
 /**
- * @brief Populates the passed JSON object with the current RPM status.
+ * @brief Populates the passed JSON object with the current RPM status, the
+ * measurement backend and its Hall interrupt rate since the last call, and
+ * the autotune state (rpm_autotune).
  * @param doc The JsonObject to populate.
  */
 void getStirringStatus(JsonObject& doc);
 
 /**
- * @brief Handles incoming Shared Attribute updates.
- * @param doc The JsonObject containing the attributes.
+ * @brief Fills the measured RPM, setpoint and motor PWM of a telemetry sample.
+ * @param sample The sample to populate.
  */
-void handleStirringAttributes(JsonObject& doc);
+void getStirringSample(TelemetrySample& sample);
+
+/**
+ * @brief Current PI gains of the speed loop: StirringPolicy's until an
+ * autotune or stirring_kp/stirring_ki replaces them.
+ */
+void getStirringGains(float& kp, float& ki);
+
+/**
+ * @brief target_rpm attribute: 0 (off) or 500 .. RPM_MAX, others are ignored.
+ */
+void onTargetRpm(JsonVariant value);
+
+/**
+ * @brief stirring_kp (V per RPM) and stirring_ki (V per RPM s) attributes, >= 0.
+ */
+void onStirringKp(JsonVariant value);
+void onStirringKi(JsonVariant value);
+
+/**
+ * @brief Starts a relay autotune of the speed loop at the current setpoint.
+ * The new gains replace the PI gains when it finishes (until reboot); it is
+ * aborted if the setpoint changes or the system goes inactive.
+ * @return nullptr if started, else why not.
+ */
+const char* startStirringAutotune();
+
+/**
+ * @brief The result of the last autotune, once per run.
+ * @return false if there is nothing new to report.
+ */
+bool takeStirringAutotune(AutotuneResult& result);
+
+constexpr AttributeEntry STIRRING_ATTRIBUTES[] = {
+  {"target_rpm", onTargetRpm},
+  {"stirring_kp", onStirringKp},
+  {"stirring_ki", onStirringKi},
+};
 
 #endif // STIRRINGSUBSYSTEM_HPP
\ No newline at end of file
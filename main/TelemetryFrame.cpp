@@ -0,0 +1,197 @@
+#include "TelemetryFrame.hpp"
+#include <string.h>
+
+// -------------------------------------------------------------
+// Varint helpers
+// -------------------------------------------------------------
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline uint64_t zigzag64(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag64(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline uint8_t* putVarint(uint8_t* p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static bool getVarint64(const uint8_t*& p, const uint8_t* end, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 70; shift += 7) {
+    if (p >= end) return false;
+    uint8_t b = *p++;
+    result |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t* v) {
+  uint64_t wide;
+  if (!getVarint64(p, end, &wide) || wide > UINT32_MAX) return false;
+  *v = (uint32_t)wide;
+  return true;
+}
+
+static inline uint8_t* putLittleEndian(uint8_t* p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) *p++ = (uint8_t)(v >> (8 * i));
+  return p;
+}
+
+static inline uint64_t getLittleEndian(const uint8_t* p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+// Numeric fields in change-mask bit order
+static const int NUMERIC_FIELDS = 5;
+
+static void numericFields(const TelemetrySample& s, int32_t* f) {
+  f[0] = s.tempCentiC;
+  f[1] = s.phMilli;
+  f[2] = s.rpm;
+  f[3] = s.heaterDuty;
+  f[4] = s.motorDuty;
+}
+
+// -------------------------------------------------------------
+// Encoder
+// -------------------------------------------------------------
+size_t encodeTelemetryFrame(const TelemetrySample* samples, int count, uint8_t* buf, size_t capacity,
+                            const TelemetryFrameInfo& info) {
+  if (count <= 0 || count > TELEMETRY_MAX_SAMPLES || capacity < telemetryFrameCapacity(count)) {
+    return 0;
+  }
+
+  uint8_t* p = buf;
+  uint64_t t0 = samples[0].timeUs;
+  *p++ = TELEMETRY_MAGIC;
+  *p++ = TELEMETRY_VERSION;
+  *p++ = (uint8_t)count;
+  *p++ = info.flags;
+  p = putLittleEndian(p, info.sequence, 4);
+  p = putLittleEndian(p, t0, 8);
+  p = putLittleEndian(p, info.publishUs, 8);
+
+  TelemetrySample prev;
+  memset(&prev, 0, sizeof(prev));
+  prev.timeUs = t0;
+
+  for (int i = 0; i < count; i++) {
+    const TelemetrySample& s = samples[i];
+    int32_t cur[NUMERIC_FIELDS], old[NUMERIC_FIELDS];
+    numericFields(s, cur);
+    numericFields(prev, old);
+
+    uint8_t mask = 0;
+    for (int f = 0; f < NUMERIC_FIELDS; f++) {
+      if (cur[f] != old[f]) mask |= (uint8_t)(1 << f);
+    }
+    if (s.flags != prev.flags) mask |= TELEMETRY_FIELD_FLAGS;
+    if (s.tempSetCentiC != prev.tempSetCentiC || s.phSetMilli != prev.phSetMilli || s.rpmSet != prev.rpmSet) {
+      mask |= TELEMETRY_FIELD_SETPOINTS;
+    }
+
+    p = putVarint(p, zigzag64((int64_t)(s.timeUs - prev.timeUs)));
+    *p++ = mask;
+    for (int f = 0; f < NUMERIC_FIELDS; f++) {
+      if (mask & (1 << f)) p = putVarint(p, zigzag(cur[f] - old[f]));
+    }
+    if (mask & TELEMETRY_FIELD_FLAGS) *p++ = s.flags;
+    if (mask & TELEMETRY_FIELD_SETPOINTS) {
+      p = putVarint(p, zigzag((int32_t)s.tempSetCentiC - prev.tempSetCentiC));
+      p = putVarint(p, zigzag((int32_t)s.phSetMilli - prev.phSetMilli));
+      p = putVarint(p, zigzag((int32_t)s.rpmSet - prev.rpmSet));
+    }
+
+    prev = s;
+  }
+
+  return (size_t)(p - buf);
+}
+
+// -------------------------------------------------------------
+// Decoder
+// -------------------------------------------------------------
+int decodeTelemetryFrame(const uint8_t* buf, size_t length, TelemetrySample* out, int maxSamples,
+                         TelemetryFrameInfo* info) {
+  if (length < TELEMETRY_HEADER_BYTES || buf[0] != TELEMETRY_MAGIC || buf[1] != TELEMETRY_VERSION) {
+    return -1;
+  }
+
+  int count = buf[2];
+  if (count > maxSamples) return -1;
+
+  const uint8_t* p = buf + TELEMETRY_HEADER_BYTES;
+  const uint8_t* end = buf + length;
+
+  if (info) {
+    info->flags = buf[3];
+    info->sequence = (uint32_t)getLittleEndian(buf + 4, 4);
+    info->publishUs = getLittleEndian(buf + 16, 8);
+  }
+
+  TelemetrySample prev;
+  memset(&prev, 0, sizeof(prev));
+  prev.timeUs = getLittleEndian(buf + 8, 8);
+
+  for (int i = 0; i < count; i++) {
+    TelemetrySample s = prev;
+    uint32_t v;
+
+    uint64_t dt;
+    if (!getVarint64(p, end, &dt)) return -1;
+    s.timeUs = prev.timeUs + (uint64_t)unzigzag64(dt);
+
+    if (p >= end) return -1;
+    uint8_t mask = *p++;
+
+    int32_t f[NUMERIC_FIELDS];
+    numericFields(prev, f);
+    for (int k = 0; k < NUMERIC_FIELDS; k++) {
+      if (!(mask & (1 << k))) continue;
+      if (!getVarint(p, end, &v)) return -1;
+      f[k] += unzigzag(v);
+    }
+    s.tempCentiC = (int16_t)f[0];
+    s.phMilli = (int16_t)f[1];
+    s.rpm = (int16_t)f[2];
+    s.heaterDuty = (uint16_t)f[3];
+    s.motorDuty = (uint16_t)f[4];
+
+    if (mask & TELEMETRY_FIELD_FLAGS) {
+      if (p >= end) return -1;
+      s.flags = *p++;
+    }
+    if (mask & TELEMETRY_FIELD_SETPOINTS) {
+      uint32_t a, b, c;
+      if (!getVarint(p, end, &a) || !getVarint(p, end, &b) || !getVarint(p, end, &c)) return -1;
+      s.tempSetCentiC = (int16_t)(prev.tempSetCentiC + unzigzag(a));
+      s.phSetMilli = (int16_t)(prev.phSetMilli + unzigzag(b));
+      s.rpmSet = (int16_t)(prev.rpmSet + unzigzag(c));
+    }
+
+    out[i] = s;
+    prev = s;
+  }
+
+  return p == end ? count : -1;
+}
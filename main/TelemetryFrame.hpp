@@ -0,0 +1,121 @@
+#ifndef TELEMETRYFRAME_HPP
+#define TELEMETRYFRAME_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary telemetry: a batch of fixed-point samples packed into one
+// MQTT message. Plain C++ so the same codec runs on the ESP32, in the host
+// tools, and mirrors data-analysis/telemetry_codec.py.
+//
+// Frame layout (little endian):
+//   [0]      TELEMETRY_MAGIC
+//   [1]      TELEMETRY_VERSION
+//   [2]      sample count
+//   [3]      frame flags (TELEMETRY_FRAME_*)
+//   [4..7]   sequence number (uint32, +1 per published frame)
+//   [8..15]  time of the first sample (us, uint64)
+//   [16..23] time the frame was handed to the MQTT client (us, uint64)
+// then per sample:
+//   zigzag varint  time delta from the previous sample (us; 0 for the first)
+//   uint8   change mask (TELEMETRY_FIELD_* bits)
+//   zigzag varint delta of each numeric field whose bit is set, in bit order
+//   uint8   flags, if TELEMETRY_FIELD_FLAGS is set
+//   3 x zigzag varint deltas of the setpoints, if TELEMETRY_FIELD_SETPOINTS is set
+// Deltas of the first sample are taken from zero, so every frame decodes on
+// its own. Times come from halTimestampUs(): Unix time once the device clock
+// is synchronised, time since boot before that (see halTimestampIsEpoch()).
+
+const uint8_t TELEMETRY_MAGIC = 0xB7;
+const uint8_t TELEMETRY_VERSION = 3; // 3: heater duty is 10-bit
+const size_t TELEMETRY_HEADER_BYTES = 24;
+const int TELEMETRY_MAX_SAMPLES = 255;
+
+// Worst case per sample: 10 (time) + 1 (mask) + 5 x 3 (fields) + 1 (flags) + 3 x 3 (setpoints)
+const size_t TELEMETRY_MAX_SAMPLE_BYTES = 36;
+
+// Frame flags
+const uint8_t TELEMETRY_FRAME_BACKFILL = 0x01; // Older samples sent after an outage
+
+// Change mask bits
+const uint8_t TELEMETRY_FIELD_TEMP      = 0x01;
+const uint8_t TELEMETRY_FIELD_PH        = 0x02;
+const uint8_t TELEMETRY_FIELD_RPM       = 0x04;
+const uint8_t TELEMETRY_FIELD_HEATER    = 0x08;
+const uint8_t TELEMETRY_FIELD_MOTOR     = 0x10;
+const uint8_t TELEMETRY_FIELD_FLAGS     = 0x20;
+const uint8_t TELEMETRY_FIELD_SETPOINTS = 0x40;
+
+// Sample flags
+const uint8_t TELEMETRY_FLAG_ACID   = 0x01;
+const uint8_t TELEMETRY_FLAG_BASE   = 0x02;
+const uint8_t TELEMETRY_FLAG_HEATER = 0x04;
+const uint8_t TELEMETRY_FLAG_ACTIVE = 0x08;
+const uint8_t TELEMETRY_FLAG_SVM    = 0x10; // One-Class SVM outlier (AnomalyMonitor)
+
+struct TelemetrySample {
+  uint64_t timeUs;      // halTimestampUs() when the sample was taken
+  int16_t tempCentiC;   // Temperature, 0.01 degC
+  int16_t phMilli;      // pH, 0.001
+  int16_t rpm;          // Measured stirring speed
+  uint16_t heaterDuty;  // Raw heater PWM (10-bit, ACTUATOR_DUTY_MAX)
+  uint16_t motorDuty;   // Raw motor PWM (10-bit)
+  uint8_t flags;        // TELEMETRY_FLAG_*
+  int16_t tempSetCentiC;
+  int16_t phSetMilli;
+  int16_t rpmSet;
+};
+
+// Per-frame header fields besides the samples
+struct TelemetryFrameInfo {
+  uint8_t flags;      // TELEMETRY_FRAME_*
+  uint32_t sequence;  // Publish order; gaps mean lost frames
+  uint64_t publishUs; // halTimestampUs() at publish
+};
+
+/**
+ * @brief Converts a reading to fixed point, rounding and saturating to int16.
+ */
+inline int16_t telemetryFixed(float value, float scale) {
+  float scaled = value * scale;
+  if (scaled >= 32767.0f) return 32767;
+  if (scaled <= -32768.0f) return -32768;
+  return (int16_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+/**
+ * @brief Bytes needed to encode `count` samples in the worst case.
+ */
+constexpr size_t telemetryFrameCapacity(int count) {
+  return TELEMETRY_HEADER_BYTES + (size_t)count * TELEMETRY_MAX_SAMPLE_BYTES;
+}
+
+/**
+ * @brief Encodes a batch of samples into one frame.
+ * @param samples Samples in time order.
+ * @param count Number of samples (1..TELEMETRY_MAX_SAMPLES).
+ * @param buf Output buffer.
+ * @param capacity Size of buf; telemetryFrameCapacity(count) is always enough.
+ * @param info Flags, sequence number and publish time for the header.
+ * @return Encoded length in bytes, or 0 if the batch did not fit.
+ */
+size_t encodeTelemetryFrame(const TelemetrySample* samples, int count, uint8_t* buf, size_t capacity,
+                            const TelemetryFrameInfo& info = TelemetryFrameInfo());
+
+/**
+ * @brief Decodes a frame produced by encodeTelemetryFrame.
+ * @param info If not null, receives the header fields.
+ * @return Number of samples written to out, or -1 if the frame is malformed
+ * or holds more than maxSamples.
+ */
+int decodeTelemetryFrame(const uint8_t* buf, size_t length, TelemetrySample* out, int maxSamples,
+                         TelemetryFrameInfo* info = nullptr);
+
+/**
+ * @brief TELEMETRY_FRAME_* flags of an encoded frame (0 if too short).
+ */
+inline uint8_t telemetryFrameFlags(const uint8_t* buf, size_t length) {
+  return length >= TELEMETRY_HEADER_BYTES ? buf[3] : 0;
+}
+
+#endif // TELEMETRYFRAME_HPP
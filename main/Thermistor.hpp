@@ -0,0 +1,159 @@
+#ifndef THERMISTOR_HPP
+#define THERMISTOR_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ADC code -> temperature for an NTC thermistor in the divider
+// R (Vcc -> pin) + NTC (pin -> GND), read ratiometrically.
+//
+// ThermistorTable evaluates the Steinhart-Hart equation at compile time for
+// every 2^SegmentBits-th ADC code; a conversion is then one index and one
+// linear interpolation. Codes outside the calibrated temperature range are
+// reported instead of being extrapolated.
+
+/**
+ * @brief Steinhart-Hart coefficients: 1/T = a + b ln(R) + c ln(R)^3, T in kelvin.
+ */
+struct SteinhartHart {
+  double a;
+  double b;
+  double c;
+};
+
+/**
+ * @brief Natural logarithm usable in constant expressions (x > 0).
+ */
+constexpr double thermistorLn(double x) {
+  // x = m 2^k with m in [1, 2), then ln(m) = 2 atanh((m - 1) / (m + 1))
+  int k = 0;
+  while (x >= 2.0) {
+    x /= 2.0;
+    k++;
+  }
+  while (x < 1.0) {
+    x *= 2.0;
+    k--;
+  }
+  double y = (x - 1.0) / (x + 1.0);
+  double y2 = y * y;
+  double term = y;
+  double sum = 0;
+  for (int n = 1; n < 40; n += 2) {
+    sum += term / n;
+    term *= y2;
+  }
+  return 2.0 * sum + k * 0.69314718055994530942;
+}
+
+/**
+ * @brief Steinhart-Hart form of the Beta model R = r0 exp(beta (1/T - 1/T0)).
+ */
+constexpr SteinhartHart thermistorBeta(double r0Ohm, double t0C, double beta) {
+  return SteinhartHart{1.0 / (t0C + 273.15) - thermistorLn(r0Ohm) / beta, 1.0 / beta, 0.0};
+}
+
+/**
+ * @brief Temperature at a thermistor resistance, straight from the model.
+ */
+constexpr double thermistorCelsius(const SteinhartHart& model, double ohm) {
+  double lnR = thermistorLn(ohm);
+  return 1.0 / (model.a + model.b * lnR + model.c * lnR * lnR * lnR) - 273.15;
+}
+
+enum ThermistorStatus : uint8_t {
+  THERMISTOR_OK,
+  THERMISTOR_BELOW_RANGE, // Colder than the table, or the thermistor is open
+  THERMISTOR_ABOVE_RANGE, // Hotter than the table, or the thermistor is shorted
+};
+
+/**
+ * @brief Interpolated ADC code -> temperature table, built at compile time.
+ * @tparam SeriesOhms The divider resistor between Vcc and the pin.
+ * @tparam AdcBits ADC resolution; full scale is 2^AdcBits - 1.
+ * @tparam SegmentBits log2 of the ADC codes per interpolation segment.
+ */
+template <uint32_t SeriesOhms, uint8_t AdcBits, uint8_t SegmentBits = 4>
+class ThermistorTable {
+  static_assert(SegmentBits < AdcBits, "at least two segments");
+
+public:
+  static constexpr uint32_t ADC_FULL_SCALE = (1u << AdcBits) - 1;
+  static constexpr uint32_t SEGMENT = 1u << SegmentBits;
+  static constexpr size_t ENTRIES = (1u << (AdcBits - SegmentBits)) + 1;
+
+  /**
+   * @param minC, maxC Range of temperatures converted; codes outside it are
+   * reported as out of range.
+   */
+  constexpr ThermistorTable(const SteinhartHart& model, double minC, double maxC)
+      : minCode_(0), maxCode_(0) {
+    for (size_t i = 0; i < ENTRIES; i++) {
+      celsius_[i] = (float)celsiusAt(model, (double)(i * SEGMENT));
+    }
+
+    // The temperature falls as the code rises: find the codes at maxC and minC
+    uint32_t low = 1;
+    uint32_t high = ADC_FULL_SCALE - 1;
+    while (low < high) {
+      uint32_t mid = (low + high) / 2;
+      if (celsiusAt(model, mid) > maxC) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    minCode_ = low;
+
+    high = ADC_FULL_SCALE - 1;
+    while (low < high) {
+      uint32_t mid = (low + high + 1) / 2;
+      if (celsiusAt(model, mid) < minC) {
+        high = mid - 1;
+      } else {
+        low = mid;
+      }
+    }
+    maxCode_ = low;
+  }
+
+  /**
+   * @brief Converts a (filtered, so possibly fractional) ADC code.
+   * @param celsius Set only if the result is THERMISTOR_OK.
+   */
+  ThermistorStatus convert(float code, float& celsius) const {
+    if (code < (float)minCode_) return THERMISTOR_ABOVE_RANGE;
+    if (code > (float)maxCode_) return THERMISTOR_BELOW_RANGE;
+
+    float x = code * (1.0f / SEGMENT);
+    uint32_t i = (uint32_t)x;
+    float frac = x - (float)i;
+    celsius = celsius_[i] + frac * (celsius_[i + 1] - celsius_[i]);
+    return THERMISTOR_OK;
+  }
+
+  /**
+   * @brief Lowest and highest code converted (at maxC and minC respectively).
+   */
+  uint32_t minCode() const { return minCode_; }
+  uint32_t maxCode() const { return maxCode_; }
+
+  /**
+   * @brief Exact temperature of the model at a code, for checking the table.
+   */
+  static constexpr double celsiusAt(const SteinhartHart& model, double code) {
+    // Table ends that are not a valid resistance (0 and past full scale) only
+    // bound segments outside any useful range; clamp them to the nearest code
+    if (code < 1.0) code = 1.0;
+    if (code > ADC_FULL_SCALE - 1.0) code = ADC_FULL_SCALE - 1.0;
+    double ohm = SeriesOhms * code / (ADC_FULL_SCALE - code);
+    return thermistorCelsius(model, ohm);
+  }
+
+private:
+  float celsius_[ENTRIES] = {};
+  uint32_t minCode_;
+  uint32_t maxCode_;
+};
+
+#endif // THERMISTOR_HPP
@@ -1,82 +1,138 @@
 #include "heatingSubsystem.hpp"
-#include <Arduino.h>
+#include "Actuators.hpp"
+#include "Controller.hpp"
+#include "Filters.hpp"
+#include "Hal.hpp"
+#include "Profiler.hpp"
+#include "RelayAutotune.hpp"
 #include <ArduinoJson.h> // Required for JsonObject, StaticJsonDocument
-#include <PubSubClient.h> // Required for PubSubClient
 
 // Configuration from heating.cpp
-// Resistor R from Vcc to thermistor pin, thermistor from pin to ground
+// Resistor from Vcc to thermistor pin, thermistor from pin to ground
+// (HEATING_THERMISTOR in heatingSubsystem.hpp)
 
 const byte thermistorpin = A5;
-const byte heaterpin = 6;
 static float Tset = 35;
-static float deltaT = 0.5;
-const float Vcc = 3.3;
-const float R = 10000;
-const float Kadc = 3.3 / 4095;
 
-static float Vadc, T, Rth;
-static unsigned long currtime, T1, T2;
+// --- PI Temperature Controller (heater PWM from temperature error) ---
+// SIMC tuning on the simulator's vessel model seen as an integrator
+// (40 W heater into ~4.5 kJ/K: 8.7e-6 K/s per 10-bit PWM count) with ~45 s
+// of lag (heater element 40 s, thermistor 5 s), closed-loop time constant 45 s.
+// The heater is ACTUATOR_HEATER: 1 kHz, ACTUATOR_DUTY_MAX counts full scale.
+struct HeatingPolicy {
+  typedef float Value;
+  static constexpr float KP = 1280;  // PWM counts per K: full power 0.8 K below Tset
+  static constexpr float KI = 3.6;   // = KP / 360 s
+  static constexpr float KD = 0;
+  static constexpr float OUT_MIN = 0;
+  static constexpr float OUT_MAX = ACTUATOR_DUTY_MAX;
+  static constexpr float SLEW = 0;
+  static constexpr float TRACKING = 0.05; // Unwinds in ~20 s after saturating
+};
+static Controller<HeatingPolicy> heatController;
+
+// --- Relay autotune (rpcAutotune, "loop": "heating") ---
+// Tyreus-Luyben: the vessel is slow and overshoot wastes more time than it saves.
+constexpr float AUTOTUNE_RELAY_PWM = 256;    // Relay amplitude d around the bias
+constexpr float AUTOTUNE_EPS_C = 0.05;      // Hysteresis, above the filtered noise
+static RelayAutotune tempTuner;
+static float tunedTset = 0;                 // Setpoint the tuner was started at
+
+// Each step: interquartile mean of a burst of raw readings, then an EMA
+// (~0.2 s time constant at 100 ms steps; the sensor itself is much slower)
+const int TEMP_BURST = 32;
+static Ema adcEma(0.5f);
+
+static float adcCode, T;
+static ThermistorStatus sensorStatus = THERMISTOR_OK;
+static uint32_t currtime, prevtime, T2;
 static int heaterPWM = 0;
 static int prevHeaterPWM = 0;
 
 void setupHeating() 
 {
-  pinMode(heaterpin, OUTPUT);
+  // The heater PWM (ACTUATOR_HEATER) is attached off by setupActuators()
   #ifdef LED_BUILTIN
-  pinMode(LED_BUILTIN, OUTPUT);
+  halPinMode(LED_BUILTIN, HAL_OUTPUT);
   #endif
 
-  T1 = micros();
-  T2 = T1;
+  if (!halAdcStartContinuous(thermistorpin)) {
+    halLog("Heating: continuous ADC unavailable, using single reads\n");
+  }
+
+  T2 = halMicros();
+  prevtime = T2;
 }
 
 void executeHeating()
 {
+  PROFILE_SCOPE(PROFILE_HEATING);
   // Safety Check: If system is not active, force heater off and exit
   if (!is_system_active) {
-    analogWrite(heaterpin, 0);
+    actuatorWrite(ACTUATOR_HEATER, 0);
     prevHeaterPWM = 0;
+    heatController.reset();
+    tempTuner.abort("system inactive");
+    prevtime = halMicros();
     return;
   }
 
-  currtime = micros();
+  currtime = halMicros();
+  float dt = (uint32_t)(currtime - prevtime) * 1e-6f;
+  prevtime = currtime;
 
-  // Execute heating control every 100ms (100000 microseconds)
-  if (currtime - T1 >= 100000) {
-    T1 = currtime;
+  // Heating control step (released every 100 ms by the scheduler)
+  uint16_t burst[TEMP_BURST];
+  int n = halAdcReadBurst(thermistorpin, burst, TEMP_BURST);
+  if (n > 0) {
+    adcEma.update(trimmedMean(burst, n, n / 4));
+  }
+  adcCode = adcEma.value();
 
-    Vadc = Kadc * analogRead(thermistorpin);
-    
-    // Avoid division by zero if Vadc is Vcc (unlikely but possible)
-    if (abs(Vcc - Vadc) > 0.01) {
-      Rth = R * Vadc / (Vcc - Vadc); // Calculate thermistor resistance from ADC voltage
-      T = -0.00295 * Rth + 50.23; // Linear temperature calculation from heating.cpp
-    } else {
-      // Handle error or saturation
-      T = 999.0; 
-    }
+  // T keeps its last valid value while the code is out of range (open or
+  // shorted thermistor), and the heater stays off
+  sensorStatus = HEATING_THERMISTOR.convert(adcCode, T);
+
+  if (tempTuner.running() && sensorStatus != THERMISTOR_OK) {
+    tempTuner.abort("sensor out of range");
+  } else if (tempTuner.running() && Tset != tunedTset) {
+    tempTuner.abort("setpoint changed");
+  }
 
-    // Hysteresis control logic
-    if (T < Tset - deltaT) { heaterPWM = 255; } // Switch on heater if temperature falls below lower threshold
-    if (T > Tset - deltaT) { heaterPWM = 0; } // Switch off heater if temperature rises above threshold
-
-    // Only write to the heater pin if its status has changed 
-    if (heaterPWM != prevHeaterPWM) {
-      analogWrite(heaterpin, heaterPWM);
-      
-      #ifdef LED_BUILTIN
-      digitalWrite(LED_BUILTIN, heaterPWM > 0); 
-      #endif
-      prevHeaterPWM = heaterPWM;
+  // Proportional heater power from the PI controller (or the relay while tuning)
+  if (sensorStatus != THERMISTOR_OK) {
+    heaterPWM = 0;
+    heatController.reset();
+  } else if (tempTuner.running()) {
+    heaterPWM = (int)round(tempTuner.update(T, halMillis()));
+    if (!tempTuner.running()) {
+      // Finished: continue with the new gains from the current power
+      if (tempTuner.state() == AUTOTUNE_DONE) {
+        heatController.setGains(tempTuner.result().kp, tempTuner.result().ki, 0);
+      }
+      heatController.reset(prevHeaterPWM);
+      heaterPWM = (int)round(heatController.output());
     }
+  } else {
+    heaterPWM = (int)round(heatController.update(Tset, T, dt));
+  }
+
+  // Only write to the heater pin if its duty has changed
+  if (heaterPWM != prevHeaterPWM) {
+    actuatorWrite(ACTUATOR_HEATER, heaterPWM);
+    
+    #ifdef LED_BUILTIN
+    halDigitalWrite(LED_BUILTIN, heaterPWM > 0); 
+    #endif
+    prevHeaterPWM = heaterPWM;
   }
 
   // Serial debug output every 1 second (1000000 microseconds)
-  if (currtime - T2 >= 1000000) {
+  if ((uint32_t)(currtime - T2) >= 1000000) {
     T2 = currtime;
-    Serial.print("Rth: "); Serial.print(Rth, 0);
-    Serial.print(" | T: "); Serial.print(T, 1);
-    Serial.print(" | Heater: "); Serial.println(heaterPWM > 0 ? "ON" : "OFF");
+    halLog("ADC: %.0f | T: %.1f%s | Heater: %d/%u\n", adcCode, T,
+           sensorStatus == THERMISTOR_OK ? "" : " (out of range)", heaterPWM,
+           (unsigned)ACTUATOR_DUTY_MAX);
   }
 }
 
@@ -84,42 +140,79 @@ void getHeatingStatus(JsonObject& doc) {
     doc["temperature"] = T;
     doc["heater_state"] = heaterPWM > 0;
     doc["target_temperature"] = Tset;
+    static const char* SENSOR_NAMES[] = {"ok", "below_range", "above_range"};
+    doc["temp_sensor"] = SENSOR_NAMES[sensorStatus];
+    doc["temp_autotune"] = autotuneStateName(tempTuner.state());
+}
+
+void getHeatingSample(TelemetrySample& sample) {
+    sample.tempCentiC = telemetryFixed(T, 100);
+    sample.tempSetCentiC = telemetryFixed(Tset, 100);
+    int duty = is_system_active ? heaterPWM : 0; // executeHeating() forces 0 when inactive
+    sample.heaterDuty = (uint16_t)duty;
+    if (duty > 0) sample.flags |= TELEMETRY_FLAG_HEATER;
+}
+
+void getHeatingGains(float& kp, float& ki) {
+  kp = heatController.kp();
+  ki = heatController.ki();
+}
+
+void onTargetTemperature(JsonVariant value) {
+  Tset = value;
+  halLog("Updated target temperature: %.2f\n", Tset);
 }
 
-void handleHeatingAttributes(JsonObject& doc) {
-  if (doc.containsKey("target_temperature")) {
-    Tset = doc["target_temperature"];
-    Serial.print("Updated target temperature: ");
-    Serial.println(Tset);
+void onHeatingKp(JsonVariant value) {
+  if (!value.is<float>() || (float)value < 0) {
+    halLog("Attribute Error: heating_kp must be a number >= 0.\n");
+    return;
   }
-  if (doc.containsKey("temp_tolerance")) {
-    deltaT = doc["temp_tolerance"];
-    Serial.print("Updated temp tolerance: ");
-    Serial.println(deltaT);
+  heatController.setGains(value, heatController.ki(), 0);
+  halLog("Updated heating Kp: %.1f\n", heatController.kp());
+}
+
+void onHeatingKi(JsonVariant value) {
+  if (!value.is<float>() || (float)value < 0) {
+    halLog("Attribute Error: heating_ki must be a number >= 0.\n");
+    return;
   }
+  heatController.setGains(heatController.kp(), value, 0);
+  halLog("Updated heating Ki: %.3f\n", heatController.ki());
 }
 
-void handleHeatingCommand(PubSubClient& client, char* topic, byte* payload, unsigned int length) {
-  // 1. Get the RPC Request ID
-  String topicStr = String(topic);
-  String requestId = topicStr.substring(topicStr.lastIndexOf('/') + 1);
-
-  // 2. Deserialize
-  StaticJsonDocument<200> doc;
-  deserializeJson(doc, payload, length);
-  
-  // Example: {"method": "setTemperature", "params": 37.0}
-  
-  const char* method = doc["method"];
-  
-  if (strcmp(method, "setTemperature") == 0) {
-      float newTemp = doc["params"];
-      Tset = newTemp; 
-      
-      char responseTopic[100];
-      sprintf(responseTopic, "v1/devices/me/rpc/response/%s", requestId.c_str());
-      client.publish(responseTopic, "{\"status\": \"ok\", \"message\": \"Temperature target updated\"}");
-  } else {
-      // Unknown method
+// {"method": "setTemperature", "params": 37.0}
+void rpcSetTemperature(RpcContext& rpc, JsonVariant params) {
+  if (!params.is<float>()) {
+    rpc.error("Invalid parameters");
+    return;
   }
-}
\ No newline at end of file
+  Tset = params;
+  halLog("Updated target temperature: %.2f\n", Tset);
+  rpc.reply("{\"status\": \"ok\", \"message\": \"Temperature target updated\"}");
+}
+
+const char* startHeatingAutotune() {
+  if (!is_system_active) return "System inactive";
+  if (sensorStatus != THERMISTOR_OK) return "Temperature sensor out of range";
+  if (tempTuner.running()) return "Autotune already running";
+
+  // Relay around the power that currently holds the setpoint
+  float bias = heatController.output();
+  AutotuneConfig config;
+  config.setpoint = Tset;
+  config.low = fmaxf(bias - AUTOTUNE_RELAY_PWM, 0);
+  config.high = fminf(bias + AUTOTUNE_RELAY_PWM, ACTUATOR_DUTY_MAX);
+  config.hysteresis = AUTOTUNE_EPS_C;
+  config.cycles = 3;
+  config.timeoutMs = 2 * 3600 * 1000UL;
+  config.rule = AUTOTUNE_TYREUS_LUYBEN;
+  tempTuner.start(config, T, halMillis());
+  tunedTset = Tset;
+  halLog("Heating: autotune at %.2f C, relay %.0f-%.0f\n", Tset, config.low, config.high);
+  return nullptr;
+}
+
+bool takeHeatingAutotune(AutotuneResult& result) {
+  return tempTuner.takeResult(result);
+}
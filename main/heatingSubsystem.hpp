@@ -1,16 +1,61 @@
 #ifndef HEATINGSUBSYSTEM_HPP
 #define HEATINGSUBSYSTEM_HPP
 
+#include "Hal.hpp"
+#include "TelemetryFrame.hpp"
 #include <ArduinoJson.h>
-#include <PubSubClient.h>
+#include "Dispatch.hpp"
+#include "RelayAutotune.hpp"
+#include "Thermistor.hpp"
 
 extern bool is_system_active;
 
+// NTC below a 10k series resistor on the 12-bit ADC. Beta model through
+// 5162 ohm at 35 degC, the point where the old linear fit
+// (T = -0.00295 R + 50.23) was calibrated. Readings outside 0-100 degC
+// switch the heater off.
+constexpr SteinhartHart HEATING_NTC = thermistorBeta(5162.0, 35.0, 3950.0);
+constexpr ThermistorTable<10000, 12> HEATING_THERMISTOR(HEATING_NTC, 0.0, 100.0);
+
 void setupHeating();
 void executeHeating();
+/**
+ * @brief Adds temperature, heater_state, target_temperature, temp_sensor
+ * ("ok", "below_range" or "above_range") and temp_autotune.
+ */
 void getHeatingStatus(JsonObject& doc);
-void handleHeatingAttributes(JsonObject& doc);
-void handleHeatingCommand(PubSubClient& client, char* topic, byte* payload, unsigned int length);
+void getHeatingSample(TelemetrySample& sample);
+
+/**
+ * @brief Current PI gains of the temperature loop: HeatingPolicy's until an
+ * autotune or heating_kp/heating_ki replaces them.
+ */
+void getHeatingGains(float& kp, float& ki);
+
+/**
+ * @brief Starts a relay autotune of the temperature loop at the current
+ * setpoint; see startStirringAutotune(). Also aborted by a sensor fault.
+ * @return nullptr if started, else why not.
+ */
+const char* startHeatingAutotune();
+bool takeHeatingAutotune(AutotuneResult& result);
+
+// --- Shared attributes and RPC methods (dispatched by ControlLoop.cpp) ---
+void onTargetTemperature(JsonVariant value);
+// heating_kp (PWM counts per K) and heating_ki (counts per K s), >= 0
+void onHeatingKp(JsonVariant value);
+void onHeatingKi(JsonVariant value);
+void rpcSetTemperature(RpcContext& rpc, JsonVariant params);
+
+constexpr AttributeEntry HEATING_ATTRIBUTES[] = {
+  {"target_temperature", onTargetTemperature},
+  {"heating_kp", onHeatingKp},
+  {"heating_ki", onHeatingKi},
+};
+
+constexpr RpcEntry HEATING_RPCS[] = {
+  {"setTemperature", rpcSetTemperature},
+};
 
 #endif
 
@@ -4,6 +4,13 @@
 #include "PHSubsystem.hpp"
 #include "StirringSubsystem.hpp"
 #include "heatingSubsystem.hpp"
+#include "ControlLoop.hpp"
+#include "AnomalyMonitor.hpp"
+#include "SampleHistory.hpp"
+#include "Hal.hpp"
+#include "Profiler.hpp"
+#include <atomic>
+#include <new>
 // end of configuration
 
 // Includes for MQTT
@@ -22,15 +29,74 @@ const char* pass = WIFI_PASS;
 // MQTT Client Setup
 WiFiClient espClient;
 PubSubClient client(espClient);
-const char* mqtt_client_id = "bioreactor_ph_client"; // Unique client ID
+// The client ID must be unique per reactor: a broker, and bioreactor_gateway,
+// closes the older of two connections with the same ID. It is made from the
+// MAC address unless secrets.h defines MQTT_CLIENT_ID.
+#ifdef MQTT_CLIENT_ID
+const char* mqtt_client_id = MQTT_CLIENT_ID;
+#else
+char mqtt_client_id[24]; // "bioreactor-" and 12 hex digits, set in setup()
+#endif
 
 // --- ThingsBoard Topics ---
 // This is the topic we subscribe to for commands (RPC)
 const char* command_topic = "v1/devices/me/rpc/request/+"; 
 
-// Timing for publishing data
-long lastPublishTime = 0;
-const long PUBLISH_INTERVAL = 5000; // Publish data every 5 seconds (5000 ms)
+// --- Cores ---
+// Control runs in the Arduino loop task (core 1). WiFi, MQTT and publishing run
+// in their own task on core 0, next to the WiFi stack, so a reconnect can block
+// for as long as it likes. The two sides share only the lock-free queues below
+// and the sample history.
+const BaseType_t NETWORK_CORE = 0;
+const uint32_t NETWORK_STACK_BYTES = 8192;
+const uint32_t NETWORK_POLL_MS = 10;
+
+MqttQueue inbox;                      // network -> control: attribute updates, RPC requests
+MqttQueue outboxQueue;                // control -> network: JSON status, RPC responses
+MqttOutbox outbox(outboxQueue);
+std::atomic<bool> mqttOnline(false);  // Connection state as last seen by the network task
+
+// --- Binary Telemetry ---
+// Samples are taken at 10 Hz into a SampleHistory and published in batches as
+// one binary frame (TelemetryFrame.hpp); samples taken while the broker is
+// unreachable are back-filled after reconnecting. The JSON publish then only
+// feeds the dashboard. Off by default: ThingsBoard closes the session on a
+// topic outside v1/ and relays none. Define TELEMETRY_BINARY 1 in secrets.h
+// when MQTT_SERVER accepts TELEMETRY_BIN_TOPIC (mosquitto, bioreactor_gateway).
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY 0
+#endif
+// TELEMETRY_BIN_TOPIC, the sample period and the batch size are in ControlLoop.hpp.
+const int TELEMETRY_BACKFILL_FRAMES = 1;             // Frames per network poll while catching up
+
+// Timing for publishing data (control task periods are in ControlLoop.hpp)
+#if TELEMETRY_BINARY
+const uint32_t PUBLISH_PERIOD_US = 30000000; // JSON status every 30 seconds
+#else
+const uint32_t PUBLISH_PERIOD_US = 5000000; // Publish data every 5 seconds
+#endif
+
+// --- Clock ---
+// Samples are stamped with halTimestampUs(), which becomes Unix time once
+// SNTP has synchronised the clock. Override in secrets.h for a local server.
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+
+// --- Diagnostics ---
+// With PROFILING (Profiler.hpp), section timings, ISR counts and the heap
+// watermark go out as their own telemetry message every DIAG_PERIOD_US.
+
+SampleHistory* history = nullptr; // ~130 KB, placed in PSRAM by setup() when available
+TelemetrySample telemetryBatch[TELEMETRY_BATCH_SAMPLES];
+uint8_t telemetryFrame[TELEMETRY_FRAME_MAX];
+
+// Sequence number of binary frames (network task), so a receiver can tell
+// lost frames from a quiet device. The JSON status counts its own ("seq").
+uint32_t frameSequence = 0;
+
+// Cooperative scheduler driven by the HAL clock
+Scheduler scheduler(halMicros);
 
 // --- Global State ---
 bool is_system_active = true; // Default to ON
@@ -39,129 +105,150 @@ bool is_system_active = true; // Default to ON
 void print_wifi_info();
 void wifi_connect(float timeout = 15);
 void mqtt_callback(char* topic, byte* payload, unsigned int length);
-void attributes_callback(char* topic, byte* payload, unsigned int length);
-void handleGlobalAttributes(JsonObject& doc);
 void mqtt_reconnect();
+void networkTask(void* arg);
+void publishOutbox();
+void publishHistory();
 
 void setup() {
 
   Serial.println("Initialising...");
   Serial.begin(115200);
   Serial.println("Booting Bioreactor pH Controller (ThingsBoard)...");
+#ifndef MQTT_CLIENT_ID
+  snprintf(mqtt_client_id, sizeof(mqtt_client_id), "bioreactor-%012llx", (unsigned long long)ESP.getEfuseMac());
+#endif
+  Serial.print("MQTT client ID: ");
+  Serial.println(mqtt_client_id);
 
   // Setup subsystem hardware pins
-  setupPH();
-  Serial.println("ph done");
-
-  setupStirring(); // <-- CALL STIRRING SETUP
-  Serial.println("stirring done");
-
-  setupHeating();
-  Serial.println("heating done");
-
-  // Connect to WiFi
-  wifi_connect();
+  setupControl();
+
+  // Register periodic tasks (lower priority number runs first)
+  addControlTasks(scheduler);
+  addTelemetryTasks(scheduler, outbox, mqttOnline, PUBLISH_PERIOD_US);
+#if TELEMETRY_BINARY
+  void* historyMemory = halAllocLarge(sizeof(SampleHistory));
+  if (historyMemory) {
+    history = new (historyMemory) SampleHistory();
+    addSampleTask(scheduler, *history);
+  } else {
+    Serial.println("No memory for the sample history, binary telemetry disabled.");
+  }
+#endif
+  scheduler.start();
 
-  // Configure MQTT
-  client.setServer(MQTT_SERVER, MQTT_PORT);
-  client.setCallback(mqtt_callback); // Set function to handle incoming messages
+  // WiFi and MQTT come up in the background; control is already running
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_STACK_BYTES, nullptr, 1, nullptr, NETWORK_CORE);
 
   Serial.println("Setup complete.");
 }
 
 void loop() {
-  // 1. Maintain WiFi and MQTT Connection
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi disconnected. Reconnecting...");
-    wifi_connect();
+  // 1. Apply attribute updates and RPCs received by the network task
+  processInbox(inbox, outbox);
+
+  // 2. Run every task that is due, highest priority first
+  while (scheduler.runOnce()) {
   }
-  
-  if (WiFi.status() == WL_CONNECTED && !client.connected()) {
-    mqtt_reconnect(); // Reconnect to MQTT broker if disconnected
+
+  // 3. Sleep until just before the next release (delay() yields to FreeRTOS)
+  uint32_t idleUs = scheduler.untilNextReleaseUs();
+  if (idleUs >= 2000) {
+    halDelayMs(idleUs / 1000 - 1);
   }
+}
 
-  // 2. Allow MQTT client to process incoming messages
-  client.loop();
+/**
+ * @brief Network side (core 0): owns WiFi and the MQTT client.
+ * Reconnects when needed, pumps client.loop() (which queues incoming messages
+ * for the control loop), and sends the outbox and the sample history.
+ */
+void networkTask(void* arg) {
+  wifi_connect();
+  halClockSyncStart(NTP_SERVER);
 
-  // 3. Run the autonomous control logic for all subsystems
-  executePH();
-  executeStirring();
-  executeHeating();
+  client.setServer(MQTT_SERVER, MQTT_PORT);
+  client.setCallback(mqtt_callback); // Set function to handle incoming messages
+  client.setBufferSize(2048); // Fits a full binary batch; JSON with scheduler stats needs ~1 KB
 
-  // 4. Publish status update to ThingsBoard periodically
-  if (millis() - lastPublishTime > PUBLISH_INTERVAL) {
-    // Send status for PH and Stirring subsystems
-    StaticJsonDocument<500> doc; // Combined JSON doc, increased size
-    JsonObject root = doc.to<JsonObject>();
+  for (;;) {
+    if (WiFi.status() != WL_CONNECTED) {
+      Serial.println("WiFi disconnected. Reconnecting...");
+      mqttOnline = false;
+      wifi_connect();
+    }
 
-    getPHStatus(root);
-    getStirringStatus(root);
-    getHeatingStatus(root);
+    if (WiFi.status() == WL_CONNECTED && !client.connected()) {
+      mqttOnline = false;
+      mqtt_reconnect(); // Reconnect to MQTT broker if disconnected
+    }
 
-    // Global status
-    root["operational_mode"] = is_system_active;
+    {
+      PROFILE_SCOPE(PROFILE_MQTT_LOOP);
+      client.loop();
+    }
+    mqttOnline = client.connected();
 
-    char buffer[500];
-    serializeJson(doc, buffer);
-    client.publish("v1/devices/me/telemetry", buffer);
+    publishOutbox();
+#if TELEMETRY_BINARY
+    if (history) {
+      publishHistory();
+    }
+#endif
 
-    lastPublishTime = millis();
+    delay(NETWORK_POLL_MS);
   }
 }
 
 /**
- * @brief Handles incoming MQTT messages (from ThingsBoard).
+ * @brief Publishes the messages queued by the control side. While offline
+ * they are dropped: status and RPC responses are stale after a reconnect.
  */
-void mqtt_callback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message arrived on topic: ");
-  Serial.println(topic);
-
-  // Check if it's an attribute update or response
-  if (String(topic).startsWith("v1/devices/me/attributes")) {
-    attributes_callback(topic, payload, length);
-    return;
-  }
-
-  // Check if it's an RPC command
-  if (String(topic).startsWith("v1/devices/me/rpc/request/")) {
-    // Dispatch to PH subsystem for setPump commands
-    handlePHCommand(client, topic, payload, length);
-    
-    // Note: setRPM and setTemperature are now handled via attributes, so we don't call their command handlers.
+void publishOutbox() {
+  while (!outboxQueue.empty()) {
+    const MqttMessage& message = outboxQueue.at(0);
+    if (client.connected() && !client.publish(message.topic, message.payload, message.length)) {
+      return; // Retry on the next poll
+    }
+    outboxQueue.discard(1);
   }
 }
 
-void attributes_callback(char* topic, byte* payload, unsigned int length) {
-  Serial.println("Attributes update received");
-  
-  StaticJsonDocument<500> doc;
-  DeserializationError error = deserializeJson(doc, payload, length);
+/**
+ * @brief Publishes buffered samples oldest first, one frame per batch.
+ * Live samples wait for a full batch; after an outage up to
+ * TELEMETRY_BACKFILL_FRAMES frames of back-fill go out per call. Samples stay
+ * in the history until their frame has been handed to the client.
+ * Runs in the network task, the history's consumer.
+ */
+void publishHistory() {
+  history->age(); // Keeps the live ring from overflowing while offline
 
-  if (error) {
-    Serial.print("deserializeJson() failed: ");
-    Serial.println(error.c_str());
+  if (!client.connected()) {
     return;
   }
-  
-  JsonObject shared;
-  if (doc.containsKey("shared")) {
-    shared = doc["shared"];
-  } else {
-    shared = doc.as<JsonObject>();
-  }
 
-  // Dispatch to all subsystems to check for their keys
-  handleGlobalAttributes(shared);
-  handlePHAttributes(shared);
-  handleStirringAttributes(shared);
-  handleHeatingAttributes(shared);
+  for (int frame = 0; frame < TELEMETRY_BACKFILL_FRAMES; frame++) {
+    int count;
+    size_t length = nextTelemetryFrame(*history, telemetryBatch, telemetryFrame, frameSequence, count);
+    if (length == 0 || !client.publish(TELEMETRY_BIN_TOPIC, telemetryFrame, length)) {
+      return; // Retry on the next poll, with the same sequence number
+    }
+    frameSequence++;
+    history->discard(count);
+  }
 }
 
-void handleGlobalAttributes(JsonObject& doc) {
-  if (doc.containsKey("operational_mode")) {
-    is_system_active = doc["operational_mode"];
-    Serial.print("Updated operational_mode: ");
-    Serial.println(is_system_active ? "ACTIVE" : "INACTIVE");
+/**
+ * @brief Handles incoming MQTT messages (from ThingsBoard).
+ * Runs inside client.loop() on the network task, so the message is only
+ * queued; processInbox() applies it on the control side.
+ */
+void mqtt_callback(char* topic, byte* payload, unsigned int length) {
+  if (!mqttEnqueue(inbox, topic, payload, length)) {
+    Serial.print("Inbox full or message too long, dropped: ");
+    Serial.println(topic);
   }
 }
 
@@ -191,7 +278,7 @@ void mqtt_reconnect() {
       Serial.print("Subscribed to RPC and Attributes");
       
       // Request initial attributes
-      client.publish("v1/devices/me/attributes/request/1", "{\"sharedKeys\":\"target_pH,pH_tolerance,target_temperature,temp_tolerance,target_rpm\"}");
+      client.publish("v1/devices/me/attributes/request/1", "{\"sharedKeys\":\"target_pH,pH_tolerance,target_temperature,target_rpm\"}");
     } else {
       Serial.print("failed, rc=");
       Serial.print(client.state());